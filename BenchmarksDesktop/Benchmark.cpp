@@ -0,0 +1,307 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iterator>
+
+#include "Benchmark.h"
+#include "Check.h"
+
+using namespace NowSound::Benchmark;
+using namespace std;
+
+namespace
+{
+    struct RegisteredBenchmark
+    {
+        string Name;
+        Function Body;
+        vector<int64_t> Args;
+    };
+
+    // Function-local, so that registrations from any translation unit's static initializers can use it.
+    vector<RegisteredBenchmark>& Registry()
+    {
+        static vector<RegisteredBenchmark> s_registry;
+        return s_registry;
+    }
+
+    // Written through by DoNotOptimize; volatile, so the compiler must assume the pointee is observed.
+    const void* volatile s_sink;
+
+    // Run the function for the given number of iterations; return the elapsed seconds.
+    double TimeRun(Function function, int64_t iterations, int64_t arg, int64_t* itemsProcessed)
+    {
+        State state(iterations, arg);
+        auto start = chrono::steady_clock::now();
+        function(state);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        *itemsProcessed = state.ItemsProcessed();
+        return seconds;
+    }
+
+    Result Run(const string& name, Function function, int64_t arg, double minimumSeconds, int repetitions)
+    {
+        // Grow the iteration count until one run takes long enough to time reliably.
+        int64_t iterations = 1;
+        int64_t itemsProcessed;
+        double seconds = TimeRun(function, iterations, arg, &itemsProcessed);
+        while (seconds < minimumSeconds && iterations < 1000000000)
+        {
+            // Aim 40% past the minimum, but never grow more than 10x at once (early runs are noisy).
+            double predicted = iterations * minimumSeconds * 1.4 / (std::max)(seconds, 1e-9);
+            iterations = (int64_t)(std::min)(predicted, (double)iterations * 10) + 1;
+            seconds = TimeRun(function, iterations, arg, &itemsProcessed);
+        }
+
+        // The fastest repetition is the one least disturbed by everything else running on the machine.
+        double bestSeconds = seconds;
+        int64_t bestItems = itemsProcessed;
+        for (int repetition = 1; repetition < repetitions; repetition++)
+        {
+            seconds = TimeRun(function, iterations, arg, &itemsProcessed);
+            if (seconds < bestSeconds)
+            {
+                bestSeconds = seconds;
+                bestItems = itemsProcessed;
+            }
+        }
+
+        Result result;
+        result.Name = name;
+        result.Iterations = iterations;
+        result.NanosecondsPerIteration = bestSeconds * 1e9 / iterations;
+        result.ItemsPerSecond = bestItems / bestSeconds;
+        return result;
+    }
+
+    // Scan the next JSON string or number token starting at position; return false at end of input.
+    // This is only as much of a JSON parser as reading back a flat list of benchmark results requires.
+    bool NextToken(const string& text, size_t& position, string& token, bool& isString)
+    {
+        while (position < text.size())
+        {
+            char c = text[position];
+            if (c == '"')
+            {
+                size_t end = position + 1;
+                token.clear();
+                while (end < text.size() && text[end] != '"')
+                {
+                    if (text[end] == '\\' && end + 1 < text.size())
+                    {
+                        end++;
+                    }
+                    token.push_back(text[end++]);
+                }
+                position = end + 1;
+                isString = true;
+                return true;
+            }
+            if (c == '-' || isdigit((unsigned char)c))
+            {
+                size_t end = position;
+                while (end < text.size() && (isdigit((unsigned char)text[end]) || strchr("+-.eE", text[end]) != nullptr))
+                {
+                    end++;
+                }
+                token = text.substr(position, end - position);
+                position = end;
+                isString = false;
+                return true;
+            }
+            position++;
+        }
+        return false;
+    }
+}
+
+State::State(int64_t iterations, int64_t arg)
+    : _remainingIterations{ iterations },
+    _arg{ arg },
+    _itemsProcessed{ 0 }
+{
+    Check(iterations > 0);
+}
+
+Registration::Registration(const char* name, Function function, vector<int64_t> args)
+{
+    Registry().push_back(RegisteredBenchmark{ name, function, args });
+}
+
+void NowSound::Benchmark::DoNotOptimize(const void* value)
+{
+    s_sink = value;
+}
+
+vector<Result> NowSound::Benchmark::RunAll(const string& filter, double minimumSeconds, int repetitions)
+{
+    Check(minimumSeconds > 0);
+    Check(repetitions > 0);
+
+    vector<Result> results;
+    for (const RegisteredBenchmark& benchmark : Registry())
+    {
+        if (benchmark.Args.empty())
+        {
+            if (benchmark.Name.find(filter) != string::npos)
+            {
+                results.push_back(Run(benchmark.Name, benchmark.Body, 0, minimumSeconds, repetitions));
+            }
+            continue;
+        }
+
+        for (int64_t arg : benchmark.Args)
+        {
+            string name = benchmark.Name + "/" + to_string(arg);
+            if (name.find(filter) != string::npos)
+            {
+                results.push_back(Run(name, benchmark.Body, arg, minimumSeconds, repetitions));
+            }
+        }
+    }
+    return results;
+}
+
+void NowSound::Benchmark::WriteTable(ostream& output, const vector<Result>& results)
+{
+    char line[200];
+    snprintf(line, sizeof(line), "%-48s %14s %12s %16s\n", "Benchmark", "Time (ns)", "Iterations", "Items/sec");
+    output << line;
+    for (const Result& result : results)
+    {
+        snprintf(line, sizeof(line), "%-48s %14.1f %12lld %16.4g\n",
+            result.Name.c_str(),
+            result.NanosecondsPerIteration,
+            (long long)result.Iterations,
+            result.ItemsPerSecond);
+        output << line;
+    }
+}
+
+void NowSound::Benchmark::WriteJson(ostream& output, const vector<Result>& results)
+{
+    char date[64];
+    time_t now = time(nullptr);
+    strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+    output << "{\n";
+    output << "  \"context\": {\n";
+    output << "    \"date\": \"" << date << "\",\n";
+    output << "    \"num_cpus\": " << thread::hardware_concurrency() << ",\n";
+#if defined(NDEBUG)
+    output << "    \"library_build_type\": \"release\"\n";
+#else
+    output << "    \"library_build_type\": \"debug\"\n";
+#endif
+    output << "  },\n";
+    output << "  \"benchmarks\": [\n";
+    char number[64];
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const Result& result = results[i];
+        output << "    {\n";
+        output << "      \"name\": \"" << result.Name << "\",\n";
+        output << "      \"run_type\": \"iteration\",\n";
+        output << "      \"iterations\": " << result.Iterations << ",\n";
+        snprintf(number, sizeof(number), "%.3f", result.NanosecondsPerIteration);
+        output << "      \"real_time\": " << number << ",\n";
+        output << "      \"cpu_time\": " << number << ",\n";
+        output << "      \"time_unit\": \"ns\"";
+        if (result.ItemsPerSecond > 0)
+        {
+            snprintf(number, sizeof(number), "%.6g", result.ItemsPerSecond);
+            output << ",\n      \"items_per_second\": " << number;
+        }
+        output << "\n    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    output << "  ]\n";
+    output << "}\n";
+}
+
+map<string, double> NowSound::Benchmark::ReadBaseline(istream& input)
+{
+    string text((istreambuf_iterator<char>(input)), istreambuf_iterator<char>());
+
+    // Walk the keys and values in order; each benchmark's "name" precedes its "real_time" and "time_unit".
+    map<string, double> baseline;
+    string name;
+    string key;
+    string token;
+    bool isString;
+    size_t position = text.find("\"benchmarks\"");
+    if (position == string::npos)
+    {
+        return baseline;
+    }
+    position += strlen("\"benchmarks\"");
+
+    while (NextToken(text, position, token, isString))
+    {
+        size_t next = text.find_first_not_of(" \t\r\n", position);
+        if (isString && next != string::npos && text[next] == ':')
+        {
+            key = token;
+            continue;
+        }
+
+        // A value (of a kind we care about; anything else, e.g. true or false, is skipped by NextToken).
+        if (key == "name")
+        {
+            name = token;
+        }
+        else if (key == "real_time" && !name.empty())
+        {
+            baseline[name] = strtod(token.c_str(), nullptr);
+        }
+        else if (key == "time_unit" && baseline.count(name) > 0)
+        {
+            double scale = token == "us" ? 1e3 : token == "ms" ? 1e6 : token == "s" ? 1e9 : 1;
+            baseline[name] *= scale;
+        }
+        key.clear();
+    }
+    return baseline;
+}
+
+int NowSound::Benchmark::CompareToBaseline(
+    ostream& report,
+    const vector<Result>& results,
+    const map<string, double>& baseline,
+    double threshold)
+{
+    int regressionCount = 0;
+    char line[200];
+    snprintf(line, sizeof(line), "%-48s %14s %14s %9s\n", "Benchmark", "Baseline (ns)", "Current (ns)", "Change");
+    report << line;
+    for (const Result& result : results)
+    {
+        auto found = baseline.find(result.Name);
+        if (found == baseline.end() || found->second <= 0)
+        {
+            snprintf(line, sizeof(line), "%-48s %14s %14.1f %9s\n", result.Name.c_str(), "-", result.NanosecondsPerIteration, "new");
+            report << line;
+            continue;
+        }
+
+        double change = result.NanosecondsPerIteration / found->second - 1;
+        bool isRegression = change > threshold;
+        if (isRegression)
+        {
+            regressionCount++;
+        }
+        snprintf(line, sizeof(line), "%-48s %14.1f %14.1f %+8.1f%%%s\n",
+            result.Name.c_str(),
+            found->second,
+            result.NanosecondsPerIteration,
+            change * 100,
+            isRegression ? "  REGRESSION" : "");
+        report << line;
+    }
+    return regressionCount;
+}
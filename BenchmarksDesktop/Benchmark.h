@@ -0,0 +1,89 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace NowSound
+{
+    // A minimal microbenchmark harness in the style of Google Benchmark (whose JSON output format it also writes,
+    // and reads back as a baseline), without taking a dependency on it.
+    namespace Benchmark
+    {
+        // The state of one timed run of a benchmark function; the function loops while KeepRunning() is true.
+        class State
+        {
+        private:
+            int64_t _remainingIterations;
+            const int64_t _arg;
+            int64_t _itemsProcessed;
+
+        public:
+            State(int64_t iterations, int64_t arg);
+
+            // Should the benchmark loop run again?
+            bool KeepRunning() { return _remainingIterations-- > 0; }
+
+            // The argument this benchmark was registered with (or 0 if none).
+            int64_t Arg() const { return _arg; }
+
+            // Report how many items (e.g. samples) the whole run processed, so throughput can be reported.
+            void SetItemsProcessed(int64_t items) { _itemsProcessed = items; }
+            int64_t ItemsProcessed() const { return _itemsProcessed; }
+        };
+
+        typedef void (*Function)(State& state);
+
+        // The results of one benchmark (with one argument).
+        struct Result
+        {
+            // The benchmark's name, with "/arg" appended if it has an argument.
+            std::string Name;
+            int64_t Iterations;
+            // The fastest repetition's time per iteration.
+            double NanosecondsPerIteration;
+            // Zero if the benchmark does not report items processed.
+            double ItemsPerSecond;
+        };
+
+        // Registers a benchmark function at static initialization time; use NOWSOUND_BENCHMARK rather than this.
+        class Registration
+        {
+        public:
+            Registration(const char* name, Function function, std::vector<int64_t> args);
+        };
+
+        // Keep the compiler from optimizing away the computation of the value at the given address.
+        void DoNotOptimize(const void* value);
+
+        // Run all benchmarks whose name contains filter, each for at least minimumSeconds per repetition.
+        std::vector<Result> RunAll(const std::string& filter, double minimumSeconds, int repetitions);
+
+        // Write results as a human-readable table.
+        void WriteTable(std::ostream& output, const std::vector<Result>& results);
+
+        // Write results in Google Benchmark's JSON format.
+        void WriteJson(std::ostream& output, const std::vector<Result>& results);
+
+        // Read (name, nanoseconds per iteration) from JSON written by WriteJson, or by Google Benchmark itself.
+        std::map<std::string, double> ReadBaseline(std::istream& input);
+
+        // Compare results against the baseline, writing a report; returns the number of benchmarks that are
+        // slower than their baseline by more than the given fraction (e.g. 0.1 for 10%).
+        int CompareToBaseline(
+            std::ostream& report,
+            const std::vector<Result>& results,
+            const std::map<std::string, double>& baseline,
+            double threshold);
+    }
+}
+
+// Register function as a benchmark, run once with each of the (optional) following arguments.
+#define NOWSOUND_BENCHMARK(function, ...) \
+    static NowSound::Benchmark::Registration s_##function##Registration(#function, function, { __VA_ARGS__ })
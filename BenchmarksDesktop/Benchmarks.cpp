@@ -0,0 +1,533 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <sstream>
+
+#include "Benchmark.h"
+#include "BiquadBank.h"
+#include "BufferAllocator.h"
+#include "Check.h"
+#include "ConstantQAnalyzer.h"
+#include "Histogram.h"
+#include "LatencyHistogram.h"
+#include "MasterBus.h"
+#include "OfflineMixdown.h"
+#include "PartitionedConvolver.h"
+#include "PolyphaseInterpolator.h"
+#include "Slice.h"
+#include "SliceStream.h"
+#include "Time.h"
+#include "Trace.h"
+#include "rosetta_fft.h"
+
+using namespace NowSound;
+using namespace NowSound::Benchmark;
+using namespace RosettaFFT;
+
+// Benchmarks of the library's hot paths: everything here runs on the audio thread at least once per quantum.
+// Where a benchmark's argument is a sample count, items processed are samples, so items/sec is directly
+// comparable to the 48Khz (or 96Khz) real-time rate.
+
+namespace
+{
+    const int SampleRateHz = 48000;
+    const int StereoSliverCount = 2;
+
+    // One second of stereo per buffer, like the library's own allocator (which uses 128 seconds).
+    const int BufferLength = SampleRateHz * StereoSliverCount;
+
+    // Deterministic, nonzero (so not trivially compressible or denormal) test signal.
+    void FillSignal(float* data, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            data[i] = (float)std::sin(i * 0.01) * 0.5f;
+        }
+    }
+}
+
+void SliceCopyTo(State& state)
+{
+    int sampleCount = (int)state.Arg();
+    BufferAllocator<float> allocator(BufferLength, 2);
+    OwningBuf<float> sourceBuf(allocator.Allocate());
+    OwningBuf<float> destinationBuf(allocator.Allocate());
+    FillSignal(sourceBuf.Data(), BufferLength);
+
+    Slice<AudioSample, float> source(Buf<float>(sourceBuf), 0, sampleCount, StereoSliverCount);
+    Slice<AudioSample, float> destination(Buf<float>(destinationBuf), 0, sampleCount, StereoSliverCount);
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        source.CopyTo(destination);
+        DoNotOptimize(destinationBuf.Data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * sampleCount);
+
+    allocator.Free(std::move(sourceBuf));
+    allocator.Free(std::move(destinationBuf));
+}
+NOWSOUND_BENCHMARK(SliceCopyTo, 64, 480, 4096);
+
+void SliceCopyFrom(State& state)
+{
+    int sampleCount = (int)state.Arg();
+    BufferAllocator<float> allocator(BufferLength, 1);
+    OwningBuf<float> buf(allocator.Allocate());
+    std::vector<float> source(sampleCount * StereoSliverCount);
+    FillSignal(source.data(), (int)source.size());
+
+    Slice<AudioSample, float> destination(Buf<float>(buf), 0, sampleCount, StereoSliverCount);
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        destination.CopyFrom(source.data());
+        DoNotOptimize(buf.Data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * sampleCount);
+
+    allocator.Free(std::move(buf));
+}
+NOWSOUND_BENCHMARK(SliceCopyFrom, 64, 480, 4096);
+
+// Append chunks of the given size to a stream which holds at most one second, so that appending also
+// exercises trimming and returning buffers to the allocator, as a recording input's history does.
+void StreamAppend(State& state)
+{
+    int chunkSize = (int)state.Arg();
+    // Small buffers, so that even one-second streams span several.
+    BufferAllocator<float> allocator(SampleRateHz / 4 * StereoSliverCount, 8);
+    BufferedSliceStream<AudioSample, float> stream(0, StereoSliverCount, &allocator, SampleRateHz, false);
+    std::vector<float> chunk(chunkSize * StereoSliverCount);
+    FillSignal(chunk.data(), (int)chunk.size());
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        stream.Append(chunkSize, chunk.data());
+        iterations++;
+    }
+    DoNotOptimize(&stream);
+    state.SetItemsProcessed(iterations * chunkSize);
+}
+NOWSOUND_BENCHMARK(StreamAppend, 1, 64, 480, 4096);
+
+namespace
+{
+    // Ten seconds and a fraction of mono audio, shut (if isShut) so it loops with the chosen mapper.
+    void MakeLoop(BufferedSliceStream<AudioSample, float>& stream, bool isShut)
+    {
+        std::vector<float> second(SampleRateHz);
+        FillSignal(second.data(), SampleRateHz);
+        for (int i = 0; i < 10; i++)
+        {
+            stream.Append(SampleRateHz, second.data());
+        }
+        stream.Append(100, second.data());
+        if (isShut)
+        {
+            stream.Shut(ContinuousDuration<AudioSample>(SampleRateHz * 10 + 99.5f));
+        }
+    }
+
+    // Look up one quantum's slice at a time, marching forwards from the start of the stream (wrapping back to
+    // the start if the stream is not looping).
+    void GetSliceContaining(State& state, bool isShut, bool useExactLoopingMapper)
+    {
+        const int quantum = 480;
+        BufferAllocator<float> allocator(SampleRateHz, 12);
+        BufferedSliceStream<AudioSample, float> stream(0, 1, &allocator, 0, useExactLoopingMapper);
+        MakeLoop(stream, isShut);
+
+        int64_t time = 0;
+        int64_t iterations = 0;
+        while (state.KeepRunning())
+        {
+            Slice<AudioSample, float> slice(stream.GetSliceContaining(Interval<AudioSample>(time, quantum)));
+            DoNotOptimize(slice.OffsetPointer());
+            time += quantum;
+            if (!isShut && time >= stream.DiscreteDuration().Value())
+            {
+                time = 0;
+            }
+            iterations++;
+        }
+        state.SetItemsProcessed(iterations * quantum);
+    }
+}
+
+void GetSliceContainingIdentity(State& state) { GetSliceContaining(state, false, false); }
+NOWSOUND_BENCHMARK(GetSliceContainingIdentity);
+
+void GetSliceContainingSimpleLooping(State& state) { GetSliceContaining(state, true, false); }
+NOWSOUND_BENCHMARK(GetSliceContainingSimpleLooping);
+
+void GetSliceContainingExactLooping(State& state) { GetSliceContaining(state, true, true); }
+NOWSOUND_BENCHMARK(GetSliceContainingExactLooping);
+
+// Read one quantum of a looping track at a time, as the mixer does: straight through (0), or through a playback
+// effect's mapper, backwards (1), at half speed (2), or stuttering a quarter second (3).
+void StreamPlaybackMapped(State& state)
+{
+    const int quantum = 480;
+    const int64_t normalSpeed = (int64_t)1 << IntervalMapper<AudioSample>::PhaseBits;
+    BufferAllocator<float> allocator(SampleRateHz, 12);
+    BufferedSliceStream<AudioSample, float> stream(0, 1, &allocator, 0, /*useExactLoopingMapper:*/true);
+    MakeLoop(stream, true);
+    PolyphaseInterpolator interpolator;
+
+    std::unique_ptr<PlaybackMapper<AudioSample>> mapper;
+    switch (state.Arg())
+    {
+    case 1: mapper.reset(new SpeedPlaybackMapper<AudioSample>(0, 0, -normalSpeed)); break;
+    case 2: mapper.reset(new SpeedPlaybackMapper<AudioSample>(0, 0, normalSpeed / 2)); break;
+    case 3: mapper.reset(new StutterPlaybackMapper<AudioSample>(0, 0, SampleRateHz / 4)); break;
+    }
+
+    std::vector<float> output(quantum);
+    int64_t time = 0;
+    while (state.KeepRunning())
+    {
+        Interval<AudioSample> interval(time, quantum);
+        if (mapper == nullptr)
+        {
+            stream.CopyToInterpolated(interval, interpolator, output.data());
+        }
+        else
+        {
+            stream.CopyToMapped(interval, *mapper, interpolator, output.data());
+        }
+        DoNotOptimize(output.data());
+        time += quantum;
+    }
+    state.SetItemsProcessed(time);
+}
+NOWSOUND_BENCHMARK(StreamPlaybackMapped, 0, 1, 2, 3);
+
+void HistogramAdd(State& state)
+{
+    Histogram histogram(200);
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        histogram.Add((float)(iterations & 1023));
+        iterations++;
+    }
+    DoNotOptimize(&histogram);
+    state.SetItemsProcessed(iterations);
+}
+NOWSOUND_BENCHMARK(HistogramAdd);
+
+void LatencyHistogramRecord(State& state)
+{
+    LatencyHistogram histogram(0.01f);
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        histogram.Record((float)(iterations & 1023));
+        iterations++;
+    }
+    DoNotOptimize(&histogram);
+    state.SetItemsProcessed(iterations);
+}
+NOWSOUND_BENCHMARK(LatencyHistogramRecord);
+
+void HistogramAddAll(State& state)
+{
+    int sampleCount = (int)state.Arg();
+    Histogram histogram(SampleRateHz / 10);
+    std::vector<float> samples(sampleCount);
+    FillSignal(samples.data(), sampleCount);
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        histogram.AddAll(samples.data(), sampleCount, true);
+        iterations++;
+    }
+    DoNotOptimize(&histogram);
+    state.SetItemsProcessed(iterations * sampleCount);
+}
+NOWSOUND_BENCHMARK(HistogramAddAll, 480, 4096);
+
+// Allocate the given number of buffers, then free them all; the free list is the steady state, so after the
+// first iteration this never touches the system allocator.
+void BufferAllocatorChurn(State& state)
+{
+    int outstanding = (int)state.Arg();
+    // Small buffers, since the cost of allocating from the free list does not depend on their size.
+    BufferAllocator<float> allocator(4096, outstanding);
+    std::vector<OwningBuf<float>> bufs;
+    bufs.reserve(outstanding);
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < outstanding; i++)
+        {
+            bufs.push_back(allocator.Allocate());
+        }
+        while (!bufs.empty())
+        {
+            allocator.Free(std::move(bufs.back()));
+            bufs.pop_back();
+        }
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * outstanding);
+}
+NOWSOUND_BENCHMARK(BufferAllocatorChurn, 1, 16, 128);
+
+// Graph startup's allocator construction with the given number of one-second buffers, faulted in on a background
+// thread, up to the first buffer being handed out; this should not grow with the buffer count.  (Each iteration
+// also destroys the allocator, which stops the background thread after at most one more buffer.)
+void AudioAllocatorStartup(State& state)
+{
+    int bufferCount = (int)state.Arg();
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        BufferAllocator<float> allocator(SampleRateHz * StereoSliverCount, bufferCount, true);
+        OwningBuf<float> buf(allocator.Allocate());
+        buf.Data()[0] = 0;
+        DoNotOptimize(buf.Data());
+        allocator.Free(std::move(buf));
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations);
+}
+NOWSOUND_BENCHMARK(AudioAllocatorStartup, 8, 64);
+
+// Filter a quantum of the given number of tracks (in one bank) through a full four-band EQ each; items are
+// track-samples, so 4 tracks should cost little more than 1.
+void BiquadBankEq(State& state)
+{
+    const int sampleCount = 480;
+    int trackCount = (int)state.Arg();
+    std::vector<std::vector<float>> buffers(trackCount, std::vector<float>(sampleCount));
+    std::vector<float*> bufferPointers;
+    std::vector<BiquadCascade> cascades(trackCount);
+    std::vector<BiquadCascade*> cascadePointers;
+    for (int track = 0; track < trackCount; track++)
+    {
+        FillSignal(buffers[track].data(), sampleCount);
+        bufferPointers.push_back(buffers[track].data());
+        cascades[track].SetStage(0, BiquadCoefficients::HighPass(SampleRateHz, 80, 0.7f));
+        cascades[track].SetStage(1, BiquadCoefficients::LowShelf(SampleRateHz, 200, 0.7f, -3));
+        cascades[track].SetStage(2, BiquadCoefficients::Peaking(SampleRateHz, 1000 + track * 100.0f, 1, 4));
+        cascades[track].SetStage(3, BiquadCoefficients::HighShelf(SampleRateHz, 8000, 0.7f, 2));
+        cascadePointers.push_back(&cascades[track]);
+    }
+    BiquadBank bank;
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        bank.Process(cascadePointers.data(), bufferPointers.data(), trackCount, sampleCount);
+        DoNotOptimize(bufferPointers[0]);
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * sampleCount * trackCount);
+}
+NOWSOUND_BENCHMARK(BiquadBankEq, 1, 4);
+
+// The cost of one NOWSOUND_TRACE statement, with tracing enabled (argument 1) and disabled at runtime (0).
+void TraceEventRecord(State& state)
+{
+    bool wasEnabled = Trace::IsEnabled();
+    Trace::IsEnabled(state.Arg() != 0);
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        NOWSOUND_TRACE(TrackMixBegin, 1, 480, iterations);
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations);
+    Trace::IsEnabled(wasEnabled);
+}
+NOWSOUND_BENCHMARK(TraceEventRecord, 0, 1);
+
+void FFT(State& state)
+{
+    int fftSize = (int)state.Arg();
+    std::vector<float> signal(fftSize);
+    FillSignal(signal.data(), fftSize);
+    CArray data(fftSize);
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < fftSize; i++)
+        {
+            data[i] = signal[i];
+        }
+        optimized_fft(data);
+        DoNotOptimize(&data[0]);
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * fftSize);
+}
+NOWSOUND_BENCHMARK(FFT, 512, 1024, 2048);
+
+// The planned real FFT that the convolution reverb uses, for comparison with the Rosetta FFT above.
+void PlannedRealFFT(State& state)
+{
+    int fftSize = (int)state.Arg();
+    std::vector<float> signal(fftSize);
+    FillSignal(signal.data(), fftSize);
+    RealFftPlan plan(fftSize);
+    std::vector<std::complex<float>> spectrum(plan.BinCount());
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        plan.Forward(signal.data(), spectrum.data());
+        DoNotOptimize(spectrum.data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * fftSize);
+}
+NOWSOUND_BENCHMARK(PlannedRealFFT, 512, 1024, 2048);
+
+// Convolve quanta with an impulse response of the given number of seconds, all on this thread (no tail thread);
+// items are samples, so this is the whole reverb's CPU cost per second of audio.
+void ConvolutionReverb(State& state)
+{
+    const int sampleCount = 480;
+    std::vector<float> impulse((size_t)(state.Arg() * SampleRateHz));
+    FillSignal(impulse.data(), (int)impulse.size());
+    PartitionedConvolver convolver(256, impulse.data(), (int)impulse.size(), false);
+    std::vector<float> input(sampleCount);
+    FillSignal(input.data(), sampleCount);
+    std::vector<float> output(sampleCount);
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        convolver.Process(input.data(), output.data(), sampleCount);
+        DoNotOptimize(output.data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * sampleCount);
+}
+NOWSOUND_BENCHMARK(ConvolutionReverb, 1, 4);
+
+// Limit and meter one 10ms quantum of stereo output, loud enough that the limiter is always working.
+void MasterBusProcess(State& state)
+{
+    const int frameCount = 480;
+    MasterBus masterBus(SampleRateHz, 96, -1, 0.1f);
+    std::vector<float> signal(frameCount * 2);
+    FillSignal(signal.data(), frameCount * 2);
+    std::vector<float> stereo(frameCount * 2);
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        for (int i = 0; i < frameCount * 2; i++)
+        {
+            stereo[i] = signal[i] * 4;
+        }
+        masterBus.Process(stereo.data(), frameCount);
+        DoNotOptimize(stereo.data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * frameCount);
+}
+NOWSOUND_BENCHMARK(MasterBusProcess);
+
+// Export ten seconds of 50 looping tracks (of different, fractional lengths, so every read is interpolated) through
+// the master bus, across the given number of workers; items are frames, so items/sec over 48000 is how many times
+// faster than real time the export runs.
+void OfflineMixdownExport(State& state)
+{
+    const int trackCount = 50;
+    const int frameCount = SampleRateHz * 10;
+    BufferAllocator<float> bufferAllocator(BufferLength, 1);
+    std::vector<std::unique_ptr<BufferedSliceStream<AudioSample, float>>> loops;
+    std::vector<OfflineMixdown::Source> sources;
+    for (int i = 0; i < trackCount; i++)
+    {
+        int loopLength = (2 + i % 7) * SampleRateHz + i * 37;
+        std::vector<float> data(loopLength);
+        FillSignal(data.data(), loopLength);
+        loops.emplace_back(new BufferedSliceStream<AudioSample, float>(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true));
+        loops.back()->Append(Duration<AudioSample>(loopLength), data.data());
+        loops.back()->Shut(ContinuousDuration<AudioSample>(loopLength - 0.5f));
+
+        OfflineMixdown::Source source{ loops.back().get(), i * 1000, (float)i / trackCount, {}, nullptr };
+        std::fill(source.EqBands, source.EqBands + BiquadCascade::StageCount, BiquadCoefficients::Identity());
+        sources.push_back(source);
+    }
+    OfflineMixdown mixdown(std::move(sources), (int)state.Arg());
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        MasterBus masterBus(SampleRateHz, 96, -1, 0.1f);
+        std::ostringstream output(std::ios::binary);
+        WavWriter mix(output, 2, SampleRateHz);
+        mixdown.Render(frameCount, &masterBus, nullptr, mix);
+        DoNotOptimize(&mix);
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * frameCount);
+}
+NOWSOUND_BENCHMARK(OfflineMixdownExport, 1, 4);
+
+// Rescale one FFT into the 20 bins (five octaves, four bins per octave) the sample app displays.
+void RescaleFFTBins(State& state)
+{
+    int fftSize = (int)state.Arg();
+    const int binCount = 20;
+    std::vector<FrequencyBinBounds> bounds(binCount);
+    MakeBinBounds(bounds, 440, 4, binCount, 9, SampleRateHz, fftSize);
+
+    std::vector<float> signal(fftSize);
+    FillSignal(signal.data(), fftSize);
+    CArray data(fftSize);
+    for (int i = 0; i < fftSize; i++)
+    {
+        data[i] = signal[i];
+    }
+    optimized_fft(data);
+
+    std::vector<float> output(binCount);
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        RescaleFFT(bounds, data, output.data(), binCount);
+        DoNotOptimize(output.data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * fftSize);
+}
+NOWSOUND_BENCHMARK(RescaleFFTBins, 512, 1024, 2048);
+
+// Analyze one frame into the same 20 bins with the constant-Q analyzer, FFT and all; compare with FFT plus
+// RescaleFFTBins.
+void ConstantQBins(State& state)
+{
+    int frameSize = (int)state.Arg();
+    const int binCount = 20;
+    ConstantQAnalyzer analyzer(440, 4, binCount, 9, SampleRateHz, frameSize);
+
+    std::vector<float> signal(frameSize);
+    FillSignal(signal.data(), frameSize);
+    std::vector<std::complex<float>> spectrum(analyzer.SpectrumSize());
+    std::vector<float> output(binCount);
+
+    int64_t iterations = 0;
+    while (state.KeepRunning())
+    {
+        analyzer.Analyze(signal.data(), spectrum.data(), output.data());
+        DoNotOptimize(output.data());
+        iterations++;
+    }
+    state.SetItemsProcessed(iterations * frameSize);
+}
+NOWSOUND_BENCHMARK(ConstantQBins, 512, 1024, 2048);
@@ -0,0 +1,125 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+#include "Benchmark.h"
+
+using namespace NowSound::Benchmark;
+using namespace std;
+
+// Runs the NowSoundLibShared microbenchmarks.
+//
+// Besides BenchmarksDesktop.vcxproj, this builds with any C++17 compiler, e.g. from the repository root:
+//   g++ -std=c++17 -O2 -IBenchmarksDesktop -INowSoundLibShared -INowSoundLib BenchmarksDesktop/*.cpp
+//       NowSoundLibShared/*.cpp -lpthread -o benchmarks
+//
+// Options (named as in Google Benchmark, where there is an equivalent):
+//   --benchmark_filter=<substring>     only run benchmarks whose name contains this
+//   --benchmark_min_time=<seconds>     minimum time per repetition (default 0.5)
+//   --benchmark_repetitions=<count>    repetitions per benchmark, of which the fastest is reported (default 3)
+//   --benchmark_format=<console|json>  what to write to standard output (default console)
+//   --benchmark_out=<file>             also write JSON results to this file (e.g. to store as a new baseline)
+//   --baseline=<file>                  compare against JSON results from a previous run
+//   --threshold=<fraction>             slowdown beyond which a benchmark counts as regressed (default 0.1)
+//
+// Exits with status 1 if any benchmark regressed against the baseline.
+
+namespace
+{
+    // If argument is "--name=value", set value and return true.
+    bool ParseOption(const string& argument, const char* name, string& value)
+    {
+        string prefix = string("--") + name + "=";
+        if (argument.compare(0, prefix.size(), prefix) != 0)
+        {
+            return false;
+        }
+        value = argument.substr(prefix.size());
+        return true;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    string filter;
+    double minimumSeconds = 0.5;
+    int repetitions = 3;
+    string format = "console";
+    string outputFile;
+    string baselineFile;
+    double threshold = 0.1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        string argument(argv[i]);
+        string value;
+        if (ParseOption(argument, "benchmark_filter", value)) { filter = value; }
+        else if (ParseOption(argument, "benchmark_min_time", value)) { minimumSeconds = atof(value.c_str()); }
+        else if (ParseOption(argument, "benchmark_repetitions", value)) { repetitions = atoi(value.c_str()); }
+        else if (ParseOption(argument, "benchmark_format", value)) { format = value; }
+        else if (ParseOption(argument, "benchmark_out", value)) { outputFile = value; }
+        else if (ParseOption(argument, "baseline", value)) { baselineFile = value; }
+        else if (ParseOption(argument, "threshold", value)) { threshold = atof(value.c_str()); }
+        else
+        {
+            cerr << "Unknown argument: " << argument << "\n";
+            return 2;
+        }
+    }
+
+    if (minimumSeconds <= 0 || repetitions <= 0 || (format != "console" && format != "json"))
+    {
+        cerr << "Invalid arguments\n";
+        return 2;
+    }
+
+    // Read the baseline first, so a bad path fails before spending the time to run everything.
+    map<string, double> baseline;
+    if (!baselineFile.empty())
+    {
+        ifstream baselineStream(baselineFile);
+        if (!baselineStream)
+        {
+            cerr << "Cannot read baseline " << baselineFile << "\n";
+            return 2;
+        }
+        baseline = ReadBaseline(baselineStream);
+    }
+
+    vector<Result> results = RunAll(filter, minimumSeconds, repetitions);
+
+    if (format == "json")
+    {
+        WriteJson(cout, results);
+    }
+    else
+    {
+        WriteTable(cout, results);
+    }
+
+    if (!outputFile.empty())
+    {
+        ofstream outputStream(outputFile);
+        WriteJson(outputStream, results);
+    }
+
+    if (!baselineFile.empty())
+    {
+        // The report goes to stderr when stdout is JSON, to keep stdout parseable.
+        ostream& report = format == "json" ? cerr : cout;
+        report << "\nComparison with " << baselineFile << ":\n";
+        int regressionCount = CompareToBaseline(report, results, baseline, threshold);
+        if (regressionCount > 0)
+        {
+            report << regressionCount << " benchmark(s) regressed by more than " << threshold * 100 << "%\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
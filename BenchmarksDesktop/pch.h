@@ -0,0 +1,29 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+// Unlike the library and the unit tests, the benchmarks use only the standard library (plus the shared code),
+// so they build and run on any platform; the shared code's few Windows-isms are stubbed out here.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#define __declspec(x)
+inline void DebugBreak() {}
+#endif
@@ -58,29 +58,22 @@ void NowSoundApp::UpdateStateLabel()
     // Must be on background context (all waits should always be in background).
 std::future<bool> NowSoundApp::WaitForGraphState(NowSoundGraphState expectedState, TimeSpan timeout)
 {
-	// TODO: ensure not on UI context.
-
-	DateTime timeoutTime = winrt::clock::now() + timeout;
-
-	// Polling wait is inferior to callbacks, but the Unity model is all about polling (aka realtime game loop),
-	// so we use polling in this example -- and to determine how it actually works in modern C++.
-	NowSoundGraphState currentState = NowSoundGraph_State();
-	// While the state isn't as expected yet, and we haven't reached timeoutTime, keep ticking.
-	while (expectedState != NowSoundGraph_State()
-		&& winrt::clock::now() < timeoutTime)
-	{
-		// wait in intervals of 1/1000 sec
-		co_await resume_after(TimeSpan((int)(TicksPerSecond * 0.001f)));
+	// Callers may be on the UI thread (the OK button's click handler reaches here synchronously), and the wait
+	// below blocks; so move to a background thread first.
+	co_await resume_background();
 
-		currentState = NowSoundGraph_State();
-	}
+	// Block this background thread until the graph signals the state change; unlike polling, this adds no latency
+	// to each startup stage.
+	bool isInExpectedState = NowSoundGraph_WaitForState(
+		expectedState,
+		(int32_t)duration_cast<milliseconds>(timeout).count());
 
 	// switch to UI thread to update state label, then back to background
 	co_await _uiThread;
 	UpdateStateLabel();
 	co_await resume_background();
 
-	return expectedState == currentState;
+	return isInExpectedState;
 }
 
 void NowSoundApp::OnLaunched(LaunchActivatedEventArgs const&)
@@ -144,13 +137,25 @@ IAsyncAction NowSoundApp::UpdateLoop()
 		NowSoundTimeInfo timeInfo = NowSoundGraph_TimeInfo();
 		NowSoundInputInfo input1Info = NowSoundGraph_InputInfo(AudioInputId::AudioInput1);
 		NowSoundInputInfo input2Info = NowSoundGraph_InputInfo(AudioInputId::AudioInput2);
+		NowSoundTimingInfo timingInfo = NowSoundGraph_TimingInfo();
+		NowSoundMemoryInfo memoryInfo = NowSoundGraph_MemoryInfo();
+		NowSoundStartupInfo startupInfo = NowSoundGraph_StartupInfo();
+		NowSoundMasterInfo masterInfo = NowSoundGraph_MasterInfo();
 		std::wstringstream wstr;
 		wstr << L"Time (in audio samples): " << timeInfo.TimeInSamples
 			<< std::fixed << std::setprecision(2)
 			<< L" | Beat: " << timeInfo.BeatInMeasure
-			<< L" | Total beats: " << timeInfo.ExactBeat
+			<< L" | Total beats: " << timeInfo.CompleteBeats
 			<< L" | Input 1 volume: " << input1Info.Volume
-			<< L" | Input 2 volume: " << input2Info.Volume;
+			<< L" | Input 2 volume: " << input2Info.Volume
+			<< L" | Quantum p99.9/max (samples): " << timingInfo.P999QuantumInterval << L"/" << timingInfo.MaximumQuantumInterval
+			<< L" | Mix p99.9 (samples): " << timingInfo.P999MixDuration
+			<< L" | Audio memory in use (MB): " << memoryInfo.InUseBytes / (1024.0 * 1024.0)
+			<< L" | Short-term loudness (LUFS): " << masterInfo.ShortTermLoudnessLufs
+			<< L" | Max true peak (dBTP): " << masterInfo.MaximumTruePeakDb
+			// leave out the time the user spent choosing input devices
+			<< L" | Startup to first audio (ms): "
+			<< startupInfo.InitializedMilliseconds + startupInfo.FirstAudioMilliseconds - startupInfo.CreateRequestedMilliseconds;
 		_textBlockTimeInfo.Text(wstr.str());
 
 		// update all buttons
@@ -21,7 +21,8 @@ const float MagicNumbers::InitialBeatsPerMinute{ 60 };
 // 4/4 time
 const int MagicNumbers::BeatsPerMeasure{ 4 };
 
-// Could be much larger but not really any reason to
+// Could be much larger but not really any reason to; startup cost doesn't grow with it, since the buffers share
+// one reservation and are faulted in on a background thread.
 const int MagicNumbers::InitialAudioBufferCount{ 8 };
 
 // 1 second of stereo float audio at 48Khz is only 384KB.  One second buffer ensures minimal fragmentation
@@ -32,11 +33,58 @@ const Duration<Second> MagicNumbers::AudioBufferSizeInSeconds{ 1 };
 // TODO: make this be dynamically settable.
 const ContinuousDuration<Second> MagicNumbers::PreRecordingDuration{ (float)0.2 };
 
-// This could easily be huge but 1000 is fine for getting at least a second's worth of per-track history at audio rate.
-const int MagicNumbers::DebugLogCapacity{ 1000 };
-
 // 200 histogram values at 100Hz = two seconds of history, enough to follow transient crackling/breakup
 // (due to losing foreground execution status, for example)
 const int MagicNumbers::AudioQuantumHistogramCapacity{ 200 };
 
 const ContinuousDuration<Second> MagicNumbers::RecentVolumeDuration{ (float)0.1 };
+
+// About 10 msec at 48Khz; finer than any UI will follow, and only a few thousand floats per minute of loop.
+const Duration<AudioSample> MagicNumbers::LoopEnvelopeBlockDuration{ 512 };
+
+// Zero skips only true digital silence, which leaves the output bit-for-bit unchanged.  Raising this would skip
+// more (e.g. noise-floor tails), at the cost of no longer being exact.
+const float MagicNumbers::SilenceThreshold{ 0 };
+
+// -100dB; the filters' state would take far longer to decay to exactly zero, if ever, and no one hears below this.
+const float MagicNumbers::InsertTailThreshold{ 0.00001f };
+
+// Long enough to capture several bars at any reasonable tempo; mono float audio at 48Khz is only 192KB per second.
+const ContinuousDuration<Second> MagicNumbers::RetroactiveRecordingDuration{ 30 };
+
+// Below this, forking and joining (and summing the workers' buses) costs more than mixing the tracks serially.
+const int MagicNumbers::MinimumParallelMixTrackCount{ 16 };
+
+// Idle workers spin for the whole quantum, so each one occupies a core; more than this starves the rest of the app.
+const int MagicNumbers::MaxMixerWorkerCount{ 4 };
+
+// A fifth of a microsecond at 48Khz, far finer than any timing that matters; at this resolution the histograms'
+// 32-bit range still covers intervals of a quarter hour.
+const float MagicNumbers::TimingHistogramResolution{ (float)0.01 };
+
+// About 5 msec at 48Khz, inside one audio graph quantum.  Smaller blocks cost more FFTs per second for the audio
+// thread; larger ones would add audible pre-delay to the reverb.
+const Duration<AudioSample> MagicNumbers::ReverbBlockDuration{ 256 };
+
+// Longer than almost any real room; at 48Khz and 256-sample blocks, the tail thread multiplies in under 2,000
+// partitions per block.
+const ContinuousDuration<Second> MagicNumbers::MaximumReverbDuration{ 10 };
+
+// 2 msec at 48Khz: long enough to fade the gain down over a peak's attack without audible distortion, short
+// enough to add only a fraction of a quantum of latency.
+const Duration<AudioSample> MagicNumbers::LimiterLookaheadDuration{ 96 };
+
+// The limiter works on sample peaks, and inter-sample peaks can run a little higher; 1 dB of headroom keeps them
+// (and lossy encoding of any recording) from clipping.
+const float MagicNumbers::LimiterCeilingDb{ -1 };
+
+// Fast enough not to hold the mix down audibly after a transient, slow enough not to pump on bass notes.
+const ContinuousDuration<Second> MagicNumbers::LimiterReleaseDuration{ (float)0.1 };
+
+// 64MB is about three minutes of mono audio at 48Khz: dozens of overdubs over a typical loop, since each version
+// costs only the buffers it changed, while still bounding what a long session of overdubbing one loop can pile up.
+const int64_t MagicNumbers::TrackHistoryMemoryCap{ 64 * 1024 * 1024 };
+
+// 32MB is about a minute and a half of stereo at 48Khz: room for the least common multiple of a few differing loop
+// lengths, but not for the many minutes that, say, a 7-, an 11- and a 13-beat loop take to line up again.
+const int64_t MagicNumbers::FreezeMemoryCap{ 32 * 1024 * 1024 };
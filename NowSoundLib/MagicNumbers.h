@@ -37,14 +37,54 @@ namespace NowSound
         // The amount of time by which to "pre-record" already-heard audio at the start of a new track.
         static const ContinuousDuration<Second> PreRecordingDuration;
 
-        // The number of strings to buffer in the per-track debug log.
-        static const int DebugLogCapacity;
-
         // How many audio frames' duration will the per-track histogram follow?
         // The histogram helps detect spikes in the latency observed by the FrameInputNode_QuantumStarted method.
         static const int AudioQuantumHistogramCapacity;
 
 		// Amount of time over which to measure volume.
 		static const ContinuousDuration<Second> RecentVolumeDuration;
+
+		// The length of each block of a loop's precomputed volume envelope.
+		static const Duration<AudioSample> LoopEnvelopeBlockDuration;
+
+		// The peak level at or below which a stretch of a loop is treated as silent, and not played at all.
+		static const float SilenceThreshold;
+
+		// The level below which a track's inserts are no longer ringing after its loop falls silent, so need no
+		// longer be run over the silence.
+		static const float InsertTailThreshold;
+
+		// How much of each input's history is kept for retroactive recording.
+		static const ContinuousDuration<Second> RetroactiveRecordingDuration;
+
+		// The fewest tracks which the mixer splits across its workers; fewer are mixed on the audio graph's thread.
+		static const int MinimumParallelMixTrackCount;
+
+		// The most workers (including the audio graph's thread) the mixer will use.
+		static const int MaxMixerWorkerCount;
+
+		// The resolution, in samples, of the percentile histograms of callback timing.
+		static const float TimingHistogramResolution;
+
+		// The partition size of the send bus's convolution reverb, which is also the reverb's latency; a power of two.
+		static const Duration<AudioSample> ReverbBlockDuration;
+
+		// The longest reverb impulse response used; longer ones are truncated.
+		static const ContinuousDuration<Second> MaximumReverbDuration;
+
+		// How far ahead the master limiter looks (which is also the latency it adds).
+		static const Duration<AudioSample> LimiterLookaheadDuration;
+
+		// The level, in dB relative to full scale, which the master limiter never lets the output exceed.
+		static const float LimiterCeilingDb;
+
+		// The time constant with which the master limiter's gain recovers after a peak.
+		static const ContinuousDuration<Second> LimiterReleaseDuration;
+
+		// The default cap, in bytes, on the memory each track's undo history may hold, counting the current version.
+		static const int64_t TrackHistoryMemoryCap;
+
+		// The default cap, in bytes, on the memory each frozen group's loop may take.
+		static const int64_t FreezeMemoryCap;
     };
 }
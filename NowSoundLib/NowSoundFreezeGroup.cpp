@@ -0,0 +1,85 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Check.h"
+#include "NowSoundFreezeGroup.h"
+#include "NowSoundTrack.h"
+
+using namespace concurrency;
+using namespace std;
+
+namespace NowSound
+{
+	NowSoundFreezeGroup::NowSoundFreezeGroup(std::vector<Member>&& members, ContinuousDuration<AudioSample> duration)
+		: _tracks{},
+		_snapshots{},
+		_sources{},
+		// the pages are faulted in on a background thread, so this does not hold up the UI thread either
+		_allocator{ (int)std::ceil(duration.Value()), 2, true },
+		_loop{ &_allocator, duration },
+		_interpolator{},
+		_position{ 0 },
+		_quantumPosition{ 0 },
+		_isPlaying{ false },
+		_isCancelled{ false },
+		_renderTask{}
+	{
+		Check(!members.empty());
+
+		for (const Member& member : members)
+		{
+			Check(member.Track->CanFreeze());
+			_tracks.push_back(member.Track);
+			_snapshots.push_back(member.Track->SnapshotLoop());
+			// the frozen loop starts where the track's quantum at the start time does
+			_sources.push_back(FrozenLoop::Source{ _snapshots.back().get(), member.StartTime, member.Track->Pan() });
+		}
+
+		_renderTask = create_task([this]() -> void { _loop.Render(_sources, _interpolator, _isCancelled); });
+	}
+
+	NowSoundFreezeGroup::~NowSoundFreezeGroup()
+	{
+		_isCancelled = true;
+		_renderTask.wait();
+	}
+
+	bool NowSoundFreezeGroup::Contains(const NowSoundTrack* track) const
+	{
+		return std::find(_tracks.begin(), _tracks.end(), track) != _tracks.end();
+	}
+
+	void NowSoundFreezeGroup::Skip(Duration<AudioSample> duration)
+	{
+		Check(duration >= 0);
+		_position = _position + duration;
+	}
+
+	bool NowSoundFreezeGroup::IsFrozen() const { return _loop.IsRendered(); }
+
+	void NowSoundFreezeGroup::BeginQuantum(int sampleCount)
+	{
+		_isPlaying = _loop.IsRendered();
+		_quantumPosition = _position;
+		_position = _position + Duration<AudioSample>(sampleCount);
+	}
+
+	bool NowSoundFreezeGroup::IsPlaying() const { return _isPlaying; }
+
+	void NowSoundFreezeGroup::MixInto(float* stereoBus, int sampleCount)
+	{
+		Check(_isPlaying);
+
+		_loop.MixInto(Interval<AudioSample>(_quantumPosition, Duration<AudioSample>(sampleCount)), _interpolator, stereoBus);
+
+		for (NowSoundTrack* track : _tracks)
+		{
+			track->SkipForMix(sampleCount);
+		}
+	}
+}
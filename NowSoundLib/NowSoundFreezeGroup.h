@@ -0,0 +1,95 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "pch.h"
+
+#include "BufferAllocator.h"
+#include "FrozenLoop.h"
+#include "PolyphaseInterpolator.h"
+#include "SliceStream.h"
+#include "Time.h"
+
+namespace NowSound
+{
+	class NowSoundTrack;
+
+	// A group of looping tracks frozen into one FrozenLoop, which the mixer plays in their place.
+	//
+	// Every track's playback position is captured, under the mixer's lock, as of the same quantum; the group is
+	// built from those outside the lock, then skipped ahead by however far the tracks played on meanwhile, and
+	// thereafter the mixer advances the group's own position every quantum, just as it advances the tracks'.  The frozen loop is rendered in the background, from snapshots of the tracks' loops; until it is
+	// done, the tracks are mixed as usual.  After, the mixer mixes the frozen loop instead, but still advances each
+	// track's position, so that unfreezing (just dropping the group) lets the tracks carry on from exactly where
+	// the frozen loop was.
+	class NowSoundFreezeGroup
+	{
+	public:
+		// One track to freeze.
+		struct Member
+		{
+			NowSoundTrack* Track;
+
+			// The track's next sample time as of the quantum the group starts at.
+			Time<AudioSample> StartTime;
+		};
+
+	private:
+		std::vector<NowSoundTrack*> _tracks;
+
+		// Snapshots of the tracks' loops, for the render to read.
+		std::vector<std::unique_ptr<BufferedSliceStream<AudioSample, float>>> _snapshots;
+		std::vector<FrozenLoop::Source> _sources;
+
+		// The frozen loop's own allocator, holding exactly one buffer per channel; the graph's allocator may only
+		// be used from the audio threads.
+		BufferAllocator<float> _allocator;
+
+		FrozenLoop _loop;
+
+		PolyphaseInterpolator _interpolator;
+
+		// The position in the frozen loop of the next quantum; mixing thread only.
+		Time<AudioSample> _position;
+
+		// The position of the current quantum, and whether the frozen loop plays in it; set by BeginQuantum.
+		Time<AudioSample> _quantumPosition;
+		bool _isPlaying;
+
+		std::atomic<bool> _isCancelled;
+		concurrency::task<void> _renderTask;
+
+	public:
+		// Snapshot the given tracks' loops (each track must CanFreeze), and start rendering them in the background,
+		// from the given start times, into a frozen loop of the given duration.
+		NowSoundFreezeGroup(std::vector<Member>&& members, ContinuousDuration<AudioSample> duration);
+
+		// Cancels, and waits for, any render in progress.
+		~NowSoundFreezeGroup();
+
+		bool Contains(const NowSoundTrack* track) const;
+
+		// Start the frozen loop the given duration further along, as the tracks have played on since their start
+		// times.  Call under the mixer's lock, before the mixer first sees the group.
+		void Skip(Duration<AudioSample> duration);
+
+		// Has the frozen loop been rendered (so the mixer plays it in place of the tracks)?  Any thread.
+		bool IsFrozen() const;
+
+		// Start the next quantum, of sampleCount samples: fix whether the frozen loop plays in it, and advance past
+		// it.  Mixing thread only, once per quantum.
+		void BeginQuantum(int sampleCount);
+
+		// Does the frozen loop play in the current quantum?
+		bool IsPlaying() const;
+
+		// Mix the current quantum of the frozen loop into the given interleaved stereo bus, advancing each track
+		// past it.  Requires IsPlaying().
+		void MixInto(float* stereoBus, int sampleCount);
+	};
+}
@@ -20,7 +20,8 @@ namespace NowSound
 {
 	NowSoundFrequencyTracker::NowSoundFrequencyTracker(
 		const std::vector<FrequencyBinBounds>* bounds,
-		int fftSize)
+		int fftSize,
+		const ConstantQAnalyzer* constantQ)
 		: _bufferStates{},
 		_fftBuffers{},
 		_outputBuffer{},
@@ -28,8 +29,19 @@ namespace NowSound
 		_recordingBufferIndex{ 0 },
 		_recordingBufferSize{ 0 },
 		_binBounds(bounds),
-		_fftSize{ fftSize }
+		_fftSize{ fftSize },
+		_constantQ{ constantQ },
+		_constantQInput{},
+		_constantQSpectrum{}
 	{
+		if (constantQ != nullptr)
+		{
+			Check(constantQ->FrameSize() == fftSize);
+			Check(constantQ->BinCount() == (int)bounds->size());
+			_constantQInput.resize(fftSize);
+			_constantQSpectrum.resize(constantQ->SpectrumSize());
+		}
+
 		_outputBuffer = std::unique_ptr<float>(new float[bounds->size()]);
 		std::fill(_outputBuffer.get(), _outputBuffer.get() + bounds->size(), 0);
 		for (int i = 0; i < BufferCount; i++)
@@ -130,15 +142,27 @@ namespace NowSound
 	{
 		Check(_bufferStates[transformingBufferIndex] == BufferState::Transforming);
 
-		// actually run the FFT in placeB!
 		RosettaFFT::Complex* fftBuffer = _fftBuffers[transformingBufferIndex].get();
-		RosettaFFT::CArray fftArray(fftBuffer, _fftSize);
+		if (_constantQ != nullptr)
+		{
+			// the constant-Q kernels are windowed already
+			for (int i = 0; i < _fftSize; i++)
+			{
+				_constantQInput[i] = (float)fftBuffer[i].real();
+			}
+			_constantQ->Analyze(_constantQInput.data(), _constantQSpectrum.data(), _outputBuffer.get());
+		}
+		else
+		{
+			// actually run the FFT in placeB!
+			RosettaFFT::CArray fftArray(fftBuffer, _fftSize);
 
-		// and run it!
-		RosettaFFT::optimized_fft(fftArray);
+			// and run it!
+			RosettaFFT::optimized_fft(fftArray);
 
-		// and rescale it!
-		RosettaFFT::RescaleFFT(*_binBounds, fftArray, _outputBuffer.get(), _binBounds->size());
+			// and rescale it!
+			RosettaFFT::RescaleFFT(*_binBounds, fftArray, _outputBuffer.get(), _binBounds->size());
+		}
 
 		// and now release our transforming buffer and update output buffer index!
 		std::lock_guard<std::mutex> guard(_bufferMutex);
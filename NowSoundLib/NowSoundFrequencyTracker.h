@@ -10,6 +10,7 @@
 #include "pch.h"
 
 #include "Clock.h"
+#include "ConstantQAnalyzer.h"
 #include "Histogram.h"
 #include "NowSoundLibTypes.h"
 #include "Recorder.h"
@@ -72,14 +73,21 @@ namespace NowSound
 		// The FFT size.
 		const int _fftSize;
 
+		// The constant-Q analyzer to use instead of the FFT, if any, and its scratch buffers.
+		const ConstantQAnalyzer* _constantQ;
+		std::vector<float> _constantQInput;
+		std::vector<std::complex<float>> _constantQSpectrum;
+
 	private:
 		// Run the FFT inside a task and update the requisite output buffer.
 		void TransformBufferAsync(int transformBufferIndex);
 
 	public:
+		// If constantQ is not null, it analyzes each buffer, and bounds only sizes the histogram.
 		NowSoundFrequencyTracker(
 			const std::vector<RosettaFFT::FrequencyBinBounds>* bounds,
-			int fftSize);
+			int fftSize,
+			const ConstantQAnalyzer* constantQ);
 
 		// Get the latest histogram of output values.
 		void GetLatestHistogram(float* outputBuffer, int capacity);
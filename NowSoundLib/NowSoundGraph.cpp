@@ -4,7 +4,12 @@
 #include "pch.h"
 
 #include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <thread>
 
+#include "AudioKernels.h"
 #include "Clock.h"
 #include "GetBuffer.h"
 #include "Histogram.h"
@@ -12,7 +17,11 @@
 #include "NowSoundLib.h"
 #include "NowSoundGraph.h"
 #include "NowSoundTrack.h"
+#include "OfflineMixdown.h"
 #include "Option.h"
+#include "RealTimeThread.h"
+#include "Trace.h"
+#include "WavFile.h"
 
 using namespace concurrency;
 using namespace std;
@@ -41,7 +50,10 @@ namespace NowSound
 			3,
 			4,
 			5,
-			6);
+			6,
+			(float)7,
+			(float)8,
+			(float)9);
 	}
 
 	__declspec(dllexport) NowSoundTimeInfo NowSoundGraph_GetStaticTimeInfo()
@@ -51,7 +63,9 @@ namespace NowSound
 			2,
 			(float)3,
 			(float)4,
-			(float)5);
+			(float)5,
+			6,
+			(float)7);
 	}
 
 	NowSoundGraphState NowSoundGraph_State()
@@ -59,6 +73,21 @@ namespace NowSound
 		return NowSoundGraph::Instance()->State();
 	}
 
+	bool NowSoundGraph_WaitForState(NowSoundGraphState state, int32_t timeoutInMilliseconds)
+	{
+		return NowSoundGraph::Instance()->WaitForState(state, timeoutInMilliseconds);
+	}
+
+	void NowSoundGraph_SetStateChangedCallback(NowSoundGraphStateCallback callback)
+	{
+		NowSoundGraph::Instance()->SetStateChangedCallback(callback);
+	}
+
+	NowSoundStartupInfo NowSoundGraph_StartupInfo()
+	{
+		return NowSoundGraph::Instance()->StartupInfo();
+	}
+
 	void NowSoundGraph_InitializeAsync()
 	{
 		NowSoundGraph::Instance()->InitializeAsync();
@@ -96,6 +125,16 @@ namespace NowSound
 		NowSoundGraph::Instance()->InitializeFFT(outputBinCount, centralFrequency, octaveDivisions, centralBinIndex, fftSize);
 	}
 
+	void NowSoundGraph_InitializeConstantQ(
+		int outputBinCount,
+		float centralFrequency,
+		int octaveDivisions,
+		int centralBinIndex,
+		int fftSize)
+	{
+		NowSoundGraph::Instance()->InitializeConstantQ(outputBinCount, centralFrequency, octaveDivisions, centralBinIndex, fftSize);
+	}
+
 	void NowSoundGraph_CreateAudioGraphAsync()
 	{
 		NowSoundGraph::Instance()->CreateAudioGraphAsync();
@@ -111,6 +150,86 @@ namespace NowSound
 		return NowSoundGraph::Instance()->InputInfo(audioInputId);
 	}
 
+	void NowSoundGraph_SetInputMonitoring(AudioInputId audioInputId, bool isMonitoring)
+	{
+		NowSoundGraph::Instance()->SetInputMonitoring(audioInputId, isMonitoring);
+	}
+
+	void NowSoundGraph_SetInputPan(AudioInputId audioInputId, float pan)
+	{
+		NowSoundGraph::Instance()->SetInputPan(audioInputId, pan);
+	}
+
+	NowSoundMemoryInfo NowSoundGraph_MemoryInfo()
+	{
+		return NowSoundGraph::Instance()->MemoryInfo();
+	}
+
+	void NowSoundGraph_SetMemoryBudget(int64_t budgetInBytes)
+	{
+		NowSoundGraph::Instance()->SetMemoryBudget(budgetInBytes);
+	}
+
+	void NowSoundGraph_SetTrackHistoryMemoryCap(int64_t capInBytes)
+	{
+		NowSoundGraph::Instance()->SetTrackHistoryMemoryCap(capInBytes);
+	}
+
+	NowSoundTimingInfo NowSoundGraph_TimingInfo()
+	{
+		return NowSoundGraph::Instance()->TimingInfo();
+	}
+
+	void NowSoundGraph_ResetTimingInfo()
+	{
+		NowSoundGraph::Instance()->ResetTimingInfo();
+	}
+
+	NowSoundMasterInfo NowSoundGraph_MasterInfo()
+	{
+		return NowSoundGraph::Instance()->MasterInfo();
+	}
+
+	bool NowSoundGraph_ExportTrace(LPWSTR fileName)
+	{
+		return NowSoundGraph::Instance()->ExportTrace(fileName);
+	}
+
+	bool NowSoundGraph_LoadReverbImpulseResponse(LPWSTR fileName)
+	{
+		return NowSoundGraph::Instance()->LoadReverbImpulseResponse(fileName);
+	}
+
+	void NowSoundGraph_RemoveReverb()
+	{
+		NowSoundGraph::Instance()->RemoveReverb();
+	}
+
+	int32_t NowSoundGraph_FreezeTracks()
+	{
+		return NowSoundGraph::Instance()->FreezeTracks();
+	}
+
+	void NowSoundGraph_SetFreezeMemoryCap(int64_t capInBytes)
+	{
+		NowSoundGraph::Instance()->SetFreezeMemoryCap(capInBytes);
+	}
+
+	void NowSoundGraph_ExportMixdownAsync(LPWSTR fileName, int64_t beatCount, bool exportStems)
+	{
+		NowSoundGraph::Instance()->ExportMixdownAsync(fileName, beatCount, exportStems);
+	}
+
+	NowSoundExportState NowSoundGraph_ExportState()
+	{
+		return NowSoundGraph::Instance()->ExportState();
+	}
+
+	bool NowSoundGraph_WaitForExport(int32_t timeoutInMilliseconds)
+	{
+		return NowSoundGraph::Instance()->WaitForExport(timeoutInMilliseconds);
+	}
+
 	void NowSoundGraph_StartAudioGraphAsync()
 	{
 		NowSoundGraph::Instance()->StartAudioGraphAsync();
@@ -131,6 +250,11 @@ namespace NowSound
 		return NowSoundGraph::Instance()->CreateRecordingTrackAsync(audioInputId);
 	}
 
+	TrackId NowSoundGraph_CreateRetroactiveTrack(AudioInputId audioInputId, int64_t beatDuration)
+	{
+		return NowSoundGraph::Instance()->CreateRetroactiveTrack(audioInputId, beatDuration);
+	}
+
 	TimeSpan timeSpanFromSeconds(int seconds)
 	{
 		// TimeSpan is in 100ns units
@@ -145,37 +269,107 @@ namespace NowSound
 		: _audioGraph{ nullptr },
 		_audioGraphState{ NowSoundGraphState::GraphUninitialized },
 		_deviceOutputNode{ nullptr },
+		_mixer{},
 		_audioAllocator{ nullptr },
+		_interpolator{},
 		_trackId{ TrackId::TrackIdUndefined },
 		_nextAudioInputId{ AudioInputId::AudioInputUndefined },
 		_inputDeviceIndicesToInitialize{},
+		_monitorFrameInputNode{ nullptr },
+		_monitorFrame{ nullptr },
+		_monitorBuffer{},
+		_monitorDuration{ 0 },
+		_monitorLatencyHistogram{ MagicNumbers::TimingHistogramResolution },
+		_lastQuantumTime{},
+		_quantumIntervalHistogram{ MagicNumbers::TimingHistogramResolution },
+		_memoryBudgetInBytes{ 0 },
+		_trackHistoryMemoryCapInBytes{ MagicNumbers::TrackHistoryMemoryCap },
+		_freezeMemoryCapInBytes{ MagicNumbers::FreezeMemoryCap },
+		_refusedRecordingCount{ 0 },
+		_inputDevices{ },
 		_audioInputs{ },
 		_changingState{ false },
+		_stateChangedCallback{ nullptr },
+		_exportState{ NowSoundExportState::ExportNone },
+		_exportTask{},
+		_reverbImpulseResponse{},
+		_initializeRequestedTime{},
+		_initializedTime{},
+		_createRequestedTime{},
+		_createdTime{},
+		_runningTime{},
+		_firstQuantumTime{},
+		_hasStartedAudio{ false },
 		_fftBinBounds{},
-		_fftSize{ -1 }
+		_fftSize{ -1 },
+		_constantQ{}
 	{ }
 
 	AudioGraph NowSoundGraph::GetAudioGraph() const { return _audioGraph; }
 
 	AudioDeviceOutputNode NowSoundGraph::GetAudioDeviceOutputNode() const { return _deviceOutputNode; }
 
+	NowSoundMixer* NowSoundGraph::GetMixer() const { return _mixer.get(); }
+
 	BufferAllocator<float>* NowSoundGraph::GetAudioAllocator() const { return _audioAllocator.get(); }
 
+	const PolyphaseInterpolator& NowSoundGraph::GetInterpolator() const { return _interpolator; }
+
+	int64_t NowSoundGraph::TrackHistoryMemoryCap() const { return _trackHistoryMemoryCapInBytes; }
+
 	void NowSoundGraph::PrepareToChangeState(NowSoundGraphState expectedState)
 	{
 		std::lock_guard<std::mutex> guard(_stateMutex);
 		Check(_audioGraphState == expectedState);
 		Check(!_changingState);
 		_changingState = true;
+
+		if (expectedState == NowSoundGraphState::GraphUninitialized)
+		{
+			_initializeRequestedTime = steady_clock::now();
+		}
+		else if (expectedState == NowSoundGraphState::GraphInitialized)
+		{
+			_createRequestedTime = steady_clock::now();
+		}
 	}
 
 	void NowSoundGraph::ChangeState(NowSoundGraphState newState)
+	{
+		{
+			std::lock_guard<std::mutex> guard(_stateMutex);
+			Check(_changingState);
+			Check(newState != _audioGraphState);
+			_changingState = false;
+			_audioGraphState = newState;
+
+			switch (newState)
+			{
+			case NowSoundGraphState::GraphInitialized: _initializedTime = steady_clock::now(); break;
+			case NowSoundGraphState::GraphCreated: _createdTime = steady_clock::now(); break;
+			case NowSoundGraphState::GraphRunning: _runningTime = steady_clock::now(); break;
+			default: break;
+			}
+
+			_stateChangedCondition.notify_all();
+		}
+
+		NOWSOUND_TRACE(GraphStateChanged, TrackIdUndefined, newState, 0);
+
+		// outside the lock, so the callback can call back into the graph
+		NowSoundGraphStateCallback callback = _stateChangedCallback;
+		if (callback != nullptr)
+		{
+			callback(newState);
+		}
+	}
+
+	void NowSoundGraph::ChangeExportState(NowSoundExportState newState)
 	{
 		std::lock_guard<std::mutex> guard(_stateMutex);
-		Check(_changingState);
-		Check(newState != _audioGraphState);
-		_changingState = false;
-		_audioGraphState = newState;
+		_exportState = newState;
+		// (waiters for graph states recheck theirs, and wait on)
+		_stateChangedCondition.notify_all();
 	}
 
 	NowSoundGraphState NowSoundGraph::State() const
@@ -184,6 +378,44 @@ namespace NowSound
 		return _audioGraphState;
 	}
 
+	bool NowSoundGraph::WaitForState(NowSoundGraphState state, int timeoutInMilliseconds)
+	{
+		Check(timeoutInMilliseconds >= 0);
+
+		std::unique_lock<std::mutex> lock(_stateMutex);
+		_stateChangedCondition.wait_for(lock, milliseconds(timeoutInMilliseconds), [&]()
+		{
+			return _audioGraphState == state || _audioGraphState == NowSoundGraphState::GraphInError;
+		});
+		return _audioGraphState == state;
+	}
+
+	void NowSoundGraph::SetStateChangedCallback(NowSoundGraphStateCallback callback)
+	{
+		_stateChangedCallback = callback;
+	}
+
+	float NowSoundGraph::MillisecondsSinceInitializeRequested(steady_clock::time_point time) const
+	{
+		if (time == steady_clock::time_point{})
+		{
+			return 0;
+		}
+		return duration<float, std::milli>(time - _initializeRequestedTime).count();
+	}
+
+	NowSoundStartupInfo NowSoundGraph::StartupInfo()
+	{
+		std::lock_guard<std::mutex> guard(_stateMutex);
+
+		return CreateNowSoundStartupInfo(
+			MillisecondsSinceInitializeRequested(_initializedTime),
+			MillisecondsSinceInitializeRequested(_createRequestedTime),
+			MillisecondsSinceInitializeRequested(_createdTime),
+			MillisecondsSinceInitializeRequested(_runningTime),
+			MillisecondsSinceInitializeRequested(_hasStartedAudio ? _firstQuantumTime : steady_clock::time_point{}));
+	}
+
 	void NowSoundGraph::InitializeAsync()
 	{
 		PrepareToChangeState(NowSoundGraphState::GraphUninitialized);
@@ -223,9 +455,11 @@ namespace NowSound
 			MagicNumbers::InitialBeatsPerMinute,
 			MagicNumbers::BeatsPerMeasure);
 
+		// The buffers' pages are faulted in on a background thread, so this returns (and audio can start) at once.
 		_audioAllocator = std::unique_ptr<BufferAllocator<float>>(new BufferAllocator<float>(
 			(int)(Clock::Instance().BytesPerSecond() * MagicNumbers::AudioBufferSizeInSeconds.Value()),
-			MagicNumbers::InitialAudioBufferCount));
+			MagicNumbers::InitialAudioBufferCount,
+			true));
 
 		// save the local across the co_await statement
 		std::vector<DeviceInformation>& inputDeviceInfoRef = _inputDeviceInfos;
@@ -251,7 +485,10 @@ namespace NowSound
 			_audioGraph.EncodingProperties().BitsPerSample(),
 			_audioGraph.LatencyInSamples(),
 			_audioGraph.SamplesPerQuantum(),
-			(int32_t)_inputDeviceInfos.size());
+			(int32_t)_inputDeviceInfos.size(),
+			_monitorLatencyHistogram.Percentile(50),
+			_monitorLatencyHistogram.Percentile(99),
+			_monitorLatencyHistogram.Max());
 
 		return graphInfo;
 	}
@@ -282,6 +519,7 @@ namespace NowSound
 	{
 		_fftBinBounds.resize(outputBinCount);
 		_fftSize = fftSize;
+		_constantQ.reset();
 
 		// Initialize the bounds of the bins into which we collate FFT data.
 		RosettaFFT::MakeBinBounds(
@@ -294,44 +532,61 @@ namespace NowSound
 			fftSize);
 	}
 
+	void NowSoundGraph::InitializeConstantQ(
+		int outputBinCount,
+		float centralFrequency,
+		int octaveDivisions,
+		int centralBinIndex,
+		int fftSize)
+	{
+		// the bin bounds still size everything which holds a histogram
+		InitializeFFT(outputBinCount, centralFrequency, octaveDivisions, centralBinIndex, fftSize);
+
+		_constantQ.reset(new ConstantQAnalyzer(
+			centralFrequency,
+			octaveDivisions,
+			outputBinCount,
+			centralBinIndex,
+			Clock::Instance().SampleRateHz(),
+			fftSize));
+	}
+
 	const std::vector<RosettaFFT::FrequencyBinBounds>* NowSoundGraph::GetBinBounds() const { return &_fftBinBounds; }
 
 	int NowSoundGraph::FftSize() const { return _fftSize; }
 
-	IAsyncAction NowSoundGraph::CreateInputDeviceAsync(int deviceIndex)
-	{
-		// Create a device input node
-		CreateAudioDeviceInputNodeResult deviceInputNodeResult = co_await _audioGraph.CreateDeviceInputNodeAsync(
-			Windows::Media::Capture::MediaCategory::Media,
-			_audioGraph.EncodingProperties(),
-			_inputDeviceInfos[deviceIndex]);
+	const ConstantQAnalyzer* NowSoundGraph::GetConstantQ() const { return _constantQ.get(); }
 
+	void NowSoundGraph::CreateInputDevice(CreateAudioDeviceInputNodeResult deviceInputNodeResult)
+	{
 		if (deviceInputNodeResult.Status() != AudioDeviceNodeCreationStatus::Success)
 		{
-			// Cannot create device output node
+			// Cannot create device input node
 			Check(false);
 			return;
 		}
 
-		AudioDeviceInputNode inputNode = deviceInputNodeResult.DeviceInputNode();
+		std::unique_ptr<NowSoundInputDevice> inputDevice(new NowSoundInputDevice(this, deviceInputNodeResult.DeviceInputNode()));
 
 		// create one AudioInput per input channel of the device
-		for (uint32_t i = 0; i < inputNode.EncodingProperties().ChannelCount(); i++)
+		for (int i = 0; i < inputDevice->ChannelCount(); i++)
 		{
-			CreateInputDeviceFromNode(inputNode, (int)i);
+			CreateInputDeviceFromNode(inputDevice.get(), i);
 		}
+
+		_inputDevices.emplace_back(std::move(inputDevice));
 	}
 
-	void NowSoundGraph::CreateInputDeviceFromNode(AudioDeviceInputNode inputNode, int channel)
+	void NowSoundGraph::CreateInputDeviceFromNode(NowSoundInputDevice* inputDevice, int channel)
 	{
 		AudioInputId nextAudioInputId(static_cast<AudioInputId>((int)(_audioInputs.size() + 1)));
 		std::unique_ptr<NowSoundInput> input(new NowSoundInput(
 			this,
 			nextAudioInputId,
-			inputNode,
 			_audioAllocator.get(),
 			channel));
 
+		inputDevice->AddInput(input.get());
 		_audioInputs.emplace_back(std::move(input));
 	}
 
@@ -357,14 +612,38 @@ namespace NowSound
 
         _deviceOutputNode = deviceOutputNodeResult.DeviceOutputNode();
 
+		// The monitor bus is fed directly from HandleIncomingAudio, so it needs no QuantumStarted handler of its own.
+		_monitorFrameInputNode = _audioGraph.CreateFrameInputNode();
+		_monitorFrameInputNode.AddOutgoingConnection(_deviceOutputNode);
+		// Like the mixer's, the monitor bus's frame (and buffer) are allocated once, here, and reused every quantum.
+		_monitorFrame = Windows::Media::AudioFrame(
+			(uint32_t)(MagicNumbers::AudioFrameDuration.Value() * sizeof(float) * Clock::Instance().ChannelCount()));
+		_monitorBuffer.reserve(MagicNumbers::AudioFrameDuration.Value() * Clock::Instance().ChannelCount());
+
+		// Leave one core for the rest of the graph (and the app), and don't hog more cores than the mix can use.
+		int mixerWorkerCount = (std::max)(1, (std::min)(
+			MagicNumbers::MaxMixerWorkerCount,
+			(int)std::thread::hardware_concurrency() - 1));
+		_mixer.reset(new NowSoundMixer(this, mixerWorkerCount));
+
 		_audioGraph.QuantumStarted([&](AudioGraph, IInspectable)
 		{
 			HandleIncomingAudio();
 		});
 
-		for (int i = 0; i < _inputDeviceIndicesToInitialize.size(); i++)
+		// Opening a device can take a good fraction of a second, so start opening them all at once; then add them
+		// in the order they were selected, so the inputs' IDs do not depend on which device happened to open first.
+		std::vector<IAsyncOperation<CreateAudioDeviceInputNodeResult>> deviceInputNodeOperations;
+		for (int deviceIndex : _inputDeviceIndicesToInitialize)
 		{
-			co_await CreateInputDeviceAsync(_inputDeviceIndicesToInitialize[i]);
+			deviceInputNodeOperations.push_back(_audioGraph.CreateDeviceInputNodeAsync(
+				Windows::Media::Capture::MediaCategory::Media,
+				_audioGraph.EncodingProperties(),
+				_inputDeviceInfos[deviceIndex]));
+		}
+		for (IAsyncOperation<CreateAudioDeviceInputNodeResult>& operation : deviceInputNodeOperations)
+		{
+			CreateInputDevice(co_await operation);
 		}
 
         ChangeState(NowSoundGraphState::GraphCreated);
@@ -377,15 +656,16 @@ namespace NowSound
 		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
 
 		Time<AudioSample> now = Clock::Instance().Now();
-		ContinuousDuration<Beat> durationBeats = Clock::Instance().TimeToBeats(now);
-		int64_t completeBeats = (int64_t)durationBeats.Value();
+		BeatPosition beatPosition = Clock::Instance().TimeToBeatPosition(now);
 
 		NowSoundTimeInfo timeInfo = CreateNowSoundTimeInfo(
 			(int32_t)_audioInputs.size(),
 			now.Value(),
-			durationBeats.Value(),
+			(float)beatPosition.Beats().Value(),
 			Clock::Instance().BeatsPerMinute(),
-			(float)(completeBeats % Clock::Instance().BeatsPerMeasure()));
+			(float)beatPosition.Modulo(Clock::Instance().BeatsPerMeasure()).CompleteBeats,
+			beatPosition.CompleteBeats,
+			(float)beatPosition.FractionalBeat);
 
 		return timeInfo;
 	}
@@ -394,12 +674,367 @@ namespace NowSound
 	{
 		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
 
+		return Input(audioInputId)->Info();
+	}
+
+	void NowSoundGraph::SetInputMonitoring(AudioInputId audioInputId, bool isMonitoring)
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		Input(audioInputId)->IsMonitoring(isMonitoring);
+	}
+
+	void NowSoundGraph::SetInputPan(AudioInputId audioInputId, float pan)
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		Input(audioInputId)->Pan(pan);
+	}
+
+	NowSoundMemoryInfo NowSoundGraph::MemoryInfo()
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphInitialized);
+
+		return CreateNowSoundMemoryInfo(
+			_audioAllocator->BufferSizeInBytes(),
+			_audioAllocator->TotalReservedSpace(),
+			_audioAllocator->TotalFreeListSpace(),
+			_audioAllocator->TotalInUseSpace(),
+			_audioAllocator->PeakInUseSpace(),
+			_audioAllocator->HeapAllocationCount(),
+			_audioAllocator->LockRequestedSpace(),
+			_audioAllocator->LockedSpace(),
+			_memoryBudgetInBytes,
+			_refusedRecordingCount);
+	}
+
+	void NowSoundGraph::SetMemoryBudget(int64_t budgetInBytes)
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphInitialized);
+		Check(budgetInBytes >= 0);
+
+		_memoryBudgetInBytes = budgetInBytes;
+	}
+
+	void NowSoundGraph::SetTrackHistoryMemoryCap(int64_t capInBytes)
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphInitialized);
+		Check(capInBytes >= 0);
+
+		_trackHistoryMemoryCapInBytes = capInBytes;
+	}
+
+	bool NowSoundGraph::HasMemoryForNewTrack()
+	{
+		return HasMemoryFor(_audioAllocator->BufferSizeInBytes());
+	}
+
+	bool NowSoundGraph::HasMemoryFor(int64_t bytes)
+	{
+		if (_memoryBudgetInBytes > 0
+			&& _audioAllocator->TotalInUseSpace() + bytes > _memoryBudgetInBytes)
+		{
+			_refusedRecordingCount++;
+			return false;
+		}
+		return true;
+	}
+
+	NowSoundTimingInfo NowSoundGraph::TimingInfo()
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		LatencyHistogram trackTimings(MagicNumbers::TimingHistogramResolution);
+		_mixer->MergeTrackTimings(trackTimings);
+		const LatencyHistogram& mixDurations = _mixer->MixDurationHistogram();
+
+		return CreateNowSoundTimingInfo(
+			_quantumIntervalHistogram.Count(),
+			_quantumIntervalHistogram.Percentile(50),
+			_quantumIntervalHistogram.Percentile(99),
+			_quantumIntervalHistogram.Percentile(99.9),
+			_quantumIntervalHistogram.Max(),
+			mixDurations.Percentile(50),
+			mixDurations.Percentile(99),
+			mixDurations.Percentile(99.9),
+			mixDurations.Max(),
+			trackTimings.Percentile(50),
+			trackTimings.Percentile(99),
+			trackTimings.Percentile(99.9),
+			trackTimings.Max());
+	}
+
+	void NowSoundGraph::ResetTimingInfo()
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		_quantumIntervalHistogram.Reset();
+		_mixer->ResetTimingInfo();
+	}
+
+	NowSoundMasterInfo NowSoundGraph::MasterInfo()
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		MasterBus& masterBus = _mixer->GetMasterBus();
+		return CreateNowSoundMasterInfo(
+			MasterBus::ToDb(masterBus.TruePeak().TakePeak()),
+			MasterBus::ToDb(masterBus.TruePeak().MaximumPeak()),
+			// the reduction is the inverse of the gain
+			MasterBus::ToDb(1 / masterBus.Limiter().TakeMinimumGain()),
+			masterBus.Loudness().MomentaryLufs(),
+			masterBus.Loudness().ShortTermLufs());
+	}
+
+	bool NowSoundGraph::ExportTrace(LPWSTR fileName)
+	{
+		std::ofstream output(fileName);
+		if (!output)
+		{
+			return false;
+		}
+		Trace::WriteChromeJson(output);
+		return (bool)output;
+	}
+
+	bool NowSoundGraph::LoadReverbImpulseResponse(LPWSTR fileName)
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		std::ifstream input(fileName, std::ios::binary);
+		WavData wav;
+		if (!input || !WavFile::Read(input, wav) || wav.FrameCount() == 0)
+		{
+			return false;
+		}
+
+		// Mix down to mono, with one sample of padding before and two after, for the interpolator.
+		int64_t frameCount = wav.FrameCount();
+		std::vector<float> mono((size_t)frameCount + PolyphaseInterpolator::TapCount - 1);
+		for (int64_t frame = 0; frame < frameCount; frame++)
+		{
+			float sum = 0;
+			for (int channel = 0; channel < wav.ChannelCount; channel++)
+			{
+				sum += wav.Samples[(size_t)(frame * wav.ChannelCount + channel)];
+			}
+			mono[(size_t)frame + 1] = sum / wav.ChannelCount;
+		}
+
+		// Resample to the graph's rate (exactly, if the rates already match, since phase 0 is the identity).
+		double step = (double)wav.SampleRateHz / Clock::Instance().SampleRateHz();
+		int64_t maximumLength = (int64_t)(MagicNumbers::MaximumReverbDuration.Value() * Clock::Instance().SampleRateHz());
+		int64_t length = (std::min)((int64_t)(frameCount / step), maximumLength);
+		std::vector<float> impulseResponse((size_t)length);
+		for (int64_t i = 0; i < length; i++)
+		{
+			double position = i * step;
+			int64_t index = (int64_t)position;
+			int phase = (int)((position - index) * PolyphaseInterpolator::PhaseCount);
+			impulseResponse[(size_t)i] = _interpolator.Interpolate(&mono[(size_t)index], phase);
+		}
+
+		_mixer->SetReverb(std::unique_ptr<PartitionedConvolver>(new PartitionedConvolver(
+			(int)MagicNumbers::ReverbBlockDuration.Value(),
+			impulseResponse.data(),
+			(int)length,
+			true)));
+		// kept, so that exports can render the same reverb
+		_reverbImpulseResponse = std::move(impulseResponse);
+		return true;
+	}
+
+	void NowSoundGraph::RemoveReverb()
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphCreated);
+
+		_mixer->SetReverb(nullptr);
+		_reverbImpulseResponse.clear();
+	}
+
+	int32_t NowSoundGraph::FreezeTracks()
+	{
+		Check(_audioGraphState == NowSoundGraphState::GraphRunning);
+
+		return _mixer->FreezeTracks(_freezeMemoryCapInBytes);
+	}
+
+	void NowSoundGraph::SetFreezeMemoryCap(int64_t capInBytes)
+	{
+		Check(_audioGraphState >= NowSoundGraphState::GraphInitialized);
+		Check(capInBytes >= 0);
+
+		_freezeMemoryCapInBytes = capInBytes;
+	}
+
+	namespace
+	{
+		// Everything an export captures from the graph, owned by its rendering.
+		struct MixdownCapture
+		{
+			std::vector<std::unique_ptr<BufferedSliceStream<AudioSample, float>>> Snapshots;
+			std::vector<OfflineMixdown::Source> Sources;
+			std::vector<std::shared_ptr<const SparseSliceStream<AudioSample, float>>> Automation;
+			std::vector<std::unique_ptr<PlaybackMapper<AudioSample>>> Mappers;
+			std::vector<TrackId> TrackIds;
+
+			// A reverb of the export's own, built from the send bus's impulse response; null if none.
+			std::unique_ptr<PartitionedConvolver> Reverb;
+		};
+
+		// Render the next frameCount frames of the captured tracks into the given file, and (if exportStems) each
+		// track into a file of its own; return false, leaving no partly written files, if any could not be.
+		bool WriteMixdown(const std::wstring& fileName, int64_t frameCount, bool exportStems, MixdownCapture& capture)
+		{
+			std::vector<OfflineMixdown::Source>& sources = capture.Sources;
+
+			// The mix's file, then each stem's: "session.wav" gets "session-track1.wav", and so on.
+			std::vector<std::wstring> fileNames{ fileName };
+			if (exportStems)
+			{
+				std::wstring base(fileName);
+				std::wstring extension;
+				size_t dot = base.rfind(L'.');
+				if (dot != std::wstring::npos && base.find_first_of(L"\\/", dot) == std::wstring::npos)
+				{
+					extension = base.substr(dot);
+					base.resize(dot);
+				}
+				for (TrackId trackId : capture.TrackIds)
+				{
+					fileNames.push_back(base + L"-track" + std::to_wstring((int)trackId) + extension);
+				}
+			}
+
+			// Every file is written under a temporary name, and renamed to its own only once all of them have been
+			// written; so a failure partway (a stem which cannot be opened, a full disk) leaves no partial files, and
+			// overwrites none of a previous export's.
+			auto partialName = [](const std::wstring& name) { return name + L".partial"; };
+			std::vector<std::unique_ptr<std::ofstream>> outputs;
+			auto discardOutputs = [&]()
+			{
+				for (size_t i = 0; i < outputs.size(); i++)
+				{
+					outputs[i]->close();
+					std::error_code error;
+					std::filesystem::remove(partialName(fileNames[i]), error);
+				}
+				return false;
+			};
+			for (const std::wstring& name : fileNames)
+			{
+				outputs.emplace_back(new std::ofstream(partialName(name), std::ios::binary));
+				if (!*outputs.back())
+				{
+					return discardOutputs();
+				}
+			}
+
+			int sampleRateHz = Clock::Instance().SampleRateHz();
+			WavWriter mix(*outputs[0], 2, sampleRateHz);
+			std::vector<std::unique_ptr<WavWriter>> stems;
+			for (size_t i = 1; i < outputs.size(); i++)
+			{
+				stems.emplace_back(new WavWriter(*outputs[i], 2, sampleRateHz));
+				sources[i - 1].Stem = stems.back().get();
+			}
+
+			// a master bus of the export's own, set up as the mixer's is, so the live output is undisturbed
+			MasterBus masterBus(
+				(float)sampleRateHz,
+				(int)MagicNumbers::LimiterLookaheadDuration.Value(),
+				MagicNumbers::LimiterCeilingDb,
+				(float)MagicNumbers::LimiterReleaseDuration.Value());
+			OfflineMixdown mixdown(std::move(sources), (int)(std::max)(1u, std::thread::hardware_concurrency()));
+			mixdown.Render(frameCount, &masterBus, capture.Reverb.get(), mix);
+
+			bool isWritten = mix.Finish();
+			for (const std::unique_ptr<WavWriter>& stem : stems)
+			{
+				isWritten = stem->Finish() && isWritten;
+			}
+			for (const std::unique_ptr<std::ofstream>& output : outputs)
+			{
+				// closing flushes, which can fail too
+				output->close();
+				isWritten = !output->fail() && isWritten;
+			}
+			if (!isWritten)
+			{
+				return discardOutputs();
+			}
+
+			bool isRenamed = true;
+			for (const std::wstring& name : fileNames)
+			{
+				std::error_code error;
+				std::filesystem::rename(partialName(name), name, error);
+				if (error)
+				{
+					// (any renamed already stay; they are complete)
+					std::filesystem::remove(partialName(name), error);
+					isRenamed = false;
+				}
+			}
+			return isRenamed;
+		}
+	}
+
+	void NowSoundGraph::ExportMixdownAsync(LPWSTR fileName, int64_t beatCount, bool exportStems)
+	{
+		Check(_audioGraphState == NowSoundGraphState::GraphRunning);
+		Check(_exportState != NowSoundExportState::ExportRendering);
+		Check(beatCount > 0);
+
+		// Capture now, on the calling thread, so the export starts where the tracks play next; only the rendering
+		// (which can take seconds) is left to the background.
+		std::shared_ptr<MixdownCapture> capture(new MixdownCapture());
+		capture->TrackIds = _mixer->CaptureMixdown(capture->Snapshots, capture->Sources, capture->Automation, capture->Mappers);
+		if (!_reverbImpulseResponse.empty())
+		{
+			// fresh, as the master bus is, and with the same block size (so the same latency) as the mixer's
+			capture->Reverb.reset(new PartitionedConvolver(
+				(int)MagicNumbers::ReverbBlockDuration.Value(),
+				_reverbImpulseResponse.data(),
+				(int)_reverbImpulseResponse.size(),
+				false));
+		}
+		int64_t frameCount = (int64_t)std::ceil(beatCount * Clock::Instance().ExactBeatDuration());
+		std::wstring name(fileName);
+
+		ChangeExportState(NowSoundExportState::ExportRendering);
+		_exportTask = create_task([this, name, frameCount, exportStems, capture]() -> void
+		{
+			bool isWritten = WriteMixdown(name, frameCount, exportStems, *capture);
+			ChangeExportState(isWritten ? NowSoundExportState::ExportSucceeded : NowSoundExportState::ExportFailed);
+		});
+	}
+
+	NowSoundExportState NowSoundGraph::ExportState() const
+	{
+		// as with State(), a machine word, atomically written; no need to lock
+		return _exportState;
+	}
+
+	bool NowSoundGraph::WaitForExport(int timeoutInMilliseconds)
+	{
+		Check(timeoutInMilliseconds >= 0);
+
+		std::unique_lock<std::mutex> lock(_stateMutex);
+		_stateChangedCondition.wait_for(lock, milliseconds(timeoutInMilliseconds), [&]()
+		{
+			return _exportState != NowSoundExportState::ExportRendering;
+		});
+		return _exportState != NowSoundExportState::ExportRendering;
+	}
+
+	NowSoundInput* NowSoundGraph::Input(AudioInputId audioInputId)
+	{
 		Check(audioInputId > AudioInputId::AudioInputUndefined);
 		// Input IDs are one-based
 		Check((audioInputId - 1) < _audioInputs.size());
 
-		std::unique_ptr<NowSoundInput>& input = _audioInputs[(int)audioInputId - 1];
-		return input->Info();
+		return _audioInputs[(int)audioInputId - 1].get();
 	}
 
     void NowSoundGraph::StartAudioGraphAsync()
@@ -423,6 +1058,11 @@ namespace NowSound
 		Check(audioInput >= 1);
 		Check(audioInput < _audioInputs.size() + 1);
 
+		if (!HasMemoryForNewTrack())
+		{
+			return TrackId::TrackIdUndefined;
+		}
+
         // by construction this will be greater than TrackId::Undefined
         TrackId id = (TrackId)((int)_trackId + 1);
         _trackId = id;
@@ -432,6 +1072,30 @@ namespace NowSound
 		return id;
     }
 
+	TrackId NowSoundGraph::CreateRetroactiveTrack(AudioInputId audioInput, int64_t beatDuration)
+	{
+		// TODO: verify not on audio graph thread
+		Check(_audioGraphState == NowSoundGraphState::GraphRunning);
+		Check(audioInput >= 1);
+		Check(audioInput < _audioInputs.size() + 1);
+		Check(beatDuration > 0);
+
+		if (!HasMemoryForNewTrack())
+		{
+			return TrackId::TrackIdUndefined;
+		}
+
+		TrackId id = (TrackId)((int)_trackId + 1);
+		if (!_audioInputs[(int)(audioInput - 1)]->CreateRetroactiveTrack(id, Duration<Beat>(beatDuration)))
+		{
+			// nothing created, so don't consume the id
+			return TrackId::TrackIdUndefined;
+		}
+
+		_trackId = id;
+		return id;
+	}
+
     IAsyncAction NowSoundGraph::PlayUserSelectedSoundFileAsyncImpl()
     {
         // This must be called on the UI thread.
@@ -478,11 +1142,100 @@ namespace NowSound
 
     void NowSoundGraph::HandleIncomingAudio()
     {
+		RealTimeThread::PrepareAudioCallback();
+		NOWSOUND_TRACE_THREAD_NAME("AudioGraph");
+		NOWSOUND_TRACE(GraphQuantumBegin, TrackIdUndefined, _audioGraph.SamplesPerQuantum(), 0);
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (_lastQuantumTime != std::chrono::steady_clock::time_point{})
+		{
+			_quantumIntervalHistogram.Record(
+				std::chrono::duration<float>(now - _lastQuantumTime).count() * Clock::Instance().SampleRateHz());
+		}
+		_lastQuantumTime = now;
+
+		if (!_hasStartedAudio.load(std::memory_order_relaxed))
+		{
+			_firstQuantumTime = now;
+			_hasStartedAudio.store(true, std::memory_order_release);
+		}
+
 		Clock::Instance().AdvanceFromAudioGraph(_audioGraph.SamplesPerQuantum());
 
-		for (std::unique_ptr<NowSoundInput>& input : _audioInputs)
+		for (std::unique_ptr<NowSoundInputDevice>& inputDevice : _inputDevices)
 		{
-			input->HandleIncomingAudio();
+			inputDevice->HandleIncomingAudio();
 		}
+
+		EmitMonitorAudio();
+
+		NOWSOUND_TRACE(GraphQuantumEnd, TrackIdUndefined, _audioGraph.SamplesPerQuantum(), 0);
     }
+
+	void NowSoundGraph::MixIntoMonitorBus(Duration<AudioSample> duration, const float* monoData, float pan)
+	{
+		int channelCount = Clock::Instance().ChannelCount();
+		// only stereo supported
+		Check(channelCount == 2);
+
+		// If this input delivered more audio than any other so far this quantum, extend the bus with silence.
+		if (duration > _monitorDuration)
+		{
+			_monitorBuffer.resize(duration.Value() * channelCount);
+			std::fill(
+				_monitorBuffer.begin() + _monitorDuration.Value() * channelCount,
+				_monitorBuffer.begin() + duration.Value() * channelCount,
+				0.0f);
+			_monitorDuration = duration;
+		}
+
+		AudioKernels::MixMonoToStereo(monoData, (int)duration.Value(), pan, _monitorBuffer.data());
+	}
+
+	void NowSoundGraph::EmitMonitorAudio()
+	{
+		if (_monitorDuration.Value() == 0)
+		{
+			// nothing monitored this quantum
+			return;
+		}
+
+		uint64_t samplesPerQuantum = (uint64_t)_audioGraph.SamplesPerQuantum();
+
+		// Anything still queued from earlier quanta is stale; drop it rather than letting the monitor latency grow.
+		if (_monitorFrameInputNode.QueuedSampleCount() > samplesPerQuantum)
+		{
+			_monitorFrameInputNode.DiscardQueuedFrames();
+		}
+
+		// The monitored input was captured during the previous quantum, and will play after whatever is still queued
+		// on the node when this frame joins it; that is the latency the monitor bus adds beyond the graph's own
+		// LatencyInSamples.
+		_monitorLatencyHistogram.Record((float)(_monitorFrameInputNode.QueuedSampleCount() + samplesPerQuantum));
+
+		// The frame holds MagicNumbers::AudioFrameDuration; any more than that is stale too, so emit the latest.
+		int channelCount = Clock::Instance().ChannelCount();
+		int64_t frameDuration = (std::min)(_monitorDuration.Value(), MagicNumbers::AudioFrameDuration.Value());
+		const float* frameData = _monitorBuffer.data() + (_monitorDuration.Value() - frameDuration) * channelCount;
+		uint32_t bytesInFrame = (uint32_t)(frameDuration * channelCount * sizeof(float));
+
+		{
+			// This nested scope sets the extent of the LockBuffer call below, which must close before the AddFrame call.
+			uint8_t* dataInBytes{};
+			uint32_t capacityInBytes{};
+
+			Windows::Media::AudioBuffer buffer(_monitorFrame.LockBuffer(Windows::Media::AudioBufferAccessMode::Write));
+			IMemoryBufferReference reference(buffer.CreateReference());
+			winrt::impl::com_ref<IMemoryBufferByteAccess> interop = reference.as<IMemoryBufferByteAccess>();
+			check_hresult(interop->GetBuffer(&dataInBytes, &capacityInBytes));
+
+			Check(capacityInBytes >= bytesInFrame);
+			buffer.Length(bytesInFrame);
+			std::copy(frameData, frameData + bytesInFrame / sizeof(float), (float*)dataInBytes);
+		}
+
+		_monitorFrameInputNode.AddFrame(_monitorFrame);
+		NOWSOUND_TRACE(MonitorEmitted, TrackIdUndefined, _monitorDuration.Value(), 0);
+		_monitorDuration = 0;
+	}
 }
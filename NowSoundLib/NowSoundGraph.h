@@ -5,6 +5,9 @@
 
 #include "pch.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <future>
 #include <vector>
 #include <string>
@@ -13,9 +16,14 @@
 
 #include "BufferAllocator.h"
 #include "Check.h"
+#include "ConstantQAnalyzer.h"
 #include "Histogram.h"
+#include "LatencyHistogram.h"
 #include "NowSoundInput.h"
+#include "NowSoundInputDevice.h"
 #include "NowSoundLibTypes.h"
+#include "NowSoundMixer.h"
+#include "PolyphaseInterpolator.h"
 #include "Recorder.h"
 #include "rosetta_fft.h"
 #include "SliceStream.h"
@@ -28,13 +36,22 @@ namespace NowSound
     public: // API methods called by the NowSoundGraphAPI P/Invoke bridge methods
 
         // Get the current state of the audio graph; intended to be efficiently pollable by the client.
-        // This is one of the only two methods that may be called in any state whatoever.
+        // This is one of the few methods that may be called in any state whatoever.
         // All other methods declare which state the graph must be in to call the method, and the state
         // the method transitions the graph to once the asynchronous action is complete.
         // TODO: consider having some separate mutual exclusion to prevent multiple concurrent methods
         // from firing (don't want the graph to, e.g., get started twice in a race).
         NowSoundGraphState State() const;
 
+        // Wait until the graph is in the given state (or in error), or until the timeout; may be called in any state.
+        bool WaitForState(NowSoundGraphState state, int timeoutInMilliseconds);
+
+        // Set the callback to call after every state change; may be called in any state.
+        void SetStateChangedCallback(NowSoundGraphStateCallback callback);
+
+        // The time taken by each stage of startup so far; may be called in any state.
+        NowSoundStartupInfo StartupInfo();
+
         // Initialize the audio graph subsystem such that device information can be queried.
         // Graph must be Uninitialized.  On completion, graph becomes Initialized.
         void InitializeAsync();
@@ -60,6 +77,14 @@ namespace NowSound
 			int octaveDivisions,
 			int centralBinIndex,
 			int fftSize);
+
+		// Initialize the same bins as InitializeFFT, but analyze frequencies with a constant-Q analyzer.
+		void InitializeConstantQ(
+			int outputBinCount,
+			float centralFrequency,
+			int octaveDivisions,
+			int centralBinIndex,
+			int fftSize);
 			
 		// Create the audio graph.
 		// Graph must be Initialized.  On completion, graph becomes Created.
@@ -73,6 +98,72 @@ namespace NowSound
 		// Graph must be Created or Running.
 		NowSoundInputInfo InputInfo(AudioInputId inputId);
 
+		// Set whether the given input is monitored (routed straight to the output mix, panned).
+		// Graph must be Created or Running.
+		void SetInputMonitoring(AudioInputId inputId, bool isMonitoring);
+
+		// Set the pan of the given input.
+		// Graph must be Created or Running.
+		void SetInputPan(AudioInputId inputId, float pan);
+
+		// The audio buffer allocator's memory use.
+		// Graph must be Initialized or later.
+		NowSoundMemoryInfo MemoryInfo();
+
+		// Set the budget for audio buffers in use, in bytes; 0 for none.
+		// Graph must be Initialized or later.
+		void SetMemoryBudget(int64_t budgetInBytes);
+
+		// Set the cap on each track's undo history, in bytes; 0 for none.
+		// Graph must be Initialized or later.
+		void SetTrackHistoryMemoryCap(int64_t capInBytes);
+
+		// Percentiles of the graph's, mixer's and tracks' callback timing.
+		// Graph must be Created or Running.
+		NowSoundTimingInfo TimingInfo();
+
+		// Forget all the timing percentiles recorded so far, e.g. to measure just one part of a session.
+		// Graph must be Created or Running.
+		void ResetTimingInfo();
+
+		// The meters on the output bus.
+		// Graph must be at least Created.
+		NowSoundMasterInfo MasterInfo();
+
+		// Write the event trace to the given file as Chrome trace JSON; return false if it could not be written.
+		// Graph may be in any state.
+		bool ExportTrace(LPWSTR fileName);
+
+		// Load the given WAV file as the send bus's reverb impulse response; return false if it could not be read.
+		// Graph must be at least Created.
+		bool LoadReverbImpulseResponse(LPWSTR fileName);
+
+		// Remove the send bus's reverb.
+		// Graph must be at least Created.
+		void RemoveReverb();
+
+		// Freeze the looping tracks which can be into one group; return how many were frozen.
+		// Graph must be Running.
+		int32_t FreezeTracks();
+
+		// Set the cap on each frozen group's loop, in bytes; 0 for none.
+		// Graph must be Initialized or later.
+		void SetFreezeMemoryCap(int64_t capInBytes);
+
+		// Capture the looping tracks, then render their next beatCount beats offline in the background into the
+		// given WAV file, and (if exportStems) each track into a file of its own; ExportState reports when done.
+		// Graph must be Running, and no export rendering.
+		void ExportMixdownAsync(LPWSTR fileName, int64_t beatCount, bool exportStems);
+
+		// How far the latest export has got.
+		// Graph may be in any state.
+		NowSoundExportState ExportState() const;
+
+		// Wait until the latest export is no longer rendering, or until timeoutInMilliseconds has passed; return
+		// whether it is no longer rendering.
+		// Graph may be in any state.
+		bool WaitForExport(int timeoutInMilliseconds);
+
 		// Start the audio graph.
         // Graph must be Created.  On completion, graph becomes Running.
         void StartAudioGraphAsync();
@@ -86,9 +177,14 @@ namespace NowSound
         void DestroyAudioGraphAsync();
 
         // Create a new track and begin recording.
-        // Graph may be in any state other than InError. On completion, graph becomes Uninitialized.
+        // Graph must be Running. Returns TrackIdUndefined if the memory budget does not allow another track.
 		TrackId CreateRecordingTrackAsync(AudioInputId inputIndex);
 
+		// Create a new, already looping track from the last beatDuration beats of the input's history.
+		// Graph must be Running. Returns TrackIdUndefined if the input has not buffered enough history, or if
+		// the memory budget does not allow another track.
+		TrackId CreateRetroactiveTrack(AudioInputId inputIndex, int64_t beatDuration);
+
     private: // Constructor and internal implementations
 
         // construct a graph, but do not yet initialize it
@@ -103,14 +199,26 @@ namespace NowSound
         // Async helper method, to work around compiler bug with lambdas which await and capture this.
         winrt::Windows::Foundation::IAsyncAction PlayUserSelectedSoundFileAsyncImpl();
 
+        // Send the monitor bus audio mixed during this quantum (if any) to the output, and reset the bus.
+        void EmitMonitorAudio();
+
+        // Does the memory budget (if any) allow another track to start?  Counts the refusal if not.
+        bool HasMemoryForNewTrack();
+
         // Check that the expected state is the current state, and that no current state change is happening;
         // then mark that a state change is now happening.
         void PrepareToChangeState(NowSoundGraphState expectedState);
 
         // Check that a state change is happening, then switch the state to newState and mark the state change
-        // as no longer happening.
+        // as no longer happening; then wake any waiters and call the state changed callback.
         void ChangeState(NowSoundGraphState newState);
 
+        // Set the export state, and wake any waiters.
+        void ChangeExportState(NowSoundExportState newState);
+
+        // Milliseconds from _initializeRequestedTime to time, or 0 if time has not happened yet.
+        float MillisecondsSinceInitializeRequested(std::chrono::steady_clock::time_point time) const;
+
     private: // instance variables
 
         // The singleton (for now) graph.
@@ -128,12 +236,18 @@ namespace NowSound
         // The default output device. TODO: support multiple output devices.
         winrt::Windows::Media::Audio::AudioDeviceOutputNode _deviceOutputNode;
 
+		// The mixer which carries all tracks to the output device.
+		std::unique_ptr<NowSoundMixer> _mixer;
+
 		// The AudioGraph DeviceInformation structures for all input devices.
 		::std::vector<winrt::Windows::Devices::Enumeration::DeviceInformation> _inputDeviceInfos;
 
         // First, an allocator for 128-second 48Khz stereo float sample buffers.
         std::unique_ptr<BufferAllocator<float>> _audioAllocator;
 
+        // The interpolator tracks use to play loops with fractional-sample durations; immutable once constructed.
+        PolyphaseInterpolator _interpolator;
+
         // The next TrackId to be allocated.
         TrackId _trackId;
 
@@ -149,6 +263,47 @@ namespace NowSound
 		// The FFT size.
 		int _fftSize;
 
+		// The constant-Q analyzer, used instead of rescaling an FFT into _fftBinBounds; null unless
+		// InitializeConstantQ was called.
+		std::unique_ptr<ConstantQAnalyzer> _constantQ;
+
+		// The frame input node of the monitor bus, which carries live input straight to the output device,
+		// bypassing all recording and track streams.
+		winrt::Windows::Media::Audio::AudioFrameInputNode _monitorFrameInputNode;
+
+		// The frame the monitor bus's audio is emitted in, every quantum.
+		winrt::Windows::Media::AudioFrame _monitorFrame;
+
+		// The interleaved stereo audio mixed into the monitor bus during the current quantum.
+		std::vector<float> _monitorBuffer;
+
+		// The duration of the audio in _monitorBuffer; zero if no monitored input has delivered audio this quantum.
+		Duration<AudioSample> _monitorDuration;
+
+		// Percentiles of the latency which the monitor bus adds to the graph's own latency, in samples.
+		LatencyHistogram _monitorLatencyHistogram;
+
+		// When the previous audio graph quantum started; zero before the first.
+		std::chrono::steady_clock::time_point _lastQuantumTime;
+
+		// Percentiles of the time between audio graph quanta, in samples.
+		LatencyHistogram _quantumIntervalHistogram;
+
+		// The budget for audio buffers in use, in bytes; 0 if none.
+		int64_t _memoryBudgetInBytes;
+
+		// The cap on each track's undo history, in bytes; 0 if none.
+		int64_t _trackHistoryMemoryCapInBytes;
+
+		// The cap on each frozen group's loop, in bytes; 0 if none.
+		int64_t _freezeMemoryCapInBytes;
+
+		// How many track creations the budget has refused.
+		int _refusedRecordingCount;
+
+		// The input devices we have, each of which feeds one or more of _audioInputs; currently unchanging after graph creation.
+		std::vector<std::unique_ptr<NowSoundInputDevice>> _inputDevices;
+
 		// The audio inputs we have; currently unchanging after graph creation.
 		// TODO: vaguely consider supporting dynamically added/removed inputs.
 		std::vector<std::unique_ptr<NowSoundInput>> _audioInputs;
@@ -157,6 +312,34 @@ namespace NowSound
         // The combination of _audioGraphState and _changingState must be updated atomically, or hazards are possible.
         std::mutex _stateMutex;
 
+        // Notified (with _stateMutex held) whenever _audioGraphState changes.
+        std::condition_variable _stateChangedCondition;
+
+        // Called after every state change, if not nullptr.
+        std::atomic<NowSoundGraphStateCallback> _stateChangedCallback;
+
+        // How far the latest export has got; written with _stateMutex held, and _stateChangedCondition notified.
+        NowSoundExportState _exportState;
+
+        // The latest export's rendering.
+        concurrency::task<void> _exportTask;
+
+        // The send bus's reverb's impulse response, resampled, for exports to build reverbs of their own from;
+        // empty if none.
+        std::vector<float> _reverbImpulseResponse;
+
+        // When each startup stage was requested or completed; zero if not yet.  Locked by _stateMutex.
+        std::chrono::steady_clock::time_point _initializeRequestedTime;
+        std::chrono::steady_clock::time_point _initializedTime;
+        std::chrono::steady_clock::time_point _createRequestedTime;
+        std::chrono::steady_clock::time_point _createdTime;
+        std::chrono::steady_clock::time_point _runningTime;
+
+        // When the first audio graph quantum started; written once, by the audio graph thread, before it sets
+        // _hasStartedAudio.
+        std::chrono::steady_clock::time_point _firstQuantumTime;
+        std::atomic<bool> _hasStartedAudio;
+
     public: // Implementation methods used from elsewhere in the library
 
         // The static instance of the graph.  We may eventually have multiple.
@@ -175,23 +358,45 @@ namespace NowSound
         // The default audio output node.  TODO: support device selection.
         winrt::Windows::Media::Audio::AudioDeviceOutputNode GetAudioDeviceOutputNode() const;
 
+		// The mixer which tracks register with to be heard.
+		NowSoundMixer* GetMixer() const;
+
         // Audio allocator has static lifetime currently, but we give borrowed pointers rather than just statically
         // referencing it everywhere, because all this mutable static state continues to be concerning.
         BufferAllocator<float>* GetAudioAllocator() const;
 
-		// Create an input device (or a pair of them, if monoPair is true).
-		winrt::Windows::Foundation::IAsyncAction CreateInputDeviceAsync(int deviceIndex);
+        // The interpolator for reading loops at sub-sample phase; safe to share across tracks since it is immutable.
+        const PolyphaseInterpolator& GetInterpolator() const;
+
+        // Get the given input, checking that it exists.
+        NowSoundInput* Input(AudioInputId inputId);
+
+		// The cap on each track's undo history, in bytes; 0 if none.
+		int64_t TrackHistoryMemoryCap() const;
 
-		// Create an input device (or a pair of them, if monoPair is true).
-		void CreateInputDeviceFromNode(winrt::Windows::Media::Audio::AudioDeviceInputNode deviceInputNode, int channel);
+		// Does the memory budget (if any) allow for the given number of bytes more?  Counts a refused recording if not.
+		bool HasMemoryFor(int64_t bytes);
+
+		// Create an input device, with one input per channel, from its newly created device input node.
+		void CreateInputDevice(winrt::Windows::Media::Audio::CreateAudioDeviceInputNodeResult deviceInputNodeResult);
+
+		// Create an input for the given channel of the given input device.
+		void CreateInputDeviceFromNode(NowSoundInputDevice* inputDevice, int channel);
 
 		// A graph quantum has started; handle any available input audio.
         void HandleIncomingAudio();
 
+		// Mix the given mono input audio, panned, into the monitor bus for this quantum.
+		// Called by monitored inputs from HandleIncomingAudio, on the audio graph thread.
+		void MixIntoMonitorBus(Duration<AudioSample> duration, const float* monoData, float pan);
+
 		// Access the vector of frequency bins, when generating frequency histograms.
 		const std::vector<RosettaFFT::FrequencyBinBounds>* GetBinBounds() const;
 
 		// Access to the FFT size.
 		int FftSize() const;
+
+		// Access to the constant-Q analyzer, if frequencies are to be analyzed with it; else null.
+		const ConstantQAnalyzer* GetConstantQ() const;
     };
 }
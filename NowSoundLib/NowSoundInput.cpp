@@ -4,9 +4,9 @@
 #include "pch.h"
 
 #include <algorithm>
+#include <cmath>
 
 #include "Clock.h"
-#include "GetBuffer.h"
 #include "Histogram.h"
 #include "MagicNumbers.h"
 #include "NowSoundLib.h"
@@ -26,24 +26,39 @@ namespace NowSound
 	NowSoundInput::NowSoundInput(
 		NowSoundGraph* nowSoundGraph,
 		AudioInputId inputId,
-		AudioDeviceInputNode inputNode,
 		BufferAllocator<float>* audioAllocator,
 		int channel)
 		: _nowSoundGraph{ nowSoundGraph },
 		_audioInputId{ inputId },
-		_inputDevice{ inputNode },
 		_channel{ channel },
 		_pan{ 0.5 },
-		// TODO: make NowSoundInputs on the same device share FrameOutputNodes as well as DeviceInputNodes
-		_frameOutputNode{ nowSoundGraph->GetAudioGraph().CreateFrameOutputNode() },
+		_isMonitoring{ false },
 		_recorders{},
-		_incomingAudioStream{ 0, Clock::Instance().ChannelCount(), audioAllocator, Clock::Instance().SampleRateHz(), /*useExactLoopingMapper:*/false },
+		_incomingAudioStream{
+			0,
+			1, // mono, like the tracks recorded from it
+			audioAllocator,
+			Clock::Instance().TimeToSamples(MagicNumbers::RetroactiveRecordingDuration),
+			/*useExactLoopingMapper:*/false },
 		_incomingAudioStreamRecorder{ &_incomingAudioStream },
-		_volumeHistogram{ (int)Clock::Instance().TimeToSamples(MagicNumbers::RecentVolumeDuration).Value() }
+		_incomingAudioClockTime{ 0 },
+		// one volume value per quantum
+		_volumeHistogram{ (std::max)(
+			1,
+			(int)Clock::Instance().TimeToSamples(MagicNumbers::RecentVolumeDuration).Value()
+				/ nowSoundGraph->GetAudioGraph().SamplesPerQuantum()) }
 	{
-		_inputDevice.AddOutgoingConnection(_frameOutputNode);
 	}
 
+	void NowSoundInput::Pan(float pan)
+	{
+		Check(pan >= 0 && pan <= 1);
+		_pan = pan;
+	}
+
+	bool NowSoundInput::IsMonitoring() const { return _isMonitoring; }
+	void NowSoundInput::IsMonitoring(bool isMonitoring) { _isMonitoring = isMonitoring; }
+
 	NowSoundInputInfo NowSoundInput::Info()
 	{
 		float volume = _volumeHistogram.Average();
@@ -69,72 +84,90 @@ namespace NowSound
 		NowSoundTrack::AddTrack(id, std::move(newTrack));
 	}
 
-	void NowSoundInput::HandleIncomingAudio()
+	bool NowSoundInput::CreateRetroactiveTrack(TrackId id, Duration<Beat> beatDuration)
 	{
-		AudioFrame frame = _frameOutputNode.GetFrame();
+		Check(beatDuration > 0);
 
-		// The frame has this many channels.
-		// TODO: decouple input channels from overall graph channels.
-		int channelCount = Clock::Instance().ChannelCount();
+		const Clock& clock = Clock::Instance();
+		// the discrete duration is derived from the very duration the loop is shut with, as Shut requires
+		ContinuousDuration<AudioSample> exactDuration(beatDuration.Value() * clock.ExactBeatDuration());
+		Duration<AudioSample> discreteDuration((int64_t)std::ceil(exactDuration.Value()));
 
-		uint8_t* dataInBytes{};
-		uint32_t capacityInBytes{};
-
-		// OMG KENNY KERR WINS AGAIN:
-		// https://gist.github.com/kennykerr/f1d941c2d26227abbf762481bcbd84d3
-		Windows::Media::AudioBuffer buffer(frame.LockBuffer(Windows::Media::AudioBufferAccessMode::Read));
-		IMemoryBufferReference reference(buffer.CreateReference());
-		winrt::impl::com_ref<IMemoryBufferByteAccess> interop = reference.as<IMemoryBufferByteAccess>();
-		check_hresult(interop->GetBuffer(&dataInBytes, &capacityInBytes));
-
-		if (capacityInBytes == 0)
+		std::unique_ptr<BufferedSliceStream<AudioSample, float>> loopStream;
 		{
-			// we don't count zero-byte frames... and why do they ever happen???
-			return;
-		}
-
-		// Must be multiple of channels * sizeof(float)
-		uint32_t sampleSizeInBytes = Clock::Instance().ChannelCount() * sizeof(float);
-		// make sure capacity is an exact multiple of sample size
-		Check((capacityInBytes & (sampleSizeInBytes - 1)) == 0);
-
-		uint32_t bufferStart = 0;
-		if (Clock::Instance().Now().Value() == 0)
-		{
-			// if maxCapacityEncountered is greater than the audio graph buffer size, 
-			// then the audio graph decided to give us a big backload of buffer content
-			// as its first callback.  Not sure why it does this, but we don't want it,
-			// so take only the tail of the buffer.
-			uint32_t latencyInSamples = (uint32_t)_nowSoundGraph->GetAudioGraph().LatencyInSamples();
+			std::lock_guard<std::mutex> guard(_recorderMutex);
 
-			if (latencyInSamples == 0)
+			// End the loop on the latest beat boundary such that the whole loop has arrived.
+			Time<AudioSample> historyEnd = _incomingAudioClockTime;
+			int64_t endBeat = clock.TimeToBeatPosition(historyEnd).CompleteBeats;
+			Time<AudioSample> loopStart((int64_t)std::ceil((endBeat - beatDuration.Value()) * clock.ExactBeatDuration()));
+			while (loopStart + discreteDuration > historyEnd)
 			{
-				// sorry audiograph, don't really believe you when you say zero latency.
-				latencyInSamples = MagicNumbers::AudioFrameDuration.Value();
+				endBeat--;
+				loopStart = Time<AudioSample>((int64_t)std::ceil((endBeat - beatDuration.Value()) * clock.ExactBeatDuration()));
 			}
 
-			uint32_t latencyBufferSize = (uint32_t)latencyInSamples * sampleSizeInBytes;
-			if (capacityInBytes > latencyBufferSize)
+			// Map from clock time to the history stream's time.
+			Duration<AudioSample> historyLag =
+				historyEnd - (_incomingAudioStream.InitialTime() + _incomingAudioStream.DiscreteDuration());
+			Time<AudioSample> historyStart = loopStart - historyLag;
+			if (loopStart.Value() < 0 || historyStart < _incomingAudioStream.InitialTime())
 			{
-				bufferStart = capacityInBytes - latencyBufferSize;
-				capacityInBytes = latencyBufferSize;
+				return false;
 			}
+
+			// The loop keeps clock time, so it is in phase with the beats it was played against.
+			loopStream.reset(new BufferedSliceStream<AudioSample, float>(
+				loopStart,
+				1,
+				NowSoundGraph::Instance()->GetAudioAllocator(),
+				/*maxBufferedDuration:*/ 0,
+				/*useExactLoopingMapper:*/ true));
+			_incomingAudioStream.TransferTo(Interval<AudioSample>(historyStart, discreteDuration), loopStream.get());
 		}
 
-		Duration<AudioSample> duration(capacityInBytes / sampleSizeInBytes);
+		loopStream->Shut(exactDuration);
+
+		std::unique_ptr<NowSoundTrack> newTrack(new NowSoundTrack(
+			_nowSoundGraph,
+			id,
+			_audioInputId,
+			std::move(*loopStream),
+			beatDuration,
+			// the loop was cut from the input history in clock time, with no pre-roll
+			/*inputLatency:*/ 0,
+			_pan));
 
-		// update input volume histograms
-		float* dataInFloats = (float*)(dataInBytes + bufferStart);
+		// Move the new track over to the collection of tracks in NowSoundTrackAPI.
+		NowSoundTrack::AddTrack(id, std::move(newTrack));
+		return true;
+	}
 
-		// Make sure our buffer is big enough; note that we don't multiply by channelCount because this is a mono buffer.
-		_monoBuffer.resize(duration.Value());
+	void NowSoundInput::AddRecorder(IRecorder<AudioSample, float>* recorder)
+	{
+		std::lock_guard<std::mutex> guard(_recorderMutex);
+		_recorders.push_back(recorder);
+	}
 
-		// Copy the data from the appropriate channel of the input device into the mono buffer.
-		for (int i = 0 ; i < duration.Value(); i++)
+	void NowSoundInput::RemoveRecorder(IRecorder<AudioSample, float>* recorder)
+	{
+		// HandleIncomingAudio calls recorders only under the mutex, so none is still being called once we have it
+		std::lock_guard<std::mutex> guard(_recorderMutex);
+		auto found = std::find(_recorders.begin(), _recorders.end(), recorder);
+		if (found != _recorders.end())
 		{
-			float value = dataInFloats[i * channelCount + _channel];
-			_volumeHistogram.Add(std::abs(value));
-			_monoBuffer.data()[i] = value;
+			_recorders.erase(found);
+		}
+	}
+
+	void NowSoundInput::HandleIncomingAudio(Duration<AudioSample> duration, float* monoData, float averageVolume)
+	{
+		_volumeHistogram.Add(averageVolume);
+
+		// Monitored audio goes straight to the output, with no buffering beyond this quantum.
+		if (_isMonitoring)
+		{
+			_nowSoundGraph->MixIntoMonitorBus(duration, monoData, _pan);
 		}
 
 		// iterate through all active Recorders
@@ -144,10 +177,14 @@ namespace NowSound
 		{
 			std::lock_guard<std::mutex> guard(_recorderMutex);
 
+			// Keep this input's history for retroactive recording.
+			_incomingAudioStreamRecorder.Record(duration, monoData);
+			_incomingAudioClockTime = Clock::Instance().Now();
+
 			// Give the new audio to each Recorder, collecting the ones that are done.
 			for (IRecorder<AudioSample, float>* recorder : _recorders)
 			{
-				bool stillRecording = recorder->Record(duration, _monoBuffer.data());
+				bool stillRecording = recorder->Record(duration, monoData);
 
 				if (!stillRecording)
 				{
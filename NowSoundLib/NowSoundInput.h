@@ -30,17 +30,14 @@ namespace NowSound
 		// The audio input ID of this input.
 		const AudioInputId _audioInputId;
 
-		// The input device. Note that this device input node may be shared between multiple NowSoundInputs.
-		winrt::Windows::Media::Audio::AudioDeviceInputNode _inputDevice;
-
-		// The channel to select from the input device.
+		// The channel of the input device which this input receives.
 		int _channel;
 
 		// The panning value (0 = left, 1 = right).
 		float _pan;
 
-		// The frame output node which allows buffering input audio into memory.
-		winrt::Windows::Media::Audio::AudioFrameOutputNode _frameOutputNode;
+		// Is this input being monitored (mixed straight into the graph's monitor bus)?
+		bool _isMonitoring;
 
 		// Vector of active Recorders; these are non-owning pointers borrowed from the collection of Tracks
 		// held by NowSoundTrackAPI.
@@ -50,34 +47,35 @@ namespace NowSound
 		// existing recorder collection.
 		std::mutex _recorderMutex;
 
-		// Stream that buffers the last second of input audio, for latency compensation.
-		// (Not really clear why latency compensation should be needed for NowSoundApp which shouldn't really
-		// have any problematic latency... but this was needed for gesture latency compensation with Kinect,
-		// so let's at least experiment with it.)
+		// Stream that buffers the recent history of this input's mono audio, so the last few beats can be turned
+		// into a track after they have been played.  Appended (and transferred from) only under _recorderMutex.
 		BufferedSliceStream<AudioSample, float> _incomingAudioStream;
 
 		// Adapter to record incoming data into _incomingAudioStream.
 		StreamRecorder<AudioSample, float> _incomingAudioStreamRecorder;
 
-		// Histograms on the input volume of this input's channel.
-		Histogram _volumeHistogram;
+		// The Clock time corresponding to the end of _incomingAudioStream.
+		// The stream's own timeline starts when this input first receives audio, so it lags the Clock slightly.
+		Time<AudioSample> _incomingAudioClockTime;
 
-		// Temporary buffer, reused across calls to HandleInputAudio.
-		std::vector<float> _monoBuffer;
+		// Histogram of the average input volume of this input's channel over each recent quantum.
+		Histogram _volumeHistogram;
 
 	public:
 		// Construct a NowSoundInput.
 		NowSoundInput(
 			NowSoundGraph* audioGraph,
 			AudioInputId audioInputId,
-			winrt::Windows::Media::Audio::AudioDeviceInputNode inputNode,
 			BufferAllocator<float>* audioAllocator,
 			int channel);
 
 		// Set the stereo panning (0 = left, 1 = right, 0.5 = center).
-		// TODO: implement panning fully and expose to user!
 		void Pan(float pan);
 
+		// Is this input being monitored?
+		bool IsMonitoring() const;
+		void IsMonitoring(bool isMonitoring);
+
 		// Get information about this input.
 		NowSoundInputInfo Info();
 
@@ -86,8 +84,18 @@ namespace NowSound
 		// (It is of course concurrency-safe with respect to ongoing audio activity.)
 		void CreateRecordingTrack(TrackId id);
 
-		// Handle any audio incoming for this input.
-		// This method is invoked by audio quantum processing, as an audio activity.
-		void HandleIncomingAudio();
+		// Create a looping track from the most recent beatDuration beats of this input's history, ending at the
+		// latest beat boundary that has fully arrived.  The track takes over the history's buffers without copying.
+		// Returns false (creating nothing) if not enough history is buffered.
+		bool CreateRetroactiveTrack(TrackId id, Duration<Beat> beatDuration);
+
+		// Start and stop giving this input's audio to the given recorder, as well as to any recording tracks (an
+		// overdubbing track uses this).  Once RemoveRecorder returns, the recorder will not be called again.
+		void AddRecorder(IRecorder<AudioSample, float>* recorder);
+		void RemoveRecorder(IRecorder<AudioSample, float>* recorder);
+
+		// Handle this quantum's (already deinterleaved) mono audio for this input, with its average absolute value.
+		// This method is invoked by the NowSoundInputDevice during audio quantum processing, as an audio activity.
+		void HandleIncomingAudio(Duration<AudioSample> duration, float* monoData, float averageVolume);
 	};
 }
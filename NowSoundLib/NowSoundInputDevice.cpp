@@ -0,0 +1,126 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+
+#include "AudioKernels.h"
+#include "Clock.h"
+#include "GetBuffer.h"
+#include "MagicNumbers.h"
+#include "NowSoundGraph.h"
+#include "NowSoundInput.h"
+#include "NowSoundInputDevice.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace winrt;
+
+using namespace Windows::Foundation;
+using namespace Windows::Media;
+using namespace Windows::Media::Audio;
+using namespace Windows::Media::Render;
+
+namespace NowSound
+{
+	NowSoundInputDevice::NowSoundInputDevice(
+		NowSoundGraph* nowSoundGraph,
+		AudioDeviceInputNode inputDeviceNode)
+		: _nowSoundGraph{ nowSoundGraph },
+		_inputDeviceNode{ inputDeviceNode },
+		// Use the device's own encoding, so the frames carry all of its channels.
+		_frameOutputNode{ nowSoundGraph->GetAudioGraph().CreateFrameOutputNode(inputDeviceNode.EncodingProperties()) },
+		_channelCount{ (int)inputDeviceNode.EncodingProperties().ChannelCount() },
+		_inputs{},
+		_channelBuffers(_channelCount),
+		_channelPointers(_channelCount),
+		_channelAbsoluteSums(_channelCount)
+	{
+		_inputDeviceNode.AddOutgoingConnection(_frameOutputNode);
+	}
+
+	int NowSoundInputDevice::ChannelCount() const { return _channelCount; }
+
+	void NowSoundInputDevice::AddInput(NowSoundInput* input)
+	{
+		Check((int)_inputs.size() < _channelCount);
+		_inputs.push_back(input);
+	}
+
+	void NowSoundInputDevice::HandleIncomingAudio()
+	{
+		AudioFrame frame = _frameOutputNode.GetFrame();
+
+		uint8_t* dataInBytes{};
+		uint32_t capacityInBytes{};
+
+		// OMG KENNY KERR WINS AGAIN:
+		// https://gist.github.com/kennykerr/f1d941c2d26227abbf762481bcbd84d3
+		Windows::Media::AudioBuffer buffer(frame.LockBuffer(Windows::Media::AudioBufferAccessMode::Read));
+		IMemoryBufferReference reference(buffer.CreateReference());
+		winrt::impl::com_ref<IMemoryBufferByteAccess> interop = reference.as<IMemoryBufferByteAccess>();
+		check_hresult(interop->GetBuffer(&dataInBytes, &capacityInBytes));
+
+		if (capacityInBytes == 0)
+		{
+			// we don't count zero-byte frames... and why do they ever happen???
+			return;
+		}
+
+		// Must be multiple of channels * sizeof(float)
+		uint32_t sampleSizeInBytes = _channelCount * sizeof(float);
+		// make sure capacity is an exact multiple of sample size
+		Check((capacityInBytes % sampleSizeInBytes) == 0);
+
+		uint32_t bufferStart = 0;
+		if (Clock::Instance().Now().Value() == 0)
+		{
+			// if maxCapacityEncountered is greater than the audio graph buffer size, 
+			// then the audio graph decided to give us a big backload of buffer content
+			// as its first callback.  Not sure why it does this, but we don't want it,
+			// so take only the tail of the buffer.
+			uint32_t latencyInSamples = (uint32_t)_nowSoundGraph->GetAudioGraph().LatencyInSamples();
+
+			if (latencyInSamples == 0)
+			{
+				// sorry audiograph, don't really believe you when you say zero latency.
+				latencyInSamples = MagicNumbers::AudioFrameDuration.Value();
+			}
+
+			uint32_t latencyBufferSize = (uint32_t)latencyInSamples * sampleSizeInBytes;
+			if (capacityInBytes > latencyBufferSize)
+			{
+				bufferStart = capacityInBytes - latencyBufferSize;
+				capacityInBytes = latencyBufferSize;
+			}
+		}
+
+		Duration<AudioSample> duration(capacityInBytes / sampleSizeInBytes);
+		NOWSOUND_TRACE(InputDeviceAudio, TrackIdUndefined, duration.Value(), _channelCount);
+
+		// Make sure our buffers are big enough.
+		for (int channel = 0; channel < _channelCount; channel++)
+		{
+			_channelBuffers[channel].resize(duration.Value());
+			_channelPointers[channel] = _channelBuffers[channel].data();
+		}
+		std::fill(_channelAbsoluteSums.begin(), _channelAbsoluteSums.end(), 0.0f);
+
+		// One pass over the interleaved data, for all channels at once.
+		AudioKernels::Deinterleave(
+			(float*)(dataInBytes + bufferStart),
+			_channelCount,
+			(int)duration.Value(),
+			_channelPointers.data(),
+			_channelAbsoluteSums.data());
+
+		for (int channel = 0; channel < (int)_inputs.size(); channel++)
+		{
+			_inputs[channel]->HandleIncomingAudio(
+				duration,
+				_channelPointers[channel],
+				_channelAbsoluteSums[channel] / duration.Value());
+		}
+	}
+}
@@ -0,0 +1,66 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <vector>
+
+#include "stdint.h"
+
+#include "Check.h"
+#include "Time.h"
+
+namespace NowSound
+{
+	class NowSoundGraph;
+	class NowSoundInput;
+
+	// A single audio input device, shared by the NowSoundInputs for each of its channels.
+	// Each quantum, this fetches the device's interleaved audio exactly once, and deinterleaves all its channels
+	// (measuring their volumes along the way) in a single pass, before handing each channel to its NowSoundInput.
+	class NowSoundInputDevice
+	{
+	private:
+		// The NowSoundAudioGraph that created this device.
+		NowSoundGraph* _nowSoundGraph;
+
+		// The input device node.
+		winrt::Windows::Media::Audio::AudioDeviceInputNode _inputDeviceNode;
+
+		// The frame output node which allows buffering input audio into memory; this has the device's own channel count.
+		winrt::Windows::Media::Audio::AudioFrameOutputNode _frameOutputNode;
+
+		// The number of channels delivered by the device.
+		const int _channelCount;
+
+		// The inputs for each channel, in channel order; these are non-owning pointers borrowed from the graph.
+		std::vector<NowSoundInput*> _inputs;
+
+		// Per-channel mono buffers, reused across calls to HandleIncomingAudio.
+		std::vector<std::vector<float>> _channelBuffers;
+
+		// Pointers to the start of each of _channelBuffers, for passing to the deinterleaving kernel.
+		std::vector<float*> _channelPointers;
+
+		// Per-channel sums of absolute sample values, reused across calls to HandleIncomingAudio.
+		std::vector<float> _channelAbsoluteSums;
+
+	public:
+		// Construct a NowSoundInputDevice for the given device node.
+		NowSoundInputDevice(
+			NowSoundGraph* nowSoundGraph,
+			winrt::Windows::Media::Audio::AudioDeviceInputNode inputDeviceNode);
+
+		// The number of channels delivered by the device.
+		int ChannelCount() const;
+
+		// Add the input for the next channel; inputs must be added in channel order.
+		void AddInput(NowSoundInput* input);
+
+		// Handle any audio incoming from this device, passing each channel's audio to its input.
+		// This method is invoked by audio quantum processing, as an audio activity.
+		void HandleIncomingAudio();
+	};
+}
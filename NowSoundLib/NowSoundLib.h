@@ -41,9 +41,25 @@ namespace NowSound
 		__declspec(dllexport) NowSoundTimeInfo NowSoundGraph_GetStaticTimeInfo();
 
 		// Get the current state of the audio graph; intended to be efficiently pollable by the client.
-        // This is the only method that may be called in any state whatoever.
+        // This is one of the few methods that may be called in any state whatoever.
         __declspec(dllexport) NowSoundGraphState NowSoundGraph_State();
 
+        // Wait, blocking the calling thread, until the graph is in the given state, or until timeoutInMilliseconds
+        // has passed; returns whether the graph is in that state.  Gives up at once if the graph goes into error.
+        // This lets clients wait for each *Async method to complete without polling NowSoundGraph_State.
+        // May be called in any state, from any thread except the audio graph's.
+        __declspec(dllexport) bool NowSoundGraph_WaitForState(NowSoundGraphState state, int32_t timeoutInMilliseconds);
+
+        // Set the callback to call on every graph state change (nullptr for none).  It is called on whichever thread
+        // completed the change, after the change is complete, so it may call back into the library (even to start
+        // the next state change).
+        // May be called in any state.
+        __declspec(dllexport) void NowSoundGraph_SetStateChangedCallback(NowSoundGraphStateCallback callback);
+
+        // Get the time taken by each stage of startup so far.
+        // May be called in any state.
+        __declspec(dllexport) NowSoundStartupInfo NowSoundGraph_StartupInfo();
+
         // Initialize the audio graph subsystem such that device information can be queried.
         // Graph must be Uninitialized.  On completion, graph becomes Initialized.
         __declspec(dllexport) void NowSoundGraph_InitializeAsync();
@@ -78,6 +94,18 @@ namespace NowSound
 			// How many samples as input to and output from the FFT?
 			int fftSize);
 
+		// Initialize the FFT subsystem as InitializeFFT does, with the same bins, but analyze frequencies with a
+		// constant-Q transform instead of folding a linear FFT into the bins.  Each bin then has its own frequency
+		// response, as wide as the bin, so the low bins resolve separate pitches (down to where a bin's window would
+		// be longer than fftSize samples) rather than sharing a few FFT bins between them; and it costs less.
+		// The bins read amplitudes: a full-scale sinusoid at a bin's frequency reads 1.  fftSize must be a power of two.
+		__declspec(dllexport) void NowSoundGraph_InitializeConstantQ(
+			int outputBinCount,
+			float centralFrequency,
+			int octaveDivisions,
+			int centralBinIndex,
+			int fftSize);
+
 		// Create the audio graph.
         // Graph must be Initialized.  On completion, graph becomes Created.
         __declspec(dllexport) void NowSoundGraph_CreateAudioGraphAsync();
@@ -90,6 +118,98 @@ namespace NowSound
 		// Graph must be at least Created; time will not be running until the graph is Running.
 		__declspec(dllexport) NowSoundInputInfo NowSoundGraph_InputInfo(AudioInputId inputId);
 
+		// Set whether the specified input is monitored: routed, panned, straight to the output within the same quantum
+		// it arrives in (without passing through any recording stream).  NowSoundGraph_Info reports the added latency.
+		// Graph must be at least Created.
+		__declspec(dllexport) void NowSoundGraph_SetInputMonitoring(AudioInputId inputId, bool isMonitoring);
+
+		// Set the pan of the specified input (0 = left, 0.5 = center, 1 = right); this pans its monitored audio,
+		// and is the initial pan of tracks subsequently recorded from it.
+		// Graph must be at least Created.
+		__declspec(dllexport) void NowSoundGraph_SetInputPan(AudioInputId inputId, float pan);
+
+		// Get the audio buffer allocator's memory use (see NowSoundTrack_Info for each track's share).
+		// Graph must be at least Initialized.
+		__declspec(dllexport) NowSoundMemoryInfo NowSoundGraph_MemoryInfo();
+
+		// Set a budget for the bytes of audio buffers in use; 0 (the default) means no budget.  Once the bytes in use
+		// plus one more buffer would exceed the budget, creating a track is refused.  (Recordings already under way
+		// are never cut short, so the budget can still be exceeded by however long they run.)
+		// Graph must be at least Initialized.
+		__declspec(dllexport) void NowSoundGraph_SetMemoryBudget(int64_t budgetInBytes);
+
+		// Set the cap on the memory each track's undo history may hold, in bytes, counting the version playing; 0
+		// for no cap.  Whenever a track adds a version, its oldest versions are dropped until it is under the cap.
+		// Graph must be at least Initialized.
+		__declspec(dllexport) void NowSoundGraph_SetTrackHistoryMemoryCap(int64_t capInBytes);
+
+		// Get percentiles of the audio callback timing: the intervals between audio graph quanta and between each
+		// track's quanta (merged across all tracks), and the time taken to mix each quantum.  These cover the whole
+		// session (or everything since NowSoundGraph_ResetTimingInfo), so they catch the rare spikes behind dropouts.
+		// Graph must be at least Created.
+		__declspec(dllexport) NowSoundTimingInfo NowSoundGraph_TimingInfo();
+
+		// Forget all timing percentiles recorded so far, graph-wide and per track.
+		// Graph must be at least Created.
+		__declspec(dllexport) void NowSoundGraph_ResetTimingInfo();
+
+		// Get the meters on the output bus.  The output is brickwall-limited (with a couple of milliseconds of
+		// look-ahead) so that stacked loops never clip; the meters measure the limited output.
+		// Graph must be at least Created.
+		__declspec(dllexport) NowSoundMasterInfo NowSoundGraph_MasterInfo();
+
+		// Write the recent event trace of all audio threads (the last few thousand events of each) to the given file,
+		// as Chrome trace event JSON viewable in chrome://tracing or https://ui.perfetto.dev.  Returns false if the
+		// file could not be written.  The file must be writable by the app, e.g. in its local folder.
+		// Graph may be in any state.
+		__declspec(dllexport) bool NowSoundGraph_ExportTrace(LPWSTR fileName);
+
+		// Load the given WAV file as the impulse response of the reverb on the send bus (replacing any previous one),
+		// mixing it down to mono and resampling it to the graph's sample rate.  Tracks feed the send bus at their
+		// send levels (see NowSoundTrack_SetSendLevel); the reverb adds a few milliseconds' latency, and computes
+		// most of its work on a thread of its own.  Returns false if the file could not be read as a WAV file.
+		// Graph must be at least Created.
+		__declspec(dllexport) bool NowSoundGraph_LoadReverbImpulseResponse(LPWSTR fileName);
+
+		// Remove the send bus's reverb, if any; tracks' send levels then have no effect.
+		// Graph must be at least Created.
+		__declspec(dllexport) void NowSoundGraph_RemoveReverb();
+
+		// Freeze looping tracks into one group: mix them down, in the background, into one stereo loop which is then
+		// mixed in their place, saving the cost of mixing each of them.  Only unmuted tracks with no EQ or send level,
+		// and not overdubbing, can be frozen (so that their loops sound the same every time round); loops of
+		// different lengths are frozen over the least common multiple of their beat durations, as far as the freeze
+		// memory cap allows.  Muting, EQing, sending, overdubbing, undoing, redoing or deleting a frozen track
+		// unfreezes its group at once.  Returns how many tracks were frozen (0 if fewer than two could be).
+		// Graph must be Running.
+		__declspec(dllexport) int32_t NowSoundGraph_FreezeTracks();
+
+		// Set the cap on the memory each frozen group's loop may take, in bytes; 0 for no cap.
+		// Graph must be at least Initialized.
+		__declspec(dllexport) void NowSoundGraph_SetFreezeMemoryCap(int64_t capInBytes);
+
+		// Export the next beatCount beats of the session, faster than real time, to the given file as a 32-bit float
+		// stereo WAV file: every looping, unmuted track, with its playback effect, EQ, send, pan, volume and
+		// automation, through the send bus's reverb and the same limiter as the output, starting where each track
+		// plays next.  If exportStems, each track is also written to a file of its own, dry and without the limiter,
+		// named after the mix: exporting "session.wav" writes "session-track1.wav" and so on, by track ID.  The
+		// tracks are captured at once, then rendered in the background across all cores at background priority, so
+		// live audio carries on undisturbed; NowSoundGraph_ExportState becomes ExportRendering at once, and then
+		// ExportSucceeded or ExportFailed once all files are written or any could not be.  Each file is written
+		// under a temporary name and renamed into place only once all are complete, so failure leaves no partial
+		// files.
+		// Graph must be Running, with ExportState other than ExportRendering.
+		__declspec(dllexport) void NowSoundGraph_ExportMixdownAsync(LPWSTR fileName, int64_t beatCount, bool exportStems);
+
+		// Get how far the latest NowSoundGraph_ExportMixdownAsync has got; pollable, like NowSoundGraph_State.
+		// May be called in any state.
+		__declspec(dllexport) NowSoundExportState NowSoundGraph_ExportState();
+
+		// Wait, blocking the calling thread, until the latest export is no longer rendering, or until
+		// timeoutInMilliseconds has passed; returns whether it is no longer rendering.
+		// May be called in any state, from any thread except the audio graph's.
+		__declspec(dllexport) bool NowSoundGraph_WaitForExport(int32_t timeoutInMilliseconds);
+
 		// Start the audio graph.
         // Graph must be Created.  On completion, graph becomes Running.
         __declspec(dllexport) void NowSoundGraph_StartAudioGraphAsync();
@@ -103,8 +223,14 @@ namespace NowSound
         __declspec(dllexport) void NowSoundGraph_DestroyAudioGraphAsync();
 
         // Create a new track and begin recording.
+        // Returns TrackIdUndefined if this would exceed the memory budget (see NowSoundGraph_SetMemoryBudget).
         __declspec(dllexport) TrackId NowSoundGraph_CreateRecordingTrackAsync(AudioInputId audioInputId);
 
+        // Create a new looping track from the last beatDuration beats already played into the given input.
+        // Returns TrackIdUndefined if not enough of the input's history is buffered, or if this would exceed the
+        // memory budget.
+        __declspec(dllexport) TrackId NowSoundGraph_CreateRetroactiveTrack(AudioInputId audioInputId, int64_t beatDuration);
+
         // Interface used to invoke operations on a particular audio track.
         //
         // Note that this API is not thread-safe; methods are not re-entrant and must be called sequentially,
@@ -137,6 +263,74 @@ namespace NowSound
         __declspec(dllexport) bool NowSoundTrack_IsMuted(TrackId trackId);
         __declspec(dllexport) void NowSoundTrack_SetIsMuted(TrackId trackId, bool isMuted);
 
+        // Get and set how much of the track (after its inserts, before panning) is sent to the send bus, whose
+        // sum is convolved with the reverb impulse response; 0 (the default) sends nothing, 1 sends it at full level.
+        __declspec(dllexport) float NowSoundTrack_SendLevel(TrackId trackId);
+        __declspec(dllexport) void NowSoundTrack_SetSendLevel(TrackId trackId, float sendLevel);
+
+        // Get and set the track's pan (0 = left, 0.5 = center, 1 = right) and volume (a linear gain, applied after
+        // its inserts and send; 1 is unchanged).  Changes are ramped over the next quantum.
+        __declspec(dllexport) float NowSoundTrack_Pan(TrackId trackId);
+        __declspec(dllexport) void NowSoundTrack_SetPan(TrackId trackId, float pan);
+        __declspec(dllexport) float NowSoundTrack_Volume(TrackId trackId);
+        __declspec(dllexport) void NowSoundTrack_SetVolume(TrackId trackId, float volume);
+
+        // Record the track's pan and volume as they are set, from now until StopAutomationRecording (or for one
+        // pass round the loop, whichever is sooner), replacing any earlier automation; once stopped, the recorded
+        // changes play back every time round the loop, ramped quantum by quantum.  Clearing drops the automation,
+        // leaving the pan and volume where it left them.
+        // Contractually requires State == NowSoundTrack_State.Looping to start recording.
+        __declspec(dllexport) void NowSoundTrack_StartAutomationRecording(TrackId trackId);
+        __declspec(dllexport) void NowSoundTrack_StopAutomationRecording(TrackId trackId);
+        __declspec(dllexport) bool NowSoundTrack_IsRecordingAutomation(TrackId trackId);
+        __declspec(dllexport) void NowSoundTrack_ClearAutomation(TrackId trackId);
+
+        // Get and set how the track reads its loop: backwards, at half or double speed, or repeating the stutterBeats
+        // (ignored by the other effects) of it starting where the effect is set.  Each effect takes over from what
+        // is playing, and PlaybackNormal rejoins the loop where it would have been; none copies the loop, so
+        // switching is cheap enough to do in time with the music.
+        // Contractually requires State == NowSoundTrack_State.Looping, for any effect but PlaybackNormal.
+        __declspec(dllexport) NowSoundPlaybackEffect NowSoundTrack_PlaybackEffect(TrackId trackId);
+        __declspec(dllexport) void NowSoundTrack_SetPlaybackEffect(TrackId trackId, NowSoundPlaybackEffect effect, float stutterBeats);
+
+        // Set one band (0 to 3) of the track's EQ, the first effect in its insert chain.  Inserts are processed as
+        // part of mixing the track, not by audio graph nodes; changes are smoothed over the next quantum.
+        // A band which is off (or which peaks or shelves by 0 dB) is bypassed, and a track whose bands are all
+        // bypassed costs nothing extra to mix.  frequencyHz must be below half the sample rate; q must be positive.
+        __declspec(dllexport) void NowSoundTrack_SetEqBand(
+            TrackId trackId,
+            int32_t band,
+            NowSoundEqBandType type,
+            float frequencyHz,
+            float gainDb,
+            float q);
+
+        // Start overdubbing: summing the track's input into its loop as it plays, at the loop positions the input
+        // lines up with (compensating for latency just as recording does).  The track must be looping.  When the
+        // overdub stops, it becomes a new version in the track's undo history; since each version shares with the
+        // one before all the buffers it did not change, overdubbing costs memory only for the parts of the loop it
+        // changes.  If the memory budget could not hold a copy of the whole loop, the overdub does not start (and
+        // counts as a refused recording); check NowSoundTrack_IsOverdubbing.
+        __declspec(dllexport) void NowSoundTrack_StartOverdub(TrackId trackId);
+
+        // Stop overdubbing, if the track is overdubbing.
+        __declspec(dllexport) void NowSoundTrack_StopOverdub(TrackId trackId);
+
+        // Is the track overdubbing?
+        __declspec(dllexport) bool NowSoundTrack_IsOverdubbing(TrackId trackId);
+
+        // Undo the track's last overdub (stopping any overdub in progress), going back to the previous version of
+        // its loop; the mixer plays it from the next quantum.  Returns false if there is no earlier version (none
+        // was recorded, or it was dropped to keep under the history's memory cap).
+        __declspec(dllexport) bool NowSoundTrack_Undo(TrackId trackId);
+
+        // Redo the overdub last undone.  Returns false if there is none (an overdub since the undo drops the
+        // versions that could have been redone).
+        __declspec(dllexport) bool NowSoundTrack_Redo(TrackId trackId);
+
+        // Is the track frozen (see NowSoundGraph_FreezeTracks), with its group's frozen loop playing in its place?
+        __declspec(dllexport) bool NowSoundTrack_IsFrozen(TrackId trackId);
+
         // Delete this Track; after this, all methods become invalid to call (contract failure).
         void __declspec(dllexport) NowSoundTrack_Delete(TrackId trackId);
     };
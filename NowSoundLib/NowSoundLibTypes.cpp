@@ -13,7 +13,10 @@ namespace NowSound
 		int32_t bitsPerSample,
 		int32_t latencyInSamples,
 		int32_t samplesPerQuantum,
-		int32_t inputDeviceCount)
+		int32_t inputDeviceCount,
+		float medianMonitorLatencyInSamples,
+		float p99MonitorLatencyInSamples,
+		float maximumMonitorLatencyInSamples)
 	{
 		NowSoundGraphInfo info;
 		info.SampleRateHz = sampleRateHz;
@@ -22,6 +25,9 @@ namespace NowSound
 		info.LatencyInSamples = latencyInSamples;
 		info.SamplesPerQuantum = samplesPerQuantum;
 		info.InputDeviceCount = inputDeviceCount;
+		info.MedianMonitorLatencyInSamples = medianMonitorLatencyInSamples;
+		info.P99MonitorLatencyInSamples = p99MonitorLatencyInSamples;
+		info.MaximumMonitorLatencyInSamples = maximumMonitorLatencyInSamples;
 		return info;
 	}
 
@@ -30,7 +36,9 @@ namespace NowSound
 		int64_t timeInSamples,
 		float exactBeat,
 		float beatsPerMinute,
-		float beatInMeasure)
+		float beatInMeasure,
+		int64_t completeBeats,
+		float fractionalBeat)
 	{
 		NowSoundTimeInfo info;
 		info.AudioInputCount = audioInputCount;
@@ -38,6 +46,8 @@ namespace NowSound
 		info.ExactBeat = exactBeat;
 		info.BeatsPerMinute = beatsPerMinute;
 		info.BeatInMeasure = beatInMeasure;
+		info.CompleteBeats = completeBeats;
+		info.FractionalBeat = fractionalBeat;
 		return info;
 	}
 
@@ -51,6 +61,96 @@ namespace NowSound
 		return info;
 	}
 
+	NowSoundMemoryInfo CreateNowSoundMemoryInfo(
+		int64_t bufferSizeInBytes,
+		int64_t reservedBytes,
+		int64_t freeBytes,
+		int64_t inUseBytes,
+		int64_t peakInUseBytes,
+		int64_t heapAllocationCount,
+		int64_t lockRequestedBytes,
+		int64_t lockedBytes,
+		int64_t budgetInBytes,
+		int32_t refusedRecordingCount)
+	{
+		NowSoundMemoryInfo info;
+		info.BufferSizeInBytes = bufferSizeInBytes;
+		info.ReservedBytes = reservedBytes;
+		info.FreeBytes = freeBytes;
+		info.InUseBytes = inUseBytes;
+		info.PeakInUseBytes = peakInUseBytes;
+		info.HeapAllocationCount = heapAllocationCount;
+		info.LockRequestedBytes = lockRequestedBytes;
+		info.LockedBytes = lockedBytes;
+		info.BudgetInBytes = budgetInBytes;
+		info.RefusedRecordingCount = refusedRecordingCount;
+		return info;
+	}
+
+	NowSoundMasterInfo CreateNowSoundMasterInfo(
+		float truePeakDb,
+		float maximumTruePeakDb,
+		float limiterGainReductionDb,
+		float momentaryLoudnessLufs,
+		float shortTermLoudnessLufs)
+	{
+		NowSoundMasterInfo info;
+		info.TruePeakDb = truePeakDb;
+		info.MaximumTruePeakDb = maximumTruePeakDb;
+		info.LimiterGainReductionDb = limiterGainReductionDb;
+		info.MomentaryLoudnessLufs = momentaryLoudnessLufs;
+		info.ShortTermLoudnessLufs = shortTermLoudnessLufs;
+		return info;
+	}
+
+	NowSoundStartupInfo CreateNowSoundStartupInfo(
+		float initializedMilliseconds,
+		float createRequestedMilliseconds,
+		float createdMilliseconds,
+		float runningMilliseconds,
+		float firstAudioMilliseconds)
+	{
+		NowSoundStartupInfo info;
+		info.InitializedMilliseconds = initializedMilliseconds;
+		info.CreateRequestedMilliseconds = createRequestedMilliseconds;
+		info.CreatedMilliseconds = createdMilliseconds;
+		info.RunningMilliseconds = runningMilliseconds;
+		info.FirstAudioMilliseconds = firstAudioMilliseconds;
+		return info;
+	}
+
+	NowSoundTimingInfo CreateNowSoundTimingInfo(
+		int64_t quantumCount,
+		float medianQuantumInterval,
+		float p99QuantumInterval,
+		float p999QuantumInterval,
+		float maximumQuantumInterval,
+		float medianMixDuration,
+		float p99MixDuration,
+		float p999MixDuration,
+		float maximumMixDuration,
+		float medianTrackTimeSinceLastQuantum,
+		float p99TrackTimeSinceLastQuantum,
+		float p999TrackTimeSinceLastQuantum,
+		float maximumTrackTimeSinceLastQuantum)
+	{
+		NowSoundTimingInfo info;
+		info.QuantumCount = quantumCount;
+		info.MedianQuantumInterval = medianQuantumInterval;
+		info.P99QuantumInterval = p99QuantumInterval;
+		info.P999QuantumInterval = p999QuantumInterval;
+		info.MaximumQuantumInterval = maximumQuantumInterval;
+		info.MedianMixDuration = medianMixDuration;
+		info.P99MixDuration = p99MixDuration;
+		info.P999MixDuration = p999MixDuration;
+		info.MaximumMixDuration = maximumMixDuration;
+		info.MedianTrackTimeSinceLastQuantum = medianTrackTimeSinceLastQuantum;
+		info.P99TrackTimeSinceLastQuantum = p99TrackTimeSinceLastQuantum;
+		info.P999TrackTimeSinceLastQuantum = p999TrackTimeSinceLastQuantum;
+		info.MaximumTrackTimeSinceLastQuantum = maximumTrackTimeSinceLastQuantum;
+		return info;
+	}
+
     NowSoundTrackInfo CreateNowSoundTrackInfo(
         int64_t startTimeInSamples,
         float startTimeInBeats,
@@ -67,7 +167,13 @@ namespace NowSound
         float averageRequiredSamples,
         float minimumTimeSinceLastQuantum,
         float maximumTimeSinceLastQuantum,
-        float averageTimeSinceLastQuantum)
+        float averageTimeSinceLastQuantum,
+        float medianTimeSinceLastQuantum,
+        float p99TimeSinceLastQuantum,
+        float p999TimeSinceLastQuantum,
+        float p999RequiredSamples,
+        int64_t bufferBytes,
+        int32_t bufferCount)
     {
         NowSoundTrackInfo info;
         info.StartTimeInSamples = startTimeInSamples;
@@ -86,6 +192,12 @@ namespace NowSound
         info.MinimumTimeSinceLastQuantum = minimumTimeSinceLastQuantum;
         info.MaximumTimeSinceLastQuantum = maximumTimeSinceLastQuantum;
         info.AverageTimeSinceLastQuantum = averageTimeSinceLastQuantum;
+        info.MedianTimeSinceLastQuantum = medianTimeSinceLastQuantum;
+        info.P99TimeSinceLastQuantum = p99TimeSinceLastQuantum;
+        info.P999TimeSinceLastQuantum = p999TimeSinceLastQuantum;
+        info.P999RequiredSamples = p999RequiredSamples;
+        info.BufferBytes = bufferBytes;
+        info.BufferCount = bufferCount;
         return info;
     }
 }
@@ -35,6 +35,12 @@ namespace NowSound
 			int32_t SamplesPerQuantum;
 			// The number of input devices.
 			int32_t InputDeviceCount;
+			// The median latency, in samples, which input monitoring adds to LatencyInSamples; 0 if nothing has been monitored.
+			float MedianMonitorLatencyInSamples;
+			// The 99th percentile latency which input monitoring adds to LatencyInSamples.
+			float P99MonitorLatencyInSamples;
+			// The longest latency which input monitoring has added to LatencyInSamples.
+			float MaximumMonitorLatencyInSamples;
 		} NowSoundGraphInfo;
 
 		// Time information from a Created or Running graph.
@@ -45,11 +51,17 @@ namespace NowSound
 			// The number of samples elapsed since the audio graph started.
 			int64_t TimeInSamples;
 			// The exact current beat (including fractional part; truncate to get integral beat count).
+			// This is a float, so it loses precision after a few minutes; use CompleteBeats and FractionalBeat
+			// for anything that must stay accurate over a long session.
 			float ExactBeat;
 			// The current BPM of the graph.
 			float BeatsPerMinute;
 			// The current position in the measure. (e.g. 4/4 time = this ranges from 0 to 3)
 			float BeatInMeasure;
+			// The number of complete beats elapsed since the audio graph started.
+			int64_t CompleteBeats;
+			// The fraction of the current beat elapsed so far; ranges from 0 to 1.
+			float FractionalBeat;
 		} NowSoundTimeInfo;
 
 		// Information about a created input; currently only mono inputs are supported.
@@ -63,6 +75,96 @@ namespace NowSound
 			float Pan;
 		} NowSoundInputInfo;
 
+		// Percentiles of the graph's callback timing, over the whole session (or since timing was last reset).
+		// All times are in (fractional) samples.
+		typedef struct NowSoundTimingInfo
+		{
+			// The number of audio graph quanta timed.
+			int64_t QuantumCount;
+			// The median time between audio graph quanta.
+			float MedianQuantumInterval;
+			// The 99th percentile time between audio graph quanta.
+			float P99QuantumInterval;
+			// The 99.9th percentile time between audio graph quanta.
+			float P999QuantumInterval;
+			// The longest time between audio graph quanta.
+			float MaximumQuantumInterval;
+			// The median time taken to mix all tracks, per quantum.
+			float MedianMixDuration;
+			// The 99th percentile time taken to mix all tracks, per quantum.
+			float P99MixDuration;
+			// The 99.9th percentile time taken to mix all tracks, per quantum.
+			float P999MixDuration;
+			// The longest time taken to mix all tracks, per quantum.
+			float MaximumMixDuration;
+			// The median time since last quantum of any track (merged over all current tracks).
+			float MedianTrackTimeSinceLastQuantum;
+			// The 99th percentile time since last quantum of any track.
+			float P99TrackTimeSinceLastQuantum;
+			// The 99.9th percentile time since last quantum of any track.
+			float P999TrackTimeSinceLastQuantum;
+			// The longest time since last quantum of any track.
+			float MaximumTrackTimeSinceLastQuantum;
+		} NowSoundTimingInfo;
+
+		// The audio buffer allocator's memory use, which is almost all of the library's memory use.
+		typedef struct NowSoundMemoryInfo
+		{
+			// The size of each audio buffer, in bytes.
+			int64_t BufferSizeInBytes;
+			// The total bytes of audio buffers ever allocated (none are ever returned to the system).
+			int64_t ReservedBytes;
+			// The bytes of audio buffers on the free list, ready for reuse.
+			int64_t FreeBytes;
+			// The bytes of audio buffers in use by tracks and by inputs' recent history.
+			int64_t InUseBytes;
+			// The most bytes of audio buffers ever in use at once.
+			int64_t PeakInUseBytes;
+			// The number of buffer allocations that found the free list empty and had to allocate from the heap.
+			int64_t HeapAllocationCount;
+			// The bytes of audio buffers the allocator has tried to lock into physical memory so far.
+			int64_t LockRequestedBytes;
+			// Of LockRequestedBytes, the bytes the OS actually locked; any shortfall can be paged out.
+			int64_t LockedBytes;
+			// The memory budget, in bytes, or 0 if there is none.
+			int64_t BudgetInBytes;
+			// The number of recordings refused because they would have exceeded the budget.
+			int32_t RefusedRecordingCount;
+		} NowSoundMemoryInfo;
+
+		// How long graph startup took: the time at which each stage completed, in milliseconds since
+		// NowSoundGraph_InitializeAsync was called.  Each is 0 until the graph gets that far.
+		typedef struct NowSoundStartupInfo
+		{
+			// The graph became Initialized.
+			float InitializedMilliseconds;
+			// NowSoundGraph_CreateAudioGraphAsync was called (so the gap since InitializedMilliseconds is the client's
+			// own time, e.g. the user choosing input devices).
+			float CreateRequestedMilliseconds;
+			// The graph became Created, with all its input devices.
+			float CreatedMilliseconds;
+			// The graph became Running.
+			float RunningMilliseconds;
+			// The first audio graph quantum arrived.
+			float FirstAudioMilliseconds;
+		} NowSoundStartupInfo;
+
+		// The meters on the output, after the master limiter.  Levels are in dB relative to full scale, loudness in
+		// LUFS; either is negative infinity for silence.
+		typedef struct NowSoundMasterInfo
+		{
+			// The highest true (inter-sample) peak since the last NowSoundGraph_MasterInfo call, so that no peak is
+			// missed however seldom the meters are polled.
+			float TruePeakDb;
+			// The highest true peak since the graph was created.
+			float MaximumTruePeakDb;
+			// The most the limiter turned the gain down since the last NowSoundGraph_MasterInfo call, in dB (0 if not at all).
+			float LimiterGainReductionDb;
+			// EBU R128 momentary (last 400 msec) and short-term (last 3 sec) loudness, updated every 100 msec.
+			float MomentaryLoudnessLufs;
+			float ShortTermLoudnessLufs;
+		} NowSoundMasterInfo;
+
         // Information about a track's time in NowSound terms.
         typedef struct NowSoundTrackInfo
         {
@@ -98,6 +200,19 @@ namespace NowSound
             float MaximumTimeSinceLastQuantum;
             // The average time since last quantum over the last N seconds.
             float AverageTimeSinceLastQuantum;
+            // The median time since last quantum, over the whole life of the track (or since timing was reset).
+            float MedianTimeSinceLastQuantum;
+            // The 99th percentile time since last quantum, likewise.
+            float P99TimeSinceLastQuantum;
+            // The 99.9th percentile time since last quantum, likewise; spikes here are what cause dropouts.
+            float P999TimeSinceLastQuantum;
+            // The 99.9th percentile count of required samples, likewise.
+            float P999RequiredSamples;
+            // The number of bytes in the audio buffers holding this track's loop, and the layer kept to undo its last
+            // overdub (which shares all the buffers the overdub did not write).
+            int64_t BufferBytes;
+            // The number of audio buffers holding this track's loop and its undo layer, likewise.
+            int32_t BufferCount;
         } NowSoundTrackTimeInfo;
 
         // The states of a NowSound graph.
@@ -127,6 +242,25 @@ namespace NowSound
             // NOTYET: Stopped,
         };
 
+        // Called on every graph state change, with the new state.
+        typedef void(__stdcall *NowSoundGraphStateCallback)(NowSoundGraphState newState);
+
+        // How far the latest NowSoundGraph_ExportMixdownAsync has got.
+        enum NowSoundExportState
+        {
+            // No export has been started.
+            ExportNone,
+
+            // The export is rendering.
+            ExportRendering,
+
+            // Every file of the export has been written.
+            ExportSucceeded,
+
+            // Some file of the export could not be written (or would have been over 4GB); none were left behind.
+            ExportFailed,
+        };
+
         // The state of a particular IHolofunkAudioTrack.
         // Note that since this is extern "C", this is not an enum class, so these identifiers have to begin with Track
         // to disambiguate them from the GraphState identifiers.
@@ -146,6 +280,48 @@ namespace NowSound
             TrackLooping,
         };
 
+        // The shape of one band of a track's EQ.
+        enum NowSoundEqBandType
+        {
+            // The band is bypassed.
+            EqBandOff,
+
+            // Boosts or cuts around the band's frequency.
+            EqBandPeaking,
+
+            // Boosts or cuts everything below the band's frequency.
+            EqBandLowShelf,
+
+            // Boosts or cuts everything above the band's frequency.
+            EqBandHighShelf,
+
+            // Removes everything above the band's frequency; the band's gain is ignored.
+            EqBandLowPass,
+
+            // Removes everything below the band's frequency; the band's gain is ignored.
+            EqBandHighPass,
+        };
+
+        // How a looping track reads its loop.  Each effect takes over from what is playing when it is set; the loop's
+        // own position moves on meanwhile, so returning to PlaybackNormal rejoins the loop in time.
+        enum NowSoundPlaybackEffect
+        {
+            // The loop plays straight through.
+            PlaybackNormal,
+
+            // The loop plays backwards.
+            PlaybackReverse,
+
+            // The loop plays at half speed, an octave down.
+            PlaybackHalfSpeed,
+
+            // The loop plays at double speed, an octave up.
+            PlaybackDoubleSpeed,
+
+            // The window of the loop starting where the effect is set repeats (a beat-repeat).
+            PlaybackStutter,
+        };
+
         // The indices for audio inputs created by the app.
         // Prevents confusing an audio input with some other int value.
 		//
@@ -181,19 +357,65 @@ namespace NowSound
 			int32_t bitsPerSample,
 			int32_t latencyInSamples,
 			int32_t samplesPerQuantum,
-			int32_t inputDeviceCount);
+			int32_t inputDeviceCount,
+			float medianMonitorLatencyInSamples,
+			float p99MonitorLatencyInSamples,
+			float maximumMonitorLatencyInSamples);
 
 		NowSoundTimeInfo CreateNowSoundTimeInfo(
 			int32_t audioInputCount,
 			int64_t timeInSamples,
 			float exactBeat,
 			float beatsPerMinute,
-			float beatInMeasure);
+			float beatInMeasure,
+			int64_t completeBeats,
+			float fractionalBeat);
 
 		NowSoundInputInfo CreateNowSoundInputInfo(
 			float volume,
 			float pan);
 
+		NowSoundMemoryInfo CreateNowSoundMemoryInfo(
+			int64_t bufferSizeInBytes,
+			int64_t reservedBytes,
+			int64_t freeBytes,
+			int64_t inUseBytes,
+			int64_t peakInUseBytes,
+			int64_t heapAllocationCount,
+			int64_t lockRequestedBytes,
+			int64_t lockedBytes,
+			int64_t budgetInBytes,
+			int32_t refusedRecordingCount);
+
+		NowSoundMasterInfo CreateNowSoundMasterInfo(
+			float truePeakDb,
+			float maximumTruePeakDb,
+			float limiterGainReductionDb,
+			float momentaryLoudnessLufs,
+			float shortTermLoudnessLufs);
+
+		NowSoundStartupInfo CreateNowSoundStartupInfo(
+			float initializedMilliseconds,
+			float createRequestedMilliseconds,
+			float createdMilliseconds,
+			float runningMilliseconds,
+			float firstAudioMilliseconds);
+
+		NowSoundTimingInfo CreateNowSoundTimingInfo(
+			int64_t quantumCount,
+			float medianQuantumInterval,
+			float p99QuantumInterval,
+			float p999QuantumInterval,
+			float maximumQuantumInterval,
+			float medianMixDuration,
+			float p99MixDuration,
+			float p999MixDuration,
+			float maximumMixDuration,
+			float medianTrackTimeSinceLastQuantum,
+			float p99TrackTimeSinceLastQuantum,
+			float p999TrackTimeSinceLastQuantum,
+			float maximumTrackTimeSinceLastQuantum);
+
         NowSoundTrackInfo CreateNowSoundTrackInfo(
             int64_t startTimeInSamples,
             float startTimeInBeats,
@@ -210,6 +432,12 @@ namespace NowSound
 			float averageRequiredSamples,
             float minimumTimeSinceLastQuantum,
 			float maximumTimeSinceLastQuantum,
-			float averageTimeSinceLastQuantum);
+			float averageTimeSinceLastQuantum,
+			float medianTimeSinceLastQuantum,
+			float p99TimeSinceLastQuantum,
+			float p999TimeSinceLastQuantum,
+			float p999RequiredSamples,
+			int64_t bufferBytes,
+			int32_t bufferCount);
     }
 }
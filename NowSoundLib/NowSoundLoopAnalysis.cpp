@@ -0,0 +1,174 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "stdint.h"
+
+#include "Check.h"
+#include "MagicNumbers.h"
+#include "NowSoundLibTypes.h"
+#include "NowSoundLoopAnalysis.h"
+#include "RealTimeThread.h"
+#include "Trace.h"
+
+using namespace concurrency;
+using namespace RosettaFFT;
+using namespace std;
+
+namespace NowSound
+{
+	NowSoundLoopAnalysis::NowSoundLoopAnalysis(
+		const std::vector<FrequencyBinBounds>* bounds,
+		int fftSize,
+		const ConstantQAnalyzer* constantQ)
+		: _binBounds{ bounds },
+		_fftSize{ fftSize },
+		_constantQ{ constantQ },
+		_loopDuration{ 0 },
+		_frameCount{ 0 },
+		_spectrumFrames{},
+		_rmsEnvelope{},
+		_peakEnvelope{},
+		_isComplete{ false },
+		_analysisTask{},
+		_isStarted{ false }
+	{
+	}
+
+	NowSoundLoopAnalysis::~NowSoundLoopAnalysis()
+	{
+		if (_isStarted)
+		{
+			_analysisTask.wait();
+		}
+	}
+
+	void NowSoundLoopAnalysis::AnalyzeAsync(const BufferedSliceStream<AudioSample, float>* stream)
+	{
+		Check(!_isStarted);
+		Check(stream->IsShut());
+		Check(stream->SliverCount() == 1);
+
+		_isStarted = true;
+		_analysisTask = create_task([this, stream]() -> void { Analyze(stream); });
+	}
+
+	bool NowSoundLoopAnalysis::IsComplete() const { return _isComplete; }
+
+	void NowSoundLoopAnalysis::Analyze(const BufferedSliceStream<AudioSample, float>* stream)
+	{
+		// The loop's fade-outs and quietest FFT bins would otherwise grind through denormals on this pool thread.
+		RealTimeThread::FlushDenormalsScope flushDenormals(true);
+
+		_loopDuration = stream->DiscreteDuration().Value();
+		Check(_loopDuration > 0);
+		NOWSOUND_TRACE(LoopAnalysisBegin, TrackIdUndefined, _loopDuration, 0);
+
+		// Spectrum: one FFT per (non-overlapping) window, wrapping around the end of the loop if need be,
+		// just as the loop sounds when played.
+		if (_fftSize > 0 && _binBounds != nullptr)
+		{
+			int binCount = (int)_binBounds->size();
+			_frameCount = (int)((_loopDuration + _fftSize - 1) / _fftSize);
+			_spectrumFrames.resize((size_t)_frameCount * binCount);
+
+			std::vector<float> samples(_fftSize);
+			CArray fftArray(_constantQ == nullptr ? _fftSize : 0);
+			std::vector<std::complex<float>> constantQSpectrum(_constantQ == nullptr ? 0 : _constantQ->SpectrumSize());
+
+			// A Blackman-Harris window, scaled to a mean of one, so a sinusoid's bin reads as loud as it would
+			// unwindowed (as the live input's spectrum is) while leaking far less into its neighbours.
+			std::vector<double> window(_constantQ == nullptr ? _fftSize : 0);
+			if (_constantQ == nullptr)
+			{
+				CreateBlackmanHarrisWindow(_fftSize, window.data());
+				double windowSum = 0;
+				for (double value : window)
+				{
+					windowSum += value;
+				}
+				for (double& value : window)
+				{
+					value *= _fftSize / windowSum;
+				}
+			}
+			for (int frame = 0; frame < _frameCount; frame++)
+			{
+				stream->CopyWrapped(Duration<AudioSample>((int64_t)frame * _fftSize), _fftSize, samples.data());
+				float* frameData = _spectrumFrames.data() + (size_t)frame * binCount;
+
+				if (_constantQ != nullptr)
+				{
+					_constantQ->Analyze(samples.data(), constantQSpectrum.data(), frameData);
+					continue;
+				}
+
+				for (int i = 0; i < _fftSize; i++)
+				{
+					fftArray[i] = samples[i] * window[i];
+				}
+				optimized_fft(fftArray);
+				RescaleFFT(*_binBounds, fftArray, frameData, binCount);
+			}
+		}
+
+		// Envelope: RMS and peak of each block; the last block may be partial.
+		int blockSize = (int)MagicNumbers::LoopEnvelopeBlockDuration.Value();
+		int blockCount = (int)((_loopDuration + blockSize - 1) / blockSize);
+		_rmsEnvelope.resize(blockCount);
+		_peakEnvelope.resize(blockCount);
+
+		std::vector<float> block(blockSize);
+		for (int blockIndex = 0; blockIndex < blockCount; blockIndex++)
+		{
+			int64_t blockStart = (int64_t)blockIndex * blockSize;
+			int count = (int)(std::min)((int64_t)blockSize, _loopDuration - blockStart);
+			stream->CopyWrapped(Duration<AudioSample>(blockStart), count, block.data());
+
+			double sumOfSquares = 0;
+			float peak = 0;
+			for (int i = 0; i < count; i++)
+			{
+				sumOfSquares += (double)block[i] * block[i];
+				peak = (std::max)(peak, std::abs(block[i]));
+			}
+			_rmsEnvelope[blockIndex] = (float)std::sqrt(sumOfSquares / count);
+			_peakEnvelope[blockIndex] = peak;
+		}
+
+		NOWSOUND_TRACE(LoopAnalysisEnd, TrackIdUndefined, _loopDuration, 0);
+		_isComplete = true;
+	}
+
+	void NowSoundLoopAnalysis::GetFrequencies(int64_t loopPosition, float* outputBuffer, int capacity) const
+	{
+		Check(_isComplete);
+		Check(capacity == (int)_binBounds->size());
+
+		if (_frameCount == 0)
+		{
+			return;
+		}
+
+		int frame = (int)((loopPosition % _loopDuration) / _fftSize);
+		const float* frameData = _spectrumFrames.data() + (size_t)frame * capacity;
+		std::copy(frameData, frameData + capacity, outputBuffer);
+	}
+
+	float NowSoundLoopAnalysis::RmsVolume(int64_t loopPosition) const
+	{
+		Check(_isComplete);
+		return _rmsEnvelope[(size_t)((loopPosition % _loopDuration) / MagicNumbers::LoopEnvelopeBlockDuration.Value())];
+	}
+
+	float NowSoundLoopAnalysis::PeakVolume(int64_t loopPosition) const
+	{
+		Check(_isComplete);
+		return _peakEnvelope[(size_t)((loopPosition % _loopDuration) / MagicNumbers::LoopEnvelopeBlockDuration.Value())];
+	}
+}
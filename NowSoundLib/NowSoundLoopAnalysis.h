@@ -0,0 +1,84 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include <atomic>
+#include <vector>
+
+#include "pch.h"
+
+#include "ConstantQAnalyzer.h"
+#include "rosetta_fft.h"
+#include "SliceStream.h"
+#include "Time.h"
+
+namespace NowSound
+{
+	// The spectrum and volume envelope of a loop, computed once when the loop is shut.
+	// A looping track plays the same audio over and over, so rather than re-analyzing the audio as it plays,
+	// the track analyzes its loop once (as a background task) and afterwards just looks up the values at
+	// the current loop position.
+	class NowSoundLoopAnalysis
+	{
+	private:
+		// The bin bounds (may be null if no spectrum is wanted).
+		const std::vector<RosettaFFT::FrequencyBinBounds>* _binBounds;
+
+		// The FFT size (negative if no spectrum is wanted).
+		const int _fftSize;
+
+		// The constant-Q analyzer to use instead of the FFT, if any.
+		const ConstantQAnalyzer* _constantQ;
+
+		// The (discrete) duration of the analyzed loop.
+		int64_t _loopDuration;
+
+		// The number of spectrum frames; each frame covers _fftSize samples of the loop.
+		int _frameCount;
+
+		// The spectrum frames, _binBounds->size() floats per frame, in loop order.
+		std::vector<float> _spectrumFrames;
+
+		// The RMS value of each envelope block, in loop order.
+		std::vector<float> _rmsEnvelope;
+
+		// The peak absolute value of each envelope block, in loop order.
+		std::vector<float> _peakEnvelope;
+
+		// Set once all the tables above are complete; they are never modified afterwards.
+		std::atomic<bool> _isComplete;
+
+		// The task doing the analysis, if started.
+		concurrency::task<void> _analysisTask;
+		bool _isStarted;
+
+		// Analyze the whole (shut) stream; runs inside _analysisTask.
+		void Analyze(const BufferedSliceStream<AudioSample, float>* stream);
+
+	public:
+		// If constantQ is not null, it analyzes the spectrum, and bounds only sizes it.
+		NowSoundLoopAnalysis(
+			const std::vector<RosettaFFT::FrequencyBinBounds>* bounds,
+			int fftSize,
+			const ConstantQAnalyzer* constantQ);
+
+		// Waits for any analysis in progress, since it reads from the stream being analyzed.
+		~NowSoundLoopAnalysis();
+
+		// Start analyzing the given stream, which must be shut and must outlive this object.
+		void AnalyzeAsync(const BufferedSliceStream<AudioSample, float>* stream);
+
+		// Has the analysis finished?  Until it has, no lookups may be made.
+		bool IsComplete() const;
+
+		// Copy the spectrum at the given sample position within the loop (taken modulo the loop duration).
+		void GetFrequencies(int64_t loopPosition, float* outputBuffer, int capacity) const;
+
+		// The RMS volume at the given sample position within the loop.
+		float RmsVolume(int64_t loopPosition) const;
+
+		// The peak volume at the given sample position within the loop.
+		float PeakVolume(int64_t loopPosition) const;
+	};
+}
@@ -0,0 +1,541 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <map>
+
+#include "AudioKernels.h"
+#include "Check.h"
+#include "Clock.h"
+#include "FrozenLoop.h"
+#include "GetBuffer.h"
+#include "MagicNumbers.h"
+#include "NowSoundGraph.h"
+#include "NowSoundMixer.h"
+#include "NowSoundTrack.h"
+#include "RealTimeThread.h"
+#include "Trace.h"
+
+using namespace std;
+using namespace winrt;
+
+using namespace Windows::Foundation;
+using namespace Windows::Media::Audio;
+
+namespace NowSound
+{
+	NowSoundMixer::NowSoundMixer(NowSoundGraph* graph, int workerCount)
+		: _frameInputNode{ graph->GetAudioGraph().CreateFrameInputNode() },
+		// The AudioFrame.Duration property is a TimeSpan, despite the fact that this seems an inherently
+		// inaccurate way to precisely express an audio sample count.  So we just have a short frame and
+		// we fill it completely and often.
+		_audioFrame{ (uint32_t)(MagicNumbers::AudioFrameDuration.Value() * sizeof(float) * Clock::Instance().ChannelCount()) },
+		_zeroByteOutgoingFrameCount{ 0 },
+		_masterBus{
+			(float)Clock::Instance().SampleRateHz(),
+			(int)MagicNumbers::LimiterLookaheadDuration.Value(),
+			MagicNumbers::LimiterCeilingDb,
+			(float)MagicNumbers::LimiterReleaseDuration.Value() },
+		_mixDurationHistogram{ MagicNumbers::TimingHistogramResolution },
+		_pool{ workerCount },
+		_buses(workerCount),
+		_busIsUsed(workerCount),
+		_usedBuses{},
+		_sendBuses(workerCount),
+		_usedSendBuses{},
+		_send{},
+		_reverbOutput{},
+		_reverb{},
+		_banks(workerCount),
+		_units{},
+		_tracks{},
+		_tracksMutex{},
+		_freezeGroups{},
+		_mixedSampleCount{ 0 },
+		_sampleCount{ 0 },
+		_output{ nullptr },
+		_isSending{ false }
+	{
+		_usedBuses.reserve(workerCount);
+		_usedSendBuses.reserve(workerCount);
+
+		_mixTask = [this](int worker, int unitIndex)
+		{
+			float* bus = _buses[worker].data();
+			float* sendBus = _isSending ? _sendBuses[worker].data() : nullptr;
+			int busLength = _sampleCount * Clock::Instance().ChannelCount();
+			if (!_busIsUsed[worker])
+			{
+				std::fill(bus, bus + busLength, 0.0f);
+				if (sendBus != nullptr)
+				{
+					std::fill(sendBus, sendBus + _sampleCount, 0.0f);
+				}
+				_busIsUsed[worker] = 1;
+			}
+			MixUnitInto(worker, _units[unitIndex], bus, sendBus, _sampleCount);
+		};
+
+		_reduceTask = [this](int, int chunk)
+		{
+			int length = _sampleCount * Clock::Instance().ChannelCount();
+			int chunkCount = _pool.WorkerCount();
+			int begin = (int)((int64_t)length * chunk / chunkCount);
+			int end = (int)((int64_t)length * (chunk + 1) / chunkCount);
+			AudioKernels::TreeSum(_usedBuses.data(), (int)_usedBuses.size(), begin, end - begin, _output);
+		};
+
+		_frameInputNode.QuantumStarted([&](AudioFrameInputNode sender, FrameInputNodeQuantumStartedEventArgs args)
+		{
+			FrameInputNode_QuantumStarted(sender, args);
+		});
+		_frameInputNode.AddOutgoingConnection(graph->GetAudioDeviceOutputNode());
+	}
+
+	void NowSoundMixer::AddTrack(NowSoundTrack* track)
+	{
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+		_tracks.push_back(track);
+		// at worst, one unit per track
+		_units.reserve(_tracks.size());
+	}
+
+	void NowSoundMixer::RemoveTrack(NowSoundTrack* track)
+	{
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+		_tracks.erase(std::find(_tracks.begin(), _tracks.end(), track));
+	}
+
+	void NowSoundMixer::SetReverb(std::unique_ptr<PartitionedConvolver> reverb)
+	{
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+		std::swap(_reverb, reverb);
+		// the previous reverb is destroyed (joining its tail thread) as reverb goes out of scope
+	}
+
+	int NowSoundMixer::FreezeTracks(int64_t memoryCapInBytes)
+	{
+		Check(memoryCapInBytes >= 0);
+
+		// The candidates, by beat duration; a loop whose duration is already in the group costs nothing more to
+		// freeze, so the durations shared by the most tracks go first.  Only this needs the lock: capturing every
+		// candidate's position under it, along with how much has been mixed, fixes them all as of the same
+		// quantum.  Choosing and building the group happens outside it; the tracks themselves change only on this
+		// (the UI) thread, so they are still candidates once the group is built.
+		std::map<int64_t, std::vector<NowSoundFreezeGroup::Member>> candidatesByBeats;
+		int64_t capturedSampleCount;
+		{
+			std::lock_guard<std::mutex> guard(_tracksMutex);
+			for (NowSoundTrack* track : _tracks)
+			{
+				if (track->CanFreeze() && FreezeGroupOf(track) == nullptr)
+				{
+					candidatesByBeats[track->BeatDuration().Value()].push_back(
+						NowSoundFreezeGroup::Member{ track, track->NextSampleTime() });
+				}
+			}
+			capturedSampleCount = _mixedSampleCount;
+		}
+
+		std::vector<std::vector<NowSoundFreezeGroup::Member>*> candidates;
+		for (auto& entry : candidatesByBeats)
+		{
+			candidates.push_back(&entry.second);
+		}
+		std::stable_sort(candidates.begin(), candidates.end(), [](
+			std::vector<NowSoundFreezeGroup::Member>* a,
+			std::vector<NowSoundFreezeGroup::Member>* b)
+		{
+			return a->size() > b->size();
+		});
+
+		// The group's loops all line up again only after the least common multiple of their durations.
+		int64_t groupBeats = 1;
+		std::vector<NowSoundFreezeGroup::Member> members;
+		for (std::vector<NowSoundFreezeGroup::Member>* sameBeats : candidates)
+		{
+			int64_t beats = FrozenLoop::LeastCommonMultiple(groupBeats, sameBeats->front().Track->BeatDuration().Value());
+			double samples = std::ceil(beats * Clock::Instance().ExactBeatDuration());
+			if (samples > INT_MAX
+				|| (memoryCapInBytes > 0 && FrozenLoop::RenderedBytes(ContinuousDuration<AudioSample>(samples)) > memoryCapInBytes))
+			{
+				continue;
+			}
+			groupBeats = beats;
+			members.insert(members.end(), sameBeats->begin(), sameBeats->end());
+		}
+
+		if (members.size() < 2)
+		{
+			return 0;
+		}
+
+		// Exactly as long as the tracks' loops, which are as long as their (generally fractional) beats; rounding
+		// would drift the frozen loop against them, a little more every time round.
+		int trackCount = (int)members.size();
+		ContinuousDuration<AudioSample> duration(groupBeats * Clock::Instance().ExactBeatDuration());
+		std::unique_ptr<NowSoundFreezeGroup> group(new NowSoundFreezeGroup(std::move(members), duration));
+
+		{
+			std::lock_guard<std::mutex> guard(_tracksMutex);
+			// the tracks have played on while the group was built, so the group starts that far along
+			group->Skip(Duration<AudioSample>(_mixedSampleCount - capturedSampleCount));
+			_freezeGroups.push_back(std::move(group));
+		}
+		return trackCount;
+	}
+
+	void NowSoundMixer::Unfreeze(NowSoundTrack* track)
+	{
+		std::unique_ptr<NowSoundFreezeGroup> group;
+		{
+			std::lock_guard<std::mutex> guard(_tracksMutex);
+			auto found = std::find_if(_freezeGroups.begin(), _freezeGroups.end(), [track](const std::unique_ptr<NowSoundFreezeGroup>& g)
+			{
+				return g->Contains(track);
+			});
+			if (found == _freezeGroups.end())
+			{
+				return;
+			}
+			group = std::move(*found);
+			_freezeGroups.erase(found);
+		}
+		// The group is destroyed (cancelling and waiting for its render, if still running) only now, outside the
+		// lock, so the mixing thread never waits for it.
+	}
+
+	bool NowSoundMixer::IsFrozen(NowSoundTrack* track)
+	{
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+		NowSoundFreezeGroup* group = FreezeGroupOf(track);
+		return group != nullptr && group->IsFrozen();
+	}
+
+	NowSoundFreezeGroup* NowSoundMixer::FreezeGroupOf(const NowSoundTrack* track) const
+	{
+		for (const std::unique_ptr<NowSoundFreezeGroup>& group : _freezeGroups)
+		{
+			if (group->Contains(track))
+			{
+				return group.get();
+			}
+		}
+		return nullptr;
+	}
+
+	std::vector<TrackId> NowSoundMixer::CaptureMixdown(
+		std::vector<std::unique_ptr<BufferedSliceStream<AudioSample, float>>>& snapshots,
+		std::vector<OfflineMixdown::Source>& sources,
+		std::vector<std::shared_ptr<const SparseSliceStream<AudioSample, float>>>& automation,
+		std::vector<std::unique_ptr<PlaybackMapper<AudioSample>>>& mappers)
+	{
+		// as in FreezeTracks, holding the lock captures every track's position as of the same quantum
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+
+		std::vector<TrackId> trackIds;
+		for (NowSoundTrack* track : _tracks)
+		{
+			if (track->State() != NowSoundTrackState::TrackLooping || track->IsMuted())
+			{
+				continue;
+			}
+			snapshots.push_back(track->SnapshotLoop());
+			OfflineMixdown::Source source{ snapshots.back().get(), track->NextSampleTime(), track->Pan(), {}, nullptr };
+			track->GetEqBands(source.EqBands);
+			source.Volume = track->Volume();
+			std::shared_ptr<const SparseSliceStream<AudioSample, float>> panAutomation, volumeAutomation;
+			track->GetAutomation(&panAutomation, &volumeAutomation);
+			source.PanAutomation = panAutomation.get();
+			source.VolumeAutomation = volumeAutomation.get();
+			automation.push_back(panAutomation);
+			automation.push_back(volumeAutomation);
+			mappers.push_back(track->SnapshotPlaybackMapper());
+			source.Mapper = mappers.back().get();
+			source.SendLevel = track->SendLevel();
+			sources.push_back(source);
+			trackIds.push_back(track->Id());
+		}
+		return trackIds;
+	}
+
+	MasterBus& NowSoundMixer::GetMasterBus() { return _masterBus; }
+
+	const LatencyHistogram& NowSoundMixer::MixDurationHistogram() const { return _mixDurationHistogram; }
+
+	std::vector<NowSoundTrack*> NowSoundMixer::CopyTracks()
+	{
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+		return _tracks;
+	}
+
+	void NowSoundMixer::MergeTrackTimings(LatencyHistogram& sinceLastQuantum)
+	{
+		// The histograms may be read while the audio thread records into them, so only the track list needs the
+		// lock; merging every track's buckets under it would stall the very mixing being measured.
+		for (NowSoundTrack* track : CopyTracks())
+		{
+			sinceLastQuantum.Merge(track->SinceLastQuantumPercentiles());
+		}
+	}
+
+	void NowSoundMixer::ResetTimingInfo()
+	{
+		_mixDurationHistogram.Reset();
+
+		// as in MergeTrackTimings, the histograms need no lock of their own
+		for (NowSoundTrack* track : CopyTracks())
+		{
+			track->ResetTimingInfo();
+		}
+	}
+
+	void NowSoundMixer::BuildMixUnits(int sampleCount)
+	{
+		_units.clear();
+
+		// Each frozen group is one unit, in place of all its tracks (of which it has at least two, so there are
+		// still no more units than tracks).
+		for (const std::unique_ptr<NowSoundFreezeGroup>& freezeGroup : _freezeGroups)
+		{
+			freezeGroup->BeginQuantum(sampleCount);
+			if (freezeGroup->IsPlaying())
+			{
+				_units.push_back(MixUnit{ {}, 0, false, freezeGroup.get() });
+			}
+		}
+
+		// the index of the unit still filling up with tracks with inserts, if any
+		int openGroup = -1;
+		for (NowSoundTrack* track : _tracks)
+		{
+			track->UpdateInserts();
+			NowSoundFreezeGroup* freezeGroup = FreezeGroupOf(track);
+			if (freezeGroup != nullptr && freezeGroup->IsPlaying())
+			{
+				continue;
+			}
+
+			if (!track->HasActiveInserts())
+			{
+				_units.push_back(MixUnit{ { track }, 1, false, nullptr });
+				continue;
+			}
+
+			if (openGroup == -1 || _units[openGroup].TrackCount == BiquadBank::LaneCount)
+			{
+				openGroup = (int)_units.size();
+				_units.push_back(MixUnit{ {}, 0, true, nullptr });
+			}
+			MixUnit& group = _units[openGroup];
+			group.Tracks[group.TrackCount++] = track;
+		}
+	}
+
+	void NowSoundMixer::MixUnitInto(int worker, const MixUnit& unit, float* stereoBus, float* sendBus, int sampleCount)
+	{
+		if (unit.FreezeGroup != nullptr)
+		{
+			// frozen tracks send nothing (or they could not have been frozen)
+			unit.FreezeGroup->MixInto(stereoBus, sampleCount);
+			return;
+		}
+
+		if (!unit.HasInserts)
+		{
+			unit.Tracks[0]->MixInto(stereoBus, sendBus, sampleCount);
+			return;
+		}
+
+		// Read all the tracks with something to mix, run their inserts together, then pan them all.
+		NowSoundTrack* tracks[BiquadBank::LaneCount];
+		BiquadCascade* eqs[BiquadBank::LaneCount];
+		float* monoData[BiquadBank::LaneCount];
+		int laneCount = 0;
+		for (int i = 0; i < unit.TrackCount; i++)
+		{
+			float* data = unit.Tracks[i]->ReadForMix(sampleCount);
+			if (data != nullptr)
+			{
+				tracks[laneCount] = unit.Tracks[i];
+				eqs[laneCount] = unit.Tracks[i]->Eq();
+				monoData[laneCount] = data;
+				laneCount++;
+			}
+		}
+		if (laneCount == 0)
+		{
+			return;
+		}
+
+		NOWSOUND_TRACE(InsertsBegin, TrackIdUndefined, sampleCount, laneCount);
+		_banks[worker].Process(eqs, monoData, laneCount, sampleCount);
+		NOWSOUND_TRACE(InsertsEnd, TrackIdUndefined, sampleCount, laneCount);
+
+		for (int lane = 0; lane < laneCount; lane++)
+		{
+			tracks[lane]->PanForMix(stereoBus, sendBus, sampleCount);
+		}
+	}
+
+	void NowSoundMixer::Mix(int sampleCount, float* output)
+	{
+		std::lock_guard<std::mutex> guard(_tracksMutex);
+		_mixedSampleCount += sampleCount;
+
+		int length = sampleCount * Clock::Instance().ChannelCount();
+		int trackCount = (int)_tracks.size();
+		NOWSOUND_TRACE(MixerQuantumBegin, TrackIdUndefined, sampleCount, trackCount);
+
+		BuildMixUnits(sampleCount);
+		int unitCount = (int)_units.size();
+
+		_isSending = _reverb != nullptr;
+		if (_isSending && (int)_send.size() < sampleCount)
+		{
+			// only ever grows, so this allocates only in the first quanta
+			_send.resize(sampleCount);
+			_reverbOutput.resize(sampleCount);
+		}
+
+		if (trackCount < MagicNumbers::MinimumParallelMixTrackCount || _pool.WorkerCount() == 1)
+		{
+			// Not worth forking; mix directly into the output.
+			std::fill(output, output + length, 0.0f);
+			float* sendBus = _isSending ? _send.data() : nullptr;
+			if (_isSending)
+			{
+				std::fill(sendBus, sendBus + sampleCount, 0.0f);
+			}
+			for (const MixUnit& unit : _units)
+			{
+				MixUnitInto(0, unit, output, sendBus, sampleCount);
+			}
+			if (_isSending)
+			{
+				MixReverb(sampleCount, output);
+			}
+			NOWSOUND_TRACE(MixerQuantumEnd, TrackIdUndefined, sampleCount, trackCount);
+			return;
+		}
+
+		// Fork: each worker mixes the units it takes (or steals) into its own bus.
+		for (int worker = 0; worker < _pool.WorkerCount(); worker++)
+		{
+			if ((int)_buses[worker].size() < length)
+			{
+				// only ever grows, so this allocates only in the first quanta
+				_buses[worker].resize(length);
+			}
+			if (_isSending && (int)_sendBuses[worker].size() < sampleCount)
+			{
+				_sendBuses[worker].resize(sampleCount);
+			}
+			_busIsUsed[worker] = 0;
+		}
+		_sampleCount = sampleCount;
+		_pool.Run(unitCount, _mixTask);
+
+		// Join: sum the used buses into the output, each worker summing one chunk of it.
+		_usedBuses.clear();
+		for (int worker = 0; worker < _pool.WorkerCount(); worker++)
+		{
+			if (_busIsUsed[worker])
+			{
+				_usedBuses.push_back(_buses[worker].data());
+			}
+		}
+		_output = output;
+		_pool.Run(_pool.WorkerCount(), _reduceTask);
+		_output = nullptr;
+
+		if (_isSending)
+		{
+			// the send bus is mono, so summing it is cheap enough not to fork for
+			_usedSendBuses.clear();
+			for (int worker = 0; worker < _pool.WorkerCount(); worker++)
+			{
+				if (_busIsUsed[worker])
+				{
+					_usedSendBuses.push_back(_sendBuses[worker].data());
+				}
+			}
+			if (_usedSendBuses.empty())
+			{
+				std::fill(_send.begin(), _send.begin() + sampleCount, 0.0f);
+			}
+			else
+			{
+				AudioKernels::TreeSum(_usedSendBuses.data(), (int)_usedSendBuses.size(), 0, sampleCount, _send.data());
+			}
+			MixReverb(sampleCount, output);
+		}
+
+		NOWSOUND_TRACE(MixerQuantumEnd, TrackIdUndefined, sampleCount, trackCount);
+	}
+
+	void NowSoundMixer::MixReverb(int sampleCount, float* output)
+	{
+		NOWSOUND_TRACE(ReverbBegin, TrackIdUndefined, sampleCount, _reverb->PartitionCount());
+		_reverb->Process(_send.data(), _reverbOutput.data(), sampleCount);
+		// the reverb is mono, so it goes to the center
+		AudioKernels::MixMonoToStereo(_reverbOutput.data(), sampleCount, 0.5f, output);
+		NOWSOUND_TRACE(ReverbEnd, TrackIdUndefined, sampleCount, _reverb->PartitionCount());
+	}
+
+	void NowSoundMixer::FrameInputNode_QuantumStarted(AudioFrameInputNode sender, FrameInputNodeQuantumStartedEventArgs args)
+	{
+		RealTimeThread::PrepareAudioCallback();
+		NOWSOUND_TRACE_THREAD_NAME("Mixer");
+
+		Check(sender == _frameInputNode);
+
+		Check(args.RequiredSamples() >= 0);
+		if (args.RequiredSamples() == 0)
+		{
+			NOWSOUND_TRACE(MixerZeroByteFrame, TrackIdUndefined, 0, 0);
+			_zeroByteOutgoingFrameCount++;
+			return;
+		}
+
+		{
+			// This nested scope sets the extent of the LockBuffer call below, which must close before the AddFrame call.
+			// Otherwise the AddFrame will throw E_ACCESSDENIED when it tries to take a read lock on the frame.
+			uint8_t* dataInBytes{};
+			uint32_t capacityInBytes{};
+
+			// OMG KENNY KERR WINS AGAIN:
+			// https://gist.github.com/kennykerr/f1d941c2d26227abbf762481bcbd84d3
+			Windows::Media::AudioBuffer buffer(_audioFrame.LockBuffer(Windows::Media::AudioBufferAccessMode::Write));
+			IMemoryBufferReference reference(buffer.CreateReference());
+			winrt::impl::com_ref<IMemoryBufferByteAccess> interop = reference.as<IMemoryBufferByteAccess>();
+			check_hresult(interop->GetBuffer(&dataInBytes, &capacityInBytes));
+
+			int channelCount = Clock::Instance().ChannelCount();
+			// only stereo supported
+			// TODO: support more channels, fuller spatialization
+			Check(channelCount == 2);
+
+			uint32_t sampleSizeInBytes = channelCount * sizeof(float);
+			Check((capacityInBytes % sampleSizeInBytes) == 0);
+
+			auto mixStart = std::chrono::steady_clock::now();
+			int sampleCount = (int)(capacityInBytes / sampleSizeInBytes);
+			Mix(sampleCount, (float*)dataInBytes);
+
+			NOWSOUND_TRACE(MasterBusBegin, TrackIdUndefined, sampleCount, 0);
+			_masterBus.Process((float*)dataInBytes, sampleCount);
+			NOWSOUND_TRACE(MasterBusEnd, TrackIdUndefined, sampleCount, 0);
+
+			_mixDurationHistogram.Record(
+				std::chrono::duration<float>(std::chrono::steady_clock::now() - mixStart).count() * Clock::Instance().SampleRateHz());
+		}
+
+		sender.AddFrame(_audioFrame);
+	}
+}
@@ -0,0 +1,202 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "BiquadBank.h"
+#include "ForkJoinPool.h"
+#include "LatencyHistogram.h"
+#include "MasterBus.h"
+#include "NowSoundFreezeGroup.h"
+#include "NowSoundLibTypes.h"
+#include "OfflineMixdown.h"
+#include "PartitionedConvolver.h"
+
+namespace NowSound
+{
+	class NowSoundGraph;
+	class NowSoundTrack;
+
+	// Mixes all tracks into the single frame input node that carries them to the output device.
+	//
+	// With enough tracks, each quantum's tracks are split across the workers of a ForkJoinPool, each worker mixing
+	// its tracks into its own stereo bus; the buses are then summed (pairwise, in a tree) into the output frame,
+	// again split across the workers.  With only a few tracks, the fork and join would cost more than it saves,
+	// so they are simply mixed on the audio graph's own thread.
+	//
+	// Tracks with active insert effects are mixed in groups of up to BiquadBank::LaneCount, so that the group's
+	// inserts can be processed together, one track per SIMD lane; tracks without them cost nothing extra.
+	//
+	// Once a reverb impulse response is loaded, each track is also mixed, at its send level, into a mono send bus
+	// (per worker, like the stereo buses), and the summed send bus is convolved with the impulse response and mixed
+	// into the output: one reverb for the whole mix, however many tracks feed it.
+	//
+	// Groups of looping tracks which would sound the same every time round can be frozen: mixed down, in the
+	// background, into one stereo loop which is then mixed in their place.  Changing anything about a frozen track
+	// unfreezes its group at once.
+	//
+	// Finally the output goes through the master bus, whose look-ahead limiter keeps stacked loops from clipping,
+	// and whose meters measure the result.
+	class NowSoundMixer
+	{
+	private:
+		// One task of a quantum's mixing: either a single track without active inserts, or a group of tracks
+		// with them, or a frozen group.
+		struct MixUnit
+		{
+			NowSoundTrack* Tracks[BiquadBank::LaneCount];
+			int TrackCount;
+			bool HasInserts;
+			NowSoundFreezeGroup* FreezeGroup;
+		};
+
+		// The node this mixer emits the mixed tracks through.
+		winrt::Windows::Media::Audio::AudioFrameInputNode _frameInputNode;
+
+		// Audio frame, reused for every quantum.
+		winrt::Windows::Media::AudioFrame _audioFrame;
+
+		// How many outgoing frames had zero bytes requested?
+		int _zeroByteOutgoingFrameCount;
+
+		// The limiter and meters on the mixed output.
+		MasterBus _masterBus;
+
+		// How long (in samples of real time) each quantum's mixing took.
+		LatencyHistogram _mixDurationHistogram;
+
+		// The workers; worker 0 is the audio graph's thread.
+		ForkJoinPool _pool;
+
+		// Each worker's interleaved stereo bus.
+		std::vector<std::vector<float>> _buses;
+
+		// Whether each worker's bus has been cleared and mixed into in the current quantum.
+		// (Not vector<bool>, since the workers write their own entries concurrently.)
+		std::vector<int> _busIsUsed;
+
+		// The buses used in the current quantum, to be summed.
+		std::vector<float*> _usedBuses;
+
+		// Each worker's mono send bus; only mixed into while there is a reverb.
+		std::vector<std::vector<float>> _sendBuses;
+
+		// The send buses used in the current quantum, to be summed.
+		std::vector<float*> _usedSendBuses;
+
+		// The summed send bus, and the reverb's output from it.
+		std::vector<float> _send;
+		std::vector<float> _reverbOutput;
+
+		// The reverb on the send bus, if any.  Like _tracks, locked by _tracksMutex.
+		std::unique_ptr<PartitionedConvolver> _reverb;
+
+		// Each worker's bank for processing inserts.
+		std::vector<BiquadBank> _banks;
+
+		// The current quantum's units of mixing work.  Reserved as tracks are added, so rebuilding this every
+		// quantum does not allocate.
+		std::vector<MixUnit> _units;
+
+		// The tracks to mix; non-owning.  Locked by the audio thread for the duration of each quantum's mixing,
+		// so a track is never deleted while being mixed.
+		std::vector<NowSoundTrack*> _tracks;
+		std::mutex _tracksMutex;
+
+		// The groups of tracks frozen, or being frozen; no track is in more than one.  Like _tracks, locked by
+		// _tracksMutex.
+		std::vector<std::unique_ptr<NowSoundFreezeGroup>> _freezeGroups;
+
+		// The samples mixed so far; advanced by Mix, under _tracksMutex.  Tells how far the tracks have played on
+		// since their positions were captured.
+		int64_t _mixedSampleCount;
+
+		// The task run for each track, and for each chunk of the reduction; created once, to avoid allocating per quantum.
+		std::function<void(int, int)> _mixTask;
+		std::function<void(int, int)> _reduceTask;
+
+		// The state of the current quantum's mixing, for the tasks above.
+		int _sampleCount;
+		float* _output;
+		bool _isSending;
+
+		// Group the tracks into this quantum's _units, first picking up any changes to their inserts; each frozen
+		// group plays in place of its tracks.
+		void BuildMixUnits(int sampleCount);
+
+		// The group the track is frozen in, if any.
+		NowSoundFreezeGroup* FreezeGroupOf(const NowSoundTrack* track) const;
+
+		// A copy of _tracks, taken under the lock, for work which need not hold up the audio thread.  Tracks are
+		// only deleted through the API, on the same thread as any such work, so the pointers stay valid.
+		std::vector<NowSoundTrack*> CopyTracks();
+
+		// Mix the unit's tracks into the given stereo bus (and send bus, if not null), using the given worker's bank.
+		void MixUnitInto(int worker, const MixUnit& unit, float* stereoBus, float* sendBus, int sampleCount);
+
+		// Convolve the summed send bus with the reverb, and mix the result into the interleaved stereo output.
+		void MixReverb(int sampleCount, float* output);
+
+		// Mix all tracks, overwriting the interleaved stereo output.
+		void Mix(int sampleCount, float* output);
+
+		// The quantum has started; emit the mixed tracks.
+		void FrameInputNode_QuantumStarted(
+			winrt::Windows::Media::Audio::AudioFrameInputNode sender,
+			winrt::Windows::Media::Audio::FrameInputNodeQuantumStartedEventArgs args);
+
+	public:
+		// Create the mixer's node and workers; the graph must have created its device output node.
+		NowSoundMixer(NowSoundGraph* graph, int workerCount);
+
+		// Start mixing the given track.
+		void AddTrack(NowSoundTrack* track);
+
+		// Stop mixing the given track; once this returns, the track will not be mixed again.
+		void RemoveTrack(NowSoundTrack* track);
+
+		// Freeze the looping tracks which can be (see NowSoundTrack::CanFreeze), and are not yet, into one group,
+		// whose frozen loop will take at most memoryCapInBytes (0 for no cap); loops of the durations shared by the
+		// most tracks are taken first, and any whose duration would take the group over the cap are left out.
+		// Returns how many tracks were frozen; 0 if fewer than two could be, since freezing one saves nothing.
+		int FreezeTracks(int64_t memoryCapInBytes);
+
+		// Unfreeze the group the track is in, if any; the group's tracks are mixed again from the next quantum.
+		void Unfreeze(NowSoundTrack* track);
+
+		// Is the track frozen, and its group's frozen loop playing in its place?
+		bool IsFrozen(NowSoundTrack* track);
+
+		// Capture every looping, unmuted track, with every position as of the same quantum, for an OfflineMixdown:
+		// append a snapshot of each one's loop to snapshots, and its source (with no stem) to sources, keeping its
+		// automation alive in automation and a copy of its playback effect's mapper (if any) in mappers.  Returns the
+		// tracks' IDs, in the same order.
+		std::vector<TrackId> CaptureMixdown(
+			std::vector<std::unique_ptr<BufferedSliceStream<AudioSample, float>>>& snapshots,
+			std::vector<OfflineMixdown::Source>& sources,
+			std::vector<std::shared_ptr<const SparseSliceStream<AudioSample, float>>>& automation,
+			std::vector<std::unique_ptr<PlaybackMapper<AudioSample>>>& mappers);
+
+		// Replace the send bus's reverb; null removes it (and stops mixing the send bus at all).
+		void SetReverb(std::unique_ptr<PartitionedConvolver> reverb);
+
+		// The limiter and meters on the output; the meters may be read from any thread.
+		MasterBus& GetMasterBus();
+
+		// Percentiles of how long each quantum's mixing took, in samples.
+		const LatencyHistogram& MixDurationHistogram() const;
+
+		// Merge the time-since-last-quantum percentiles of all tracks into the given histogram.
+		void MergeTrackTimings(LatencyHistogram& sinceLastQuantum);
+
+		// Forget the timing percentiles of the mixer and of all tracks.
+		void ResetTimingInfo();
+	};
+}
@@ -3,15 +3,16 @@
 
 #include "pch.h"
 
+#include <algorithm>
 #include <string>
 #include <sstream>
 
 #include "stdint.h"
 
+#include "AudioKernels.h"
 #include "BufferAllocator.h"
 #include "Check.h"
 #include "Clock.h"
-#include "GetBuffer.h"
 #include "MagicNumbers.h"
 #include "NowSoundGraph.h"
 #include "NowSoundLib.h"
@@ -20,6 +21,7 @@
 #include "Slice.h"
 #include "SliceStream.h"
 #include "Time.h"
+#include "Trace.h"
 
 using namespace concurrency;
 using namespace std;
@@ -56,7 +58,13 @@ namespace NowSound
 			(float)13,
 			(float)14,
 			(float)15,
-			(float)16);
+			(float)16,
+			(float)17,
+			(float)18,
+			(float)19,
+			(float)20,
+			21,
+			22);
 	}
 
 	__declspec(dllexport) NowSoundTrackState NowSoundTrack_State(TrackId trackId)
@@ -71,12 +79,12 @@ namespace NowSound
 
     __declspec(dllexport) float /*ContinuousDuration<Beat>*/ NowSoundTrack_BeatPositionUnityNow(TrackId trackId)
     {
-        return NowSoundTrack::Track(trackId)->BeatPositionUnityNow().Value();
+        return (float)NowSoundTrack::Track(trackId)->BeatPositionUnityNow().Value();
     }
 
     __declspec(dllexport) float /*ContinuousDuration<AudioSample>*/ NowSoundTrack_ExactDuration(TrackId trackId)
     {
-        return NowSoundTrack::Track(trackId)->ExactDuration().Value();
+        return (float)NowSoundTrack::Track(trackId)->ExactDuration().Value();
     }
 
     __declspec(dllexport) NowSoundTrackInfo NowSoundTrack_Info(TrackId trackId)
@@ -104,6 +112,107 @@ namespace NowSound
         NowSoundTrack::Track(trackId)->SetIsMuted(isMuted);
     }
 
+    __declspec(dllexport) float NowSoundTrack_SendLevel(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->SendLevel();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_SetSendLevel(TrackId trackId, float sendLevel)
+    {
+        NowSoundTrack::Track(trackId)->SetSendLevel(sendLevel);
+    }
+
+    __declspec(dllexport) float NowSoundTrack_Pan(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->Pan();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_SetPan(TrackId trackId, float pan)
+    {
+        NowSoundTrack::Track(trackId)->Pan(pan);
+    }
+
+    __declspec(dllexport) float NowSoundTrack_Volume(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->Volume();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_SetVolume(TrackId trackId, float volume)
+    {
+        NowSoundTrack::Track(trackId)->SetVolume(volume);
+    }
+
+    __declspec(dllexport) void NowSoundTrack_StartAutomationRecording(TrackId trackId)
+    {
+        NowSoundTrack::Track(trackId)->StartAutomationRecording();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_StopAutomationRecording(TrackId trackId)
+    {
+        NowSoundTrack::Track(trackId)->StopAutomationRecording();
+    }
+
+    __declspec(dllexport) bool NowSoundTrack_IsRecordingAutomation(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->IsRecordingAutomation();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_ClearAutomation(TrackId trackId)
+    {
+        NowSoundTrack::Track(trackId)->ClearAutomation();
+    }
+
+    __declspec(dllexport) NowSoundPlaybackEffect NowSoundTrack_PlaybackEffect(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->PlaybackEffect();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_SetPlaybackEffect(TrackId trackId, NowSoundPlaybackEffect effect, float stutterBeats)
+    {
+        NowSoundTrack::Track(trackId)->SetPlaybackEffect(effect, stutterBeats);
+    }
+
+    __declspec(dllexport) void NowSoundTrack_SetEqBand(
+        TrackId trackId,
+        int32_t band,
+        NowSoundEqBandType type,
+        float frequencyHz,
+        float gainDb,
+        float q)
+    {
+        NowSoundTrack::Track(trackId)->SetEqBand(band, type, frequencyHz, gainDb, q);
+    }
+
+    __declspec(dllexport) void NowSoundTrack_StartOverdub(TrackId trackId)
+    {
+        NowSoundTrack::Track(trackId)->StartOverdub();
+    }
+
+    __declspec(dllexport) void NowSoundTrack_StopOverdub(TrackId trackId)
+    {
+        NowSoundTrack::Track(trackId)->StopOverdub();
+    }
+
+    __declspec(dllexport) bool NowSoundTrack_IsOverdubbing(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->IsOverdubbing();
+    }
+
+    __declspec(dllexport) bool NowSoundTrack_Undo(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->Undo();
+    }
+
+    __declspec(dllexport) bool NowSoundTrack_Redo(TrackId trackId)
+    {
+        return NowSoundTrack::Track(trackId)->Redo();
+    }
+
+    __declspec(dllexport) bool NowSoundTrack_IsFrozen(TrackId trackId)
+    {
+        return NowSoundGraph::Instance()->GetMixer()->IsFrozen(NowSoundTrack::Track(trackId));
+    }
+
     __declspec(dllexport) void NowSoundTrack_Delete(TrackId trackId)
     {
         NowSoundTrack::DeleteTrack(trackId);
@@ -111,8 +220,6 @@ namespace NowSound
 
     std::map<TrackId, std::unique_ptr<NowSoundTrack>> NowSoundTrack::s_tracks{};
 
-    Windows::Media::AudioFrame NowSoundTrack::s_audioFrame{ nullptr };
-
     void NowSoundTrack::DeleteTrack(TrackId trackId)
     {
         Check(trackId >= TrackId::TrackIdUndefined && trackId <= s_tracks.size());
@@ -142,33 +249,89 @@ namespace NowSound
         TrackId trackId,
         AudioInputId inputId,
         const BufferedSliceStream<AudioSample, float>& sourceStream,
+		float initialPan)
+		: NowSoundTrack(
+			graph,
+			trackId,
+			inputId,
+			// latency compensation effectively means the track started before it was constructed ;-)
+			BufferedSliceStream<AudioSample, float>(
+				Clock::Instance().Now() - Clock::Instance().TimeToSamples(MagicNumbers::PreRecordingDuration),
+				1, // mono streams only for now (and maybe indefinitely)
+				NowSoundGraph::Instance()->GetAudioAllocator(),
+				/*maxBufferedDuration:*/ 0,
+				// Loop at the exact (possibly fractional) duration, so tracks never drift from the clock.
+				/*useExactLoopingMapper*/ true),
+			// one beat is the shortest any track ever is (TODO: allow optionally relaxing quantization)
+			Duration<Beat>{ 1 },
+			Clock::Instance().TimeToSamples(MagicNumbers::PreRecordingDuration),
+			initialPan)
+	{
+		/* HACK: try NOT pre-recording any data... just push the start time back
+        if (MagicNumbers::PreRecordingDuration.Value() > 0)
+        {
+            // Prepend latencyCompensation's worth of previously buffered input audio, to prepopulate this track.
+			Duration<AudioSample> latencyCompensationDuration = Clock::Instance().TimeToSamples(MagicNumbers::PreRecordingDuration);
+            Interval<AudioSample> lastIntervalOfSourceStream(
+                sourceStream.InitialTime() + sourceStream.DiscreteDuration() - latencyCompensationDuration,
+                latencyCompensationDuration);
+            sourceStream.AppendTo(lastIntervalOfSourceStream, &_audioStream);
+        }
+		*/
+	}
+
+    NowSoundTrack::NowSoundTrack(
+		NowSoundGraph* graph,
+        TrackId trackId,
+        AudioInputId inputId,
+        BufferedSliceStream<AudioSample, float>&& audioStream,
+		Duration<Beat> beatDuration,
+		Duration<AudioSample> inputLatency,
 		float initialPan)
 		: _graph{ graph },
 		_trackId{ trackId },
         _inputId{ inputId },
-        _state{ NowSoundTrackState::TrackRecording },
-        // latency compensation effectively means the track started before it was constructed ;-)
-        _audioStream(
-            Clock::Instance().Now() - Clock::Instance().TimeToSamples(MagicNumbers::PreRecordingDuration),
-            1, // mono streams only for now (and maybe indefinitely)
-            NowSoundGraph::Instance()->GetAudioAllocator(),
-            /*maxBufferedDuration:*/ 0,
-            /*useContinuousLoopingMapper*/ false),
-        // one beat is the shortest any track ever is (TODO: allow optionally relaxing quantization)
-        _beatDuration{ 1 },
-        _audioFrameInputNode{ NowSoundGraph::Instance()->GetAudioGraph().CreateFrameInputNode() },
+        _state{ audioStream.IsShut() ? NowSoundTrackState::TrackLooping : NowSoundTrackState::TrackRecording },
+        _audioStream{ new BufferedSliceStream<AudioSample, float>(std::move(audioStream)) },
+        _history{},
+        _stream{ _audioStream.get() },
+        _streamMutex{},
+        _isOverdubbing{ false },
+        _overdubTime{ 0 },
+        _inputLatency{ inputLatency },
+        _beatDuration{ beatDuration },
         _lastSampleTime{ Clock::Instance().Now() },
         _isMuted{ false },
-        _debugLog{},
         _requiredSamplesHistogram { MagicNumbers::AudioQuantumHistogramCapacity },
 		_sinceLastSampleTimingHistogram{ MagicNumbers::AudioQuantumHistogramCapacity },
+		_requiredSamplesPercentiles{ MagicNumbers::TimingHistogramResolution },
+		_sinceLastQuantumPercentiles{ MagicNumbers::TimingHistogramResolution },
 		_volumeHistogram{ (int)Clock::Instance().TimeToSamples(MagicNumbers::RecentVolumeDuration).Value() },
 		_pan{ initialPan },
+		_volume{ 1 },
+		_sendLevel{ 0 },
+		_panAutomationTake{},
+		_volumeAutomationTake{},
+		_panAutomation{},
+		_volumeAutomation{},
+		_panAutomationCursor{ 0 },
+		_volumeAutomationCursor{ 0 },
+		_rampStartPan{ initialPan },
+		_rampEndPan{ initialPan },
+		_rampStartVolume{ 1 },
+		_rampEndVolume{ 1 },
+		_playbackEffect{ NowSoundPlaybackEffect::PlaybackNormal },
+		_playbackMapper{},
+		_monoOutputBuffer{},
+		_eq{},
+		_hasPendingEqBands{ false },
+		_pendingEqBandsMutex{},
 		_frequencyTracker{ _graph->FftSize() < 0
 			? ((NowSoundFrequencyTracker*)nullptr)
-			: new NowSoundFrequencyTracker(_graph->GetBinBounds(), _graph->FftSize()) }
+			: new NowSoundFrequencyTracker(_graph->GetBinBounds(), _graph->FftSize(), _graph->GetConstantQ()) }
 	{
         Check(_lastSampleTime.Value() >= 0);
+        Check(_beatDuration > 0);
 
         // Tracks should only be created from the UI thread (or at least not from the audio thread).
         // TODO: thread contracts.
@@ -176,38 +339,19 @@ namespace NowSound
         // should only ever call this when graph is fully up and running
         Check(NowSoundGraph::Instance()->State() == NowSoundGraphState::GraphRunning);
 
-		/* HACK: try NOT pre-recording any data... just push the start time back
-        if (MagicNumbers::PreRecordingDuration.Value() > 0)
+        if (_audioStream->IsShut())
         {
-            // Prepend latencyCompensation's worth of previously buffered input audio, to prepopulate this track.
-			Duration<AudioSample> latencyCompensationDuration = Clock::Instance().TimeToSamples(MagicNumbers::PreRecordingDuration);
-            Interval<AudioSample> lastIntervalOfSourceStream(
-                sourceStream.InitialTime() + sourceStream.DiscreteDuration() - latencyCompensationDuration,
-                latencyCompensationDuration);
-            sourceStream.AppendTo(lastIntervalOfSourceStream, &_audioStream);
+            // the loop is already recorded, so it is the first version
+            std::unique_ptr<NowSoundLoopAnalysis> analysis = AnalyzeLoop(_audioStream.get());
+            _history.Commit(std::move(_audioStream), _graph->TrackHistoryMemoryCap(), std::move(analysis));
         }
-		*/
 
-        // Now is when we create the AudioFrameInputNode, because now is when we are sure we are not on the
-        // audio thread.
-        // TODO: is it right to add this outgoing connection now? Or should this happen when switching to playing?
-        // In general, what is the most synchronous / fastest way to switch from recording to playing?
-        _audioFrameInputNode.QuantumStarted([&](AudioFrameInputNode sender, FrameInputNodeQuantumStartedEventArgs args)
-        {
-            FrameInputNode_QuantumStarted(sender, args);
-        });
-		_audioFrameInputNode.AddOutgoingConnection(NowSoundGraph::Instance()->GetAudioDeviceOutputNode());
+        // The mixer ignores tracks until they are looping, so it is fine to start mixing this one right away.
+        NowSoundGraph::Instance()->GetMixer()->AddTrack(this);
     }
 
-    void NowSoundTrack::DebugLog(const std::wstring& entry)
-    {
-        _debugLog.push(entry);
-        if (_debugLog.size() > MagicNumbers::DebugLogCapacity)
-        {
-            _debugLog.pop();
-        }
-    }
-    
+    TrackId NowSoundTrack::Id() const { return _trackId; }
+
     NowSoundTrackState NowSoundTrack::State() const { return _state; }
     
     Duration<Beat> NowSoundTrack::BeatDuration() const { return _beatDuration; }
@@ -217,59 +361,209 @@ namespace NowSound
         // TODO: determine whether we really need a time that only moves forward between Unity frames.
         // For now, let time be determined solely by audio graph, and let Unity observe time increasing 
         // during a single Unity frame.
-        Duration<AudioSample> sinceStart(Clock::Instance().Now() - _audioStream.InitialTime());
+        Duration<AudioSample> sinceStart(Clock::Instance().Now() - _stream->InitialTime());
         Time<AudioSample> sinceStartTime(sinceStart.Value());
 
-        ContinuousDuration<Beat> beats = Clock::Instance().TimeToBeats(sinceStartTime);
-        int completeBeatsSinceStart = (int)beats.Value() % (int)BeatDuration().Value();
-        return (ContinuousDuration<Beat>)(completeBeatsSinceStart + (beats.Value() - (int)beats.Value()));
+        // reduce the (exact) complete beats modulo the track length before converting to float
+        return Clock::Instance().TimeToBeatPosition(sinceStartTime).Modulo(BeatDuration().Value()).Beats();
     }
 
     ContinuousDuration<AudioSample> NowSoundTrack::ExactDuration() const
     {
-        return (int)BeatDuration().Value() * Clock::Instance().BeatDuration().Value();
+        return (ContinuousDuration<AudioSample>)(BeatDuration().Value() * Clock::Instance().ExactBeatDuration());
     }
 
-    Time<AudioSample> NowSoundTrack::StartTime() const { return _audioStream.InitialTime(); }
+    Time<AudioSample> NowSoundTrack::StartTime() const { return _stream->InitialTime(); }
 
-    ContinuousDuration<Beat> TrackBeats(Duration<AudioSample> localTime, Duration<Beat> beatDuration)
+    int64_t NowSoundTrack::LoopPositionNow() const
     {
-        ContinuousDuration<Beat> totalBeats = Clock::Instance().TimeToBeats(localTime.Value());
-        Duration<Beat> nonFractionalBeats((int)totalBeats.Value());
+        return (int64_t)(BeatPositionUnityNow().Value() / BeatDuration().Value() * ExactDuration().Value());
+    }
 
-        return (ContinuousDuration<Beat>)(
-            // total (non-fractional) beats modulo the beat duration of the track
-            (nonFractionalBeats.Value() % beatDuration.Value())
-            // fractional beats of the track
-            + (totalBeats.Value() - nonFractionalBeats.Value()));
+    ContinuousDuration<Beat> TrackBeats(Duration<AudioSample> localTime, Duration<Beat> beatDuration)
+    {
+        // total beats modulo the beat duration of the track, reduced exactly before converting to float
+        return Clock::Instance().TimeToBeatPosition(localTime.Value()).Modulo(beatDuration.Value()).Beats();
     }
 
     NowSoundTrackInfo NowSoundTrack::Info() 
     {
         Time<AudioSample> lastSampleTime = this->_lastSampleTime; // to prevent any drift from this being updated concurrently
-        Time<AudioSample> startTime = this->_audioStream.InitialTime();
+        Time<AudioSample> startTime = this->_stream->InitialTime();
 		Duration<AudioSample> localClockTime = Clock::Instance().Now() - startTime;
+
+		// the versions in the history, and any overdub, cost only the buffers they do not share with each other
+		int64_t bufferBytes;
+		{
+			std::lock_guard<std::mutex> guard(_streamMutex);
+			if (_history.IsEmpty())
+			{
+				bufferBytes = _stream->BufferBytes();
+			}
+			else
+			{
+				bufferBytes = _history.BufferBytes()
+					+ (_isOverdubbing ? _stream->BufferBytesNotSharedWith(*_history.Current()) : 0);
+			}
+		}
+		int64_t bufferSizeInBytes = NowSoundGraph::Instance()->GetAudioAllocator()->BufferSizeInBytes();
+
         return CreateNowSoundTrackInfo(
             startTime.Value(),
-            Clock::Instance().TimeToBeats(startTime).Value(),
-            this->_audioStream.DiscreteDuration().Value(),
+            (float)Clock::Instance().TimeToBeats(startTime).Value(),
+            this->_stream->DiscreteDuration().Value(),
             this->BeatDuration().Value(),
-            this->_state == NowSoundTrackState::TrackLooping ? _audioStream.ExactDuration().Value() : 0,
+            this->_state == NowSoundTrackState::TrackLooping ? (float)_stream->ExactDuration().Value() : 0,
 			localClockTime.Value(),
-			TrackBeats(localClockTime, this->_beatDuration).Value(),
+			(float)TrackBeats(localClockTime, this->_beatDuration).Value(),
 			(lastSampleTime - startTime).Value(),
-			_volumeHistogram.Average(),
+			// once looping, the volume comes from the loop's precomputed envelope
+			CompletedLoopAnalysis() != nullptr
+				? CompletedLoopAnalysis()->RmsVolume(LoopPositionNow())
+				: _volumeHistogram.Average(),
 			_pan,
             _requiredSamplesHistogram.Min(),
             _requiredSamplesHistogram.Max(),
             _requiredSamplesHistogram.Average(),
             _sinceLastSampleTimingHistogram.Min(),
             _sinceLastSampleTimingHistogram.Max(),
-            _sinceLastSampleTimingHistogram.Average());
+            _sinceLastSampleTimingHistogram.Average(),
+            _sinceLastQuantumPercentiles.Percentile(50),
+            _sinceLastQuantumPercentiles.Percentile(99),
+            _sinceLastQuantumPercentiles.Percentile(99.9),
+            _requiredSamplesPercentiles.Percentile(99.9),
+            bufferBytes,
+            (int32_t)(bufferBytes / bufferSizeInBytes));
+    }
+
+    const LatencyHistogram& NowSoundTrack::SinceLastQuantumPercentiles() const { return _sinceLastQuantumPercentiles; }
+
+    void NowSoundTrack::ResetTimingInfo()
+    {
+        _requiredSamplesPercentiles.Reset();
+        _sinceLastQuantumPercentiles.Reset();
     }
 
     bool NowSoundTrack::IsMuted() const { return _isMuted; }
-    void NowSoundTrack::SetIsMuted(bool isMuted) { _isMuted = isMuted; }
+    void NowSoundTrack::SetIsMuted(bool isMuted)
+    {
+        if (isMuted != _isMuted)
+        {
+            NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+            _isMuted = isMuted;
+        }
+    }
+
+	float NowSoundTrack::Pan() { return _pan; }
+
+	void NowSoundTrack::Pan(float pan)
+	{
+		Check(pan >= 0 && pan <= 1);
+		if (pan != _pan)
+		{
+			NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+			_pan = pan;
+		}
+		if (_panAutomationTake != nullptr)
+		{
+			_panAutomationTake->Append(_lastSampleTime, pan);
+		}
+	}
+
+	float NowSoundTrack::Volume() const { return _volume; }
+
+	void NowSoundTrack::SetVolume(float volume)
+	{
+		Check(volume >= 0);
+		if (volume != _volume)
+		{
+			NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+			_volume = volume;
+		}
+		if (_volumeAutomationTake != nullptr)
+		{
+			_volumeAutomationTake->Append(_lastSampleTime, volume);
+		}
+	}
+
+	void NowSoundTrack::StartAutomationRecording()
+	{
+		Check(_state == NowSoundTrackState::TrackLooping);
+		if (_panAutomationTake != nullptr)
+		{
+			return;
+		}
+
+		// while recording, the mixer plays the pan and volume as they are set
+		DropAutomation();
+
+		// automation is timed by the track's own playback position, which is what the mixer reads it by
+		Time<AudioSample> now = _lastSampleTime;
+		_panAutomationTake.reset(new SparseSliceStream<AudioSample, float>(now, _pan, /*useExactLoopingMapper:*/true));
+		_volumeAutomationTake.reset(new SparseSliceStream<AudioSample, float>(now, _volume, /*useExactLoopingMapper:*/true));
+	}
+
+	void NowSoundTrack::StopAutomationRecording()
+	{
+		if (_panAutomationTake == nullptr)
+		{
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(_streamMutex);
+
+		// loop exactly as the audio does; a lane with no events would only hold its initial value, which is the
+		// value already set, so it is dropped
+		ContinuousDuration<AudioSample> duration = _stream->ExactDuration();
+		_panAutomationTake->Shut(duration);
+		_volumeAutomationTake->Shut(duration);
+		if (_panAutomationTake->EventCount() > 0)
+		{
+			_panAutomation.reset(_panAutomationTake.release());
+		}
+		if (_volumeAutomationTake->EventCount() > 0)
+		{
+			_volumeAutomation.reset(_volumeAutomationTake.release());
+		}
+		_panAutomationTake.reset();
+		_volumeAutomationTake.reset();
+		_panAutomationCursor = 0;
+		_volumeAutomationCursor = 0;
+	}
+
+	bool NowSoundTrack::IsRecordingAutomation() const { return _panAutomationTake != nullptr; }
+
+	void NowSoundTrack::ClearAutomation()
+	{
+		_panAutomationTake.reset();
+		_volumeAutomationTake.reset();
+		DropAutomation();
+	}
+
+	void NowSoundTrack::DropAutomation()
+	{
+		std::lock_guard<std::mutex> guard(_streamMutex);
+		// the mixer last ramped to these, so the pan and volume carry on from there without a jump
+		if (_panAutomation != nullptr)
+		{
+			_pan = _rampEndPan;
+		}
+		if (_volumeAutomation != nullptr)
+		{
+			_volume = _rampEndVolume;
+		}
+		_panAutomation.reset();
+		_volumeAutomation.reset();
+	}
+
+	void NowSoundTrack::GetAutomation(
+		std::shared_ptr<const SparseSliceStream<AudioSample, float>>* panAutomation,
+		std::shared_ptr<const SparseSliceStream<AudioSample, float>>* volumeAutomation)
+	{
+		std::lock_guard<std::mutex> guard(_streamMutex);
+		*panAutomation = _panAutomation;
+		*volumeAutomation = _volumeAutomation;
+	}
 
 	void NowSoundTrack::GetFrequencies(void* floatBuffer, int floatBufferCapacity)
 	{
@@ -278,7 +572,16 @@ namespace NowSound
 			return;
 		}
 
-		_frequencyTracker->GetLatestHistogram((float*)floatBuffer, floatBufferCapacity);
+		const NowSoundLoopAnalysis* analysis = CompletedLoopAnalysis();
+		if (analysis != nullptr)
+		{
+			// the loop was analyzed when it was shut; just look up the current position
+			analysis->GetFrequencies(LoopPositionNow(), (float*)floatBuffer, floatBufferCapacity);
+		}
+		else
+		{
+			_frequencyTracker->GetLatestHistogram((float*)floatBuffer, floatBufferCapacity);
+		}
 	}
 	
 	void NowSoundTrack::FinishRecording()
@@ -288,37 +591,277 @@ namespace NowSound
         // no need for any synchronization at all; the Record() logic will see this change.
         // We have no memory fence here but this write does reliably get seen sufficiently quickly in practice.
         _state = NowSoundTrackState::TrackFinishRecording;
+        NOWSOUND_TRACE(TrackStateChanged, _trackId, NowSoundTrackState::TrackFinishRecording, 0);
     }
 
     void NowSoundTrack::Delete()
     {
         // TODO: ThreadContract.RequireUnity();
 
-        _audioFrameInputNode.Stop();
+        // the input must not call this track once it is gone
+        StopOverdub();
 
-        while (_audioFrameInputNode.OutgoingConnections().Size() > 0)
-        {
-            _audioFrameInputNode.RemoveOutgoingConnection(_audioFrameInputNode.OutgoingConnections().GetAt(0).Destination());
-        }
-        // TODO: does destruction properly clean this up? _audioFrameInputNode.Dispose();
+        NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+
+        // once this returns, the mixer will never touch this track again
+        NowSoundGraph::Instance()->GetMixer()->RemoveTrack(this);
     }
 
-	const double Pi = std::atan(1) * 4;
+	NowSoundPlaybackEffect NowSoundTrack::PlaybackEffect() const { return _playbackEffect; }
 
-	void NowSoundTrack::FrameInputNode_QuantumStarted(AudioFrameInputNode sender, FrameInputNodeQuantumStartedEventArgs args)
-    {
-        Check(sender == _audioFrameInputNode);
+	void NowSoundTrack::SetPlaybackEffect(NowSoundPlaybackEffect effect, float stutterBeats)
+	{
+		Check(effect == NowSoundPlaybackEffect::PlaybackNormal || _state == NowSoundTrackState::TrackLooping);
+		if (effect == _playbackEffect && effect != NowSoundPlaybackEffect::PlaybackStutter)
+		{
+			return;
+		}
 
-        Check(args.RequiredSamples() >= 0);
-        uint32_t requiredSamples = (uint32_t)args.RequiredSamples();
+		NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
 
-        if (requiredSamples == 0)
-        {
-            s_zeroByteOutgoingFrameCount++;
-            return;
-        }
+		// declared before the lock, so that the mapper replaced is freed after unlocking
+		std::unique_ptr<PlaybackMapper<AudioSample>> mapper;
+		std::lock_guard<std::mutex> guard(_streamMutex);
+		if (effect != NowSoundPlaybackEffect::PlaybackNormal)
+		{
+			// take over from the position playing next, whether through an effect or straight through the loop
+			Time<AudioSample> now = _lastSampleTime;
+			int64_t position = _playbackMapper == nullptr
+				? PlaybackMapper<AudioSample>::LoopPosition(_stream, _stream->Mapper(), now)
+				: _playbackMapper->PositionAt(_stream, now);
+			const int64_t normalSpeed = (int64_t)1 << IntervalMapper<AudioSample>::PhaseBits;
+
+			switch (effect)
+			{
+			case NowSoundPlaybackEffect::PlaybackReverse:
+				mapper.reset(new SpeedPlaybackMapper<AudioSample>(now, position, -normalSpeed));
+				break;
+			case NowSoundPlaybackEffect::PlaybackHalfSpeed:
+				mapper.reset(new SpeedPlaybackMapper<AudioSample>(now, position, normalSpeed / 2));
+				break;
+			case NowSoundPlaybackEffect::PlaybackDoubleSpeed:
+				mapper.reset(new SpeedPlaybackMapper<AudioSample>(now, position, normalSpeed * 2));
+				break;
+			case NowSoundPlaybackEffect::PlaybackStutter:
+			{
+				Check(stutterBeats > 0);
+				int64_t windowDuration = std::llround(stutterBeats * Clock::Instance().ExactBeatDuration());
+				mapper.reset(new StutterPlaybackMapper<AudioSample>(now, position, (std::max)((int64_t)1, windowDuration)));
+				break;
+			}
+			default:
+				Check(false);
+			}
+		}
+		std::swap(mapper, _playbackMapper);
+		_playbackEffect = effect;
+	}
+
+	float NowSoundTrack::SendLevel() const { return _sendLevel; }
+
+	void NowSoundTrack::SetSendLevel(float sendLevel)
+	{
+		Check(sendLevel >= 0);
+		if (sendLevel != _sendLevel)
+		{
+			NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+			_sendLevel = sendLevel;
+		}
+	}
+
+	void NowSoundTrack::SetEqBand(int band, NowSoundEqBandType type, float frequencyHz, float gainDb, float q)
+	{
+		Check(band >= 0 && band < BiquadCascade::StageCount);
+
+		NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+
+		float sampleRateHz = (float)Clock::Instance().SampleRateHz();
+		BiquadCoefficients coefficients = BiquadCoefficients::Identity();
+		switch (type)
+		{
+		case NowSoundEqBandType::EqBandOff: break;
+		// a 0 dB peak or shelf does nothing, so leave it bypassed
+		case NowSoundEqBandType::EqBandPeaking:
+			if (gainDb != 0) { coefficients = BiquadCoefficients::Peaking(sampleRateHz, frequencyHz, q, gainDb); }
+			break;
+		case NowSoundEqBandType::EqBandLowShelf:
+			if (gainDb != 0) { coefficients = BiquadCoefficients::LowShelf(sampleRateHz, frequencyHz, q, gainDb); }
+			break;
+		case NowSoundEqBandType::EqBandHighShelf:
+			if (gainDb != 0) { coefficients = BiquadCoefficients::HighShelf(sampleRateHz, frequencyHz, q, gainDb); }
+			break;
+		case NowSoundEqBandType::EqBandLowPass:
+			coefficients = BiquadCoefficients::LowPass(sampleRateHz, frequencyHz, q);
+			break;
+		case NowSoundEqBandType::EqBandHighPass:
+			coefficients = BiquadCoefficients::HighPass(sampleRateHz, frequencyHz, q);
+			break;
+		default: Check(false); // unknown band type
+		}
+
+		std::lock_guard<std::mutex> guard(_pendingEqBandsMutex);
+		if (!_hasPendingEqBands)
+		{
+			// start from the bands the mixer has, so that only this band changes
+			for (int stage = 0; stage < BiquadCascade::StageCount; stage++)
+			{
+				_pendingEqBands[stage] = _eq.Stage(stage);
+			}
+		}
+		_pendingEqBands[band] = coefficients;
+		_hasPendingEqBands = true;
+	}
+
+	void NowSoundTrack::GetEqBands(BiquadCoefficients* bands)
+	{
+		// the mixer changes _eq's bands only while holding this lock (see UpdateInserts)
+		std::lock_guard<std::mutex> guard(_pendingEqBandsMutex);
+		for (int stage = 0; stage < BiquadCascade::StageCount; stage++)
+		{
+			bands[stage] = _hasPendingEqBands ? _pendingEqBands[stage] : _eq.Stage(stage);
+		}
+	}
+
+	void NowSoundTrack::UpdateInserts()
+	{
+		if (!_hasPendingEqBands.load(std::memory_order_acquire) || !_pendingEqBandsMutex.try_lock())
+		{
+			return;
+		}
+		for (int stage = 0; stage < BiquadCascade::StageCount; stage++)
+		{
+			_eq.SetStage(stage, _pendingEqBands[stage]);
+		}
+		_hasPendingEqBands = false;
+		_pendingEqBandsMutex.unlock();
+	}
+
+	void NowSoundTrack::StartOverdub()
+	{
+		Check(_state == NowSoundTrackState::TrackLooping);
+		if (_isOverdubbing)
+		{
+			return;
+		}
+
+		// an overdub can end up copying every buffer of the loop, so it starts only if the budget allows for that
+		if (!NowSoundGraph::Instance()->HasMemoryFor(_history.Current()->BufferBytes()))
+		{
+			return;
+		}
+
+		NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+
+		// Overdub a snapshot of the current version; this shares all the buffers, so costs nothing until the
+		// overdub writes them.  Nothing writes it until the input starts calling Record below.
+		{
+			std::lock_guard<std::mutex> guard(_streamMutex);
+			_audioStream = _history.Current()->Snapshot();
+			_stream = _audioStream.get();
+		}
+
+		// latency compensation, exactly as when this track was recorded
+		_overdubTime = Clock::Instance().Now() - _inputLatency;
+		_isOverdubbing = true;
+		NowSoundGraph::Instance()->Input(_inputId)->AddRecorder(this);
+	}
+
+	void NowSoundTrack::StopOverdub()
+	{
+		if (!_isOverdubbing)
+		{
+			return;
+		}
+
+		// once this returns, Record is not running and will not be called again
+		NowSoundGraph::Instance()->Input(_inputId)->RemoveRecorder(this);
+
+		// the overdubbed loop is the new current version (and _stream still points at it), analyzed from now on
+		std::unique_ptr<NowSoundLoopAnalysis> analysis = AnalyzeLoop(_audioStream.get());
+
+		// the versions this drops are destroyed outside the lock, since that waits for their analyses to finish
+		std::vector<LoopHistory<AudioSample, float, NowSoundLoopAnalysis>::Version> dropped;
+		{
+			std::lock_guard<std::mutex> guard(_streamMutex);
+			dropped = _history.Commit(std::move(_audioStream), _graph->TrackHistoryMemoryCap(), std::move(analysis));
+			_isOverdubbing = false;
+		}
+	}
+
+	bool NowSoundTrack::IsOverdubbing() const { return _isOverdubbing; }
+
+	bool NowSoundTrack::Undo()
+	{
+		StopOverdub();
+		if (!_history.CanUndo())
+		{
+			return false;
+		}
+
+		NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+		{
+			std::lock_guard<std::mutex> guard(_streamMutex);
+			_history.Undo();
+			_stream = _history.Current();
+		}
 
-        // sender.DiscardQueuedFrames();
+		return true;
+	}
+
+	bool NowSoundTrack::Redo()
+	{
+		StopOverdub();
+		if (!_history.CanRedo())
+		{
+			return false;
+		}
+
+		NowSoundGraph::Instance()->GetMixer()->Unfreeze(this);
+		{
+			std::lock_guard<std::mutex> guard(_streamMutex);
+			_history.Redo();
+			_stream = _history.Current();
+		}
+
+		return true;
+	}
+
+	std::unique_ptr<NowSoundLoopAnalysis> NowSoundTrack::AnalyzeLoop(const BufferedSliceStream<AudioSample, float>* version) const
+	{
+		// each version is immutable once committed, so is analyzed in place, and only ever once
+		std::unique_ptr<NowSoundLoopAnalysis> analysis(
+			new NowSoundLoopAnalysis(_graph->GetBinBounds(), _graph->FftSize(), _graph->GetConstantQ()));
+		analysis->AnalyzeAsync(version);
+		return analysis;
+	}
+
+	const NowSoundLoopAnalysis* NowSoundTrack::CompletedLoopAnalysis() const
+	{
+		// the history has its first version by the time this track is looping, and afterwards changes only on the
+		// UI thread, which is the only caller
+		if (_state != NowSoundTrackState::TrackLooping)
+		{
+			return nullptr;
+		}
+		const NowSoundLoopAnalysis* analysis = _history.CurrentAnalysis();
+		return analysis != nullptr && analysis->IsComplete() ? analysis : nullptr;
+	}
+
+	bool NowSoundTrack::HasActiveInserts() const { return _eq.IsActive(); }
+
+	BiquadCascade* NowSoundTrack::Eq() { return &_eq; }
+
+	void NowSoundTrack::MixInto(float* stereoBus, float* sendBus, int sampleCount)
+	{
+		if (ReadForMix(sampleCount) != nullptr)
+		{
+			PanForMix(stereoBus, sendBus, sampleCount);
+		}
+	}
+
+	float* NowSoundTrack::ReadForMix(int sampleCount)
+    {
+        Check(sampleCount > 0);
 
         DateTime dateTimeNow = DateTime::clock::now();
         TimeSpan sinceLast = dateTimeNow - _lastQuantumTime;
@@ -326,110 +869,144 @@ namespace NowSound
 
         if (IsMuted() || _state != NowSoundTrackState::TrackLooping)
         {
-            // copy nothing to anywhere
-            return;
+            // mix nothing into anything; and drop the inserts' memory of what came before, so unmuting does not
+            // play a stale tail of it
+            _eq.ClearState();
+            return nullptr;
+        }
+
+        // an overdub may be writing the loop, or the UI thread swapping it
+        std::lock_guard<std::mutex> guard(_streamMutex);
+
+        // ramp the pan and volume from where the last quantum left them to where this one ends
+        Time<AudioSample> endTime = _lastSampleTime + Duration<AudioSample>(sampleCount);
+        _rampStartPan = _rampEndPan;
+        _rampStartVolume = _rampEndVolume;
+        _rampEndPan = _panAutomation == nullptr
+            ? _pan.load(std::memory_order_relaxed)
+            : _panAutomation->ValueAt(endTime, &_panAutomationCursor);
+        _rampEndVolume = _volumeAutomation == nullptr
+            ? _volume.load(std::memory_order_relaxed)
+            : _volumeAutomation->ValueAt(endTime, &_volumeAutomationCursor);
+
+        Interval<AudioSample> outputInterval(_lastSampleTime, sampleCount);
+        // (a playback effect may read anywhere in the loop, so is never skipped as silent)
+        bool isSilent = _playbackMapper == nullptr && _stream->IsSilent(outputInterval, MagicNumbers::SilenceThreshold);
+        // but the inserts ring on after their input stops, so they filter the silence until they die away; cutting
+        // them off would click, as would picking up their stale state when the loop next plays
+        bool isRingingOut = isSilent && _eq.IsActive() && _eq.IsRinging(MagicNumbers::InsertTailThreshold);
+        if (isSilent && !isRingingOut)
+        {
+            _eq.ClearState();
         }
+        NOWSOUND_TRACE(TrackMixBegin, _trackId, sampleCount, isSilent);
 
         float samplesSinceLastQuantum = ((float)sinceLast.count() * Clock::Instance().SampleRateHz() / Clock::TicksPerSecond);
 
-        _requiredSamplesHistogram.Add((float)requiredSamples);
+        _requiredSamplesHistogram.Add((float)sampleCount);
         _sinceLastSampleTimingHistogram.Add(samplesSinceLastQuantum);
+        _requiredSamplesPercentiles.Record((float)sampleCount);
+        _sinceLastQuantumPercentiles.Record(samplesSinceLastQuantum);
 
-#if STATIC_AUDIO_FRAME
-        if (s_audioFrame == nullptr)
+        float* monoData = nullptr;
+        if (isRingingOut)
         {
-            // The AudioFrame.Duration property is a TimeSpan, despite the fact that this seems an inherently
-            // inaccurate way to precisely express an audio sample count.  So we just have a short frame and
-            // we fill it completely and often.
-            s_audioFrame = Windows::Media::AudioFrame(
-                (uint32_t)(MagicNumbers::AudioFrameDuration.Value()
-                    * sizeof(float)
-                    * Clock::Instance().ChannelCount()));
+            _monoOutputBuffer.resize(sampleCount);
+            monoData = _monoOutputBuffer.data();
+            std::fill(monoData, monoData + sampleCount, 0.0f);
         }
-        Windows::Media::AudioFrame audioFrame = s_audioFrame;
-#else
-        Windows::Media::AudioFrame audioFrame((uint32_t)(Clock::Instance().SampleRateHz()
-            * MagicNumbers::AudioFrameLengthSeconds.Value()
-            * sizeof(float)
-            * Clock::Instance().ChannelCount()));
-#endif
-
+        else if (!isSilent)
         {
-            // This nested scope sets the extent of the LockBuffer call below, which must close before the AddFrame call.
-            // Otherwise the AddFrame will throw E_ACCESSDENIED when it tries to take a read lock on the frame.
-            uint8_t* audioGraphInputDataInBytes{};
-            uint32_t capacityInBytes{};
-
-            // OMG KENNY KERR WINS AGAIN:
-            // https://gist.github.com/kennykerr/f1d941c2d26227abbf762481bcbd84d3
-            Windows::Media::AudioBuffer buffer(audioFrame.LockBuffer(Windows::Media::AudioBufferAccessMode::Write));
-            IMemoryBufferReference reference(buffer.CreateReference());
-            winrt::impl::com_ref<IMemoryBufferByteAccess> interop = reference.as<IMemoryBufferByteAccess>();
-            check_hresult(interop->GetBuffer(&audioGraphInputDataInBytes, &capacityInBytes));
-
-            int sampleSizeInBytes = Clock::Instance().ChannelCount() * sizeof(float);
-
-            /*
-            uint32_t requiredBytes = requiredSamples * sampleSizeInBytes;
-            uint32_t maxInputBytes = MagicNumbers::MaxInputSamples * sampleSizeInBytes;
-#undef max // never never should have been a macro
-            uint32_t bytesRemaining = std::max(requiredBytes, maxInputBytes);
-            */
-            uint32_t bytesRemaining = capacityInBytes;
-            Check((bytesRemaining % sampleSizeInBytes) == 0);
-
-            int samplesRemaining = (int)bytesRemaining / sampleSizeInBytes;
-
-            // TODO: contact Microsoft about this: why is this API taking a timespan rather than an exact sample count?
-            // And how does one ensure the timespan conversion is exactly right?
-            // For now, avoid this property altogether and tune things with the size of the audio frame;
-            // note that *creating* an audio frame takes a sample count and not a timespan duration....
-            //audioFrame.Duration(TimeSpan(samplesRemaining * Clock::TicksPerSecond / Clock::Instance().SampleRateHz()));
-
-			// Coefficients for panning the mono data into the audio buffer.
-			// Use cosine panner for volume preservation.
-			double angularPosition = _pan * Pi / 2;
-			double leftCoefficient = std::cos(angularPosition);
-			double rightCoefficient = std::sin(angularPosition);
-
-			int channelCount = Clock::Instance().ChannelCount();
-			// only stereo supported
-			// TODO: support more channels, fuller spatialization
-			Check(channelCount == 2); 
-
-			while (samplesRemaining > 0)
+            // Read all the mono data for this frame; the stream interpolates across fractional loop boundaries.
+            _monoOutputBuffer.resize(sampleCount);
+            monoData = _monoOutputBuffer.data();
+            if (_playbackMapper == nullptr)
             {
-                // get a slice up to samplesRemaining samples in length
-                Slice<AudioSample, float> slice(
-                    _audioStream.GetSliceContaining(Interval<AudioSample>(_lastSampleTime, samplesRemaining)));
-				Duration<AudioSample> sliceDuration = slice.SliceDuration();
-
-				// longest is a mono stream.
-				// Now is when we must stereo-pan it.
-				float* audioGraphInputDataInFloats = (float*)audioGraphInputDataInBytes;
-
-				// Record all this data in the frequency tracker.
-				_frequencyTracker->Record(slice.OffsetPointer(), sliceDuration.Value());
-
-				// Pan each mono sample (and track its volume).
-				for (int i = 0; i < sliceDuration.Value(); i++)
-				{
-					float value = slice.Get(i, 0);
-					_volumeHistogram.Add(std::abs(value));
-					audioGraphInputDataInFloats[i * channelCount] = (float)(leftCoefficient * value);
-					audioGraphInputDataInFloats[i * channelCount + 1] = (float)(rightCoefficient * value);
-				}
-
-                audioGraphInputDataInBytes += slice.SliceDuration().Value() * channelCount * sizeof(float);
-                _lastSampleTime = _lastSampleTime + slice.SliceDuration();
-                Check(_lastSampleTime.Value() >= 0);
-                samplesRemaining -= (int)slice.SliceDuration().Value();
+                _stream->CopyToInterpolated(outputInterval, _graph->GetInterpolator(), monoData);
             }
+            else
+            {
+                _stream->CopyToMapped(outputInterval, *_playbackMapper, _graph->GetInterpolator(), monoData);
+            }
+
+            // No need to analyze this data; the loop's spectrum and volume were precomputed when it was shut.
         }
+        // else nothing to read, interpolate, filter, or pan; silence adds nothing to the mix
 
-        sender.AddFrame(audioFrame);
+        _lastSampleTime = _lastSampleTime + Duration<AudioSample>(sampleCount);
+        Check(_lastSampleTime.Value() >= 0);
+
+        NOWSOUND_TRACE(TrackMixEnd, _trackId, sampleCount, isSilent);
+        return monoData;
     }
 
+	void NowSoundTrack::SkipForMix(int sampleCount)
+	{
+		Check(sampleCount > 0);
+
+		_lastQuantumTime = DateTime::clock::now();
+		_lastSampleTime = _lastSampleTime + Duration<AudioSample>(sampleCount);
+	}
+
+	bool NowSoundTrack::CanFreeze() const
+	{
+		return _state == NowSoundTrackState::TrackLooping
+			&& !_isMuted
+			&& !_isOverdubbing
+			&& !_eq.IsActive()
+			&& !_hasPendingEqBands
+			&& _sendLevel == 0
+			&& _volume == 1
+			&& _panAutomationTake == nullptr
+			&& _panAutomation == nullptr
+			&& _volumeAutomation == nullptr
+			&& _playbackEffect == NowSoundPlaybackEffect::PlaybackNormal;
+	}
+
+	std::unique_ptr<BufferedSliceStream<AudioSample, float>> NowSoundTrack::SnapshotLoop()
+	{
+		Check(_state == NowSoundTrackState::TrackLooping);
+
+		std::lock_guard<std::mutex> guard(_streamMutex);
+		return _stream->Snapshot();
+	}
+
+	std::unique_ptr<PlaybackMapper<AudioSample>> NowSoundTrack::SnapshotPlaybackMapper()
+	{
+		std::lock_guard<std::mutex> guard(_streamMutex);
+		return _playbackMapper == nullptr ? nullptr : _playbackMapper->Clone();
+	}
+
+	Time<AudioSample> NowSoundTrack::NextSampleTime() const { return _lastSampleTime; }
+
+	void NowSoundTrack::PanForMix(float* stereoBus, float* sendBus, int sampleCount)
+	{
+		Check((int)_monoOutputBuffer.size() >= sampleCount);
+
+		if (_rampStartPan == _rampEndPan && _rampStartVolume == 1 && _rampEndVolume == 1)
+		{
+			// the usual case, with nothing to ramp
+			AudioKernels::MixMonoToStereo(_monoOutputBuffer.data(), sampleCount, _rampEndPan, stereoBus);
+		}
+		else
+		{
+			AudioKernels::MixMonoToStereoRamped(
+				_monoOutputBuffer.data(),
+				sampleCount,
+				_rampStartPan,
+				_rampEndPan,
+				_rampStartVolume,
+				_rampEndVolume,
+				stereoBus);
+		}
+
+		float sendLevel = _sendLevel.load(std::memory_order_relaxed);
+		if (sendBus != nullptr && sendLevel > 0)
+		{
+			AudioKernels::MixScaled(_monoOutputBuffer.data(), sampleCount, sendLevel, sendBus);
+		}
+	}
+
     // Handle incoming audio data; manage the Recording -> FinishRecording and FinishRecording -> Looping state transitions.
     bool NowSoundTrack::Record(Duration<AudioSample> duration, float* data)
     {
@@ -441,8 +1018,8 @@ namespace NowSound
         case NowSoundTrackState::TrackRecording:
         {
             // How many complete beats after we record this data?
-            Time<AudioSample> durationAsTime((_audioStream.DiscreteDuration() + duration).Value());
-            Duration<Beat> completeBeats = (Duration<Beat>)((int)Clock::Instance().TimeToBeats(durationAsTime).Value());
+            Time<AudioSample> durationAsTime((_audioStream->DiscreteDuration() + duration).Value());
+            Duration<Beat> completeBeats(Clock::Instance().TimeToBeatPosition(durationAsTime).CompleteBeats);
 
             // If it's more than our _beatDuration, bump our _beatDuration
             // TODO: implement other quantization policies here
@@ -466,7 +1043,7 @@ namespace NowSound
             }
 
             // and actually record the full amount of available data
-            _audioStream.Append(duration, data);
+            _audioStream->Append(duration, data);
 			// and volume track
 			_volumeHistogram.AddAll(data, duration.Value(), true);
 			// and provide it to frequency histogram as well
@@ -483,26 +1060,36 @@ namespace NowSound
             Duration<AudioSample> roundedUpDuration((long)std::ceil(ExactDuration().Value()));
 
             // we should not have advanced beyond roundedUpDuration yet, or something went wrong at end of recording
-            Check(_audioStream.DiscreteDuration() <= roundedUpDuration);
+            Check(_audioStream->DiscreteDuration() <= roundedUpDuration);
 
-            if (_audioStream.DiscreteDuration() + duration >= roundedUpDuration)
+            if (_audioStream->DiscreteDuration() + duration >= roundedUpDuration)
             {
                 // reduce duration so we only capture the exact right number of samples
-                duration = roundedUpDuration - _audioStream.DiscreteDuration();
+                duration = roundedUpDuration - _audioStream->DiscreteDuration();
 
-                // we are done recording altogether
-                _state = NowSoundTrackState::TrackLooping;
                 continueRecording = false;
 
-                _audioStream.Append(duration, data);
+                _audioStream->Append(duration, data);
 
                 // now that we have done our final append, shut the stream at the current duration
-                _audioStream.Shut(ExactDuration());
+                _audioStream->Shut(ExactDuration());
+
+                // it is the first version of the loop, analyzed once, in the background, rather than on every
+                // pass through it
+                std::unique_ptr<NowSoundLoopAnalysis> analysis = AnalyzeLoop(_audioStream.get());
+                {
+                    std::lock_guard<std::mutex> guard(_streamMutex);
+                    _history.Commit(std::move(_audioStream), _graph->TrackHistoryMemoryCap(), std::move(analysis));
+                }
+
+                // we are done recording altogether; only now may the mixer play, or the UI thread overdub, the loop
+                _state = NowSoundTrackState::TrackLooping;
+                NOWSOUND_TRACE(TrackStateChanged, _trackId, NowSoundTrackState::TrackLooping, 0);
             }
             else
             {
                 // capture the full duration
-                _audioStream.Append(duration, data);
+                _audioStream->Append(duration, data);
             }
 
             break;
@@ -510,16 +1097,35 @@ namespace NowSound
 
         case NowSoundTrackState::TrackLooping:
         {
-            Check(false); // Should never still be recording once in looping state
-            return false;
+            // Only an overdubbing track still records once looping.
+            Check(_isOverdubbing);
+            Interval<AudioSample> overdubInterval(_overdubTime, duration);
+
+            // Copy any buffer this writes which earlier versions still share before taking the lock, so the mixer
+            // waits only for the copies to be swapped in (and for the overdub itself), never for the copying.
+            size_t index;
+            SharedBuf<float> copy;
+            while (_audioStream->CopySharedBuffer(overdubInterval, &index, &copy))
+            {
+                std::lock_guard<std::mutex> guard(_streamMutex);
+                _audioStream->ReplaceBuffer(index, std::move(copy));
+            }
+            {
+                std::lock_guard<std::mutex> guard(_streamMutex);
+                _audioStream->Overdub(overdubInterval, data);
+            }
+            _overdubTime = _overdubTime + duration;
+
+            // (and _lastSampleTime is the playback position, so must not move here)
+            NOWSOUND_TRACE(TrackRecorded, _trackId, duration.Value(), _stream->DiscreteDuration().Value());
+            return true;
         }
         }
 
         _lastSampleTime = Clock::Instance().Now();
         Check(_lastSampleTime.Value() >= 0);
 
+        NOWSOUND_TRACE(TrackRecorded, _trackId, duration.Value(), _stream->DiscreteDuration().Value());
         return continueRecording;
     }
-
-    int NowSoundTrack::s_zeroByteOutgoingFrameCount{};
 }
@@ -3,21 +3,26 @@
 
 #pragma once
 
-#include <queue>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 #include "pch.h"
 
+#include "BiquadBank.h"
 #include "Clock.h"
 #include "Histogram.h"
+#include "LatencyHistogram.h"
+#include "LoopHistory.h"
 #include "NowSoundFrequencyTracker.h"
 #include "NowSoundLibTypes.h"
+#include "NowSoundLoopAnalysis.h"
 #include "Recorder.h"
+#include "SparseSliceStream.h"
 #include "Time.h"
 
-// set to 1 to reuse a static AudioFrame; 0 will allocate a new AudioFrame in each audio quantum event handler
-#define STATIC_AUDIO_FRAME 1
-
 namespace NowSound
 {
 	// Represents a single looping track of recorded audio.
@@ -37,14 +42,6 @@ namespace NowSound
         // The collection of all ttracks.
         static std::map<TrackId, std::unique_ptr<NowSoundTrack>> s_tracks;
 
-        // How many outgoing frames had zero bytes requested?  (can not understand why this would ever happen)
-        static int s_zeroByteOutgoingFrameCount;
-
-#if STATIC_AUDIO_FRAME
-        // Audio frame, reused for copying audio.
-        static winrt::Windows::Media::AudioFrame s_audioFrame;
-#endif
-
 		// The graph that created this.
 		const NowSoundGraph* _graph;
 
@@ -54,7 +51,7 @@ namespace NowSound
         // The input the track is recording from, if recording.
         const AudioInputId _inputId;
 
-		// The frequency tracker for this track.
+		// The frequency tracker for this track; only used while recording.
 		const std::unique_ptr<NowSoundFrequencyTracker> _frequencyTracker;
 
         // The current state of the track.
@@ -66,12 +63,31 @@ namespace NowSound
         // TODO: relax this to permit non-quantized looping.
         Duration<Beat> _beatDuration;
 
-        // The node this track uses for emitting data into the audio graph.
-        // This is the output node for this Track, but the input node for the audio graph.
-        winrt::Windows::Media::Audio::AudioFrameInputNode _audioFrameInputNode;
+        // The stream being recorded, or overdubbed; null otherwise.  This is an owning reference.
+        std::unique_ptr<BufferedSliceStream<AudioSample, float>> _audioStream;
+
+        // The versions of the loop, once recorded: each an immutable stream sharing with the version before it
+        // all the buffers it did not change, kept with its own analysis (started as it is committed), so undo and
+        // redo never reanalyze.
+        LoopHistory<AudioSample, float, NowSoundLoopAnalysis> _history;
+
+        // The stream this track plays: _audioStream while it is recorded or overdubbed, else the current version
+        // in _history.  Changed (like _history) only under _streamMutex, under which the mixing thread reads
+        // it and an overdub writes it; so undo and redo are just a swap of this pointer, which the mixing thread
+        // picks up at its next quantum.
+        BufferedSliceStream<AudioSample, float>* _stream;
+
+        std::mutex _streamMutex;
+
+        // Is this track summing its input into its loop?  Changed only by the UI thread.
+        bool _isOverdubbing;
 
-        // The stream containing this Track's data; this is an owning reference.
-        BufferedSliceStream<AudioSample, float> _audioStream;
+        // The time of the next overdubbed input, in the same (latency-compensated) terms as the recording was.
+        Time<AudioSample> _overdubTime;
+
+        // How far before its arrival each sample of input was played, as this track's recording compensated for;
+        // overdubs compensate by the same amount, so they line up with the loop just as the recording did.
+        const Duration<AudioSample> _inputLatency;
 
         // Last sample time is based on the Now when the track started looping, and advances strictly
         // based on what the Track has pushed during looping; this variable should be unused except
@@ -82,22 +98,62 @@ namespace NowSound
 
         bool _isMuted;
 
-        // for debug logging; need to understand micro-behavior of the frame input node
-        std::queue<std::wstring> _debugLog;
-
-        void DebugLog(const std::wstring& entry);
-
         // histogram of required samples count
         Histogram _requiredSamplesHistogram;
 
         // histogram of time since last sample request
         Histogram _sinceLastSampleTimingHistogram;
 
-		// histogram of volume
+        // percentiles of the two above, over the whole life of the track (or since timing was reset)
+        LatencyHistogram _requiredSamplesPercentiles;
+        LatencyHistogram _sinceLastQuantumPercentiles;
+
+		// histogram of volume; only used while recording
 		Histogram _volumeHistogram;
 
-		// current pan value; 0 = left, 0.5 = center, 1 = right
-		float _pan;
+		// current pan value; 0 = left, 0.5 = center, 1 = right.  Set by the UI thread, read by the mixing thread.
+		std::atomic<float> _pan;
+
+		// current volume, as a linear gain; 1 = unchanged.  Set by the UI thread, read by the mixing thread.
+		std::atomic<float> _volume;
+
+		// How much of this track is sent to the mixer's send bus (and thence to the reverb); 0 = none.
+		// Set by the UI thread, read by the mixing thread.
+		std::atomic<float> _sendLevel;
+
+		// The pan and volume automation being recorded, if any; each change of pan or volume is appended at the
+		// track's playback position when it is made.  UI thread only.
+		std::unique_ptr<SparseSliceStream<AudioSample, float>> _panAutomationTake;
+		std::unique_ptr<SparseSliceStream<AudioSample, float>> _volumeAutomationTake;
+
+		// The pan and volume automation played back in place of _pan and _volume, if any.  Shut, so never changed;
+		// swapped only under _streamMutex, under which the mixing thread reads them.
+		std::shared_ptr<const SparseSliceStream<AudioSample, float>> _panAutomation;
+		std::shared_ptr<const SparseSliceStream<AudioSample, float>> _volumeAutomation;
+
+		// The mixing thread's cursors into the automation, and the pan and volume it ramps between over the current
+		// quantum: those at the end of the quantum before, and those at the end of this one.
+		int _panAutomationCursor;
+		int _volumeAutomationCursor;
+		float _rampStartPan;
+		float _rampEndPan;
+		float _rampStartVolume;
+		float _rampEndVolume;
+
+		// The playback effect set by the UI thread, and the mapper which the mixing thread reads the loop through for
+		// it (null for PlaybackNormal); swapped only under _streamMutex.
+		NowSoundPlaybackEffect _playbackEffect;
+		std::unique_ptr<PlaybackMapper<AudioSample>> _playbackMapper;
+
+		// Temporary buffer for the mono audio of one outgoing frame, reused across calls to MixInto.
+		std::vector<float> _monoOutputBuffer;
+
+		// The insert effects chain, processed by the mixer between ReadForMix and PanForMix; for now, just the EQ.
+		// Only the mixing thread touches _eq; the UI thread sets _pendingEqBands, which UpdateInserts picks up.
+		BiquadCascade _eq;
+		BiquadCoefficients _pendingEqBands[BiquadCascade::StageCount];
+		std::atomic<bool> _hasPendingEqBands;
+		std::mutex _pendingEqBandsMutex;
 
     public:
 		NowSoundTrack(
@@ -107,6 +163,21 @@ namespace NowSound
 			const BufferedSliceStream<AudioSample, float>& sourceStream,
 			float initialPan);
 
+		// Construct a track owning the given stream, of the given duration in beats, whose input was compensated for
+		// the given latency (see _inputLatency).  If the stream is already shut, the track starts out looping rather
+		// than recording.
+		NowSoundTrack(
+			NowSoundGraph* graph,
+			TrackId trackId,
+			AudioInputId inputId,
+			BufferedSliceStream<AudioSample, float>&& audioStream,
+			Duration<Beat> beatDuration,
+			Duration<AudioSample> inputLatency,
+			float initialPan);
+
+        // This track's ID.
+        TrackId Id() const;
+
         // In what state is this track?
         NowSoundTrackState State() const;
 
@@ -127,10 +198,19 @@ namespace NowSound
         // The starting moment at which this Track was created.
         Time<AudioSample> StartTime() const;
 
+        // The sample position within the loop that is playing right now.
+        int64_t LoopPositionNow() const;
+
         // The full time info for this track (to allow just one call per track for all this info).
 		// Note that this is not const because it may recalculate histograms etc. when called.
         NowSoundTrackInfo Info();
 
+        // Percentiles of the time (in samples) between this track's quanta; the mixer merges these across tracks.
+        const LatencyHistogram& SinceLastQuantumPercentiles() const;
+
+        // Forget the timing percentiles recorded so far.
+        void ResetTimingInfo();
+
         // The user wishes the track to finish recording now.
         // Contractually requires State == NowSoundTrack_State::Recording.
         void FinishRecording();
@@ -145,19 +225,125 @@ namespace NowSound
         bool IsMuted() const;
         void SetIsMuted(bool isMuted);
 
-		// Get and set the pan value for this track.
+		// Get and set the pan value for this track.  While automation is played back, it overrides this.
 		float Pan();
 		void Pan(float pan);
 
+		// Get and set the volume of this track, as a linear gain applied after its inserts; its send is taken
+		// before it.  While automation is played back, it overrides this.
+		float Volume() const;
+		void SetVolume(float volume);
+
+		// Start recording pan and volume automation: drop any automation played back so far, and from now, record
+		// each change of pan or volume at the time it is made, for (at most) one pass round the loop.
+		// Contractually requires State == NowSoundTrack_State::Looping.
+		void StartAutomationRecording();
+
+		// Stop recording automation (if recording), and play back what was recorded, looping with the track.
+		void StopAutomationRecording();
+
+		// Is this track recording automation?
+		bool IsRecordingAutomation() const;
+
+		// Drop any automation (stopping any recording first); the pan and volume hold where the automation left them.
+		void ClearAutomation();
+
+		// The automation played back, for an offline mixdown; either may be null.
+		void GetAutomation(
+			std::shared_ptr<const SparseSliceStream<AudioSample, float>>* panAutomation,
+			std::shared_ptr<const SparseSliceStream<AudioSample, float>>* volumeAutomation);
+
+		// Get and set the playback effect, which takes over from whatever is playing now; stutterBeats is the length
+		// of the window PlaybackStutter repeats (ignored by the other effects).  Switching costs no copying of the
+		// loop, so may be done as often as the user likes.
+		// Contractually requires State == NowSoundTrack_State::Looping, for any effect but PlaybackNormal.
+		NowSoundPlaybackEffect PlaybackEffect() const;
+		void SetPlaybackEffect(NowSoundPlaybackEffect effect, float stutterBeats);
+
+		// Get and set the send level for this track.
+		float SendLevel() const;
+		void SetSendLevel(float sendLevel);
+
+		// Set one band of the EQ; called from the UI thread.
+		void SetEqBand(int band, NowSoundEqBandType type, float frequencyHz, float gainDb, float q);
+
+		// Copy the EQ's StageCount bands into the given array, including any change not yet picked up by the mixer;
+		// any thread.
+		void GetEqBands(BiquadCoefficients* bands);
+
+		// Start summing this track's input into a new version of its loop, as it plays, unless the memory budget
+		// could not hold a copy of the whole loop.  Contractually requires State == NowSoundTrack_State::Looping.
+		void StartOverdub();
+
+		// Stop overdubbing (if overdubbing), adding the overdubbed loop to the history, and re-analyze the loop.
+		void StopOverdub();
+
+		// Is this track overdubbing?
+		bool IsOverdubbing() const;
+
+		// Go back to the previous version of the loop, or forward to the next (stopping any overdub first);
+		// false if there is none.
+		bool Undo();
+		bool Redo();
+
         // Delete this Track; after this, all methods become invalid to call (contract failure).
         void Delete();
 
-        // The quantum has started; consume input audio for this recording.
-        void FrameInputNode_QuantumStarted(
-            winrt::Windows::Media::Audio::AudioFrameInputNode sender,
-            winrt::Windows::Media::Audio::FrameInputNodeQuantumStartedEventArgs args);
+        // Mix this track's next sampleCount samples, panned, into the given interleaved stereo bus, and at its send
+        // level into the given mono send bus (if not null).
+        // Called by the mixer once per quantum, on whichever of its workers takes this track, if the track has
+        // no active inserts.
+        void MixInto(float* stereoBus, float* sendBus, int sampleCount);
+
+        // Pick up any insert changes made since the last quantum; called by the mixer before mixing.  Never blocks:
+        // if the UI thread is in the middle of a change, it is picked up next quantum instead.
+        void UpdateInserts();
+
+        // Is any insert effect active (so that the mixer must process the inserts, rather than call MixInto)?
+        bool HasActiveInserts() const;
 
-        // Record from (that is, copy from) the source data.
+        // The EQ, for the mixer to process (together with other tracks' EQs) between ReadForMix and PanForMix.
+        BiquadCascade* Eq();
+
+        // The first half of MixInto: read this track's next sampleCount samples of mono audio, and return them,
+        // or nullptr if there is nothing to mix (the track is muted, not looping, or silent, with no inserts still
+        // ringing).
+        float* ReadForMix(int sampleCount);
+
+        // The second half of MixInto: pan the audio last returned by ReadForMix into the given stereo bus, and send
+        // it to the given send bus (if not null).
+        void PanForMix(float* stereoBus, float* sendBus, int sampleCount);
+
+        // Instead of ReadForMix and PanForMix: advance past the next sampleCount samples without mixing them, since
+        // the mixer is playing this track's frozen group in its place.
+        void SkipForMix(int sampleCount);
+
+        // Could this track be frozen: is it looping, unmuted, and not overdubbing, with no inserts, send, volume,
+        // automation or playback effect?  Only such tracks sound the same every time round their loop.  Call only
+        // under the mixer's lock.
+        bool CanFreeze() const;
+
+        // A snapshot of the loop as it plays now, sharing all its buffers.  Contractually requires State ==
+        // NowSoundTrack_State::Looping.
+        std::unique_ptr<BufferedSliceStream<AudioSample, float>> SnapshotLoop();
+
+        // A copy of the playback effect's mapper, for reading the snapshot as the loop is read; null if none.
+        std::unique_ptr<PlaybackMapper<AudioSample>> SnapshotPlaybackMapper();
+
+        // The time in the loop of the next sample the mixer will read.  Call only under the mixer's lock.
+        Time<AudioSample> NextSampleTime() const;
+
+        // Record from (that is, copy from) the source data; once looping, overdub it.
         virtual bool Record(Duration<AudioSample> duration, float* source);
+
+    private:
+        // Start analyzing the given (shut) version of the loop, in the background; commit the result with it.
+        std::unique_ptr<NowSoundLoopAnalysis> AnalyzeLoop(const BufferedSliceStream<AudioSample, float>* version) const;
+
+        // The analysis of the current version, if it has finished; else null.  Only once looping.
+        const NowSoundLoopAnalysis* CompletedLoopAnalysis() const;
+
+        // Stop playing back automation, leaving the pan and volume where it left them; UI thread only.
+        void DropAutomation();
     };
 }
\ No newline at end of file
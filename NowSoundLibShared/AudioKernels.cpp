@@ -0,0 +1,206 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "AudioKernels.h"
+#include "Check.h"
+#include "Simd.h"
+
+using namespace NowSound;
+
+namespace
+{
+    // The samples Deinterleave takes through every group of four channels at a time; a multiple of four.  Even at
+    // 32 channels, that is only 8KB of source, well within any L1 cache.
+    const int DeinterleaveBlockSize = 64;
+}
+
+void AudioKernels::PanCoefficients(float pan, float* leftCoefficient, float* rightCoefficient)
+{
+    const double Pi = std::atan(1) * 4;
+    double angularPosition = pan * Pi / 2;
+    *leftCoefficient = (float)std::cos(angularPosition);
+    *rightCoefficient = (float)std::sin(angularPosition);
+}
+
+void AudioKernels::PanMonoToStereo(const float* source, int count, float pan, float* destination)
+{
+    float left, right;
+    PanCoefficients(pan, &left, &right);
+    for (int i = 0; i < count; i++)
+    {
+        destination[i * 2] = left * source[i];
+        destination[i * 2 + 1] = right * source[i];
+    }
+}
+
+void AudioKernels::MixMonoToStereo(const float* source, int count, float pan, float* destination)
+{
+    float left, right;
+    PanCoefficients(pan, &left, &right);
+    for (int i = 0; i < count; i++)
+    {
+        destination[i * 2] += left * source[i];
+        destination[i * 2 + 1] += right * source[i];
+    }
+}
+
+void AudioKernels::MixMonoToStereoRamped(
+    const float* source,
+    int count,
+    float startPan,
+    float endPan,
+    float startGain,
+    float endGain,
+    float* destination)
+{
+    float startLeft, startRight, endLeft, endRight;
+    PanCoefficients(startPan, &startLeft, &startRight);
+    PanCoefficients(endPan, &endLeft, &endRight);
+    startLeft *= startGain;
+    startRight *= startGain;
+    float leftStep = (endLeft * endGain - startLeft) / count;
+    float rightStep = (endRight * endGain - startRight) / count;
+    for (int i = 0; i < count; i++)
+    {
+        destination[i * 2] += (startLeft + leftStep * i) * source[i];
+        destination[i * 2 + 1] += (startRight + rightStep * i) * source[i];
+    }
+}
+
+void AudioKernels::MixScaled(const float* source, int count, float gain, float* destination)
+{
+    for (int i = 0; i < count; i++)
+    {
+        destination[i] += gain * source[i];
+    }
+}
+
+void AudioKernels::TreeSum(float* const* buses, int busCount, int offset, int count, float* destination)
+{
+    Check(busCount > 0);
+
+    // at each level, fold each bus into its neighbor stride away, until all are folded into the first
+    for (int stride = 1; stride < busCount; stride *= 2)
+    {
+        for (int bus = 0; bus + stride < busCount; bus += stride * 2)
+        {
+            float* target = buses[bus] + offset;
+            const float* source = buses[bus + stride] + offset;
+            for (int i = 0; i < count; i++)
+            {
+                target[i] += source[i];
+            }
+        }
+    }
+
+    std::copy(buses[0] + offset, buses[0] + offset + count, destination + offset);
+}
+
+void AudioKernels::DeinterleaveScalar(
+    const float* source,
+    int channelCount,
+    int start,
+    int count,
+    float* const* channelDestinations,
+    float* channelAbsoluteSums)
+{
+    for (int i = start; i < count; i++)
+    {
+        const float* sample = source + i * channelCount;
+        for (int channel = 0; channel < channelCount; channel++)
+        {
+            float value = sample[channel];
+            channelDestinations[channel][i] = value;
+            channelAbsoluteSums[channel] += std::abs(value);
+        }
+    }
+}
+
+void AudioKernels::Deinterleave(
+    const float* source,
+    int channelCount,
+    int count,
+    float* const* channelDestinations,
+    float* channelAbsoluteSums)
+{
+    int start = 0;
+
+#if NOWSOUND_SSE
+    // Clearing the sign bit gives the absolute value of four floats at once.
+    const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+    int vectorCount = count & ~3;
+
+    if (channelCount == 2)
+    {
+        __m128 leftSum = _mm_setzero_ps();
+        __m128 rightSum = _mm_setzero_ps();
+        float* left = channelDestinations[0];
+        float* right = channelDestinations[1];
+        for (int i = 0; i < vectorCount; i += 4)
+        {
+            // [L0 R0 L1 R1], [L2 R2 L3 R3] -> [L0 L1 L2 L3], [R0 R1 R2 R3]
+            __m128 first = _mm_loadu_ps(source + i * 2);
+            __m128 second = _mm_loadu_ps(source + i * 2 + 4);
+            __m128 leftValues = _mm_shuffle_ps(first, second, _MM_SHUFFLE(2, 0, 2, 0));
+            __m128 rightValues = _mm_shuffle_ps(first, second, _MM_SHUFFLE(3, 1, 3, 1));
+            _mm_storeu_ps(left + i, leftValues);
+            _mm_storeu_ps(right + i, rightValues);
+            leftSum = _mm_add_ps(leftSum, _mm_and_ps(leftValues, absMask));
+            rightSum = _mm_add_ps(rightSum, _mm_and_ps(rightValues, absMask));
+        }
+
+        float sums[4];
+        _mm_storeu_ps(sums, leftSum);
+        channelAbsoluteSums[0] += sums[0] + sums[1] + sums[2] + sums[3];
+        _mm_storeu_ps(sums, rightSum);
+        channelAbsoluteSums[1] += sums[0] + sums[1] + sums[2] + sums[3];
+        start = vectorCount;
+    }
+    else if ((channelCount & 3) == 0)
+    {
+        // Transpose each group of four channels over four samples at a time.  A block of samples at a time, every
+        // group in turn, so the block is read from memory once and then stays in cache for the groups after the
+        // first; taking each group over all the samples would read the whole source once per group.
+        for (int blockStart = 0; blockStart < vectorCount; blockStart += DeinterleaveBlockSize)
+        {
+            int blockEnd = (std::min)(blockStart + DeinterleaveBlockSize, vectorCount);
+            for (int group = 0; group < channelCount; group += 4)
+            {
+                __m128 groupSums[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+                for (int i = blockStart; i < blockEnd; i += 4)
+                {
+                    const float* sample = source + i * channelCount + group;
+                    __m128 row0 = _mm_loadu_ps(sample);
+                    __m128 row1 = _mm_loadu_ps(sample + channelCount);
+                    __m128 row2 = _mm_loadu_ps(sample + channelCount * 2);
+                    __m128 row3 = _mm_loadu_ps(sample + channelCount * 3);
+                    _MM_TRANSPOSE4_PS(row0, row1, row2, row3);
+
+                    __m128 rows[4] = { row0, row1, row2, row3 };
+                    for (int j = 0; j < 4; j++)
+                    {
+                        _mm_storeu_ps(channelDestinations[group + j] + i, rows[j]);
+                        groupSums[j] = _mm_add_ps(groupSums[j], _mm_and_ps(rows[j], absMask));
+                    }
+                }
+
+                for (int j = 0; j < 4; j++)
+                {
+                    float sums[4];
+                    _mm_storeu_ps(sums, groupSums[j]);
+                    channelAbsoluteSums[group + j] += sums[0] + sums[1] + sums[2] + sums[3];
+                }
+            }
+        }
+        start = vectorCount;
+    }
+#endif
+
+    // The remainder (or everything, on platforms or channel counts without a SIMD path).
+    DeinterleaveScalar(source, channelCount, start, count, channelDestinations, channelAbsoluteSums);
+}
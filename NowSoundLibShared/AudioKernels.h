@@ -0,0 +1,67 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+namespace NowSound
+{
+    // The per-sample inner loops of audio processing, collected in one place so they can be shared
+    // (and optimized) without each caller reimplementing them.
+    // None of these allocate; all are safe to call from the audio thread.
+    class AudioKernels
+    {
+    public:
+        // Compute cosine-law panning coefficients for the given pan value (0 = left, 0.5 = center, 1 = right).
+        // The squares of the coefficients always sum to 1, so perceived volume is preserved across the stereo field.
+        static void PanCoefficients(float pan, float* leftCoefficient, float* rightCoefficient);
+
+        // Pan count mono samples into interleaved stereo, overwriting the destination.
+        static void PanMonoToStereo(const float* source, int count, float pan, float* destination);
+
+        // Pan count mono samples into interleaved stereo, adding to the existing contents of the destination.
+        static void MixMonoToStereo(const float* source, int count, float pan, float* destination);
+
+        // Pan count mono samples into interleaved stereo, adding to the existing contents of the destination, while
+        // ramping from startPan and startGain (at the first sample) to endPan and endGain (just after the last), so
+        // that a parameter changing once per quantum never steps.  The pan coefficients themselves are ramped
+        // linearly, which stays within a fraction of a decibel of the cosine law over a quantum's pan move.
+        static void MixMonoToStereoRamped(
+            const float* source,
+            int count,
+            float startPan,
+            float endPan,
+            float startGain,
+            float endGain,
+            float* destination);
+
+        // Add count samples, scaled by gain, to the existing contents of the destination.
+        static void MixScaled(const float* source, int count, float gain, float* destination);
+
+        // Sum the values [offset, offset + count) of busCount buses into the same range of destination, adding the
+        // buses pairwise in a tree (so rounding error grows with the log of busCount rather than with busCount).
+        // The buses are used as scratch space: their values in that range are overwritten.
+        static void TreeSum(float* const* buses, int busCount, int offset, int count, float* destination);
+
+        // Deinterleave count samples of channelCount-channel audio into one mono buffer per channel, in a single pass,
+        // also adding the sum of each channel's absolute sample values to channelAbsoluteSums[channel].
+        // Stereo, and any multiple of four channels, use SIMD where available.
+        static void Deinterleave(
+            const float* source,
+            int channelCount,
+            int count,
+            float* const* channelDestinations,
+            float* channelAbsoluteSums);
+
+    private:
+        // Portable implementation of Deinterleave, for the samples [start, count).
+        static void DeinterleaveScalar(
+            const float* source,
+            int channelCount,
+            int start,
+            int count,
+            float* const* channelDestinations,
+            float* channelAbsoluteSums);
+    };
+}
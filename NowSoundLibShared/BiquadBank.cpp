@@ -0,0 +1,350 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <cmath>
+
+#include "BiquadBank.h"
+#include "Check.h"
+#include "Simd.h"
+
+using namespace NowSound;
+
+namespace
+{
+    // The number of coefficients in a BiquadCoefficients.
+    const int CoefficientCount = 5;
+
+    // The intermediate values of the cookbook formulas.
+    struct CookbookTerms
+    {
+        double Cos;
+        double Alpha;
+        // sqrt of the linear gain
+        double A;
+    };
+
+    CookbookTerms Terms(float sampleRateHz, float frequencyHz, float q, float gainDb)
+    {
+        Check(sampleRateHz > 0);
+        Check(frequencyHz > 0 && frequencyHz < sampleRateHz / 2);
+        Check(q > 0);
+
+        const double Pi = std::atan(1) * 4;
+        double w0 = 2 * Pi * frequencyHz / sampleRateHz;
+        CookbookTerms terms;
+        terms.Cos = std::cos(w0);
+        terms.Alpha = std::sin(w0) / (2 * q);
+        terms.A = std::pow(10.0, gainDb / 40.0);
+        return terms;
+    }
+
+    BiquadCoefficients Normalize(double b0, double b1, double b2, double a0, double a1, double a2)
+    {
+        BiquadCoefficients coefficients;
+        coefficients.B0 = (float)(b0 / a0);
+        coefficients.B1 = (float)(b1 / a0);
+        coefficients.B2 = (float)(b2 / a0);
+        coefficients.A1 = (float)(a1 / a0);
+        coefficients.A2 = (float)(a2 / a0);
+        return coefficients;
+    }
+
+    void ToArray(const BiquadCoefficients& coefficients, float* values)
+    {
+        values[0] = coefficients.B0;
+        values[1] = coefficients.B1;
+        values[2] = coefficients.B2;
+        values[3] = coefficients.A1;
+        values[4] = coefficients.A2;
+    }
+
+    // Run one stage over all the lanes' samples (interleaved by lane), in transposed direct form II, stepping the
+    // coefficients by step after each sample.  coefficients, step and the state are [index][lane].
+    void ProcessStage(
+        float* lanes,
+        int sampleCount,
+        float (&coefficients)[CoefficientCount][BiquadBank::LaneCount],
+        const float (&step)[CoefficientCount][BiquadBank::LaneCount],
+        float* z1,
+        float* z2)
+    {
+#if NOWSOUND_SSE
+        static_assert(BiquadBank::LaneCount == 4, "one lane per SSE float");
+        __m128 b0 = _mm_loadu_ps(coefficients[0]);
+        __m128 b1 = _mm_loadu_ps(coefficients[1]);
+        __m128 b2 = _mm_loadu_ps(coefficients[2]);
+        __m128 a1 = _mm_loadu_ps(coefficients[3]);
+        __m128 a2 = _mm_loadu_ps(coefficients[4]);
+        __m128 b0Step = _mm_loadu_ps(step[0]);
+        __m128 b1Step = _mm_loadu_ps(step[1]);
+        __m128 b2Step = _mm_loadu_ps(step[2]);
+        __m128 a1Step = _mm_loadu_ps(step[3]);
+        __m128 a2Step = _mm_loadu_ps(step[4]);
+        __m128 s1 = _mm_loadu_ps(z1);
+        __m128 s2 = _mm_loadu_ps(z2);
+
+        for (int i = 0; i < sampleCount; i++)
+        {
+            float* sample = lanes + i * BiquadBank::LaneCount;
+            __m128 x = _mm_loadu_ps(sample);
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), s1);
+            s1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), s2);
+            s2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            _mm_storeu_ps(sample, y);
+
+            b0 = _mm_add_ps(b0, b0Step);
+            b1 = _mm_add_ps(b1, b1Step);
+            b2 = _mm_add_ps(b2, b2Step);
+            a1 = _mm_add_ps(a1, a1Step);
+            a2 = _mm_add_ps(a2, a2Step);
+        }
+
+        _mm_storeu_ps(z1, s1);
+        _mm_storeu_ps(z2, s2);
+#else
+        for (int lane = 0; lane < BiquadBank::LaneCount; lane++)
+        {
+            float b0 = coefficients[0][lane], b1 = coefficients[1][lane], b2 = coefficients[2][lane];
+            float a1 = coefficients[3][lane], a2 = coefficients[4][lane];
+            float s1 = z1[lane], s2 = z2[lane];
+            for (int i = 0; i < sampleCount; i++)
+            {
+                float& sample = lanes[i * BiquadBank::LaneCount + lane];
+                float x = sample;
+                float y = b0 * x + s1;
+                s1 = b1 * x - a1 * y + s2;
+                s2 = b2 * x - a2 * y;
+                sample = y;
+
+                b0 += step[0][lane];
+                b1 += step[1][lane];
+                b2 += step[2][lane];
+                a1 += step[3][lane];
+                a2 += step[4][lane];
+            }
+            z1[lane] = s1;
+            z2[lane] = s2;
+        }
+#endif
+    }
+}
+
+BiquadCoefficients BiquadCoefficients::Identity()
+{
+    return BiquadCoefficients{ 1, 0, 0, 0, 0 };
+}
+
+BiquadCoefficients BiquadCoefficients::Peaking(float sampleRateHz, float frequencyHz, float q, float gainDb)
+{
+    CookbookTerms t = Terms(sampleRateHz, frequencyHz, q, gainDb);
+    return Normalize(
+        1 + t.Alpha * t.A,
+        -2 * t.Cos,
+        1 - t.Alpha * t.A,
+        1 + t.Alpha / t.A,
+        -2 * t.Cos,
+        1 - t.Alpha / t.A);
+}
+
+BiquadCoefficients BiquadCoefficients::LowShelf(float sampleRateHz, float frequencyHz, float q, float gainDb)
+{
+    CookbookTerms t = Terms(sampleRateHz, frequencyHz, q, gainDb);
+    double twoRootAAlpha = 2 * std::sqrt(t.A) * t.Alpha;
+    return Normalize(
+        t.A * ((t.A + 1) - (t.A - 1) * t.Cos + twoRootAAlpha),
+        2 * t.A * ((t.A - 1) - (t.A + 1) * t.Cos),
+        t.A * ((t.A + 1) - (t.A - 1) * t.Cos - twoRootAAlpha),
+        (t.A + 1) + (t.A - 1) * t.Cos + twoRootAAlpha,
+        -2 * ((t.A - 1) + (t.A + 1) * t.Cos),
+        (t.A + 1) + (t.A - 1) * t.Cos - twoRootAAlpha);
+}
+
+BiquadCoefficients BiquadCoefficients::HighShelf(float sampleRateHz, float frequencyHz, float q, float gainDb)
+{
+    CookbookTerms t = Terms(sampleRateHz, frequencyHz, q, gainDb);
+    double twoRootAAlpha = 2 * std::sqrt(t.A) * t.Alpha;
+    return Normalize(
+        t.A * ((t.A + 1) + (t.A - 1) * t.Cos + twoRootAAlpha),
+        -2 * t.A * ((t.A - 1) + (t.A + 1) * t.Cos),
+        t.A * ((t.A + 1) + (t.A - 1) * t.Cos - twoRootAAlpha),
+        (t.A + 1) - (t.A - 1) * t.Cos + twoRootAAlpha,
+        2 * ((t.A - 1) - (t.A + 1) * t.Cos),
+        (t.A + 1) - (t.A - 1) * t.Cos - twoRootAAlpha);
+}
+
+BiquadCoefficients BiquadCoefficients::LowPass(float sampleRateHz, float frequencyHz, float q)
+{
+    CookbookTerms t = Terms(sampleRateHz, frequencyHz, q, 0);
+    return Normalize(
+        (1 - t.Cos) / 2,
+        1 - t.Cos,
+        (1 - t.Cos) / 2,
+        1 + t.Alpha,
+        -2 * t.Cos,
+        1 - t.Alpha);
+}
+
+BiquadCoefficients BiquadCoefficients::HighPass(float sampleRateHz, float frequencyHz, float q)
+{
+    CookbookTerms t = Terms(sampleRateHz, frequencyHz, q, 0);
+    return Normalize(
+        (1 + t.Cos) / 2,
+        -(1 + t.Cos),
+        (1 + t.Cos) / 2,
+        1 + t.Alpha,
+        -2 * t.Cos,
+        1 - t.Alpha);
+}
+
+bool BiquadCoefficients::IsIdentity() const
+{
+    return *this == Identity();
+}
+
+bool BiquadCoefficients::operator==(const BiquadCoefficients& other) const
+{
+    return B0 == other.B0 && B1 == other.B1 && B2 == other.B2 && A1 == other.A1 && A2 == other.A2;
+}
+
+BiquadCascade::BiquadCascade()
+{
+    for (int stage = 0; stage < StageCount; stage++)
+    {
+        _current[stage] = BiquadCoefficients::Identity();
+        _target[stage] = BiquadCoefficients::Identity();
+        _z1[stage] = 0;
+        _z2[stage] = 0;
+    }
+}
+
+void BiquadCascade::SetStage(int stage, const BiquadCoefficients& coefficients)
+{
+    Check(stage >= 0 && stage < StageCount);
+    _target[stage] = coefficients;
+}
+
+const BiquadCoefficients& BiquadCascade::Stage(int stage) const
+{
+    Check(stage >= 0 && stage < StageCount);
+    return _target[stage];
+}
+
+bool BiquadCascade::IsStageActive(int stage) const
+{
+    return !_current[stage].IsIdentity() || !_target[stage].IsIdentity();
+}
+
+bool BiquadCascade::IsActive() const
+{
+    for (int stage = 0; stage < StageCount; stage++)
+    {
+        if (IsStageActive(stage))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BiquadCascade::IsRinging(float threshold) const
+{
+    for (int stage = 0; stage < StageCount; stage++)
+    {
+        if (std::abs(_z1[stage]) > threshold || std::abs(_z2[stage]) > threshold)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BiquadCascade::ClearState()
+{
+    for (int stage = 0; stage < StageCount; stage++)
+    {
+        _z1[stage] = 0;
+        _z2[stage] = 0;
+    }
+}
+
+BiquadBank::BiquadBank() : _lanes{}
+{
+}
+
+void BiquadBank::Process(BiquadCascade* const* cascades, float* const* buffers, int laneCount, int sampleCount)
+{
+    Check(laneCount >= 1 && laneCount <= LaneCount);
+    Check(sampleCount > 0);
+
+    size_t length = (size_t)sampleCount * LaneCount;
+    if (_lanes.size() < length)
+    {
+        // only ever grows, so this allocates only in the first blocks
+        _lanes.resize(length);
+    }
+    float* lanes = _lanes.data();
+
+    // Interleave the buffers into the lanes; any unused lanes filter silence through the identity.
+    for (int i = 0; i < sampleCount; i++)
+    {
+        for (int lane = 0; lane < LaneCount; lane++)
+        {
+            lanes[i * LaneCount + lane] = lane < laneCount ? buffers[lane][i] : 0;
+        }
+    }
+
+    float inverseSampleCount = 1.0f / sampleCount;
+    for (int stage = 0; stage < BiquadCascade::StageCount; stage++)
+    {
+        bool isAnyLaneActive = false;
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            isAnyLaneActive |= cascades[lane]->IsStageActive(stage);
+        }
+        if (!isAnyLaneActive)
+        {
+            continue;
+        }
+
+        float coefficients[CoefficientCount][LaneCount];
+        float step[CoefficientCount][LaneCount];
+        float z1[LaneCount];
+        float z2[LaneCount];
+        for (int lane = 0; lane < LaneCount; lane++)
+        {
+            float current[CoefficientCount];
+            float target[CoefficientCount];
+            ToArray(lane < laneCount ? cascades[lane]->_current[stage] : BiquadCoefficients::Identity(), current);
+            ToArray(lane < laneCount ? cascades[lane]->_target[stage] : BiquadCoefficients::Identity(), target);
+            for (int k = 0; k < CoefficientCount; k++)
+            {
+                coefficients[k][lane] = current[k];
+                step[k][lane] = (target[k] - current[k]) * inverseSampleCount;
+            }
+            z1[lane] = lane < laneCount ? cascades[lane]->_z1[stage] : 0;
+            z2[lane] = lane < laneCount ? cascades[lane]->_z2[stage] : 0;
+        }
+
+        ProcessStage(lanes, sampleCount, coefficients, step, z1, z2);
+
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            BiquadCascade* cascade = cascades[lane];
+            cascade->_current[stage] = cascade->_target[stage];
+            // A stage which has glided to the identity is now inactive; it starts again from silence if reactivated.
+            bool isNowInactive = cascade->_current[stage].IsIdentity();
+            cascade->_z1[stage] = isNowInactive ? 0 : z1[lane];
+            cascade->_z2[stage] = isNowInactive ? 0 : z2[lane];
+        }
+    }
+
+    for (int i = 0; i < sampleCount; i++)
+    {
+        for (int lane = 0; lane < laneCount; lane++)
+        {
+            buffers[lane][i] = lanes[i * LaneCount + lane];
+        }
+    }
+}
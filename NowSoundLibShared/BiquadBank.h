@@ -0,0 +1,100 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <vector>
+
+namespace NowSound
+{
+    // The coefficients of one biquad (two-pole, two-zero) filter, normalized so that a0 == 1.
+    struct BiquadCoefficients
+    {
+        float B0;
+        float B1;
+        float B2;
+        float A1;
+        float A2;
+
+        // The filter which passes its input through unchanged.
+        static BiquadCoefficients Identity();
+
+        // The usual EQ shapes, from Robert Bristow-Johnson's Audio EQ Cookbook.  Frequencies are in Hz and must be
+        // below half the sample rate; q > 0.  (The gain of the pass filters is ignored.)
+        static BiquadCoefficients Peaking(float sampleRateHz, float frequencyHz, float q, float gainDb);
+        static BiquadCoefficients LowShelf(float sampleRateHz, float frequencyHz, float q, float gainDb);
+        static BiquadCoefficients HighShelf(float sampleRateHz, float frequencyHz, float q, float gainDb);
+        static BiquadCoefficients LowPass(float sampleRateHz, float frequencyHz, float q);
+        static BiquadCoefficients HighPass(float sampleRateHz, float frequencyHz, float q);
+
+        bool IsIdentity() const;
+
+        bool operator==(const BiquadCoefficients& other) const;
+    };
+
+    // The state of one channel's cascade of biquad stages (e.g. one track's EQ bands): each stage's current and
+    // target coefficients, and its filter memory.  Only BiquadBank processes audio through it.
+    //
+    // A stage whose coefficients are, and are headed for, the identity is inactive, and costs nothing; a cascade
+    // with no active stages need not be processed at all.
+    class BiquadCascade
+    {
+    public:
+        static const int StageCount = 4;
+
+    private:
+        friend class BiquadBank;
+
+        BiquadCoefficients _current[StageCount];
+        BiquadCoefficients _target[StageCount];
+
+        // Transposed direct form II state of each stage.
+        float _z1[StageCount];
+        float _z2[StageCount];
+
+    public:
+        // All stages inactive.
+        BiquadCascade();
+
+        // Set the coefficients the given stage should have; they glide there over the next block processed, so
+        // changing them never clicks.  Set the identity to bypass the stage.
+        void SetStage(int stage, const BiquadCoefficients& coefficients);
+
+        const BiquadCoefficients& Stage(int stage) const;
+
+        bool IsStageActive(int stage) const;
+
+        // Is any stage active?
+        bool IsActive() const;
+
+        // Is any stage's filter memory above threshold, so that it would still output something given silence?
+        bool IsRinging(float threshold) const;
+
+        // Forget the filter memory, as if the cascade had only ever been given silence.
+        void ClearState();
+    };
+
+    // Filters up to LaneCount channels at once, each through its own BiquadCascade, with the channels in the lanes
+    // of SIMD vectors (where available): running four channels' filters costs hardly more than running one's.
+    //
+    // Owns only scratch space; keep one per thread, so that it never allocates after the first few blocks.
+    class BiquadBank
+    {
+    public:
+        static const int LaneCount = 4;
+
+    private:
+        // The channels being processed, interleaved by lane: sample i of lane j is at [i * LaneCount + j].
+        std::vector<float> _lanes;
+
+    public:
+        BiquadBank();
+
+        // Filter each of the laneCount (1 to LaneCount) buffers of sampleCount samples in place, through the
+        // corresponding cascade.  Each active stage's coefficients glide linearly from current to target across
+        // the block (so that parameter changes are smoothed across one quantum), then become current.
+        void Process(BiquadCascade* const* cascades, float* const* buffers, int laneCount, int sampleCount);
+    };
+}
@@ -6,14 +6,32 @@
 
 #include "pch.h"
 
+#include "Check.h"
+
 namespace NowSound
 {
+    // Deletes an OwningBuf's data, unless the data is borrowed from a larger block owned by someone else
+    // (as BufferAllocator's preallocated buffers are borrowed from its slab).
+    template<typename T>
+    struct OwningBufDeleter
+    {
+        bool IsBorrowed;
+
+        void operator()(T* data) const
+        {
+            if (!IsBorrowed)
+            {
+                delete[] data;
+            }
+        }
+    };
+
     // Buffer of data; owns the data contained within it.
     template<typename T>
     class OwningBuf
     {
         int _id;
-        std::unique_ptr<T> _data;
+        std::unique_ptr<T[], OwningBufDeleter<T>> _data;
         int _length;
 
     public:
@@ -21,14 +39,22 @@ namespace NowSound
 
         // Create a new OwningBuf with a newly allocated T[length] backing store.
         OwningBuf(int id, int length)
-            : _id(id), _data(std::unique_ptr<T>(new T[length])), _length(length)
+            : _id(id), _data(new T[length], OwningBufDeleter<T>{ false }), _length(length)
         {
             Check(length > 0);
         }
 
-        // Create an OwningBuf which takes ownership of rawBuffer (which had better have the given length).
+        // Create an OwningBuf which takes ownership of rawBuffer (which had better have the given length, and
+        // have been allocated with new T[]).
         OwningBuf(int id, int length, T* rawBuffer)
-            : _id(id), _data(std::unique_ptr<T>(rawBuffer)), _length(length)
+            : OwningBuf(id, length, rawBuffer, true)
+        {
+        }
+
+        // Create an OwningBuf over rawBuffer, taking ownership of it only if takeOwnership is true; if not, whoever
+        // does own rawBuffer must keep it alive for as long as this OwningBuf (or any it is moved into) lives.
+        OwningBuf(int id, int length, T* rawBuffer, bool takeOwnership)
+            : _id(id), _data(rawBuffer, OwningBufDeleter<T>{ !takeOwnership }), _length(length)
         {
             Check(length > 0);
         }
@@ -5,82 +5,368 @@
 
 #include "pch.h"
 
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "stdint.h"
+
 #include "Buf.h"
+#include "MemorySlab.h"
+#include "RealTimeThread.h"
 
 namespace NowSound
 {
+    template<typename T>
+    class BufferAllocator;
+
+    // An allocator buffer which any number of holders can share, with the count of its holders; nodes are pooled by
+    // the allocator, so sharing a buffer never allocates.
+    template<typename T>
+    struct SharedBufNode
+    {
+        // The buffer; empty while the node is on the allocator's free node list.
+        OwningBuf<T> Buffer;
+
+        // The number of SharedBufs holding this node.
+        std::atomic<int> RefCount;
+
+        BufferAllocator<T>* Allocator;
+
+        SharedBufNode(OwningBuf<T>&& buffer, BufferAllocator<T>* allocator)
+            : Buffer(std::move(buffer)), RefCount{ 0 }, Allocator{ allocator }
+        {
+        }
+    };
+
+    // Counted reference to a buffer from BufferAllocator::AllocateShared; the last one dropped returns the buffer
+    // to the allocator.  Like a shared_ptr, but the count lives in the pooled node, so there is no control block
+    // to allocate.
+    template<typename T>
+    class SharedBuf
+    {
+    private:
+        SharedBufNode<T>* _node;
+
+        void Release()
+        {
+            if (_node != nullptr && _node->RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                _node->Allocator->FreeShared(_node);
+            }
+            _node = nullptr;
+        }
+
+    public:
+        SharedBuf() : _node{ nullptr } {}
+
+        explicit SharedBuf(SharedBufNode<T>* node) : _node{ node }
+        {
+            _node->RefCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        SharedBuf(const SharedBuf<T>& other) : _node{ other._node }
+        {
+            if (_node != nullptr)
+            {
+                _node->RefCount.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        SharedBuf(SharedBuf<T>&& other) : _node{ other._node }
+        {
+            other._node = nullptr;
+        }
+
+        ~SharedBuf() { Release(); }
+
+        SharedBuf<T>& operator=(const SharedBuf<T>& other)
+        {
+            // take the new reference first, in case it is to the same node
+            SharedBuf<T> copy(other);
+            std::swap(_node, copy._node);
+            return *this;
+        }
+
+        SharedBuf<T>& operator=(SharedBuf<T>&& other)
+        {
+            if (this != &other)
+            {
+                Release();
+                _node = other._node;
+                other._node = nullptr;
+            }
+            return *this;
+        }
+
+        OwningBuf<T>& operator*() const { return _node->Buffer; }
+        OwningBuf<T>* operator->() const { return &_node->Buffer; }
+
+        // How many SharedBufs hold this buffer; 0 if this holds none.
+        int UseCount() const { return _node == nullptr ? 0 : _node->RefCount.load(std::memory_order_acquire); }
+
+        bool operator==(const SharedBuf<T>& other) const { return _node == other._node; }
+        bool operator!=(const SharedBuf<T>& other) const { return _node != other._node; }
+    };
+
     // Allocate T[] of a predetermined size, and support returning such T[] to a free list.
+    //
+    // Any thread may allocate and free: the audio input thread allocates as it records and overdubs, while the
+    // last holder of a shared buffer (a dropped loop version, say) may release it on the UI thread.  The free
+    // lists are guarded by a spinlock, held only to push or pop them; the lists' capacity grows with each heap
+    // allocation, so a free never allocates while holding it.
+    //
+    // The initial buffers are carved out of one MemorySlab, so preallocating them costs one reservation however
+    // many there are; their pages are faulted in (and locked) either up front or by a low-priority background
+    // thread, first buffer first -- and the free list hands out the first buffer first.  Buffers allocated
+    // after the free list runs dry come from the heap.
     template<typename T>
     class BufferAllocator
     {
     private:
-        int _latestBufferId = 1; // 0 = empty buf
+        std::atomic<int> _latestBufferId{ 1 }; // 0 = empty buf
 
     public:
         // The number of T in a buffer from this allocator.
         const int BufferLength;
 
     private:
+        // Backing memory of the initial buffers; those OwningBufs borrow from it rather than owning their data.
+        std::unique_ptr<MemorySlab> _slab;
+
         // Free list; we recycle from here if possible.
         // This allocator owns all these buffers.
         std::vector<OwningBuf<T>> _freeList;
 
         // Total number of buffers we have ever allocated.
-        int _totalBufferCount;
+        // The counts are atomic so that they can be read from other threads than the one allocating.
+        std::atomic<int> _totalBufferCount;
+
+        // Number of buffers on the free list; mirrors _freeList.size(), but is safe to read from any thread.
+        std::atomic<int> _freeBufferCount;
+
+        // Most buffers ever in use (allocated and not yet freed) at once.
+        std::atomic<int> _peakInUseBufferCount;
+
+        // Number of Allocate calls which found the free list empty, and so had to allocate from the heap.
+        std::atomic<int> _heapAllocationCount;
+
+        // Number of those heap buffers which the OS agreed to lock into physical memory.
+        std::atomic<int> _lockedHeapBufferCount;
+
+        // Every SharedBufNode ever created, and those not holding a buffer, which AllocateShared reuses.  One node
+        // per preallocated buffer is created up front, so (like Allocate) AllocateShared only allocates once more
+        // buffers are in use than were preallocated.
+        std::vector<std::unique_ptr<SharedBufNode<T>>> _sharedNodes;
+        std::vector<SharedBufNode<T>*> _freeSharedNodes;
+
+        // Guards _freeList, _sharedNodes and _freeSharedNodes.
+        std::atomic_flag _poolLock = ATOMIC_FLAG_INIT;
+
+        // Holds _poolLock for its lifetime.
+        class PoolLock
+        {
+        private:
+            std::atomic_flag& _lock;
+
+        public:
+            PoolLock(std::atomic_flag& lock) : _lock{ lock }
+            {
+                while (_lock.test_and_set(std::memory_order_acquire))
+                {
+                    RealTimeThread::SpinPause();
+                }
+            }
+
+            ~PoolLock() { _lock.clear(std::memory_order_release); }
+        };
+
+        // Allocate a brand new buffer, locked into physical memory so that audio threads never page-fault on it.
+        OwningBuf<T> NewBuffer()
+        {
+            OwningBuf<T> buf(_latestBufferId++, BufferLength);
+            if (RealTimeThread::LockMemory(buf.Data(), BufferLength * sizeof(T)))
+            {
+                _lockedHeapBufferCount++;
+            }
+            return buf;
+        }
+
+        void UpdatePeakInUse()
+        {
+            int inUse = _totalBufferCount - _freeBufferCount;
+            if (inUse > _peakInUseBufferCount)
+            {
+                _peakInUseBufferCount = inUse;
+            }
+        }
 
     public:
-        // bufferLength is the number of values in each buffer; initialNumberOfBuffers is the number of buffers to pre-allocate
-        BufferAllocator(int bufferLength, int initialNumberOfBuffers)
-            : BufferLength(bufferLength)
+        // bufferLength is the number of values in each buffer; initialNumberOfBuffers is the number of buffers to pre-allocate.
+        // If prefaultInBackground, the preallocated buffers' pages are faulted in on a background thread, and the
+        // constructor returns without waiting for them; buffers allocated before their pages are faulted in still
+        // work, they just take their page faults as they are first written.
+        BufferAllocator(int bufferLength, int initialNumberOfBuffers, bool prefaultInBackground = false)
+            : BufferLength(bufferLength),
+            _slab{},
+            _totalBufferCount{ 0 },
+            _freeBufferCount{ 0 },
+            _peakInUseBufferCount{ 0 },
+            _heapAllocationCount{ 0 },
+            _lockedHeapBufferCount{ 0 },
+            _sharedNodes{},
+            _freeSharedNodes{}
         {
             Check(bufferLength > 0);
             Check(initialNumberOfBuffers > 0);
 
-            // Prepopulate the free list as a way of preallocating.
-            for (int i = 0; i < initialNumberOfBuffers; i++)
+            _slab = std::unique_ptr<MemorySlab>(new MemorySlab((size_t)initialNumberOfBuffers * BufferSizeInBytes()));
+            T* slabData = (T*)_slab->Data();
+
+            // Prepopulate the free list as a way of preallocating; last buffer first, since Allocate pops from the
+            // back, and we want the first buffer (the first to be faulted in) to be the first allocated.
+            for (int i = initialNumberOfBuffers - 1; i >= 0; i--)
+            {
+                _freeList.push_back(OwningBuf<T>(_latestBufferId + i, BufferLength, slabData + (size_t)i * BufferLength, false));
+            }
+            _latestBufferId += initialNumberOfBuffers;
+
+            // each node is made around a buffer, which it hands straight back, so that it starts out empty
+            for (OwningBuf<T>& buffer : _freeList)
+            {
+                _sharedNodes.push_back(std::unique_ptr<SharedBufNode<T>>(new SharedBufNode<T>(std::move(buffer), this)));
+                buffer = std::move(_sharedNodes.back()->Buffer);
+                _freeSharedNodes.push_back(_sharedNodes.back().get());
+            }
+
+            // the OS's default limit on locked memory is far below a slab's worth, so raise it first
+            RealTimeThread::ReserveLockedMemory(_slab->ByteCount());
+            if (prefaultInBackground)
+            {
+                _slab->PrefaultInBackground((size_t)BufferSizeInBytes());
+            }
+            else
             {
-                OwningBuf<T> buf(_latestBufferId++, bufferLength);
-                _freeList.push_back(std::move(buf));
+                _slab->Prefault((size_t)BufferSizeInBytes());
             }
             _totalBufferCount = initialNumberOfBuffers;
+            _freeBufferCount = initialNumberOfBuffers;
         }
 
         // no copying this
         BufferAllocator(const BufferAllocator&) = delete;
 
+        // Number of bytes in each buffer.
+        int64_t BufferSizeInBytes() const { return (int64_t)BufferLength * sizeof(T); }
+
         // Number of bytes reserved by this allocator; will increase if free list runs out, and includes free space.
-        long TotalReservedSpace() { return _totalBufferCount * BufferLength * sizeof(T); }
+        int64_t TotalReservedSpace() const { return _totalBufferCount * BufferSizeInBytes(); }
 
         // Number of bytes held in buffers on the free list.
-        long TotalFreeListSpace() { return _freeList.Count * BufferLength * sizeof(T); }
+        int64_t TotalFreeListSpace() const { return _freeBufferCount * BufferSizeInBytes(); }
+
+        // Number of bytes in buffers currently allocated (that is, reserved and not on the free list).
+        int64_t TotalInUseSpace() const { return (_totalBufferCount - _freeBufferCount) * BufferSizeInBytes(); }
+
+        // Most bytes ever in use at once.
+        int64_t PeakInUseSpace() const { return _peakInUseBufferCount * BufferSizeInBytes(); }
 
-        // Allocate a new Buf<T>; this is an owning Buf<T>.
-        // TODO: needs thread safety or contractual thread affinity
+        // Number of bytes of buffers which this allocator has so far tried to lock into physical memory: the
+        // preallocated buffers faulted in so far, and every buffer allocated from the heap.
+        int64_t LockRequestedSpace() const
+        {
+            return (int64_t)_slab->PrefaultedByteCount() + _heapAllocationCount * BufferSizeInBytes();
+        }
+
+        // Of LockRequestedSpace(), the bytes the OS actually locked; any others can be paged out.
+        int64_t LockedSpace() const
+        {
+            return (int64_t)_slab->LockedByteCount() + _lockedHeapBufferCount * BufferSizeInBytes();
+        }
+
+        // Have all the preallocated buffers been faulted in yet?
+        bool IsPrefaulted() const { return _slab->IsPrefaulted(); }
+
+        // Wait until all the preallocated buffers have been faulted in.
+        void WaitForPrefault() { _slab->WaitForPrefault(); }
+
+        // Number of allocations which had to go to the heap because the free list was empty.
+        // (These are the ones that can stall a real-time thread, so ideally this stays at zero.)
+        int HeapAllocationCount() const { return _heapAllocationCount; }
+
+        // Allocate a new Buf<T>; this is an owning Buf<T>.  Safe to call from any thread.
         OwningBuf<T> Allocate()
         {
-            if (_freeList.size() == 0)
             {
+                PoolLock lock(_poolLock);
+                if (_freeList.size() > 0)
+                {
+                    OwningBuf<T> ret(std::move(_freeList[_freeList.size() - 1]));
+                    _freeList.erase(_freeList.end() - 1);
+                    _freeBufferCount--;
+                    UpdatePeakInUse();
+                    return ret;
+                }
+
                 _totalBufferCount++;
-                OwningBuf<T> result(_latestBufferId++, BufferLength);
-                return result;
-            }
-            else
-            {
-                OwningBuf<T> ret(std::move(_freeList[_freeList.size() - 1]));
-                _freeList.erase(_freeList.end() - 1);
-                return ret;
+                _heapAllocationCount++;
+                UpdatePeakInUse();
+                // so Free never has to grow the free list
+                _freeList.reserve(_totalBufferCount);
             }
+            return NewBuffer();
         }
 
-        // Free the given buffer back to the pool.
+        // Free the given buffer back to the pool.  Safe to call from any thread.
         virtual void Free(OwningBuf<T>&& buffer)
         {
+            PoolLock lock(_poolLock);
             // must not already be on free list or we have a bug
             for (const OwningBuf<T>& t : _freeList)
             {
                 Check(!(buffer == t)); // TODO: Buf<T>::operator!=
             }
             _freeList.push_back(std::move(buffer));
+            _freeBufferCount++;
+        }
+
+        // Allocate a buffer to be shared; it goes back to the free list when the last SharedBuf holding it is
+        // dropped, on whichever thread that is.  Safe to call from any thread.
+        SharedBuf<T> AllocateShared()
+        {
+            SharedBufNode<T>* node = nullptr;
+            {
+                PoolLock lock(_poolLock);
+                if (_freeSharedNodes.size() > 0)
+                {
+                    node = _freeSharedNodes.back();
+                    _freeSharedNodes.pop_back();
+                }
+            }
+
+            if (node == nullptr)
+            {
+                std::unique_ptr<SharedBufNode<T>> newNode(new SharedBufNode<T>(Allocate(), this));
+                node = newNode.get();
+                PoolLock lock(_poolLock);
+                _sharedNodes.push_back(std::move(newNode));
+                // so FreeShared never has to grow the free node list
+                _freeSharedNodes.reserve(_sharedNodes.size());
+            }
+            else
+            {
+                node->Buffer = Allocate();
+            }
+            return SharedBuf<T>(node);
+        }
+
+        // Return the buffer of a node no SharedBuf holds any longer; only SharedBuf calls this.
+        void FreeShared(SharedBufNode<T>* node)
+        {
+            Check(node->RefCount == 0);
+            Free(std::move(node->Buffer));
+            PoolLock lock(_poolLock);
+            _freeSharedNodes.push_back(node);
         }
     };
 }
@@ -7,11 +7,6 @@
 using namespace NowSound;
 using namespace std;
 using namespace std::chrono;
-using namespace winrt;
-
-using namespace Windows::Foundation;
-using namespace Windows::Media::Audio;
-using namespace Windows::Media::Render;
 
 std::unique_ptr<NowSound::Clock> NowSound::Clock::s_instance;
 
@@ -27,7 +22,8 @@ NowSound::Clock::Clock(int sampleRateHz, int channelCount, float beatsPerMinute,
 	_beatsPerMinute(beatsPerMinute),
 	_beatsPerMeasure(beatsPerMeasure),
 	_now(0),
-	_beatDuration(0)
+	_beatDuration(0),
+	_exactBeatDuration(0)
 {
     Check(s_instance == nullptr); // No Clock yet
     CalculateBeatDuration();
@@ -35,7 +31,8 @@ NowSound::Clock::Clock(int sampleRateHz, int channelCount, float beatsPerMinute,
 
 void NowSound::Clock::CalculateBeatDuration()
 {
-    _beatDuration = (ContinuousDuration<AudioSample>)(((float)SampleRateHz() * 60) / _beatsPerMinute);
+    _exactBeatDuration = ((double)SampleRateHz() * 60) / _beatsPerMinute;
+    _beatDuration = (ContinuousDuration<AudioSample>)_exactBeatDuration;
 }
 
 void NowSound::Clock::BeatsPerMinute(float value)
@@ -7,11 +7,39 @@
 
 #include "stdint.h"
 
+#include <cmath>
+
 #include "Check.h"
 #include "Time.h"
 
 namespace NowSound
 {
+    // A precise position on the beat timeline: a whole number of beats, plus the fraction of a beat beyond them.
+    // A single float beat count can no longer resolve individual samples after a few minutes at 48Khz, so
+    // anything derived from long-running session time should be computed from one of these, reducing the
+    // (exact, integral) CompleteBeats before converting anything to float.
+    struct BeatPosition
+    {
+        // The number of complete beats; negative for times before the start of the session.
+        int64_t CompleteBeats;
+
+        // The fraction of the next beat; always in [0, 1).
+        double FractionalBeat;
+
+        // This position modulo the given (positive) number of beats, e.g. the position within a looping track.
+        BeatPosition Modulo(int64_t beatCount) const
+        {
+            Check(beatCount > 0);
+            return BeatPosition{ ((CompleteBeats % beatCount) + beatCount) % beatCount, FractionalBeat };
+        }
+
+        // This position as a single beat count.  Only precise when CompleteBeats is small, e.g. after Modulo.
+        ContinuousDuration<Beat> Beats() const
+        {
+            return ContinuousDuration<Beat>((double)CompleteBeats + FractionalBeat);
+        }
+    };
+
     // Tracks the current time (driven from the audio input if it exists, otherwise from the Unity deltaTime),
     // and converts it to seconds and beats.
     class Clock
@@ -60,6 +88,9 @@ namespace NowSound
         // This will be a non-integer value if the BPM does not exactly divide the sample rate.
         ContinuousDuration<AudioSample> _beatDuration;
 
+        // The duration of a beat in samples, in double precision; all beat conversions are based on this.
+        double _exactBeatDuration;
+
         // Calculate the _beatDuration based on _beatsPerMinute.
         // TODO: this doesn't seem like a good way to do this -- why not do this at construction?
         void CalculateBeatDuration();
@@ -94,12 +125,37 @@ namespace NowSound
 
 		Duration<AudioSample> TimeToSamples(ContinuousDuration<Second> seconds) { return (int64_t)(SampleRateHz() * seconds.Value()); }
 
+        // The duration of a beat in samples, in double precision.
+        double ExactBeatDuration() const { return _exactBeatDuration; }
+
+        // Exactly where on the beat timeline is this time?
+        BeatPosition TimeToBeatPosition(Time<AudioSample> time) const
+        {
+            int64_t completeBeats = (int64_t)std::floor(time.Value() / _exactBeatDuration);
+
+            // The remainder is computed in samples, which are exact in a double for any realistic session length.
+            double fractionalBeat = (time.Value() - completeBeats * _exactBeatDuration) / _exactBeatDuration;
+
+            // correct any roundoff across the beat boundary
+            if (fractionalBeat < 0)
+            {
+                completeBeats--;
+                fractionalBeat += 1;
+            }
+            if (fractionalBeat >= 1)
+            {
+                completeBeats++;
+                fractionalBeat -= 1;
+            }
+            return BeatPosition{ completeBeats, fractionalBeat };
+        }
+
         // Approximately how many beats?
+        // Callers mostly pass this on as a float, which loses sample precision after a few minutes; use
+        // TimeToBeatPosition for anything that must stay precise over a long session.
         ContinuousDuration<Beat> TimeToBeats(Time<AudioSample> time) const
         {
-            return ContinuousDuration<Beat>(
-                (float)time.Value() /
-                Clock::Instance().BeatDuration().Value());
+            return ContinuousDuration<Beat>(time.Value() / _exactBeatDuration);
         }
 
         // empirically seen some Beats values come too close to this
@@ -108,8 +164,7 @@ namespace NowSound
         // What fraction of a beat?
         ContinuousDuration<Beat> TimeToFractionalBeat(Time<AudioSample> time) const
         {
-            float beatValue = TimeToBeats(time).Value();
-            return ContinuousDuration<Beat>(beatValue - std::floor(beatValue));
+            return ContinuousDuration<Beat>(TimeToBeatPosition(time).FractionalBeat);
         }
     };
 }
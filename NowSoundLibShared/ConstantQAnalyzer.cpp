@@ -0,0 +1,120 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Check.h"
+#include "ConstantQAnalyzer.h"
+
+using namespace NowSound;
+using namespace RosettaFFT;
+
+const float ConstantQAnalyzer::KernelThreshold = 0.001f;
+
+ConstantQAnalyzer::ConstantQAnalyzer(
+    double centralFrequency,
+    int octaveDivisions,
+    int binCount,
+    int centralBinIndex,
+    double sampleRate,
+    int frameSize)
+    : _fft{ frameSize },
+    _binFrequencies(binCount),
+    _kernelRanges(binCount),
+    _kernels{}
+{
+    Check(centralFrequency > 0);
+    Check(octaveDivisions > 0);
+    Check(binCount > 0);
+    Check(centralBinIndex >= 0 && centralBinIndex < binCount);
+    Check(sampleRate > 0);
+
+    // Each bin is as wide as the spacing between bins, which sets its Q, and so the length of its window.
+    double q = 1 / (std::pow(2, 1.0 / octaveDivisions) - 1);
+
+    FftPlan complexFft(frameSize);
+    std::vector<std::complex<float>> kernel(frameSize);
+    std::vector<double> window(frameSize);
+
+    for (int bin = 0; bin < binCount; bin++)
+    {
+        double frequency = centralFrequency * std::pow(2, (double)(bin - centralBinIndex) / octaveDivisions);
+        _binFrequencies[bin] = frequency;
+        _kernelRanges[bin] = KernelRange{ 0, 0, (int)_kernels.size() };
+        if (frequency >= sampleRate / 2)
+        {
+            continue;
+        }
+
+        // the Blackman-Harris-windowed sinusoid, centered in the frame, scaled so a unit sinusoid at this frequency reads 1
+        int length = (int)(std::min)((double)frameSize, (std::max)(2.0, std::ceil(q * sampleRate / frequency)));
+        CreateBlackmanHarrisWindow(length, window.data());
+        double windowSum = 0;
+        for (int i = 0; i < length; i++)
+        {
+            windowSum += window[i];
+        }
+
+        std::fill(kernel.begin(), kernel.end(), std::complex<float>(0));
+        int start = (frameSize - length) / 2;
+        for (int i = 0; i < length; i++)
+        {
+            kernel[start + i] = std::polar((float)(2 * window[i] / windowSum), (float)(2 * PI * frequency * i / sampleRate));
+        }
+        complexFft.Forward(kernel.data());
+
+        // By Parseval, the inner product of the frame with the sinusoid is that of their spectra, over frameSize.
+        // Real input's spectrum is symmetric, and the sinusoid's lies (to within the threshold) in the positive
+        // frequencies, so only those are kept: the ones the real FFT computes.
+        int spectrumSize = _fft.BinCount();
+        float peak = 0;
+        for (int i = 0; i < spectrumSize; i++)
+        {
+            peak = (std::max)(peak, std::abs(kernel[i]));
+        }
+        int first = 0;
+        while (std::abs(kernel[first]) < peak * KernelThreshold)
+        {
+            first++;
+        }
+        int last = spectrumSize - 1;
+        while (std::abs(kernel[last]) < peak * KernelThreshold)
+        {
+            last--;
+        }
+
+        _kernelRanges[bin].FirstFftBin = first;
+        _kernelRanges[bin].Length = last - first + 1;
+        for (int i = first; i <= last; i++)
+        {
+            _kernels.push_back(std::conj(kernel[i]) / (float)frameSize);
+        }
+    }
+}
+
+void ConstantQAnalyzer::Analyze(const float* input, std::complex<float>* spectrum, float* output) const
+{
+    _fft.Forward(input, spectrum);
+
+    for (int bin = 0; bin < BinCount(); bin++)
+    {
+        const KernelRange& range = _kernelRanges[bin];
+
+        // on plain floats, since std::complex's operator* must also handle infinities, which keeps it from vectorizing
+        const float* x = reinterpret_cast<const float*>(spectrum + range.FirstFftBin);
+        const float* k = reinterpret_cast<const float*>(_kernels.data() + range.Offset);
+        float real = 0;
+        float imaginary = 0;
+        for (int i = 0; i < range.Length; i++)
+        {
+            float xr = x[i * 2], xi = x[i * 2 + 1];
+            float kr = k[i * 2], ki = k[i * 2 + 1];
+            real += xr * kr - xi * ki;
+            imaginary += xr * ki + xi * kr;
+        }
+        output[bin] = std::sqrt(real * real + imaginary * imaginary);
+    }
+}
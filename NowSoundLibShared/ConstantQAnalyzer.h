@@ -0,0 +1,85 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <complex>
+#include <vector>
+
+#include "rosetta_fft.h"
+
+namespace NowSound
+{
+    // Analyzes frames of mono audio into bins spaced evenly in pitch (some number of divisions per octave), each as
+    // wide as its spacing: a constant-Q transform.
+    //
+    // Each bin is a Blackman-Harris-windowed complex sinusoid at its frequency, as long as it needs to be to resolve
+    // the bins either side of it (so longer the lower the bin), centered in the frame.  Its spectrum (the "spectral
+    // kernel") is computed once, up front, and trimmed to the run of FFT bins around its frequency which are not
+    // negligible; so analyzing a frame takes one real FFT, then a short complex dot product per bin.  Unlike folding
+    // a linear FFT into pitch bins, every bin has its own, properly shaped, frequency response; so low bins resolve
+    // pitch down to where their window would outgrow the frame (below which they are as long as the frame, and
+    // resolve as much as it allows).
+    class ConstantQAnalyzer
+    {
+    private:
+        // The nonzero run of one bin's spectral kernel.
+        struct KernelRange
+        {
+            // The first FFT bin of the run.
+            int FirstFftBin;
+
+            // The number of FFT bins in the run.
+            int Length;
+
+            // The index in _kernels of the first coefficient.
+            int Offset;
+        };
+
+        const RosettaFFT::RealFftPlan _fft;
+
+        // The center frequency of each bin.
+        std::vector<double> _binFrequencies;
+
+        // The run of each bin's kernel in _kernels.
+        std::vector<KernelRange> _kernelRanges;
+
+        // Every bin's kernel coefficients, run after run; conjugated and prescaled, so a bin's (complex) value is
+        // just the sum of each coefficient times the frame's FFT bin.
+        std::vector<std::complex<float>> _kernels;
+
+    public:
+        // Kernel coefficients less than this fraction of their kernel's peak are dropped.  The window's sidelobes
+        // are lower still, so dropping them changes nothing visible.
+        static const float KernelThreshold;
+
+        // Takes the same parameters as RosettaFFT::MakeBinBounds: the bins are octaveDivisions to the octave, with
+        // the centralBinIndex'th at centralFrequency.  Bins at or above half the sample rate always read zero.
+        // frameSize must be a power of two.
+        ConstantQAnalyzer(
+            double centralFrequency,
+            int octaveDivisions,
+            int binCount,
+            int centralBinIndex,
+            double sampleRate,
+            int frameSize);
+
+        int BinCount() const { return (int)_binFrequencies.size(); }
+
+        int FrameSize() const { return _fft.Size(); }
+
+        // The size Analyze's scratch spectrum must be.
+        int SpectrumSize() const { return _fft.BinCount(); }
+
+        double BinFrequency(int bin) const { return _binFrequencies[bin]; }
+
+        // The number of coefficients in all the kernels together: the multiply-adds per frame, after the FFT.
+        int KernelSize() const { return (int)_kernels.size(); }
+
+        // Analyze FrameSize() samples of input into BinCount() magnitudes of output: a full-scale sinusoid at a bin's
+        // frequency reads 1 in that bin.  spectrum is scratch space, of SpectrumSize(); this never allocates.
+        void Analyze(const float* input, std::complex<float>* spectrum, float* output) const;
+    };
+}
@@ -0,0 +1,219 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "Check.h"
+#include "ForkJoinPool.h"
+#include "RealTimeThread.h"
+#include "Trace.h"
+
+using namespace NowSound;
+
+const int ForkJoinPool::SpinMicroseconds = 20000;
+
+namespace
+{
+    uint64_t PackRange(uint32_t generation, uint32_t begin, uint32_t end)
+    {
+        return ((uint64_t)generation << 32) | (begin << 16) | end;
+    }
+    uint32_t RangeGeneration(uint64_t range) { return (uint32_t)(range >> 32); }
+    uint32_t RangeBegin(uint64_t range) { return (uint32_t)(range >> 16) & 0xFFFF; }
+    uint32_t RangeEnd(uint64_t range) { return (uint32_t)range & 0xFFFF; }
+}
+
+ForkJoinPool::ForkJoinPool(int workerCount, bool isRealTime)
+    : _workerCount{ workerCount },
+    _isRealTime{ isRealTime },
+    _ranges{ new TaskRange[workerCount] },
+    _threads{},
+    _task{ nullptr },
+    _generation{ 0 },
+    _completedTasks{ 0 },
+    _isStopping{ false },
+    _parkedWorkers{ 0 },
+    _parkMutex{},
+    _parkCondition{}
+{
+    Check(workerCount >= 1);
+
+    for (int worker = 0; worker < workerCount; worker++)
+    {
+        _ranges[worker].Range = PackRange(0, 0, 0);
+    }
+
+    for (int worker = 1; worker < workerCount; worker++)
+    {
+        _threads.push_back(std::thread([this, worker]() { WorkerThread(worker); }));
+    }
+}
+
+ForkJoinPool::~ForkJoinPool()
+{
+    _isStopping = true;
+    WakeParkedWorkers();
+    for (std::thread& thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+int ForkJoinPool::WorkerCount() const { return _workerCount; }
+
+int ForkJoinPool::TakeTask(int worker, uint32_t generation)
+{
+    std::atomic<uint64_t>& range = _ranges[worker].Range;
+    uint64_t current = range.load(std::memory_order_acquire);
+    while (RangeGeneration(current) == generation && RangeBegin(current) < RangeEnd(current))
+    {
+        uint64_t taken = PackRange(generation, RangeBegin(current) + 1, RangeEnd(current));
+        if (range.compare_exchange_weak(current, taken, std::memory_order_acq_rel))
+        {
+            return (int)RangeBegin(current);
+        }
+    }
+    return -1;
+}
+
+int ForkJoinPool::StealTask(int worker, uint32_t generation)
+{
+    for (int i = 1; i < _workerCount; i++)
+    {
+        std::atomic<uint64_t>& range = _ranges[(worker + i) % _workerCount].Range;
+        uint64_t current = range.load(std::memory_order_acquire);
+        while (RangeGeneration(current) == generation && RangeBegin(current) < RangeEnd(current))
+        {
+            uint64_t stolen = PackRange(generation, RangeBegin(current), RangeEnd(current) - 1);
+            if (range.compare_exchange_weak(current, stolen, std::memory_order_acq_rel))
+            {
+                return (int)RangeEnd(current) - 1;
+            }
+        }
+    }
+    return -1;
+}
+
+void ForkJoinPool::Work(int worker, uint32_t generation)
+{
+    while (true)
+    {
+        int taskIndex = TakeTask(worker, generation);
+        if (taskIndex == -1)
+        {
+            taskIndex = StealTask(worker, generation);
+        }
+        if (taskIndex == -1)
+        {
+            // Every task has been claimed (though others may still be running theirs), or this worker woke too late
+            // for this Run, which has returned.
+            return;
+        }
+
+        // Run cannot return (or start another) until this task is counted, so _task is still this Run's.
+        (*_task)(worker, taskIndex);
+        _completedTasks.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void ForkJoinPool::WorkerThread(int worker)
+{
+    if (_isRealTime)
+    {
+        // Pin each worker to its own core (on the portable backend), leaving core 0 to the thread calling Run.
+        RealTimeThread::ConfigureAudioThread(worker % (std::max)(1u, std::thread::hardware_concurrency()));
+    }
+    else
+    {
+        RealTimeThread::SetFlushDenormals(true);
+        RealTimeThread::ConfigureBackgroundThread();
+    }
+
+#if NOWSOUND_TRACING
+    char threadName[32];
+    snprintf(threadName, sizeof(threadName), "ForkJoinWorker%d", worker);
+    Trace::SetThreadName(threadName);
+#endif
+
+    uint32_t seenGeneration = 0;
+    while (true)
+    {
+        // spin until released or stopped, or until it is time to park
+        auto spinStart = std::chrono::steady_clock::now();
+        int spinCount = 0;
+        uint32_t generation;
+        while ((generation = _generation.load(std::memory_order_acquire)) == seenGeneration)
+        {
+            if (_isStopping)
+            {
+                return;
+            }
+            RealTimeThread::SpinPause();
+
+            // checking the time is much slower than pausing, so only every so often
+            if (++spinCount % 256 == 0
+                && std::chrono::steady_clock::now() - spinStart > std::chrono::microseconds(SpinMicroseconds))
+            {
+                // Announce parking before checking the generation one last time (both sequentially consistent),
+                // so either this sees Run's release or Run sees this parking and wakes it; and wait under the lock
+                // Run takes to wake, so the wakeup cannot come between that check and the wait.
+                std::unique_lock<std::mutex> lock(_parkMutex);
+                _parkedWorkers.fetch_add(1);
+                _parkCondition.wait(lock, [&]() { return _generation.load() != seenGeneration || _isStopping; });
+                _parkedWorkers.fetch_sub(1);
+                spinStart = std::chrono::steady_clock::now();
+            }
+        }
+        seenGeneration = generation;
+
+        Work(worker, generation);
+    }
+}
+
+void ForkJoinPool::WakeParkedWorkers()
+{
+    // Taking the lock waits out any worker between its last check and its wait.
+    {
+        std::lock_guard<std::mutex> guard(_parkMutex);
+    }
+    _parkCondition.notify_all();
+}
+
+void ForkJoinPool::Run(int taskCount, const std::function<void(int, int)>& task)
+{
+    Check(taskCount >= 0 && taskCount < MaxTaskCount);
+
+    // Deal the tasks out evenly, tagged with this Run's generation; the first (taskCount % _workerCount) workers get
+    // one extra.  The release stores publish _task (and the completed count) along with each range.
+    uint32_t generation = _generation.load(std::memory_order_relaxed) + 1;
+    _task = &task;
+    _completedTasks.store(0, std::memory_order_relaxed);
+    int begin = 0;
+    for (int worker = 0; worker < _workerCount; worker++)
+    {
+        int count = taskCount / _workerCount + (worker < taskCount % _workerCount ? 1 : 0);
+        _ranges[worker].Range.store(PackRange(generation, begin, begin + count), std::memory_order_release);
+        begin += count;
+    }
+
+    // Release the pool threads, and join in.
+    _generation.store(generation);
+    if (_parkedWorkers.load() > 0)
+    {
+        // only after the pool has been idle, so this never costs a busy graph anything; and Run does not wait for
+        // them to wake, since the tasks they were dealt can be stolen
+        WakeParkedWorkers();
+    }
+
+    Work(0, generation);
+
+    // Wait for tasks other workers claimed to finish; once all have, no worker can claim anything more this Run.
+    while (_completedTasks.load(std::memory_order_acquire) < taskCount)
+    {
+        RealTimeThread::SpinPause();
+    }
+    _task = nullptr;
+}
@@ -0,0 +1,110 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace NowSound
+{
+    // A pool of worker threads for splitting one audio quantum's work across cores.
+    //
+    // Each call to Run divides its tasks evenly among the workers; a worker that runs out of tasks steals from the
+    // others, so uneven tasks still balance.  Handing out and stealing tasks is lock-free, and idle workers spin
+    // rather than sleep, since waking a sleeping thread can take longer than a whole quantum -- but only for
+    // SpinMicroseconds after their last Run, after which they park until the next one; so a pool whose graph has
+    // stopped (or gone idle) does not burn whole cores.  The thread calling Run is itself worker 0, so a pool of one
+    // worker creates no threads at all.
+    //
+    // Run waits only for its tasks to complete, not for every worker to take part: the Run that wakes parked
+    // workers does not wait out their wakeup, since worker 0 and any awake workers just take their tasks.
+    class ForkJoinPool
+    {
+    private:
+        // The tasks not yet started by a worker, packed as (generation << 32) | (begin << 16) | end, so that the
+        // owning worker (taking from the beginning) and thieves (taking from the end) can both claim a task with one
+        // compare-exchange; and a worker still looking for tasks of an earlier Run cannot claim this one's.
+        // Each is aligned to its own cache line, to avoid false sharing between workers.
+        struct alignas(64) TaskRange
+        {
+            std::atomic<uint64_t> Range;
+        };
+
+        const int _workerCount;
+
+        // Do the pool threads run at real-time priority (else at background priority)?
+        const bool _isRealTime;
+
+        // One range per worker.
+        std::unique_ptr<TaskRange[]> _ranges;
+
+        // The threads of workers 1 through _workerCount - 1.
+        std::vector<std::thread> _threads;
+
+        // The task function of the current Run.
+        const std::function<void(int, int)>* _task;
+
+        // Incremented by each Run to release the workers.
+        std::atomic<uint32_t> _generation;
+
+        // The number of the current Run's tasks which have returned.
+        std::atomic<int> _completedTasks;
+
+        // Set when the pool is being destroyed.
+        std::atomic<bool> _isStopping;
+
+        // The number of pool threads parked, or about to park; Run only takes _parkMutex to wake them if any are.
+        std::atomic<int> _parkedWorkers;
+        std::mutex _parkMutex;
+        std::condition_variable _parkCondition;
+
+        // Claim a task of the given generation's Run from the beginning of the given worker's range; returns -1 if
+        // there is none.
+        int TakeTask(int worker, uint32_t generation);
+
+        // Claim a task of the given generation's Run from the end of any other worker's range; returns -1 if there
+        // is none.
+        int StealTask(int worker, uint32_t generation);
+
+        // Run tasks of the given generation's Run (own, then stolen) until none remain unclaimed.
+        void Work(int worker, uint32_t generation);
+
+        // The loop of each pool thread.
+        void WorkerThread(int worker);
+
+        // Wake any parked pool threads.
+        void WakeParkedWorkers();
+
+    public:
+        // How long an idle worker spins, waiting for the next Run, before parking.  Two quanta of the usual 10
+        // msec, so workers stay awake as long as the graph keeps running.
+        static const int SpinMicroseconds;
+
+        // The limit on the number of tasks in one Run.
+        static const int MaxTaskCount = 1 << 16;
+
+        // Create a pool of workerCount workers, including the thread that will call Run.  A pool for work off the
+        // audio path (such as rendering offline) should not be real-time, so that it only ever uses spare cores.
+        ForkJoinPool(int workerCount, bool isRealTime = true);
+
+        // Stops and joins all the pool threads.
+        ~ForkJoinPool();
+
+        // The number of workers, including the thread that calls Run.
+        int WorkerCount() const;
+
+        // Call task(workerIndex, taskIndex) once for each taskIndex in [0, taskCount), across all workers,
+        // returning once all calls have returned.  taskCount must be less than MaxTaskCount.  Each worker runs one task at a time, so task can use
+        // per-worker state indexed by workerIndex without locking.
+        // Must only be called from one thread at a time.
+        void Run(int taskCount, const std::function<void(int, int)>& task);
+    };
+}
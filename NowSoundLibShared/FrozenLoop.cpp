@@ -0,0 +1,130 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "AudioKernels.h"
+#include "Check.h"
+#include "FrozenLoop.h"
+#include "RealTimeThread.h"
+
+using namespace NowSound;
+
+int64_t FrozenLoop::LeastCommonMultiple(int64_t a, int64_t b)
+{
+    Check(a > 0 && b > 0);
+    int64_t x = a;
+    int64_t y = b;
+    while (y != 0)
+    {
+        int64_t remainder = x % y;
+        x = y;
+        y = remainder;
+    }
+    return a / x * b;
+}
+
+int64_t FrozenLoop::RenderedBytes(ContinuousDuration<AudioSample> duration)
+{
+    return (int64_t)std::ceil(duration.Value()) * 2 * sizeof(float);
+}
+
+FrozenLoop::FrozenLoop(BufferAllocator<float>* allocator, ContinuousDuration<AudioSample> duration)
+    : _duration{ duration },
+    _left{ new BufferedSliceStream<AudioSample, float>(0, 1, allocator, 0, /*useExactLoopingMapper:*/true) },
+    _right{ new BufferedSliceStream<AudioSample, float>(0, 1, allocator, 0, /*useExactLoopingMapper:*/true) },
+    _isRendered{ false },
+    _leftQuantum{},
+    _rightQuantum{}
+{
+    Check(duration.Value() > 0);
+}
+
+bool FrozenLoop::Render(const std::vector<Source>& sources, const PolyphaseInterpolator& interpolator, const std::atomic<bool>& isCancelled)
+{
+    Check(!_isRendered);
+    for (const Source& source : sources)
+    {
+        Check(source.Stream->IsShut());
+        Check(source.Stream->SliverCount() == 1);
+    }
+
+    // Quiet loop tails would otherwise grind through denormals on this thread.
+    RealTimeThread::FlushDenormalsScope flushDenormals(true);
+
+    // Like a recorded loop, the frozen loop holds its exact duration rounded up to whole samples.
+    int64_t sampleCount = (int64_t)std::ceil(_duration.Value());
+    std::vector<float> mono(RenderChunkSize);
+    std::vector<float> left(RenderChunkSize);
+    std::vector<float> right(RenderChunkSize);
+    for (int64_t position = 0; position < sampleCount; position += RenderChunkSize)
+    {
+        if (isCancelled)
+        {
+            return false;
+        }
+
+        int chunk = (int)(std::min)((int64_t)RenderChunkSize, sampleCount - position);
+        std::fill(left.begin(), left.begin() + chunk, 0.0f);
+        std::fill(right.begin(), right.begin() + chunk, 0.0f);
+        for (const Source& source : sources)
+        {
+            // read each source just as a track plays it
+            Interval<AudioSample> interval(source.StartTime + Duration<AudioSample>(position), Duration<AudioSample>(chunk));
+            if (source.Stream->IsSilent(interval, 0))
+            {
+                continue;
+            }
+            source.Stream->CopyToInterpolated(interval, interpolator, mono.data());
+
+            float leftCoefficient, rightCoefficient;
+            AudioKernels::PanCoefficients(source.Pan, &leftCoefficient, &rightCoefficient);
+            AudioKernels::MixScaled(mono.data(), chunk, leftCoefficient, left.data());
+            AudioKernels::MixScaled(mono.data(), chunk, rightCoefficient, right.data());
+        }
+
+        _left->Append(Duration<AudioSample>(chunk), left.data());
+        _right->Append(Duration<AudioSample>(chunk), right.data());
+    }
+
+    _left->Shut(_duration);
+    _right->Shut(_duration);
+    _isRendered = true;
+    return true;
+}
+
+void FrozenLoop::MixInto(Interval<AudioSample> interval, const PolyphaseInterpolator& interpolator, float* stereoBus)
+{
+    Check(_isRendered);
+
+    int count = (int)interval.IntervalDuration().Value();
+    if ((int)_leftQuantum.size() < count)
+    {
+        // only ever grows, so this allocates only in the first quanta
+        _leftQuantum.resize(count);
+        _rightQuantum.resize(count);
+    }
+
+    const BufferedSliceStream<AudioSample, float>* channels[2] = { _left.get(), _right.get() };
+    float* quanta[2] = { _leftQuantum.data(), _rightQuantum.data() };
+    for (int channel = 0; channel < 2; channel++)
+    {
+        if (channels[channel]->IsSilent(interval, 0))
+        {
+            continue;
+        }
+        channels[channel]->CopyToInterpolated(interval, interpolator, quanta[channel]);
+        for (int i = 0; i < count; i++)
+        {
+            stereoBus[i * 2 + channel] += quanta[channel][i];
+        }
+    }
+}
+
+int64_t FrozenLoop::BufferBytes() const
+{
+    return _left->BufferBytes() + _right->BufferBytes();
+}
@@ -0,0 +1,84 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "BufferAllocator.h"
+#include "PolyphaseInterpolator.h"
+#include "SliceStream.h"
+#include "Time.h"
+
+namespace NowSound
+{
+    // Several panned mono loops mixed down ("frozen") into one stereo loop, which plays in their place for the
+    // cost of reading one loop rather than all of them.
+    //
+    // The loops may be of different lengths, so the frozen loop lasts their least common multiple; only after that
+    // long do they all line up again.  It is kept as a pair of mono streams, left and right, rather than as one
+    // stereo stream, since only mono streams can be read with the interpolation that lets a loop last a fractional
+    // number of samples -- as the least common multiple, like the loops themselves, generally does.
+    class FrozenLoop
+    {
+    public:
+        // One loop to freeze.
+        struct Source
+        {
+            // A shut mono stream, which nothing may write while the frozen loop is rendered.
+            const BufferedSliceStream<AudioSample, float>* Stream;
+
+            // The time in Stream to play at the start of the frozen loop.
+            Time<AudioSample> StartTime;
+
+            // 0 = left, 0.5 = center, 1 = right.
+            float Pan;
+        };
+
+        // How many samples Render reads from each source at once.
+        static const int RenderChunkSize = 4096;
+
+        static int64_t LeastCommonMultiple(int64_t a, int64_t b);
+
+        // The bytes of audio a frozen loop of the given duration holds (not counting the rounding up to whole buffers).
+        static int64_t RenderedBytes(ContinuousDuration<AudioSample> duration);
+
+    private:
+        const ContinuousDuration<AudioSample> _duration;
+
+        std::unique_ptr<BufferedSliceStream<AudioSample, float>> _left;
+        std::unique_ptr<BufferedSliceStream<AudioSample, float>> _right;
+
+        // Set once Render has shut both streams; until then, nothing may read them.
+        std::atomic<bool> _isRendered;
+
+        // One quantum of each channel, read for MixInto; only ever grow.
+        std::vector<float> _leftQuantum;
+        std::vector<float> _rightQuantum;
+
+    public:
+        // An empty frozen loop of the given duration, whose audio will be allocated from the given allocator.
+        FrozenLoop(BufferAllocator<float>* allocator, ContinuousDuration<AudioSample> duration);
+
+        ContinuousDuration<AudioSample> LoopDuration() const { return _duration; }
+
+        // Mix the sources into the frozen loop: its sample t is each source's stream at StartTime + t, panned, so
+        // (since every source's duration divides the frozen loop's) the frozen loop then plays exactly as the
+        // sources would have.  Stops, leaving the loop unrendered, as soon as isCancelled is set; returns whether
+        // it finished.  Not real-time; call it from a background thread.
+        bool Render(const std::vector<Source>& sources, const PolyphaseInterpolator& interpolator, const std::atomic<bool>& isCancelled);
+
+        // Has Render finished?  Any thread.
+        bool IsRendered() const { return _isRendered; }
+
+        // Add the frozen loop's interleaved stereo for the given interval into the stereo bus.  Requires IsRendered().
+        void MixInto(Interval<AudioSample> interval, const PolyphaseInterpolator& interpolator, float* stereoBus);
+
+        // The bytes in the buffers of both channels.
+        int64_t BufferBytes() const;
+    };
+}
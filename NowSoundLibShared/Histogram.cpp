@@ -3,6 +3,7 @@
 
 #include "pch.h"
 
+#include "Check.h"
 #include "Histogram.h"
 
 using namespace NowSound;
@@ -6,6 +6,7 @@
 #include "stdint.h"
 
 #include <deque>
+#include <mutex>
 
 // Simple histogram structure for tracking statistics over a bounded set of float values.
 // Average() is always available with O(1) performance.  Max() and Min() are calculated lazily on demand.
@@ -4,6 +4,10 @@
 // Licensed under the MIT license
 
 #include "pch.h"
+
+#include <cmath>
+#include <memory>
+
 #include "Time.h"
 
 namespace NowSound
@@ -46,6 +50,16 @@ namespace NowSound
         // </remarks>
     public:
         virtual Interval<TTime> MapNextSubInterval(const IStream<TTime>* stream, Interval<TTime> input) const = 0;
+
+        // The number of fractional bits in the fixed-point sub-sample phases returned by SubSamplePhase.
+        static const int PhaseBits = 16;
+
+        // The sub-sample phase of the mapping of the given time, in units of 1/(1 << PhaseBits) of a TTime.
+        //
+        // The mapped interval returned by MapNextSubInterval is always discrete; this is the fraction of a
+        // TTime by which the exact (continuous) mapped position lies *after* the discrete mapped position.
+        // Mappers which never map to fractional positions return 0.
+        virtual int SubSamplePhase(const IStream<TTime>*, Time<TTime>) const { return 0; }
     };
 
     // Identity mapping.
@@ -94,11 +108,71 @@ namespace NowSound
     };
 
     // Accurate mapper that takes fractional samples into account, ensuring accurate BPM playback over indefinite intervals
-    // for arbitrary durations.  (This may not matter as much as I think but it was a nice problem to get precise about...
-    // without this, a one second loop at 48Khz would drift by 1/10 second after 160 minutes, which just seems wrong in principle.)
+    // for arbitrary durations.  (Without this, a one second loop at 48Khz would drift by 1/10 second after 160 minutes,
+    // which just seems wrong in principle.)  It tracks the loop phase without accumulating roundoff, so a loop with a
+    // fractional ContinuousDuration plays at exactly that duration, with no drift, for sessions of any realistic length.
+    //
+    // Loop iteration k begins at the exact position k * ExactDuration; its first discrete sample is the first
+    // sample at or after that position.  So the iterations have discrete lengths of either the floor or the
+    // ceiling of ExactDuration, and SubSamplePhase reports (in fixed point) how far each iteration's discrete start
+    // lags its exact start (which an interpolating reader can use to remove even that sub-sample jitter).
+    //
+    // The whole TTimes of k * ExactDuration are computed in 64-bit integers, and only k times the fraction of
+    // ExactDuration in double; that product is below k, so it stays exact to far under a sample long after any
+    // rounded duration would have drifted by whole samples.
     template<typename TTime>
     class ExactLoopingIntervalMapper : public IntervalMapper<TTime>
     {
+    private:
+        // An exact start within this much of a whole TTime is taken to be on it.  ExactDuration is itself rounded
+        // (e.g. 48000 * 60 / 97), so a start which should land exactly on a sample can compute as a hair past it.
+        static constexpr double Epsilon = 1e-6;
+
+        // The discrete time (relative to the start of the stream) at which the given loop iteration begins, and
+        // how far that lags the iteration's exact start, as a fraction of a TTime.
+        static int64_t IterationStart(int64_t wholeDuration, double fractionalDuration, int64_t loopIndex, double* lag)
+        {
+            double fractionalStart = loopIndex * fractionalDuration;
+            double ceiling = std::ceil(fractionalStart - Epsilon);
+            *lag = (std::max)(0.0, ceiling - fractionalStart);
+            return loopIndex * wholeDuration + (int64_t)ceiling;
+        }
+
+        // Find the index of the loop iteration containing the given time, the discrete time at which it begins and
+        // the one at which the next begins (both relative to the start of the stream), and how far its discrete
+        // start lags its exact start.
+        static void FindIteration(
+            const IStream<TTime>* stream,
+            Time<TTime> time,
+            int64_t* loopIndex,
+            int64_t* loopStart,
+            int64_t* nextLoopStart,
+            double* lag)
+        {
+            Check(stream->IsShut());
+            Check(time >= stream->InitialTime());
+
+            double exactDuration = stream->ExactDuration().Value();
+            Check(exactDuration > 0);
+            int64_t wholeDuration = (int64_t)std::floor(exactDuration);
+            double fractionalDuration = exactDuration - wholeDuration;
+
+            // the double quotient can be off by one right at an iteration boundary; settle it exactly
+            int64_t loopRelativeTime = (time - stream->InitialTime()).Value();
+            *loopIndex = (int64_t)(loopRelativeTime / exactDuration);
+            double nextLag;
+            while (*loopIndex > 0 && IterationStart(wholeDuration, fractionalDuration, *loopIndex, lag) > loopRelativeTime)
+            {
+                (*loopIndex)--;
+            }
+            while (IterationStart(wholeDuration, fractionalDuration, *loopIndex + 1, &nextLag) <= loopRelativeTime)
+            {
+                (*loopIndex)++;
+            }
+            *loopStart = IterationStart(wholeDuration, fractionalDuration, *loopIndex, lag);
+            *nextLoopStart = IterationStart(wholeDuration, fractionalDuration, *loopIndex + 1, &nextLag);
+        }
+
     public:
         ExactLoopingIntervalMapper()
         {
@@ -106,56 +180,163 @@ namespace NowSound
 
         virtual Interval<TTime> MapNextSubInterval(const IStream<TTime>* stream, Interval<TTime> input) const
         {
-            Check(stream->IsShut());
+            int64_t loopIndex;
+            int64_t loopStart;
+            int64_t nextLoopStart;
+            double lag;
+            FindIteration(stream, input.InitialTime(), &loopIndex, &loopStart, &nextLoopStart, &lag);
+
+            int64_t loopRelativeTime = (input.InitialTime() - stream->InitialTime()).Value();
+            Check(loopStart <= loopRelativeTime && loopRelativeTime < nextLoopStart);
+
+            Duration<TTime> offset = loopRelativeTime - loopStart;
+            Duration<TTime> mappedDuration = std::min(input.IntervalDuration().Value(), nextLoopStart - loopRelativeTime);
+            return Interval<TTime>(stream->InitialTime() + offset, mappedDuration);
+        }
+
+        virtual int SubSamplePhase(const IStream<TTime>* stream, Time<TTime> time) const
+        {
+            int64_t loopIndex;
+            int64_t loopStart;
+            int64_t nextLoopStart;
+            double lag;
+            FindIteration(stream, time, &loopIndex, &loopStart, &nextLoopStart, &lag);
+
+            const int one = 1 << IntervalMapper<TTime>::PhaseBits;
+            return (std::min)(one - 1, (int)std::llround(lag * one));
+        }
+    };
+
+    // Maps the times a loop is played at to the positions read from it, for playback effects which read a loop other
+    // than straight through: backwards, faster or slower, or repeating a window of it.
+    //
+    // Positions are offsets from the start of the stream, in fixed point with IntervalMapper::PhaseBits of fraction;
+    // fractional positions are read by interpolating, and positions wrap around the loop.  A mapper starts from an
+    // anchor, the time it took effect and the position read then; meanwhile the loop's own position moves on, so
+    // dropping the mapper rejoins the loop in time.  Mappers never touch the stream's data, so switching between
+    // them while the loop plays costs no copying at all.
+    template<typename TTime>
+    class PlaybackMapper
+    {
+    protected:
+        // The time the mapper took effect.
+        Time<TTime> _anchorTime;
+
+        // The position read at _anchorTime.
+        int64_t _anchorPosition;
+
+    public:
+        // The stream's exact duration, in fixed point.  Positions wrap at this, not at the discrete duration, so a
+        // mapper goes round the loop exactly as often as ExactLoopingIntervalMapper's iterations do, rather
+        // than falling a fraction of a TTime further behind every time round.
+        static int64_t LoopDuration(const IStream<TTime>* stream)
+        {
+            return std::llround(stream->ExactDuration().Value() * ((int64_t)1 << IntervalMapper<TTime>::PhaseBits));
+        }
+
+        // Reduce the given position into the stream's exact duration.
+        static int64_t Wrap(const IStream<TTime>* stream, int64_t position)
+        {
+            int64_t duration = LoopDuration(stream);
+            return ((position % duration) + duration) % duration;
+        }
+
+        // The fastest a mapper may read, in TTimes per TTime played, forwards or backwards.
+        static const int MaxSpeed = 2;
+
+        PlaybackMapper(Time<TTime> anchorTime, int64_t anchorPosition)
+            : _anchorTime{ anchorTime }, _anchorPosition{ anchorPosition }
+        {
+        }
+
+        virtual ~PlaybackMapper() {}
+
+        // A copy of this mapper, for reading a snapshot of the stream while this one plays on.
+        virtual std::unique_ptr<PlaybackMapper<TTime>> Clone() const = 0;
+
+        // Map the start of the given interval, which must not start before the anchor time: set *position to the
+        // position read at its start, wrapped into the stream, and *step to how far the position moves per TTime
+        // played.  Returns how much of the interval reads on at that step; as with MapNextSubInterval, call again
+        // with the rest of the interval.
+        virtual Duration<TTime> MapNextSegment(const IStream<TTime>* stream, Interval<TTime> input, int64_t* position, int64_t* step) const = 0;
+
+        // The position read at the given time; the anchor for a mapper taking over from this one.
+        int64_t PositionAt(const IStream<TTime>* stream, Time<TTime> time) const
+        {
+            int64_t position;
+            int64_t step;
+            MapNextSegment(stream, Interval<TTime>(time, 1), &position, &step);
+            return position;
+        }
+
+        // The position read at the given time when playing the stream straight through its interval mapper.
+        static int64_t LoopPosition(const IStream<TTime>* stream, const IntervalMapper<TTime>* mapper, Time<TTime> time)
+        {
+            Interval<TTime> mappedInterval = mapper->MapNextSubInterval(stream, Interval<TTime>(time, 1));
+            return ((mappedInterval.InitialTime() - stream->InitialTime()).Value() << IntervalMapper<TTime>::PhaseBits)
+                + mapper->SubSamplePhase(stream, time);
+        }
+    };
+
+    // Plays the loop at a constant speed from the anchor: a step of one TTime per TTime is normal speed, half that
+    // is half speed (and an octave down), and a negative step plays backwards.
+    template<typename TTime>
+    class SpeedPlaybackMapper : public PlaybackMapper<TTime>
+    {
+    private:
+        // The fixed-point distance read per TTime played.
+        int64_t _step;
+
+    public:
+        SpeedPlaybackMapper(Time<TTime> anchorTime, int64_t anchorPosition, int64_t step)
+            : PlaybackMapper<TTime>(anchorTime, anchorPosition), _step{ step }
+        {
+            Check(step != 0);
+            Check(std::abs(step) <= ((int64_t)PlaybackMapper<TTime>::MaxSpeed << IntervalMapper<TTime>::PhaseBits));
+        }
+
+        virtual std::unique_ptr<PlaybackMapper<TTime>> Clone() const
+        {
+            return std::unique_ptr<PlaybackMapper<TTime>>(new SpeedPlaybackMapper<TTime>(*this));
+        }
+
+        virtual Duration<TTime> MapNextSegment(const IStream<TTime>* stream, Interval<TTime> input, int64_t* position, int64_t* step) const
+        {
+            Check(input.InitialTime() >= this->_anchorTime);
+
+            *position = this->Wrap(stream, this->_anchorPosition + (input.InitialTime() - this->_anchorTime).Value() * _step);
+            *step = _step;
+            return input.IntervalDuration();
+        }
+    };
+
+    // Repeats the window of the loop which starts at the anchor, at normal speed, for a beat-repeat or stutter.
+    template<typename TTime>
+    class StutterPlaybackMapper : public PlaybackMapper<TTime>
+    {
+    private:
+        Duration<TTime> _windowDuration;
+
+    public:
+        StutterPlaybackMapper(Time<TTime> anchorTime, int64_t anchorPosition, Duration<TTime> windowDuration)
+            : PlaybackMapper<TTime>(anchorTime, anchorPosition), _windowDuration{ windowDuration }
+        {
+            Check(windowDuration.Value() > 0);
+        }
+
+        virtual std::unique_ptr<PlaybackMapper<TTime>> Clone() const
+        {
+            return std::unique_ptr<PlaybackMapper<TTime>>(new StutterPlaybackMapper<TTime>(*this));
+        }
+
+        virtual Duration<TTime> MapNextSegment(const IStream<TTime>* stream, Interval<TTime> input, int64_t* position, int64_t* step) const
+        {
+            Check(input.InitialTime() >= this->_anchorTime);
 
-            // for example reference
-            /*
-            LoopMult=AbsoluteTiem/ContinuousDuration
-            LoopIndex=FLOOR(LoopMult,1)
-            InitialTime=FLOOR(AbsoluteTime-(LoopIndex*ContinuousDuration),1)
-            Duration=CEILING((LoopIndex+1)*ContinuousDuration-AbsoluteTime,1)
-
-            FOr example, with ContinuousDuration 2.4:
-
-            Absolute time   LoopMult        LoopIndex   InitialTime        Duration
-            0                0                  0            0                3
-            1                0.416666667        0            1                2
-            2                0.833333333        0            2                1
-            3                1.25               1            0                2
-            4                1.666666667        1            1                1
-            5                2.083333333        2            0                3
-            6                2.5                2            1                2
-            7                2.916666667        2            2                1
-            8                3.333333333        3            0                2
-            9                3.75               3            1                1
-            10               4.166666667        4            0                2
-            11               4.583333333        4            1                1
-            12               5                  5            0                3
-            13               5.416666667        5            1                2
-            14               5.833333333        5            2                1
-            15               6.25               6            0                2
-            16               6.666666667        6            1                1
-            17               7.083333333        7            0                3
-            18               7.5                7            1                2
-            */
-
-            // First thing we do is, subtract our initial time from the initial time of the input.
-            Duration<TTime> loopRelativeInitialTime = input.InitialTime() - stream->InitialTime();
-            float exactDuration = stream->ExactDuration().Value();
-
-            // Now, we need to figure out how many multiples of the stream's CONTINUOUS length this is.
-            // In other words, we want adjustedInitialTime modulo the real-valued length of this stream.
-            // This is critical to avoid iterated roundoff error with streams that are a multiple of a
-            // fractional duration in length.
-            float loopMult = loopRelativeInitialTime.Value() / exactDuration;
-            int loopIndex = (int)loopMult;
-
-            Duration<TTime> adjustedLoopRelativeInitialTime =
-                (int)(loopRelativeInitialTime.Value() - (loopIndex * exactDuration));
-
-            int duration = (int)std::ceil((loopIndex + 1) * exactDuration - loopRelativeInitialTime.Value());
-
-            return Interval<TTime>(stream->InitialTime() + adjustedLoopRelativeInitialTime, duration);
+            int64_t windowOffset = (input.InitialTime() - this->_anchorTime).Value() % _windowDuration.Value();
+            *position = this->Wrap(stream, this->_anchorPosition + (windowOffset << IntervalMapper<TTime>::PhaseBits));
+            *step = (int64_t)1 << IntervalMapper<TTime>::PhaseBits;
+            return std::min(input.IntervalDuration().Value(), _windowDuration.Value() - windowOffset);
         }
     };
 }
@@ -0,0 +1,169 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#include "Check.h"
+#include "LatencyHistogram.h"
+
+using namespace NowSound;
+
+namespace
+{
+    // The index of the highest set bit of value, which must be nonzero.
+    int HighestBit(uint32_t value)
+    {
+#if defined(_MSC_VER)
+        unsigned long index;
+        _BitScanReverse(&index, value);
+        return (int)index;
+#else
+        return 31 - __builtin_clz(value);
+#endif
+    }
+}
+
+LatencyHistogram::LatencyHistogram(float resolution)
+    : _resolution{ resolution },
+    _unitsPerValue{ 1.0 / resolution },
+    _counts{ new std::atomic<uint32_t>[BucketCount] },
+    _min{ UINT32_MAX },
+    _max{ 0 }
+{
+    Check(resolution > 0);
+    Reset();
+}
+
+int LatencyHistogram::BucketIndex(uint32_t value)
+{
+    if (value < (uint32_t)SubBucketCount)
+    {
+        // the first SubBucketCount values each get a bucket of their own
+        return (int)value;
+    }
+    // Halve value until it fits in the top half of the sub-buckets; each halving is another power-of-two range.
+    int shift = HighestBit(value) - (SubBucketBits - 1);
+    return shift * SubBucketHalfCount + (int)(value >> shift);
+}
+
+uint32_t LatencyHistogram::BucketLowestValue(int index)
+{
+    if (index < SubBucketCount)
+    {
+        return (uint32_t)index;
+    }
+    int shift = index / SubBucketHalfCount - 1;
+    return (uint32_t)(index - shift * SubBucketHalfCount) << shift;
+}
+
+uint32_t LatencyHistogram::BucketHighestValue(int index)
+{
+    int shift = index < SubBucketCount ? 0 : index / SubBucketHalfCount - 1;
+    return BucketLowestValue(index) + ((1u << shift) - 1);
+}
+
+void LatencyHistogram::Record(float value)
+{
+    // Round to the nearest unit, saturating (and sending NaN to zero).
+    double scaled = value * _unitsPerValue + 0.5;
+    uint32_t units = !(scaled >= 1) ? 0 : scaled >= (double)UINT32_MAX ? UINT32_MAX : (uint32_t)scaled;
+
+    _counts[BucketIndex(units)].fetch_add(1, std::memory_order_relaxed);
+
+    // These loops almost never go around more than once, since new extremes are rare.
+    uint32_t min = _min.load(std::memory_order_relaxed);
+    while (units < min && !_min.compare_exchange_weak(min, units, std::memory_order_relaxed))
+    {
+    }
+    uint32_t max = _max.load(std::memory_order_relaxed);
+    while (units > max && !_max.compare_exchange_weak(max, units, std::memory_order_relaxed))
+    {
+    }
+}
+
+int64_t LatencyHistogram::Count() const
+{
+    uint64_t total = 0;
+    for (int i = 0; i < BucketCount; i++)
+    {
+        total += _counts[i].load(std::memory_order_relaxed);
+    }
+    return (int64_t)total;
+}
+
+float LatencyHistogram::Min() const
+{
+    uint32_t min = _min.load(std::memory_order_relaxed);
+    return min == UINT32_MAX ? 0 : min * _resolution;
+}
+
+float LatencyHistogram::Max() const
+{
+    return _max.load(std::memory_order_relaxed) * _resolution;
+}
+
+float LatencyHistogram::Percentile(double percentile) const
+{
+    Check(percentile >= 0 && percentile <= 100);
+
+    uint64_t total = (uint64_t)Count();
+    if (total == 0)
+    {
+        return 0;
+    }
+
+    // The rank of the value we want, counting from 1; the 0th percentile is the smallest value.
+    uint64_t rank = (std::max)((uint64_t)1, (uint64_t)std::ceil(percentile / 100 * total));
+    uint64_t seen = 0;
+    for (int i = 0; i < BucketCount; i++)
+    {
+        seen += _counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank)
+        {
+            return (std::min)(BucketHighestValue(i), _max.load(std::memory_order_relaxed)) * _resolution;
+        }
+    }
+    return Max();
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+    Check(other._resolution == _resolution);
+
+    for (int i = 0; i < BucketCount; i++)
+    {
+        uint32_t count = other._counts[i].load(std::memory_order_relaxed);
+        if (count > 0)
+        {
+            _counts[i].fetch_add(count, std::memory_order_relaxed);
+        }
+    }
+
+    uint32_t otherMin = other._min.load(std::memory_order_relaxed);
+    uint32_t min = _min.load(std::memory_order_relaxed);
+    while (otherMin < min && !_min.compare_exchange_weak(min, otherMin, std::memory_order_relaxed))
+    {
+    }
+    uint32_t otherMax = other._max.load(std::memory_order_relaxed);
+    uint32_t max = _max.load(std::memory_order_relaxed);
+    while (otherMax > max && !_max.compare_exchange_weak(max, otherMax, std::memory_order_relaxed))
+    {
+    }
+}
+
+void LatencyHistogram::Reset()
+{
+    for (int i = 0; i < BucketCount; i++)
+    {
+        _counts[i].store(0, std::memory_order_relaxed);
+    }
+    _min.store(UINT32_MAX, std::memory_order_relaxed);
+    _max.store(0, std::memory_order_relaxed);
+}
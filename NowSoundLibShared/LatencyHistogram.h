@@ -0,0 +1,89 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <memory>
+
+#include "stdint.h"
+
+namespace NowSound
+{
+    // Fixed-memory histogram of non-negative values (typically latencies or intervals), in the style of
+    // HdrHistogram: counts are kept in log-linear buckets, so every value is recorded to within about 1% of its
+    // magnitude, however widely the values range.  Unlike Histogram, this keeps every value since the last
+    // Reset(), so it can report any percentile -- including the rare spikes that averages hide.
+    //
+    // Record() is O(1), lock-free and allocation-free, so it is safe to call from the audio thread (from any
+    // number of threads at once, even).  Reading percentiles while recording is in progress is safe too, though
+    // the result may miss the very latest values.
+    class LatencyHistogram
+    {
+    public:
+        // Each power-of-two range of values is divided into 2^(SubBucketBits - 1) linear sub-buckets, which
+        // sets the precision: 7 bits bounds the recorded error to 1/64 (about 1.6%).
+        static const int SubBucketBits = 7;
+        static const int SubBucketCount = 1 << SubBucketBits;
+        static const int SubBucketHalfCount = SubBucketCount / 2;
+
+        // Values are recorded as (value / resolution) rounded to an integer, and saturate at 2^ValueBits - 1.
+        static const int ValueBits = 32;
+
+        // The number of buckets needed to cover every value below 2^ValueBits.
+        static const int BucketCount = (ValueBits - SubBucketBits + 2) * SubBucketHalfCount;
+
+    private:
+        // The size of one integer unit of recorded value, and its reciprocal.
+        const float _resolution;
+        const double _unitsPerValue;
+
+        // The number of values recorded in each bucket.  (There is deliberately no separate total count, which
+        // would cost Record() another atomic increment; Count() sums the buckets instead.)
+        std::unique_ptr<std::atomic<uint32_t>[]> _counts;
+
+        // The exact extreme values recorded, in units of _resolution; _min is UINT32_MAX when empty.
+        std::atomic<uint32_t> _min;
+        std::atomic<uint32_t> _max;
+
+        // The bucket a value falls into.
+        static int BucketIndex(uint32_t value);
+
+        // The smallest and largest values in the given bucket.
+        static uint32_t BucketLowestValue(int index);
+        static uint32_t BucketHighestValue(int index);
+
+    public:
+        // Construct an empty histogram recording values to the given resolution (e.g. 0.1 microseconds).
+        LatencyHistogram(float resolution);
+
+        // Not copyable (it is pretty big, and the counts are atomic); use Merge to combine histograms.
+        LatencyHistogram(const LatencyHistogram& other) = delete;
+        LatencyHistogram& operator=(const LatencyHistogram& other) = delete;
+
+        float Resolution() const { return _resolution; }
+
+        // Record one value; negative values record as zero.
+        void Record(float value);
+
+        // The number of values recorded since the last Reset().  O(BucketCount), like Percentile().
+        int64_t Count() const;
+
+        // The smallest and largest values recorded since the last Reset(); 0 if empty.
+        float Min() const;
+        float Max() const;
+
+        // The value below which the given percentage (0 to 100) of the recorded values fall; 0 if empty.
+        // This is the highest value of the bucket the percentile falls in (so it never understates the
+        // percentile by more than the histogram's precision), but never more than Max().
+        float Percentile(double percentile) const;
+
+        // Add all of other's values into this histogram; both must have the same resolution.
+        void Merge(const LatencyHistogram& other);
+
+        // Forget all recorded values.  Values being recorded concurrently may or may not survive.
+        void Reset();
+    };
+}
@@ -0,0 +1,137 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <deque>
+#include <memory>
+#include <vector>
+
+#include "Check.h"
+#include "SliceStream.h"
+
+namespace NowSound
+{
+    // The analysis kept with each version of a LoopHistory which keeps none.
+    struct NoLoopAnalysis
+    {
+    };
+
+    // The versions of a loop, for undo and redo.
+    //
+    // Each version is a shut stream which nothing writes any more, made as a Snapshot of the version before it
+    // (and then, say, overdubbed); so each shares with the version before it every buffer it did not change, and
+    // costs memory only for the buffers it did.  Each version can also keep an analysis of itself, so undo and
+    // redo just move which version (and so which analysis) is current, and never reanalyze.
+    //
+    // Not thread-safe; the owner must keep readers of the current version from racing with changes to it.
+    template<typename TTime, typename TValue, typename TAnalysis = NoLoopAnalysis>
+    class LoopHistory
+    {
+    public:
+        struct Version
+        {
+            std::unique_ptr<BufferedSliceStream<TTime, TValue>> Stream;
+
+            // Null if none.  Declared after Stream, so destroyed first, as an analysis may still be reading it.
+            std::unique_ptr<TAnalysis> Analysis;
+        };
+
+    private:
+        // Oldest first.
+        std::deque<Version> _versions;
+
+        // The index of the current version in _versions; -1 if there are none.
+        int _current;
+
+    public:
+        LoopHistory() : _versions{}, _current{ -1 } {}
+
+        // no copying this
+        LoopHistory(const LoopHistory&) = delete;
+
+        bool IsEmpty() const { return _versions.empty(); }
+
+        int VersionCount() const { return (int)_versions.size(); }
+
+        int CurrentIndex() const { return _current; }
+
+        // The current version; null if there are none.
+        BufferedSliceStream<TTime, TValue>* Current() const { return _current < 0 ? nullptr : _versions[_current].Stream.get(); }
+
+        // The analysis of the current version; null if there are no versions, or it has none.
+        TAnalysis* CurrentAnalysis() const { return _current < 0 ? nullptr : _versions[_current].Analysis.get(); }
+
+        bool CanUndo() const { return _current > 0; }
+        bool CanRedo() const { return _current + 1 < (int)_versions.size(); }
+
+        // Make the previous version current.
+        void Undo()
+        {
+            Check(CanUndo());
+            _current--;
+        }
+
+        // Make the next version current again.
+        void Redo()
+        {
+            Check(CanRedo());
+            _current++;
+        }
+
+        // Make the given stream (with its analysis, if any) the newest version, and the current one.  It must be
+        // shut, and (unless it is the first) derived from a Snapshot of the current version.  The versions after
+        // the current one can then no longer be redone, so are dropped; and then the oldest versions are dropped
+        // until all together hold no more than memoryCapInBytes (0 for no cap), though the current version always
+        // stays.
+        //
+        // Returns the dropped versions, so the caller can destroy them outside any lock it holds: destroying a
+        // version waits for its analysis, if that is still running.
+        std::vector<Version> Commit(
+            std::unique_ptr<BufferedSliceStream<TTime, TValue>>&& version,
+            int64_t memoryCapInBytes,
+            std::unique_ptr<TAnalysis>&& analysis = nullptr)
+        {
+            Check(version != nullptr && version->IsShut());
+            Check(memoryCapInBytes >= 0);
+
+            std::vector<Version> dropped;
+            for (size_t i = _current + 1; i < _versions.size(); i++)
+            {
+                dropped.push_back(std::move(_versions[i]));
+            }
+            _versions.erase(_versions.begin() + (_current + 1), _versions.end());
+            _versions.push_back(Version{ std::move(version), std::move(analysis) });
+            _current = (int)_versions.size() - 1;
+
+            while (memoryCapInBytes > 0 && _current > 0 && BufferBytes() > memoryCapInBytes)
+            {
+                dropped.push_back(std::move(_versions.front()));
+                _versions.pop_front();
+                _current--;
+            }
+            return dropped;
+        }
+
+        // The bytes in the buffers of all the versions, counting each buffer shared between versions just once.
+        int64_t BufferBytes() const
+        {
+            if (_versions.empty())
+            {
+                return 0;
+            }
+
+            // Once replaced, a buffer never comes back; so any buffer a version shares with an earlier version, it
+            // shares with the version just before it, and counting only the buffers each version does not share with
+            // the one before counts each buffer once.
+            int64_t bytes = _versions[0].Stream->BufferBytes();
+            for (size_t i = 1; i < _versions.size(); i++)
+            {
+                bytes += _versions[i].Stream->BufferBytesNotSharedWith(*_versions[i - 1].Stream);
+            }
+            return bytes;
+        }
+    };
+}
@@ -0,0 +1,341 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "AudioKernels.h"
+#include "Check.h"
+#include "MasterBus.h"
+
+using namespace NowSound;
+
+namespace
+{
+    const double Pi = 3.14159265358979323846;
+
+    // Raise the atomic to value, if value is higher.
+    void AtomicMax(std::atomic<float>& atomic, float value)
+    {
+        float current = atomic.load(std::memory_order_relaxed);
+        while (value > current && !atomic.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // Lower the atomic to value, if value is lower.
+    void AtomicMin(std::atomic<float>& atomic, float value)
+    {
+        float current = atomic.load(std::memory_order_relaxed);
+        while (value < current && !atomic.compare_exchange_weak(current, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    // The two stages of the ITU-R BS.1770 K-weighting filter at the given sample rate: a high shelf modelling the
+    // head, then a high pass.  (The standard gives coefficients only for 48Khz; these are its analog prototypes,
+    // which reproduce them exactly at 48Khz.)
+    BiquadCoefficients KWeightingShelf(float sampleRateHz)
+    {
+        const double frequencyHz = 1681.974450955533;
+        const double gainDb = 3.999843853973347;
+        const double q = 0.7071752369554196;
+        double k = std::tan(Pi * frequencyHz / sampleRateHz);
+        double vh = std::pow(10.0, gainDb / 20);
+        double vb = std::pow(vh, 0.4996667741545416);
+        double a0 = 1 + k / q + k * k;
+        return BiquadCoefficients{
+            (float)((vh + vb * k / q + k * k) / a0),
+            (float)(2 * (k * k - vh) / a0),
+            (float)((vh - vb * k / q + k * k) / a0),
+            (float)(2 * (k * k - 1) / a0),
+            (float)((1 - k / q + k * k) / a0) };
+    }
+
+    BiquadCoefficients KWeightingHighPass(float sampleRateHz)
+    {
+        const double frequencyHz = 38.13547087602444;
+        const double q = 0.5003270373238773;
+        double k = std::tan(Pi * frequencyHz / sampleRateHz);
+        double a0 = 1 + k / q + k * k;
+        return BiquadCoefficients{ 1, -2, 1, (float)(2 * (k * k - 1) / a0), (float)((1 - k / q + k * k) / a0) };
+    }
+}
+
+SlidingMaximum::SlidingMaximum(int windowLength)
+    : _windowLength{ windowLength },
+    _positions(windowLength),
+    _values(windowLength),
+    _front{ 0 },
+    _count{ 0 },
+    _position{ 0 }
+{
+    Check(windowLength > 0);
+}
+
+float SlidingMaximum::Push(float value)
+{
+    // drop the oldest candidate if it has left the window
+    if (_count > 0 && _positions[_front] <= _position - _windowLength)
+    {
+        _front = (_front + 1) % _windowLength;
+        _count--;
+    }
+
+    // drop the candidates this value outlasts and outweighs; each value is dropped at most once, hence O(1)
+    while (_count > 0 && _values[(_front + _count - 1) % _windowLength] <= value)
+    {
+        _count--;
+    }
+
+    int back = (_front + _count) % _windowLength;
+    _positions[back] = _position;
+    _values[back] = value;
+    _count++;
+    _position++;
+
+    return _values[_front];
+}
+
+LookaheadLimiter::LookaheadLimiter(int lookaheadFrames, float ceiling, float releaseFrames)
+    : _lookaheadFrames{ lookaheadFrames },
+    _ceiling{ ceiling },
+    _releaseCoefficient{ (float)(1 - std::exp(-1.0 / releaseFrames)) },
+    _peak{ lookaheadFrames + 1 },
+    _delay(lookaheadFrames * 2),
+    _delayPosition{ 0 },
+    _envelopes(lookaheadFrames + 1, 1.0f),
+    _envelopePosition{ 0 },
+    _envelopeSum{ (double)(lookaheadFrames + 1) },
+    _envelope{ 1 },
+    _minimumGain{ 1 }
+{
+    Check(lookaheadFrames > 0);
+    Check(ceiling > 0);
+    Check(releaseFrames > 0);
+}
+
+void LookaheadLimiter::Process(float* stereo, int frameCount)
+{
+    const int windowLength = _lookaheadFrames + 1;
+    float minimumGain = 1;
+    for (int i = 0; i < frameCount; i++)
+    {
+        float left = stereo[i * 2];
+        float right = stereo[i * 2 + 1];
+
+        float peak = _peak.Push((std::max)(std::abs(left), std::abs(right)));
+        float neededGain = peak > _ceiling ? _ceiling / peak : 1;
+        _envelope = neededGain < _envelope
+            ? neededGain
+            : _envelope + (neededGain - _envelope) * _releaseCoefficient;
+
+        _envelopeSum += _envelope - _envelopes[_envelopePosition];
+        _envelopes[_envelopePosition] = _envelope;
+        _envelopePosition = _envelopePosition + 1 == windowLength ? 0 : _envelopePosition + 1;
+        float gain = (float)(_envelopeSum / windowLength);
+        minimumGain = (std::min)(minimumGain, gain);
+
+        // The average can round a hair above the needed gain; clamp so that the ceiling is never exceeded.
+        float* delayed = &_delay[_delayPosition * 2];
+        stereo[i * 2] = (std::max)(-_ceiling, (std::min)(_ceiling, delayed[0] * gain));
+        stereo[i * 2 + 1] = (std::max)(-_ceiling, (std::min)(_ceiling, delayed[1] * gain));
+        delayed[0] = left;
+        delayed[1] = right;
+        _delayPosition = _delayPosition + 1 == _lookaheadFrames ? 0 : _delayPosition + 1;
+    }
+
+    AtomicMin(_minimumGain, minimumGain);
+}
+
+float LookaheadLimiter::TakeMinimumGain()
+{
+    return _minimumGain.exchange(1);
+}
+
+TruePeakMeter::TruePeakMeter()
+    : _coefficients{},
+    _history{},
+    _channel{},
+    _peak{ 0 },
+    _maximumPeak{ 0 }
+{
+    // The point phase / Oversampling of the way from tap TapCount / 2 - 1 to the next is at distance
+    // TapCount / 2 - 1 + phase / Oversampling - tap from each tap; weight each by a Hann-windowed sinc of that
+    // distance, normalized so that each phase passes DC unchanged.
+    const double halfWidth = TapCount / 2;
+    for (int phase = 1; phase < Oversampling; phase++)
+    {
+        double sum = 0;
+        for (int tap = 0; tap < TapCount; tap++)
+        {
+            double distance = halfWidth - 1 + (double)phase / Oversampling - tap;
+            double sinc = std::sin(Pi * distance) / (Pi * distance);
+            double window = 0.5 * (1 + std::cos(Pi * distance / halfWidth));
+            _coefficients[phase - 1][tap] = (float)(sinc * window);
+            sum += sinc * window;
+        }
+        for (int tap = 0; tap < TapCount; tap++)
+        {
+            _coefficients[phase - 1][tap] = (float)(_coefficients[phase - 1][tap] / sum);
+        }
+    }
+}
+
+void TruePeakMeter::Process(const float* stereo, int frameCount)
+{
+    const int historyLength = TapCount - 1;
+    if ((int)_channel.size() < historyLength + frameCount)
+    {
+        _channel.resize(historyLength + frameCount);
+    }
+
+    float peak = 0;
+    for (int channel = 0; channel < 2; channel++)
+    {
+        float* samples = _channel.data();
+        std::copy(_history[channel], _history[channel] + historyLength, samples);
+        for (int i = 0; i < frameCount; i++)
+        {
+            samples[historyLength + i] = stereo[i * 2 + channel];
+        }
+
+        // Each new sample completes the window around one more gap between samples, TapCount / 2 samples back;
+        // measure the sample before that gap, and the points in it.
+        for (int i = 0; i < frameCount; i++)
+        {
+            const float* window = samples + i;
+            peak = (std::max)(peak, std::abs(window[TapCount / 2 - 1]));
+            for (int phase = 0; phase < Oversampling - 1; phase++)
+            {
+                float value = 0;
+                for (int tap = 0; tap < TapCount; tap++)
+                {
+                    value += window[tap] * _coefficients[phase][tap];
+                }
+                peak = (std::max)(peak, std::abs(value));
+            }
+        }
+
+        std::copy(samples + frameCount, samples + frameCount + historyLength, _history[channel]);
+    }
+
+    AtomicMax(_peak, peak);
+    AtomicMax(_maximumPeak, peak);
+}
+
+float TruePeakMeter::TakePeak()
+{
+    return _peak.exchange(0);
+}
+
+LoudnessMeter::LoudnessMeter(float sampleRateHz)
+    : _bank{},
+    _kWeighting{},
+    _channels{},
+    _blockFrames{ (int)(sampleRateHz / 10) },
+    _blockPosition{ 0 },
+    _blockSumOfSquares{ 0 },
+    _blockPowers{},
+    _newestBlock{ 0 },
+    _momentaryLufs{ -std::numeric_limits<float>::infinity() },
+    _shortTermLufs{ -std::numeric_limits<float>::infinity() }
+{
+    Check(_blockFrames > 0);
+
+    for (BiquadCascade& cascade : _kWeighting)
+    {
+        cascade.SetStage(0, KWeightingShelf(sampleRateHz));
+        cascade.SetStage(1, KWeightingHighPass(sampleRateHz));
+    }
+    // Settle the cascades' coefficients (which otherwise glide in over the first block) on one sample of silence.
+    float silence[2] = { 0, 0 };
+    float* silencePointers[2] = { &silence[0], &silence[1] };
+    BiquadCascade* cascades[2] = { &_kWeighting[0], &_kWeighting[1] };
+    _bank.Process(cascades, silencePointers, 2, 1);
+}
+
+float LoudnessMeter::Lufs(double power)
+{
+    return power > 0 ? (float)(-0.691 + 10 * std::log10(power)) : -std::numeric_limits<float>::infinity();
+}
+
+void LoudnessMeter::CompleteBlock()
+{
+    _newestBlock = (_newestBlock + 1) % ShortTermBlockCount;
+    _blockPowers[_newestBlock] = _blockSumOfSquares / _blockFrames;
+    _blockSumOfSquares = 0;
+    _blockPosition = 0;
+
+    double momentary = 0;
+    double shortTerm = 0;
+    for (int age = 0; age < ShortTermBlockCount; age++)
+    {
+        double power = _blockPowers[(_newestBlock - age + ShortTermBlockCount) % ShortTermBlockCount];
+        shortTerm += power;
+        if (age < MomentaryBlockCount)
+        {
+            momentary += power;
+        }
+    }
+    _momentaryLufs = Lufs(momentary / MomentaryBlockCount);
+    _shortTermLufs = Lufs(shortTerm / ShortTermBlockCount);
+}
+
+void LoudnessMeter::Process(const float* stereo, int frameCount)
+{
+    for (std::vector<float>& channel : _channels)
+    {
+        if ((int)channel.size() < frameCount)
+        {
+            channel.resize(frameCount);
+        }
+    }
+
+    float* channels[2] = { _channels[0].data(), _channels[1].data() };
+    float absoluteSums[2] = { 0, 0 };
+    AudioKernels::Deinterleave(stereo, 2, frameCount, channels, absoluteSums);
+    BiquadCascade* cascades[2] = { &_kWeighting[0], &_kWeighting[1] };
+    _bank.Process(cascades, channels, 2, frameCount);
+
+    int i = 0;
+    while (i < frameCount)
+    {
+        int count = (std::min)(frameCount - i, _blockFrames - _blockPosition);
+        double sum = 0;
+        for (int j = i; j < i + count; j++)
+        {
+            sum += channels[0][j] * channels[0][j] + channels[1][j] * channels[1][j];
+        }
+        _blockSumOfSquares += sum;
+        _blockPosition += count;
+        i += count;
+
+        if (_blockPosition == _blockFrames)
+        {
+            CompleteBlock();
+        }
+    }
+}
+
+MasterBus::MasterBus(float sampleRateHz, int lookaheadFrames, float ceilingDb, float releaseSeconds)
+    : _limiter{ lookaheadFrames, std::pow(10.0f, ceilingDb / 20), releaseSeconds * sampleRateHz },
+    _truePeakMeter{},
+    _loudnessMeter{ sampleRateHz }
+{
+}
+
+void MasterBus::Process(float* stereo, int frameCount)
+{
+    _limiter.Process(stereo, frameCount);
+    _truePeakMeter.Process(stereo, frameCount);
+    _loudnessMeter.Process(stereo, frameCount);
+}
+
+float MasterBus::ToDb(float amplitude)
+{
+    return amplitude > 0 ? 20 * std::log10(amplitude) : -std::numeric_limits<float>::infinity();
+}
@@ -0,0 +1,189 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <vector>
+
+#include "BiquadBank.h"
+
+namespace NowSound
+{
+    // The maximum of the last WindowLength values pushed, in amortized O(1) time per value: keeps only the values
+    // which could still become the maximum (each larger than all pushed after it), in a fixed ring, so it never
+    // allocates after construction.
+    class SlidingMaximum
+    {
+    private:
+        const int _windowLength;
+
+        // The candidates, oldest (and largest) first, as a ring of _windowLength entries starting at _front.
+        std::vector<int64_t> _positions;
+        std::vector<float> _values;
+        int _front;
+        int _count;
+
+        // The position of the next value pushed.
+        int64_t _position;
+
+    public:
+        SlidingMaximum(int windowLength);
+
+        // Push the next value, and return the maximum of the last windowLength values (fewer, at first).
+        float Push(float value);
+    };
+
+    // A brickwall limiter for interleaved stereo, which looks ahead so that it can turn the gain down smoothly
+    // *before* each peak, rather than distorting it.
+    //
+    // Each frame's gain is the box average, over lookahead + 1 frames, of an envelope which attacks instantly to
+    // the gain needed by the loudest frame within the lookahead window (a sliding maximum) and releases
+    // exponentially.  So by the time a peak emerges from the delay line, every gain in the average is at most the
+    // gain that peak needs, and the output never exceeds the ceiling.
+    class LookaheadLimiter
+    {
+    private:
+        const int _lookaheadFrames;
+        const float _ceiling;
+
+        // The fraction of the way back up to the needed gain the envelope rises each frame.
+        const float _releaseCoefficient;
+
+        SlidingMaximum _peak;
+
+        // The last lookaheadFrames frames of input, interleaved, as a ring.
+        std::vector<float> _delay;
+        int _delayPosition;
+
+        // The last lookaheadFrames + 1 envelope values, as a ring, and their sum.
+        std::vector<float> _envelopes;
+        int _envelopePosition;
+        double _envelopeSum;
+
+        float _envelope;
+
+        // The least gain applied since the last TakeMinimumGain.
+        std::atomic<float> _minimumGain;
+
+    public:
+        // ceiling is linear (1 = full scale); releaseFrames is the time constant of the release.
+        LookaheadLimiter(int lookaheadFrames, float ceiling, float releaseFrames);
+
+        // The delay the limiter adds.
+        int LatencyFrames() const { return _lookaheadFrames; }
+
+        // Limit frameCount frames of interleaved stereo in place (delaying them by LatencyFrames()).
+        void Process(float* stereo, int frameCount);
+
+        // The least gain (the most gain reduction) applied since the last call; 1 if none.  Any thread.
+        float TakeMinimumGain();
+    };
+
+    // Measures the true (inter-sample) peak of interleaved stereo, as ITU-R BS.1770 specifies: oversample four
+    // times, and take the largest absolute value.  The oversampling filter is a windowed sinc, in polyphase form.
+    // (The cubic PolyphaseInterpolator would be cheaper, but reads about a dB low on peaks at a quarter of the
+    // sample rate.)
+    class TruePeakMeter
+    {
+    public:
+        static const int Oversampling = 4;
+
+        // The taps per phase of the oversampling filter.
+        static const int TapCount = 12;
+
+    private:
+        // The filter for each of the Oversampling - 1 points between two samples.
+        float _coefficients[Oversampling - 1][TapCount];
+
+        // The last TapCount - 1 samples of each channel.
+        float _history[2][TapCount - 1];
+
+        // One channel's history followed by its new samples; only ever grows.
+        std::vector<float> _channel;
+
+        // The highest peak since the last TakePeak, and ever.
+        std::atomic<float> _peak;
+        std::atomic<float> _maximumPeak;
+
+    public:
+        TruePeakMeter();
+
+        void Process(const float* stereo, int frameCount);
+
+        // The highest absolute true peak since the last call (linear).  Any thread.
+        float TakePeak();
+
+        // The highest absolute true peak ever measured (linear).  Any thread.
+        float MaximumPeak() const { return _maximumPeak; }
+    };
+
+    // Measures the EBU R128 momentary (400 ms) and short-term (3 s) loudness of interleaved stereo.
+    //
+    // The audio is K-weighted (through a BiquadBank, one channel per lane), and then summarized in 100 ms blocks,
+    // keeping only each block's mean square; both loudnesses are then power averages over the most recent blocks,
+    // so no audio is stored, and each is updated ten times a second.
+    class LoudnessMeter
+    {
+    public:
+        static const int MomentaryBlockCount = 4;
+        static const int ShortTermBlockCount = 30;
+
+    private:
+        BiquadBank _bank;
+        BiquadCascade _kWeighting[2];
+
+        // Each channel's K-weighted audio, deinterleaved; only ever grows.
+        std::vector<float> _channels[2];
+
+        const int _blockFrames;
+        int _blockPosition;
+        double _blockSumOfSquares;
+
+        // The mean squares of the last ShortTermBlockCount blocks, as a ring (initially silence).
+        double _blockPowers[ShortTermBlockCount];
+        int _newestBlock;
+
+        std::atomic<float> _momentaryLufs;
+        std::atomic<float> _shortTermLufs;
+
+        // The loudness, in LUFS, of the given mean square summed over channels.
+        static float Lufs(double power);
+
+        void CompleteBlock();
+
+    public:
+        LoudnessMeter(float sampleRateHz);
+
+        void Process(const float* stereo, int frameCount);
+
+        // The loudnesses as of the last complete block, in LUFS (negative infinity for silence).  Any thread.
+        float MomentaryLufs() const { return _momentaryLufs; }
+        float ShortTermLufs() const { return _shortTermLufs; }
+    };
+
+    // The last stage of the output: the limiter, then the meters (which so measure what is actually heard).
+    class MasterBus
+    {
+    private:
+        LookaheadLimiter _limiter;
+        TruePeakMeter _truePeakMeter;
+        LoudnessMeter _loudnessMeter;
+
+    public:
+        MasterBus(float sampleRateHz, int lookaheadFrames, float ceilingDb, float releaseSeconds);
+
+        // Limit and meter frameCount frames of interleaved stereo in place.  Never allocates after the first few
+        // calls.
+        void Process(float* stereo, int frameCount);
+
+        LookaheadLimiter& Limiter() { return _limiter; }
+        TruePeakMeter& TruePeak() { return _truePeakMeter; }
+        const LoudnessMeter& Loudness() const { return _loudnessMeter; }
+
+        // Convert a linear amplitude to decibels (negative infinity for 0).
+        static float ToDb(float amplitude);
+    };
+}
@@ -0,0 +1,136 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "Check.h"
+#include "MemorySlab.h"
+#include "RealTimeThread.h"
+
+using namespace NowSound;
+
+namespace
+{
+    size_t PageSize()
+    {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        return info.dwPageSize;
+#else
+        return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    // Make the OS supply physical pages for the given range, without changing its contents; returns whether they
+    // are locked in, too.
+    bool FaultIn(char* data, size_t byteCount, size_t pageSize)
+    {
+        // Locking faults the pages in as a side effect (and keeps them in); if the OS refuses to lock any more,
+        // we still want the pages faulted in.
+        if (RealTimeThread::LockMemory(data, byteCount))
+        {
+            return true;
+        }
+
+#if defined(MADV_POPULATE_WRITE)
+        if (madvise(data, byteCount, MADV_POPULATE_WRITE) == 0)
+        {
+            return false;
+        }
+#endif
+
+        // Reading a page faults it in (on Linux, only as a shared zero page until written, but that is the most
+        // we can do without writing to memory someone may already be using).
+        for (size_t offset = 0; offset < byteCount; offset += pageSize)
+        {
+            (void)*(volatile char*)(data + offset);
+        }
+        return false;
+    }
+}
+
+MemorySlab::MemorySlab(size_t byteCount)
+    : _data{ nullptr },
+    _byteCount{ (byteCount + PageSize() - 1) / PageSize() * PageSize() },
+    _prefaultedByteCount{ 0 },
+    _lockedByteCount{ 0 },
+    _isStopping{ false },
+    _prefaultThread{}
+{
+    Check(byteCount > 0);
+
+#if defined(_WIN32)
+    // Committing only charges the commit limit; physical pages are still supplied on first touch.
+    _data = VirtualAlloc(nullptr, _byteCount, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    Check(_data != nullptr);
+#else
+    _data = mmap(nullptr, _byteCount, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    Check(_data != MAP_FAILED);
+#endif
+}
+
+MemorySlab::~MemorySlab()
+{
+    _isStopping = true;
+    WaitForPrefault();
+
+#if defined(_WIN32)
+    VirtualFree(_data, 0, MEM_RELEASE);
+#else
+    munmap(_data, _byteCount);
+#endif
+}
+
+void MemorySlab::PrefaultChunks(size_t chunkByteCount)
+{
+    Check(chunkByteCount > 0);
+
+    size_t pageSize = PageSize();
+    while (!_isStopping && _prefaultedByteCount < _byteCount)
+    {
+        size_t begin = _prefaultedByteCount;
+        size_t count = (std::min)(chunkByteCount, _byteCount - begin);
+        if (FaultIn((char*)_data + begin, count, pageSize))
+        {
+            _lockedByteCount += count;
+        }
+        _prefaultedByteCount = begin + count;
+    }
+}
+
+void MemorySlab::Prefault(size_t chunkByteCount)
+{
+    Check(!_prefaultThread.joinable());
+
+    PrefaultChunks(chunkByteCount);
+}
+
+void MemorySlab::PrefaultInBackground(size_t chunkByteCount)
+{
+    Check(!_prefaultThread.joinable());
+    Check(chunkByteCount > 0);
+
+    _prefaultThread = std::thread([this, chunkByteCount]()
+    {
+        RealTimeThread::ConfigureBackgroundThread();
+        PrefaultChunks(chunkByteCount);
+    });
+}
+
+void MemorySlab::WaitForPrefault()
+{
+    if (_prefaultThread.joinable())
+    {
+        _prefaultThread.join();
+    }
+}
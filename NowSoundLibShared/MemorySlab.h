@@ -0,0 +1,73 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+
+namespace NowSound
+{
+    // One contiguous range of virtual memory, reserved from the OS in a single call and initially zero.
+    //
+    // Reserving is cheap however large the slab is: the OS only supplies physical pages when they are first
+    // touched.  Prefault() and PrefaultInBackground() touch the pages ahead of time (and lock them into physical
+    // memory, if the OS allows), one chunk at a time from the start of the slab, so that whoever uses the memory
+    // later does not take the page faults.  Prefaulting never writes to the memory, so it is safe to prefault
+    // memory which is already in use.
+    class MemorySlab
+    {
+    private:
+        void* _data;
+        const size_t _byteCount;
+
+        // How many bytes, from the start of the slab, have been prefaulted so far.
+        std::atomic<size_t> _prefaultedByteCount;
+
+        // How many of the prefaulted bytes the OS agreed to lock into physical memory.
+        std::atomic<size_t> _lockedByteCount;
+
+        // Set to ask the background prefault thread to stop early.
+        std::atomic<bool> _isStopping;
+
+        std::thread _prefaultThread;
+
+        // Prefault the whole slab, chunkByteCount bytes at a time, unless asked to stop.
+        void PrefaultChunks(size_t chunkByteCount);
+
+    public:
+        // Reserve a slab of at least byteCount bytes (rounded up to a whole number of pages).
+        MemorySlab(size_t byteCount);
+
+        // Stops any background prefaulting, then returns the memory to the OS.
+        ~MemorySlab();
+
+        // no copying this
+        MemorySlab(const MemorySlab&) = delete;
+        MemorySlab& operator=(const MemorySlab&) = delete;
+
+        void* Data() const { return _data; }
+
+        size_t ByteCount() const { return _byteCount; }
+
+        size_t PrefaultedByteCount() const { return _prefaultedByteCount; }
+
+        // Of PrefaultedByteCount(), how many are locked; any others can still be paged out.
+        size_t LockedByteCount() const { return _lockedByteCount; }
+
+        bool IsPrefaulted() const { return _prefaultedByteCount == _byteCount; }
+
+        // Prefault the whole slab on this thread, chunkByteCount bytes at a time.
+        void Prefault(size_t chunkByteCount);
+
+        // Prefault the whole slab on a new low-priority thread, chunkByteCount bytes at a time, and return
+        // immediately.  May only be called once.
+        void PrefaultInBackground(size_t chunkByteCount);
+
+        // Wait for background prefaulting (if any) to finish.
+        void WaitForPrefault();
+    };
+}
@@ -0,0 +1,223 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+
+#include "AudioKernels.h"
+#include "Check.h"
+#include "OfflineMixdown.h"
+#include "RealTimeThread.h"
+
+using namespace NowSound;
+
+OfflineMixdown::OfflineMixdown(std::vector<Source>&& sources, int workerCount)
+    : _sources{ std::move(sources) },
+    _ramps(_sources.size()),
+    // background priority, so that rendering never holds up live audio
+    _pool{ workerCount, /*isRealTime:*/false },
+    _interpolator{},
+    _eqs(_sources.size()),
+    _banks(workerCount),
+    _mono(workerCount, std::vector<float>(BlockSize)),
+    _stereo(_sources.size(), std::vector<float>(BlockSize * 2)),
+    _stereoPointers{},
+    _mix(BlockSize * 2),
+    _send(workerCount, std::vector<float>(BlockSize)),
+    _sendPointers{},
+    _sendSum(BlockSize),
+    _reverbOutput(BlockSize),
+    _reverb{ nullptr },
+    _frameCount{ 0 },
+    _blockPosition{ 0 },
+    _blockFrameCount{ 0 }
+{
+    for (std::vector<float>& send : _send)
+    {
+        _sendPointers.push_back(send.data());
+    }
+
+    for (size_t i = 0; i < _sources.size(); i++)
+    {
+        Check(_sources[i].Stream->IsShut());
+        Check(_sources[i].Stream->SliverCount() == 1);
+        Check(_sources[i].PanAutomation == nullptr || _sources[i].PanAutomation->IsShut());
+        Check(_sources[i].VolumeAutomation == nullptr || _sources[i].VolumeAutomation->IsShut());
+
+        _stereoPointers.push_back(_stereo[i].data());
+
+        for (int stage = 0; stage < BiquadCascade::StageCount; stage++)
+        {
+            _eqs[i].SetStage(stage, _sources[i].EqBands[stage]);
+        }
+        // Settle the EQ's coefficients (which otherwise glide in over the first block) on one sample of silence.
+        if (_eqs[i].IsActive())
+        {
+            float silence = 0;
+            float* silencePointer = &silence;
+            BiquadCascade* eq = &_eqs[i];
+            _banks[0].Process(&eq, &silencePointer, 1, 1);
+        }
+    }
+
+    _renderTask = [this](int worker, int sourceIndex)
+    {
+        const Source& source = _sources[sourceIndex];
+        float* stereo = _stereo[sourceIndex].data();
+        Interval<AudioSample> interval(source.StartTime + Duration<AudioSample>(_blockPosition), Duration<AudioSample>(_blockFrameCount));
+        float* mono = nullptr;
+        // (as in the mixer, a playback effect may read anywhere in the loop, so is never skipped as silent)
+        if (source.Mapper != nullptr || !source.Stream->IsSilent(interval, 0))
+        {
+            mono = _mono[worker].data();
+            if (source.Mapper == nullptr)
+            {
+                source.Stream->CopyToInterpolated(interval, _interpolator, mono);
+            }
+            else
+            {
+                source.Stream->CopyToMapped(interval, *source.Mapper, _interpolator, mono);
+            }
+            if (_eqs[sourceIndex].IsActive())
+            {
+                BiquadCascade* eq = &_eqs[sourceIndex];
+                _banks[worker].Process(&eq, &mono, 1, _blockFrameCount);
+            }
+            if (_reverb != nullptr && source.SendLevel > 0)
+            {
+                AudioKernels::MixScaled(mono, _blockFrameCount, source.SendLevel, _send[worker].data());
+            }
+        }
+        // else as in the mixer, silence is neither read nor filtered
+
+        if (IsRamped(source))
+        {
+            Ramp(sourceIndex, mono, stereo);
+        }
+        else if (mono == nullptr)
+        {
+            std::fill(stereo, stereo + _blockFrameCount * 2, 0.0f);
+        }
+        else
+        {
+            AudioKernels::PanMonoToStereo(mono, _blockFrameCount, source.Pan, stereo);
+        }
+
+        // (the last blocks may run past the end, to make up for the master bus's latency)
+        if (source.Stem != nullptr && _blockPosition < _frameCount)
+        {
+            source.Stem->Write(stereo, (int)(std::min)((int64_t)_blockFrameCount, _frameCount - _blockPosition));
+        }
+    };
+
+    _sumTask = [this](int, int chunk)
+    {
+        int length = _blockFrameCount * 2;
+        int chunkCount = _pool.WorkerCount();
+        int begin = (int)((int64_t)length * chunk / chunkCount);
+        int end = (int)((int64_t)length * (chunk + 1) / chunkCount);
+        AudioKernels::TreeSum(_stereoPointers.data(), (int)_stereoPointers.size(), begin, end - begin, _mix.data());
+        if (_reverb != nullptr)
+        {
+            int sendBegin = (int)((int64_t)_blockFrameCount * chunk / chunkCount);
+            int sendEnd = (int)((int64_t)_blockFrameCount * (chunk + 1) / chunkCount);
+            AudioKernels::TreeSum(_sendPointers.data(), (int)_sendPointers.size(), sendBegin, sendEnd - sendBegin, _sendSum.data());
+        }
+    };
+}
+
+bool OfflineMixdown::IsRamped(const Source& source)
+{
+    return source.PanAutomation != nullptr || source.VolumeAutomation != nullptr || source.Volume != 1;
+}
+
+void OfflineMixdown::ValuesAt(const Source& source, Duration<AudioSample> offset, RampState* state)
+{
+    Time<AudioSample> time = source.StartTime + offset;
+    state->Pan = source.PanAutomation == nullptr ? source.Pan : source.PanAutomation->ValueAt(time, &state->PanCursor);
+    state->Volume = source.VolumeAutomation == nullptr ? source.Volume : source.VolumeAutomation->ValueAt(time, &state->VolumeCursor);
+}
+
+void OfflineMixdown::Ramp(int sourceIndex, const float* mono, float* stereo)
+{
+    const Source& source = _sources[sourceIndex];
+    RampState& state = _ramps[sourceIndex];
+
+    std::fill(stereo, stereo + _blockFrameCount * 2, 0.0f);
+    for (int position = 0; position < _blockFrameCount; position += RampSize)
+    {
+        int count = (std::min)((int)RampSize, _blockFrameCount - position);
+        float startPan = state.Pan;
+        float startVolume = state.Volume;
+        // each ramp ends at the values just after it, as in the mixer; silent ramps are skipped, but not their values
+        ValuesAt(source, Duration<AudioSample>(_blockPosition + position + count), &state);
+        if (mono != nullptr)
+        {
+            AudioKernels::MixMonoToStereoRamped(
+                mono + position,
+                count,
+                startPan,
+                state.Pan,
+                startVolume,
+                state.Volume,
+                stereo + position * 2);
+        }
+    }
+}
+
+void OfflineMixdown::Render(int64_t frameCount, MasterBus* masterBus, PartitionedConvolver* reverb, WavWriter& mix)
+{
+    Check(frameCount >= 0);
+    Check(mix.ChannelCount() == 2);
+
+    // The pool's own threads flush denormals already; this one, which is worker 0, may not.
+    RealTimeThread::FlushDenormalsScope flushDenormals(true);
+
+    // The master bus delays the mix by its latency; so render that much more, and drop that much from the start.
+    int64_t latency = masterBus == nullptr ? 0 : masterBus->Limiter().LatencyFrames();
+    _frameCount = frameCount;
+    _reverb = reverb;
+    for (size_t i = 0; i < _sources.size(); i++)
+    {
+        _ramps[i] = RampState{ 0, 0, 0, 0 };
+        ValuesAt(_sources[i], 0, &_ramps[i]);
+    }
+    for (_blockPosition = 0; _blockPosition < frameCount + latency; _blockPosition += BlockSize)
+    {
+        _blockFrameCount = (int)(std::min)((int64_t)BlockSize, frameCount + latency - _blockPosition);
+
+        if (_sources.empty())
+        {
+            std::fill(_mix.begin(), _mix.begin() + _blockFrameCount * 2, 0.0f);
+        }
+        else
+        {
+            if (_reverb != nullptr)
+            {
+                for (std::vector<float>& send : _send)
+                {
+                    std::fill(send.begin(), send.begin() + _blockFrameCount, 0.0f);
+                }
+            }
+            _pool.Run((int)_sources.size(), _renderTask);
+            // the stems have been written, so the panned blocks can now be summed (which overwrites them)
+            _pool.Run(_pool.WorkerCount(), _sumTask);
+
+            if (_reverb != nullptr)
+            {
+                // the reverb is mono, so it goes to the center, as in the mixer
+                _reverb->Process(_sendSum.data(), _reverbOutput.data(), _blockFrameCount);
+                AudioKernels::MixMonoToStereo(_reverbOutput.data(), _blockFrameCount, 0.5f, _mix.data());
+            }
+        }
+
+        if (masterBus != nullptr)
+        {
+            masterBus->Process(_mix.data(), _blockFrameCount);
+        }
+
+        int skipped = (int)(std::min)((int64_t)_blockFrameCount, (std::max)((int64_t)0, latency - _blockPosition));
+        mix.Write(_mix.data() + skipped * 2, _blockFrameCount - skipped);
+    }
+}
@@ -0,0 +1,145 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <functional>
+#include <vector>
+
+#include "BiquadBank.h"
+#include "ForkJoinPool.h"
+#include "MasterBus.h"
+#include "PartitionedConvolver.h"
+#include "PolyphaseInterpolator.h"
+#include "SliceStream.h"
+#include "SparseSliceStream.h"
+#include "Time.h"
+#include "WavFile.h"
+
+namespace NowSound
+{
+    // Renders looping tracks offline -- as fast as the cores allow, rather than in real time -- into a stereo
+    // mixdown, and optionally a stereo stem per track, in one pass.
+    //
+    // Time is walked in blocks of BlockSize frames.  In each block the tracks are split across the workers of a
+    // ForkJoinPool, each track read just as the mixer reads it (through its stream's looping mapper, with the same
+    // interpolation, and through its playback effect's mapper if it has one), put through its EQ, sent to the reverb,
+    // and panned; then the panned tracks are summed (again split across the workers), the reverb of the summed sends
+    // is added, and the mix is put through the master bus and written out.
+    class OfflineMixdown
+    {
+    public:
+        // One track to render.
+        struct Source
+        {
+            // A shut mono loop, which nothing may write during the render.
+            const BufferedSliceStream<AudioSample, float>* Stream;
+
+            // The time in Stream of the render's first frame.
+            Time<AudioSample> StartTime;
+
+            // 0 = left, 0.5 = center, 1 = right.
+            float Pan;
+
+            // The EQ bands; the identity for those off.
+            BiquadCoefficients EqBands[BiquadCascade::StageCount];
+
+            // Where to write this track's stem (panned, after its EQ, before the master bus); null for none.
+            WavWriter* Stem;
+
+            // The linear gain, after the EQ.
+            float Volume = 1;
+
+            // Shut automation of the pan and volume, read at the same times as Stream; null for none (in which case
+            // Pan and Volume hold throughout).
+            const SparseSliceStream<AudioSample, float>* PanAutomation = nullptr;
+            const SparseSliceStream<AudioSample, float>* VolumeAutomation = nullptr;
+
+            // The playback effect to read Stream through, as the track reads its loop; null for none.
+            const PlaybackMapper<AudioSample>* Mapper = nullptr;
+
+            // The gain of the send to the reverb, taken after the EQ and before the volume.
+            float SendLevel = 0;
+        };
+
+        // The frames rendered at once: large, so that forking and joining the workers costs next to nothing, but
+        // small enough that all the tracks' blocks stay in cache.
+        static const int BlockSize = 16384;
+
+        // Automated sources are ramped from one value to the next every RampSize frames, as the mixer ramps them
+        // once per (10ms) quantum.
+        static const int RampSize = 480;
+
+    private:
+        // Where a source's ramps have got to: its pan and volume at the end of the last ramp, and its cursors into
+        // its automation.
+        struct RampState
+        {
+            float Pan;
+            float Volume;
+            int PanCursor;
+            int VolumeCursor;
+        };
+
+        std::vector<Source> _sources;
+
+        std::vector<RampState> _ramps;
+
+        ForkJoinPool _pool;
+
+        PolyphaseInterpolator _interpolator;
+
+        // Each source's EQ, already settled on its bands.
+        std::vector<BiquadCascade> _eqs;
+
+        // Each worker's bank, and mono block.
+        std::vector<BiquadBank> _banks;
+        std::vector<std::vector<float>> _mono;
+
+        // Each source's panned block, interleaved, and pointers to them all (for summing).
+        std::vector<std::vector<float>> _stereo;
+        std::vector<float*> _stereoPointers;
+
+        // The summed block.
+        std::vector<float> _mix;
+
+        // Each worker's send bus, pointers to them all, their sum, and the reverb of that; used only with a reverb.
+        std::vector<std::vector<float>> _send;
+        std::vector<float*> _sendPointers;
+        std::vector<float> _sendSum;
+        std::vector<float> _reverbOutput;
+
+        // The reverb of the current render; null for none.
+        PartitionedConvolver* _reverb;
+
+        // The state of the current block, for the tasks below.
+        int64_t _frameCount;
+        int64_t _blockPosition;
+        int _blockFrameCount;
+
+        // The task rendering each source, and summing each chunk of the mix; created once.
+        std::function<void(int, int)> _renderTask;
+        std::function<void(int, int)> _sumTask;
+
+        // Is the source's pan or volume other than constant?
+        static bool IsRamped(const Source& source);
+
+        // The source's pan and volume at the given offset from its StartTime, updating its cursors.
+        static void ValuesAt(const Source& source, Duration<AudioSample> offset, RampState* state);
+
+        // Ramp the block of the given source from its mono block (null if silent) into its stereo block.
+        void Ramp(int sourceIndex, const float* mono, float* stereo);
+
+    public:
+        OfflineMixdown(std::vector<Source>&& sources, int workerCount);
+
+        // Render frameCount frames: into mix, the sum of all the sources through the master bus (if not null), and
+        // into each source's Stem, that source alone.  The master bus's latency is compensated for, so the mix and
+        // the stems all start at the sources' StartTimes.  The master bus should be fresh, so that nothing before
+        // the render leaks into it.  The sources' sends go through reverb (if not null, and likewise fresh) into the
+        // mix, but not into the stems.
+        void Render(int64_t frameCount, MasterBus* masterBus, PartitionedConvolver* reverb, WavWriter& mix);
+    };
+}
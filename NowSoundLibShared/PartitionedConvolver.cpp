@@ -0,0 +1,263 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Check.h"
+#include "PartitionedConvolver.h"
+#include "RealTimeThread.h"
+
+using namespace NowSound;
+
+const int PartitionedConvolver::SpinMicroseconds = 20000;
+
+// The first block of lateness is absorbed by the previous tail alone; each one after needs another input spectrum.
+const int PartitionedConvolver::MaxLateBlocks = 2;
+
+namespace
+{
+    // destination += a * b, over count complex values.
+    void MultiplyAdd(const std::complex<float>* a, const std::complex<float>* b, int count, std::complex<float>* destination)
+    {
+        // on plain floats, since std::complex's operator* must also handle infinities, which keeps it from vectorizing
+        const float* x = reinterpret_cast<const float*>(a);
+        const float* y = reinterpret_cast<const float*>(b);
+        float* d = reinterpret_cast<float*>(destination);
+        for (int i = 0; i < count; i++)
+        {
+            float xr = x[i * 2], xi = x[i * 2 + 1];
+            float yr = y[i * 2], yi = y[i * 2 + 1];
+            d[i * 2] += xr * yr - xi * yi;
+            d[i * 2 + 1] += xr * yi + xi * yr;
+        }
+    }
+}
+
+PartitionedConvolver::PartitionedConvolver(int blockSize, const float* impulseResponse, int impulseResponseLength, bool useTailThread)
+    : _blockSize{ blockSize },
+    _partitionCount{ (std::max)(1, (impulseResponseLength + blockSize - 1) / blockSize) },
+    _spectrumCount{ _partitionCount + MaxLateBlocks - 1 },
+    _fft{ blockSize * 2 },
+    _partitions{},
+    _inputSpectra{},
+    _newestSpectrum{ 0 },
+    _inputFrame(blockSize * 2),
+    _outputBlock(blockSize),
+    _blockPosition{ 0 },
+    _outputSpectrum{},
+    _outputFrame(blockSize * 2),
+    _tails{},
+    _tailNewestSpectrum{ 0 },
+    _requestedTails{ 0 },
+    _computedTails{ 0 },
+    _blocksSinceTailRequest{ 0 },
+    _tailThread{},
+    _isStopping{ false },
+    _isTailThreadParked{ false },
+    _parkMutex{},
+    _parkCondition{},
+    _lateTailCount{ 0 }
+{
+    Check(blockSize > 0);
+    Check(impulseResponseLength >= 0);
+
+    _partitions.resize(_partitionCount * BinCount());
+    _inputSpectra.resize(_spectrumCount * BinCount());
+    _outputSpectrum.resize(BinCount());
+    _tails[0].resize(BinCount());
+    _tails[1].resize(BinCount());
+
+    // Each partition is zero-padded to two blocks, so that its product with a two-block input frame has the
+    // block of linear convolution we want in its second half.
+    float scale = 1.0f / (blockSize * 2);
+    std::vector<float> padded(blockSize * 2);
+    for (int partition = 0; partition < _partitionCount; partition++)
+    {
+        std::fill(padded.begin(), padded.end(), 0.0f);
+        int begin = partition * blockSize;
+        int end = (std::min)(begin + blockSize, impulseResponseLength);
+        for (int i = begin; i < end; i++)
+        {
+            padded[i - begin] = impulseResponse[i] * scale;
+        }
+        _fft.Forward(padded.data(), Partition(partition));
+    }
+
+    if (useTailThread && _partitionCount > 1)
+    {
+        _tailThread = std::thread([this]() { TailThread(); });
+    }
+}
+
+PartitionedConvolver::~PartitionedConvolver()
+{
+    if (_tailThread.joinable())
+    {
+        _isStopping = true;
+        WakeTailThread();
+        _tailThread.join();
+    }
+}
+
+void PartitionedConvolver::ComputeTail(int64_t request)
+{
+    std::vector<std::complex<float>>& tail = _tails[request % 2];
+    std::fill(tail.begin(), tail.end(), std::complex<float>());
+    // In the next block, partition p applies to the input spectrum p blocks older than that block's, which is
+    // p - 1 blocks older than the newest now.
+    for (int partition = 1; partition < _partitionCount; partition++)
+    {
+        MultiplyAdd(Partition(partition), InputSpectrum(_tailNewestSpectrum, partition - 1), BinCount(), tail.data());
+    }
+}
+
+void PartitionedConvolver::RequestTail()
+{
+    if (_partitionCount == 1)
+    {
+        return;
+    }
+
+    _tailNewestSpectrum = _newestSpectrum;
+    _blocksSinceTailRequest = 0;
+    int64_t request = _requestedTails.load(std::memory_order_relaxed) + 1;
+    if (!_tailThread.joinable())
+    {
+        ComputeTail(request);
+        _requestedTails.store(request, std::memory_order_relaxed);
+        _computedTails.store(request, std::memory_order_relaxed);
+        return;
+    }
+
+    // Publish the request before checking for parking (both sequentially consistent), so either the tail thread
+    // sees the request or this sees it parking, and wakes it.
+    _requestedTails.store(request);
+    if (_isTailThreadParked.load())
+    {
+        WakeTailThread();
+    }
+}
+
+void PartitionedConvolver::WakeTailThread()
+{
+    // Taking the lock waits out the tail thread between its last check and its wait.
+    {
+        std::lock_guard<std::mutex> guard(_parkMutex);
+    }
+    _parkCondition.notify_all();
+}
+
+void PartitionedConvolver::TailThread()
+{
+    // the tail has a deadline (the end of the next block), so this is audio work, not background work
+    RealTimeThread::ConfigureAudioThread(-1);
+
+    int64_t computed = 0;
+    while (true)
+    {
+        // spin until requested or stopped, or until it is time to park
+        auto spinStart = std::chrono::steady_clock::now();
+        int spinCount = 0;
+        while (_requestedTails.load(std::memory_order_acquire) == computed)
+        {
+            if (_isStopping)
+            {
+                return;
+            }
+            RealTimeThread::SpinPause();
+
+            // checking the time is much slower than pausing, so only every so often
+            if (++spinCount % 256 == 0
+                && std::chrono::steady_clock::now() - spinStart > std::chrono::microseconds(SpinMicroseconds))
+            {
+                // as in ForkJoinPool, announce parking before the last check, and wait under the lock taken to wake
+                std::unique_lock<std::mutex> lock(_parkMutex);
+                _isTailThreadParked = true;
+                _parkCondition.wait(lock, [&]() { return _requestedTails.load() != computed || _isStopping; });
+                _isTailThreadParked = false;
+                spinStart = std::chrono::steady_clock::now();
+            }
+        }
+
+        // there is only ever one request outstanding
+        computed++;
+        ComputeTail(computed);
+        _computedTails.store(computed, std::memory_order_release);
+    }
+}
+
+void PartitionedConvolver::ProcessBlock()
+{
+    // A late tail is still reading the spectra of the blocks before its request; the ring has room for
+    // MaxLateBlocks - 1 more blocks of input before the next would overwrite one of them.  Only a tail later than
+    // that (as when the tail thread has been starved of a core for several blocks) is waited for, spinning.
+    if (!IsTailReady() && ++_blocksSinceTailRequest > MaxLateBlocks)
+    {
+        while (!IsTailReady())
+        {
+            RealTimeThread::SpinPause();
+        }
+    }
+
+    // The newest block can go into the ring meanwhile, over the oldest block's spectrum, which no partition needs
+    // any more.
+    _newestSpectrum = (_newestSpectrum + 1) % _spectrumCount;
+    _fft.Forward(_inputFrame.data(), InputSpectrum(_newestSpectrum, 0));
+
+    // A tail which has missed its deadline leaves the previous block's standing in for it; it is not requested
+    // again until it is done.
+    bool isTailReady = IsTailReady();
+    int64_t requested = _requestedTails.load(std::memory_order_relaxed);
+    if (!isTailReady)
+    {
+        _lateTailCount++;
+    }
+    if (_partitionCount > 1)
+    {
+        const std::vector<std::complex<float>>& tail = _tails[(isTailReady ? requested : requested - 1) % 2];
+        std::copy(tail.begin(), tail.end(), _outputSpectrum.begin());
+    }
+    else
+    {
+        std::fill(_outputSpectrum.begin(), _outputSpectrum.end(), std::complex<float>());
+    }
+    MultiplyAdd(Partition(0), InputSpectrum(_newestSpectrum, 0), BinCount(), _outputSpectrum.data());
+
+    // the first half of the inverse is wrapped around (circular convolution); the second half is the output
+    _fft.Inverse(_outputSpectrum.data(), _outputFrame.data());
+    std::copy(_outputFrame.begin() + _blockSize, _outputFrame.end(), _outputBlock.begin());
+
+    // the block just completed becomes the first half of the next frame
+    std::copy(_inputFrame.begin() + _blockSize, _inputFrame.end(), _inputFrame.begin());
+
+    if (isTailReady)
+    {
+        RequestTail();
+    }
+}
+
+void PartitionedConvolver::Process(const float* input, float* output, int sampleCount)
+{
+    Check(sampleCount >= 0);
+
+    while (sampleCount > 0)
+    {
+        int count = (std::min)(sampleCount, _blockSize - _blockPosition);
+        std::copy(input, input + count, _inputFrame.begin() + _blockSize + _blockPosition);
+        std::copy(_outputBlock.begin() + _blockPosition, _outputBlock.begin() + _blockPosition + count, output);
+
+        input += count;
+        output += count;
+        sampleCount -= count;
+        _blockPosition += count;
+
+        if (_blockPosition == _blockSize)
+        {
+            ProcessBlock();
+            _blockPosition = 0;
+        }
+    }
+}
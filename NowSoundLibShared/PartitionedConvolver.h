@@ -0,0 +1,156 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <complex>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "rosetta_fft.h"
+
+namespace NowSound
+{
+    // Convolves a mono signal with a long impulse response (e.g. a room's, for reverb), with one block of latency.
+    //
+    // The impulse response is cut into partitions of BlockSize() samples, each transformed once up front; the
+    // input is transformed a block at a time, and the output is the sum of each partition's spectrum times the
+    // spectrum of the input block that many blocks ago (uniformly partitioned overlap-save convolution, with a
+    // frequency-domain delay line).  So the cost per block is two FFTs plus one complex multiply-add per partition,
+    // however long the impulse response.
+    //
+    // Only the first partition depends on the newest input block; the rest (the tail) depend only on older blocks,
+    // so the tail's sum for the next block can be computed while this block's input is still arriving.  With a
+    // tail thread, that is what happens: the calling (audio) thread does the FFTs and the first partition, and the
+    // tail thread does the rest, with a whole block's time to do it in.  The calling thread never waits for it on a
+    // lock: requests and results are handed over through atomic counters, and a tail which misses its block's
+    // deadline is stood in for by the previous block's, which differs from it only by one block's worth of decay.
+    // (The tail thread spins between requests, like a ForkJoinPool worker, parking only once it has been idle for
+    // SpinMicroseconds; so only the first block after such an idle spell takes a lock, to wake it.)
+    class PartitionedConvolver
+    {
+    public:
+        // How long the tail thread spins for its next request before parking; longer than any block.
+        static const int SpinMicroseconds;
+
+        // How many blocks late a tail may be before the calling thread must spin until it is done, as the next
+        // block's input spectrum would overwrite one the tail is still reading.
+        static const int MaxLateBlocks;
+
+    private:
+        const int _blockSize;
+        const int _partitionCount;
+
+        // The number of input spectra kept: enough for every partition, plus one more for each block a tail may
+        // be late beyond the first.
+        const int _spectrumCount;
+
+        // The plan for FFTs of two blocks.
+        const RosettaFFT::RealFftPlan _fft;
+
+        // The spectrum of each partition of the impulse response, BinCount() bins apiece, prescaled by the inverse
+        // FFT's 1 / (2 * blockSize).
+        std::vector<std::complex<float>> _partitions;
+
+        // The spectra of the last _spectrumCount blocks of input, in a ring; _newestSpectrum is the latest.
+        std::vector<std::complex<float>> _inputSpectra;
+        int _newestSpectrum;
+
+        // The previous block of input followed by the block now arriving; the overlap-save FFT frame.
+        std::vector<float> _inputFrame;
+
+        // The output of the last complete block, being emitted while the next block's input arrives.
+        std::vector<float> _outputBlock;
+
+        // How many samples of the current block have arrived (and of _outputBlock have been emitted).
+        int _blockPosition;
+
+        // Scratch for the output spectrum and its inverse FFT.
+        std::vector<std::complex<float>> _outputSpectrum;
+        std::vector<float> _outputFrame;
+
+        // The sums over the tail partitions: request n's is computed into _tails[n % 2], so the previous request's
+        // can still stand in, untouched, while the latest is late.
+        std::vector<std::complex<float>> _tails[2];
+
+        // The newest spectrum as of the latest request; written only by the calling thread, and only while no
+        // request is outstanding.
+        int _tailNewestSpectrum;
+
+        // How many tails have been requested, and how many computed; a request is outstanding while they differ,
+        // and there is never more than one.
+        std::atomic<int64_t> _requestedTails;
+        std::atomic<int64_t> _computedTails;
+
+        // How many blocks have found the latest request still outstanding; calling thread only.
+        int _blocksSinceTailRequest;
+
+        // The tail thread, if any, and where it parks when idle.
+        std::thread _tailThread;
+        std::atomic<bool> _isStopping;
+        std::atomic<bool> _isTailThreadParked;
+        std::mutex _parkMutex;
+        std::condition_variable _parkCondition;
+
+        // How many blocks missed their tail's deadline.
+        std::atomic<int64_t> _lateTailCount;
+
+        int BinCount() const { return _fft.BinCount(); }
+
+        std::complex<float>* Partition(int partition) { return &_partitions[partition * BinCount()]; }
+
+        // The spectrum of the input block age blocks before the given one.
+        std::complex<float>* InputSpectrum(int newest, int age)
+        {
+            return &_inputSpectra[((newest - age + _spectrumCount) % _spectrumCount) * BinCount()];
+        }
+
+        // Sum the products of the tail partitions with the input spectra they apply to in the next block, as of
+        // the given request, into that request's tail.
+        void ComputeTail(int64_t request);
+
+        // Start (or, without a tail thread, do) ComputeTail for the next block.  No request may be outstanding.
+        void RequestTail();
+
+        // Wake the tail thread, if it has parked.
+        void WakeTailThread();
+
+        // A whole block of input has arrived: compute the next block of output.
+        void ProcessBlock();
+
+        // The loop of the tail thread.
+        void TailThread();
+
+    public:
+        // Prepare to convolve with the given impulse response, in partitions of blockSize samples (a power of two).
+        // If useTailThread, the tail is computed on a new thread; otherwise, on the thread calling Process.
+        PartitionedConvolver(int blockSize, const float* impulseResponse, int impulseResponseLength, bool useTailThread);
+
+        // Stops and joins the tail thread, if any.
+        ~PartitionedConvolver();
+
+        // no copying this
+        PartitionedConvolver(const PartitionedConvolver&) = delete;
+        PartitionedConvolver& operator=(const PartitionedConvolver&) = delete;
+
+        // The partition size, which is also the latency.
+        int BlockSize() const { return _blockSize; }
+
+        int PartitionCount() const { return _partitionCount; }
+
+        // How many blocks found their tail not yet computed, and made do with the previous block's.
+        int64_t LateTailCount() const { return _lateTailCount; }
+
+        // Has the tail for the next block been computed?  Calling thread only.
+        bool IsTailReady() const { return _computedTails.load(std::memory_order_acquire) == _requestedTails.load(std::memory_order_relaxed); }
+
+        // Convolve the next sampleCount samples of input, overwriting output with the convolution delayed by
+        // BlockSize() samples.  Any sampleCount may be passed; never allocates.
+        void Process(const float* input, float* output, int sampleCount);
+    };
+}
@@ -0,0 +1,37 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include "Check.h"
+#include "PolyphaseInterpolator.h"
+
+using namespace NowSound;
+
+PolyphaseInterpolator::PolyphaseInterpolator()
+    : _coefficients(PhaseCount * TapCount)
+{
+    for (int phase = 0; phase < PhaseCount; phase++)
+    {
+        double f = (double)phase / PhaseCount;
+        double f2 = f * f;
+        double f3 = f2 * f;
+
+        float* c = &_coefficients[phase * TapCount];
+        c[0] = (float)((-f3 + 2 * f2 - f) / 2);
+        c[1] = (float)((3 * f3 - 5 * f2 + 2) / 2);
+        c[2] = (float)((-3 * f3 + 4 * f2 + f) / 2);
+        c[3] = (float)((f3 - f2) / 2);
+    }
+}
+
+void PolyphaseInterpolator::Interpolate(const float* source, int phaseIndex, float* destination, int count) const
+{
+    Check(phaseIndex >= 0 && phaseIndex < PhaseCount);
+
+    const float* c = &_coefficients[phaseIndex * TapCount];
+    for (int i = 0; i < count; i++)
+    {
+        destination[i] = source[i] * c[0] + source[i + 1] * c[1] + source[i + 2] * c[2] + source[i + 3] * c[3];
+    }
+}
@@ -0,0 +1,55 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <vector>
+
+namespace NowSound
+{
+    // Small polyphase interpolator for reading mono audio at fractional sample positions.
+    //
+    // This is a four-tap cubic (Catmull-Rom) interpolator, with the coefficients for each of PhaseCount
+    // evenly spaced sub-sample phases precomputed, so interpolating a sample is just a four-term dot product.
+    // Phase 0 is exactly the identity, so unshifted data passes through unchanged.
+    class PolyphaseInterpolator
+    {
+    public:
+        // The number of taps per phase.
+        static const int TapCount = 4;
+
+        // The number of bits of sub-sample phase resolution; there are 1 << PhaseBits phases.
+        static const int PhaseBits = 8;
+
+        // The number of precomputed phases.
+        static const int PhaseCount = 1 << PhaseBits;
+
+    private:
+        // The coefficients; TapCount entries per phase.
+        std::vector<float> _coefficients;
+
+    public:
+        PolyphaseInterpolator();
+
+        // Map a fixed-point fraction with the given number of fractional bits to the nearest lower phase index.
+        static int PhaseIndex(int fixedPointPhase, int fractionalBits)
+        {
+            return fractionalBits >= PhaseBits
+                ? fixedPointPhase >> (fractionalBits - PhaseBits)
+                : fixedPointPhase << (PhaseBits - fractionalBits);
+        }
+
+        // Interpolate the value at source[1] + phaseIndex / PhaseCount; source[0] through source[3] must all be valid.
+        float Interpolate(const float* source, int phaseIndex) const
+        {
+            const float* c = &_coefficients[phaseIndex * TapCount];
+            return source[0] * c[0] + source[1] * c[1] + source[2] * c[2] + source[3] * c[3];
+        }
+
+        // Interpolate count values, all at the same phase.
+        // source[0] is the sample *before* the first output position, and source must contain count + 3 samples.
+        void Interpolate(const float* source, int phaseIndex, float* destination, int count) const;
+    };
+}
@@ -0,0 +1,234 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#if defined(_MSC_VER)
+// _controlfp_s sets both FTZ and DAZ (as _DN_FLUSH) on every platform MSVC targets.
+#include <float.h>
+#define NOWSOUND_DENORMAL_CONTROLFP 1
+#elif defined(__SSE2__)
+#include <xmmintrin.h>
+#define NOWSOUND_DENORMAL_MXCSR 1
+// MXCSR bits: flush to zero (15) and denormals are zero (6).
+#define NOWSOUND_MXCSR_FTZ_DAZ 0x8040
+#elif defined(__aarch64__)
+#define NOWSOUND_DENORMAL_FPCR 1
+// FPCR bit 24 (FZ) both flushes denormal results and treats denormal inputs as zero.
+#define NOWSOUND_FPCR_FZ (1ull << 24)
+#endif
+
+#include <mutex>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include "Check.h"
+#include "RealTimeThread.h"
+#include "Simd.h"
+
+using namespace NowSound;
+
+namespace
+{
+#if NOWSOUND_DENORMAL_FPCR
+    uint64_t ReadFpcr()
+    {
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        return fpcr;
+    }
+
+    void WriteFpcr(uint64_t fpcr)
+    {
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+    }
+#endif
+
+    // Give the current thread real-time priority, and pin it if cpuIndex is not -1.
+    bool RaisePriority(int cpuIndex)
+    {
+#if defined(_WIN32)
+        // Affinity is left to the OS on Windows; MMCSS and the scheduler know better than we do which cores are free.
+        (void)cpuIndex;
+        return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0;
+#else
+        bool succeeded = true;
+
+        // Just below the maximum, leaving the top priority for the system's own audio server (if any).
+        sched_param param{};
+        param.sched_priority = sched_get_priority_max(SCHED_FIFO) - 1;
+        succeeded &= pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+
+#if defined(__linux__)
+        if (cpuIndex != -1)
+        {
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cpuIndex, &cpuSet);
+            succeeded &= pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) == 0;
+        }
+#else
+        (void)cpuIndex;
+#endif
+
+        return succeeded;
+#endif
+    }
+}
+
+bool RealTimeThread::CanFlushDenormals()
+{
+#if NOWSOUND_DENORMAL_CONTROLFP || NOWSOUND_DENORMAL_MXCSR || NOWSOUND_DENORMAL_FPCR
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool RealTimeThread::IsFlushingDenormals()
+{
+#if NOWSOUND_DENORMAL_CONTROLFP
+    unsigned int control;
+    _controlfp_s(&control, 0, 0);
+    return (control & _MCW_DN) == _DN_FLUSH;
+#elif NOWSOUND_DENORMAL_MXCSR
+    return (_mm_getcsr() & NOWSOUND_MXCSR_FTZ_DAZ) == NOWSOUND_MXCSR_FTZ_DAZ;
+#elif NOWSOUND_DENORMAL_FPCR
+    return (ReadFpcr() & NOWSOUND_FPCR_FZ) != 0;
+#else
+    return false;
+#endif
+}
+
+bool RealTimeThread::SetFlushDenormals(bool flush)
+{
+    bool wasFlushing = IsFlushingDenormals();
+#if NOWSOUND_DENORMAL_CONTROLFP
+    unsigned int control;
+    _controlfp_s(&control, flush ? _DN_FLUSH : _DN_SAVE, _MCW_DN);
+#elif NOWSOUND_DENORMAL_MXCSR
+    unsigned int csr = _mm_getcsr();
+    _mm_setcsr(flush ? (csr | NOWSOUND_MXCSR_FTZ_DAZ) : (csr & ~NOWSOUND_MXCSR_FTZ_DAZ));
+#elif NOWSOUND_DENORMAL_FPCR
+    uint64_t fpcr = ReadFpcr();
+    WriteFpcr(flush ? (fpcr | NOWSOUND_FPCR_FZ) : (fpcr & ~NOWSOUND_FPCR_FZ));
+#else
+    (void)flush;
+#endif
+    return wasFlushing;
+}
+
+void RealTimeThread::SpinPause()
+{
+    // Never a yield to the OS where there is a pause instruction: a spinning real-time thread (pinned and SCHED_FIFO
+    // on the portable backend) would make a syscall every time round.
+#if NOWSOUND_SSE
+    _mm_pause();
+#elif defined(__aarch64__)
+    __asm__ volatile("yield");
+#else
+    std::this_thread::yield();
+#endif
+}
+
+void RealTimeThread::PrepareAudioCallback()
+{
+    SetFlushDenormals(true);
+
+#if !defined(_WIN32)
+    // AudioGraph's threads are already MMCSS-scheduled; the portable backend's callback threads may not be.
+    thread_local bool s_isPrioritySet = false;
+    if (!s_isPrioritySet)
+    {
+        RaisePriority(-1);
+        s_isPrioritySet = true;
+    }
+#endif
+}
+
+bool RealTimeThread::ConfigureAudioThread(int cpuIndex)
+{
+    Check(cpuIndex >= -1);
+
+    SetFlushDenormals(true);
+    return RaisePriority(cpuIndex);
+}
+
+bool RealTimeThread::ConfigureBackgroundThread()
+{
+#if defined(_WIN32)
+    return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST) != 0;
+#elif defined(__linux__)
+    sched_param param{};
+    return pthread_setschedparam(pthread_self(), SCHED_IDLE, &param) == 0;
+#else
+    // No idle class; the lowest priority of the ordinary policy will do.
+    sched_param param{};
+    param.sched_priority = sched_get_priority_min(SCHED_OTHER);
+    return pthread_setschedparam(pthread_self(), SCHED_OTHER, &param) == 0;
+#endif
+}
+
+bool RealTimeThread::LockMemory(const void* address, size_t byteCount)
+{
+    Check(address != nullptr);
+
+#if defined(_WIN32)
+    if (VirtualLock(const_cast<void*>(address), byteCount) != 0)
+    {
+        return true;
+    }
+    return GetLastError() == ERROR_WORKING_SET_QUOTA
+        && ReserveLockedMemory(byteCount)
+        && VirtualLock(const_cast<void*>(address), byteCount) != 0;
+#else
+    if (mlock(address, byteCount) == 0)
+    {
+        return true;
+    }
+    return (errno == ENOMEM || errno == EPERM)
+        && ReserveLockedMemory(byteCount)
+        && mlock(address, byteCount) == 0;
+#endif
+}
+
+bool RealTimeThread::ReserveLockedMemory(size_t byteCount)
+{
+    // the limits are read, then raised, so two threads reserving at once must not both raise from the same value
+    static std::mutex s_reserveMutex;
+    std::lock_guard<std::mutex> guard(s_reserveMutex);
+
+#if defined(_WIN32)
+    HANDLE process = GetCurrentProcess();
+    SIZE_T minimum;
+    SIZE_T maximum;
+    if (GetProcessWorkingSetSize(process, &minimum, &maximum) == 0)
+    {
+        return false;
+    }
+    return SetProcessWorkingSetSize(process, minimum + byteCount, maximum + byteCount) != 0;
+#else
+    rlimit limit;
+    if (getrlimit(RLIMIT_MEMLOCK, &limit) != 0)
+    {
+        return false;
+    }
+    if (limit.rlim_cur == RLIM_INFINITY)
+    {
+        return true;
+    }
+    rlim_t wanted = limit.rlim_cur + (rlim_t)byteCount;
+    bool isRoomy = limit.rlim_max == RLIM_INFINITY || wanted <= limit.rlim_max;
+    limit.rlim_cur = isRoomy ? wanted : limit.rlim_max;
+    return setrlimit(RLIMIT_MEMLOCK, &limit) == 0 && isRoomy;
+#endif
+}
@@ -0,0 +1,74 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <cstddef>
+
+namespace NowSound
+{
+    // Setup for threads which run audio code.
+    //
+    // Decaying loop tails, filter feedback and FFT bins all eventually fall into denormal floats, which many CPUs
+    // handle many times more slowly than normal ones; so audio threads flush denormals to zero (FTZ), and treat
+    // denormal inputs as zero (DAZ).  On the portable (non-Windows) backend, audio threads are also given real-time
+    // FIFO scheduling, and optionally pinned to one CPU; on Windows, AudioGraph's own threads are already scheduled
+    // by MMCSS, so only our own worker threads have their priority raised.
+    class RealTimeThread
+    {
+    public:
+        // Can this platform flush denormals at all?  (If not, all the denormal methods below do nothing.)
+        static bool CanFlushDenormals();
+
+        // Is the current thread flushing denormals to zero?
+        static bool IsFlushingDenormals();
+
+        // Set (or clear) FTZ and DAZ on the current thread; returns whether they were previously set.
+        static bool SetFlushDenormals(bool flush);
+
+        // Call at the start of every audio callback.  Sets FTZ/DAZ every time (it costs a few cycles, and the host
+        // may reset the floating-point state between callbacks); on the portable backend, the first call on each
+        // thread also gives it real-time priority.
+        static void PrepareAudioCallback();
+
+        // Call once at the start of a thread we create to do audio work.  Sets FTZ/DAZ and real-time priority,
+        // and pins the thread to the given CPU if cpuIndex is not -1 (portable backend only).
+        // Returns false if the priority or affinity could not be set (e.g. for lack of privilege); the thread
+        // still runs, just with ordinary scheduling.
+        static bool ConfigureAudioThread(int cpuIndex);
+
+        // Call once at the start of a thread doing housekeeping which audio threads never wait on (such as
+        // faulting in preallocated memory); lowers its priority as far as the OS allows, so it only uses otherwise
+        // idle CPU time.  Returns false if the priority could not be changed.
+        static bool ConfigureBackgroundThread();
+
+        // Call in each turn of a loop spinning while another thread finishes something; lets the other hyperthread
+        // on this core run meanwhile.
+        static void SpinPause();
+
+        // Lock the pages of the given memory into physical memory, so the audio thread never takes a page fault
+        // on them.  If the OS refuses for lack of room, this reserves room for byteCount more (as
+        // ReserveLockedMemory) and tries once more.  Best effort: returns false if the OS still refused (e.g. over
+        // a hard locked-page limit the process cannot raise).
+        static bool LockMemory(const void* address, size_t byteCount);
+
+        // Make room for byteCount more bytes of locked memory: on Windows, by growing the process's working set
+        // (whose minimum bounds the pages it can lock, and defaults to a few hundred KB); elsewhere, by raising
+        // the soft RLIMIT_MEMLOCK, as far as the hard limit allows.  Call before locking a large allocation.
+        // Returns false if the room could not be made.
+        static bool ReserveLockedMemory(size_t byteCount);
+
+        // Sets (or clears) FTZ/DAZ for the lifetime of this object, then restores the previous state.
+        class FlushDenormalsScope
+        {
+        private:
+            const bool _wasFlushing;
+
+        public:
+            FlushDenormalsScope(bool flush) : _wasFlushing{ SetFlushDenormals(flush) } {}
+            ~FlushDenormalsScope() { SetFlushDenormals(_wasFlushing); }
+        };
+    };
+}
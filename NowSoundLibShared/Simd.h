@@ -0,0 +1,13 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+// NOWSOUND_SSE is 1 wherever SSE2 intrinsics can be used: on MSVC's x86 and x64 targets, and wherever GCC or Clang
+// target SSE2 (as they always do on x86-64).  Code with an SSE path tests this, and only this, to choose it.
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__) || defined(__x86_64__)
+#include <emmintrin.h>
+#define NOWSOUND_SSE 1
+#endif
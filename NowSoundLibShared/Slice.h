@@ -176,7 +176,7 @@ namespace NowSound
         // Equality comparison.
         bool Equals(const Slice<TTime, TValue>& other) const
         {
-            return Buffer.Equals(other.Buffer) && Offset == other.Offset && _duration == other.SliceDuration();
+            return _buffer.Data() == other._buffer.Data() && _offset == other._offset && _duration == other.SliceDuration();
         }
     };
 
@@ -6,10 +6,14 @@
 #include "pch.h"
 
 #include <algorithm>
+#include <cmath>
+#include <deque>
+#include <memory>
 
 #include "BufferAllocator.h"
 #include "Check.h"
 #include "IntervalMapper.h"
+#include "PolyphaseInterpolator.h"
 #include "Slice.h"
 #include "Time.h"
 
@@ -182,24 +186,110 @@ namespace NowSound
         Duration<TTime> _maxBufferedDuration;
 
         // This is the vector of buffers appended in the stream thus far; the last one is the current append buffer.
-        // This vector owns the buffers within it; ownership is transferred from allocator to stream whenever a
-        // new append buffer is needed.
-        std::vector<OwningBuf<TValue>> _buffers;
+        // This vector owns the buffers within it, sharing ownership with any snapshots of this stream (see Snapshot);
+        // ownership is transferred from allocator to stream whenever a new append buffer is needed, and back again
+        // when the last stream holding a buffer drops it.
+        std::vector<SharedBuf<TValue>> _buffers;
 
         // This is the remaining not-yet-allocated portion of the current append buffer (the last in _buffers).
         Slice<TTime, TValue> _remainingFreeSlice;
 
         bool _useExactLoopingMapper;
 
+        // The number of slivers interpolated at a time by CopyToInterpolated.
+        static const int InterpolationChunkSize = 256;
+
+        // The most slivers CopyChunkMapped reads for one chunk, at the fastest a PlaybackMapper may read.
+        static const int MaxMappedWindowSize =
+            PlaybackMapper<TTime>::MaxSpeed * (InterpolationChunkSize - 1) + PolyphaseInterpolator::TapCount + 1;
+
+        // The peak absolute value of each block of PeakBlockSize slivers, with blocks aligned to multiples of
+        // PeakBlockSize from time 0 (not from InitialTime, so trimming never moves them).  Maintained on append,
+        // so players can skip reading blocks that are silent.
+        std::deque<TValue> _blockPeaks;
+
+        // The index of the block whose peak is _blockPeaks.front().
+        int64_t _firstPeakBlock;
+
+        // The index of the peak block containing the given time.
+        static int64_t PeakBlockIndex(Time<TTime> time)
+        {
+            int64_t value = time.Value();
+            // round towards negative infinity, in case the stream starts before time 0
+            return value >= 0 ? value / PeakBlockSize : -((-value + PeakBlockSize - 1) / PeakBlockSize);
+        }
+
+        // Fold the peaks of the given slice, which starts at the given time, into _blockPeaks.
+        void RecordBlockPeaks(Time<TTime> initialTime, const Slice<TTime, TValue>& slice)
+        {
+            const TValue* data = slice.Buffer().Data() + slice.Offset().Value() * this->SliverCount();
+            int64_t sliceDuration = slice.SliceDuration().Value();
+            int64_t i = 0;
+            while (i < sliceDuration)
+            {
+                Time<TTime> time = initialTime + Duration<TTime>(i);
+                int64_t block = PeakBlockIndex(time);
+                int64_t count = std::min(sliceDuration - i, (block + 1) * PeakBlockSize - time.Value());
+
+                if (_blockPeaks.empty())
+                {
+                    _firstPeakBlock = block;
+                }
+                Check(block >= _firstPeakBlock);
+                while (block >= _firstPeakBlock + (int64_t)_blockPeaks.size())
+                {
+                    _blockPeaks.push_back(0);
+                }
+
+                TValue& peak = _blockPeaks[(size_t)(block - _firstPeakBlock)];
+                const TValue* end = data + (i + count) * this->SliverCount();
+                for (const TValue* value = data + i * this->SliverCount(); value < end; value++)
+                {
+                    peak = std::max(peak, (TValue)std::abs(*value));
+                }
+
+                i += count;
+            }
+        }
+
+        // Drop the peaks of blocks wholly before the given time.
+        void DropBlockPeaksBefore(Time<TTime> time)
+        {
+            int64_t block = PeakBlockIndex(time);
+            while (!_blockPeaks.empty() && _firstPeakBlock < block)
+            {
+                _blockPeaks.pop_front();
+                _firstPeakBlock++;
+            }
+        }
+
+        // Are all blocks overlapping the given stream-relative range (which must not wrap) no louder than threshold?
+        // Blocks with no recorded peak count as loud.
+        bool IsSilentUnwrapped(int64_t position, int64_t count, TValue threshold) const
+        {
+            int64_t firstBlock = PeakBlockIndex(this->InitialTime() + Duration<TTime>(position));
+            int64_t lastBlock = PeakBlockIndex(this->InitialTime() + Duration<TTime>(position + count - 1));
+            for (int64_t block = firstBlock; block <= lastBlock; block++)
+            {
+                if (block < _firstPeakBlock
+                    || block >= _firstPeakBlock + (int64_t)_blockPeaks.size()
+                    || _blockPeaks[(size_t)(block - _firstPeakBlock)] > threshold)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
         void EnsureFreeSlice()
         {
             if (_remainingFreeSlice.IsEmpty())
             {
                 // allocate a new buffer and transfer ownership of it to _buffers
-                _buffers.push_back(std::move(_allocator->Allocate()));
+                _buffers.push_back(_allocator->AllocateShared());
 
                 // get a reference to the current append buffer
-                OwningBuf<TValue>& appendBuffer = _buffers.at(_buffers.size() - 1);
+                OwningBuf<TValue>& appendBuffer = *_buffers.at(_buffers.size() - 1);
 
                 _remainingFreeSlice = Slice<TTime, TValue>(
                     Buf<TValue>(appendBuffer),
@@ -215,6 +305,8 @@ namespace NowSound
         {
             Check(source.Buffer().Data() == _remainingFreeSlice.Buffer().Data()); // dest must be from our free buffer
 
+            RecordBlockPeaks(this->InitialTime() + this->DiscreteDuration(), source);
+
             if (_data.size() == 0)
             {
                 _data.push_back(TimedSlice<TTime, TValue>(this->InitialTime(), source));
@@ -236,7 +328,18 @@ namespace NowSound
             _remainingFreeSlice = _remainingFreeSlice.SubsliceStartingAt(source.SliceDuration());
         }
 
+        // The slice at the given index, as it lies in a copy of its buffer.
+        Slice<TTime, TValue> CopySlice(size_t index, const SharedBuf<TValue>& copy) const
+        {
+            const Slice<TTime, TValue>& slice = _data[index].Value();
+            return Slice<TTime, TValue>(Buf<TValue>(*copy), slice.Offset(), slice.SliceDuration(), this->SliverCount());
+        }
+
+
     public:
+        // The number of slivers summarized by each block of peak metadata.
+        static const int PeakBlockSize = 256;
+
         BufferedSliceStream(
             Time<TTime> initialTime,
             int sliverCount,
@@ -254,7 +357,9 @@ namespace NowSound
             _buffers{ },
             _remainingFreeSlice{ },
             _maxBufferedDuration{ maxBufferedDuration },
-            _useExactLoopingMapper{ useExactLoopingMapper }
+            _useExactLoopingMapper{ useExactLoopingMapper },
+            _blockPeaks{},
+            _firstPeakBlock{ 0 }
         { }
 
         BufferedSliceStream(
@@ -271,7 +376,9 @@ namespace NowSound
             _buffers{},
             _remainingFreeSlice{},
             _maxBufferedDuration{ Duration<TTime>{} },
-            _useExactLoopingMapper{ false }
+            _useExactLoopingMapper{ false },
+            _blockPeaks{},
+            _firstPeakBlock{ 0 }
         { }
 
         BufferedSliceStream(BufferedSliceStream<TTime, TValue>&& other)
@@ -283,10 +390,13 @@ namespace NowSound
                 other.DiscreteDuration(),
                 std::move(other._intervalMapper)),
             _allocator{ other._allocator },
+            _data{ std::move(other._data) },
             _buffers{ std::move(other._buffers) },
             _remainingFreeSlice{ other._remainingFreeSlice },
             _maxBufferedDuration{ other._maxBufferedDuration },
-            _useExactLoopingMapper{ other._useExactLoopingMapper }
+            _useExactLoopingMapper{ other._useExactLoopingMapper },
+            _blockPeaks{ std::move(other._blockPeaks) },
+            _firstPeakBlock{ other._firstPeakBlock }
         {
             Check(_allocator != nullptr);
             Check(this->InitialTime() == other.InitialTime());
@@ -296,15 +406,36 @@ namespace NowSound
 
         BufferedSliceStream(const BufferedSliceStream<TTime, TValue>& other) = delete;
 
-        // On destruction, return all buffers to free list
-        // TODO: does this need locking and/or thread checks?
-        ~BufferedSliceStream()
+        // The number of allocator buffers this stream holds.
+        int BufferCount() const { return (int)_buffers.size(); }
+
+        // The number of bytes in the allocator buffers this stream holds (whether or not they are full yet, and
+        // whether or not other streams share them).
+        int64_t BufferBytes() const { return (int64_t)_buffers.size() * _allocator->BufferSizeInBytes(); }
+
+        // The number of bytes in the allocator buffers this stream holds which the given stream -- a snapshot of
+        // this one, or the stream this is a snapshot of -- does not; that is, the memory that keeping this stream
+        // costs on top of keeping the other.
+        int64_t BufferBytesNotSharedWith(const BufferedSliceStream<TTime, TValue>& other) const
         {
-            for (int i = 0; i < _buffers.size(); i++)
+            // copying on write keeps every buffer at its index, so the two streams' buffers correspond
+            Check(_buffers.size() == other._buffers.size());
+            int64_t unsharedCount = 0;
+            for (size_t i = 0; i < _buffers.size(); i++)
             {
-                // transfer ownership of each buffer back to allocator
-                _allocator->Free(std::move(_buffers.at(i)));
+                if (_buffers[i] != other._buffers[i])
+                {
+                    unsharedCount++;
+                }
             }
+            return unsharedCount * _allocator->BufferSizeInBytes();
+        }
+
+        // On destruction, return all buffers no snapshot still holds to free list
+        // TODO: does this need locking and/or thread checks?
+        ~BufferedSliceStream()
+        {
+            _buffers.clear();
         }
 
         virtual void Shut(ContinuousDuration<AudioSample> finalDuration)
@@ -353,6 +484,7 @@ namespace NowSound
 
                 // and update our loop variables
                 duration = duration - durationToCopy;
+                p += durationToCopy.Value() * this->SliverCount();
 
                 Trim();
             }
@@ -441,8 +573,8 @@ namespace NowSound
                             "make sure our later stream data doesn't reference this one we're about to free");
                     }
 #endif
-                    Check(firstSlice.Value().Buffer().Data() == _buffers[0].Data());
-                    _allocator->Free(std::move(_buffers.at(0)));
+                    Check(firstSlice.Value().Buffer().Data() == _buffers[0]->Data());
+                    // (returning it to the allocator)
                     _buffers.erase(_buffers.begin());
                     this->_discreteDuration = this->_discreteDuration - firstSlice.Value().SliceDuration();
                     this->_initialTime = this->_initialTime + firstSlice.Value().SliceDuration();
@@ -462,6 +594,219 @@ namespace NowSound
                     this->_initialTime = this->_initialTime + toTrim;
                 }
             }
+
+            DropBlockPeaksBefore(this->InitialTime());
+        }
+
+        // Transfer the given interval of this open stream's data to the destination stream, which must be open and
+        // empty, and must share this stream's allocator and sliver count.  The data keeps the destination's
+        // InitialTime, so the two streams' timelines need not agree.
+        //
+        // No data within the interval is copied: the destination takes ownership of the buffers holding it.
+        // Buffers holding only data from before the interval go back to the allocator.  Data after the interval
+        // stays in this stream, which afterwards begins at the end of the interval; only the part of it sharing a
+        // buffer with the interval's last slivers needs to be copied (into a fresh buffer).
+        void TransferTo(Interval<TTime> interval, BufferedSliceStream<TTime, TValue>* destination)
+        {
+            Check(!this->IsShut());
+            Check(!destination->IsShut());
+            Check(destination->_data.size() == 0 && destination->_buffers.size() == 0);
+            Check(destination->_allocator == _allocator);
+            Check(destination->SliverCount() == this->SliverCount());
+            Check(!interval.IsEmpty());
+            Check(interval.InitialTime() >= this->InitialTime());
+
+            Time<TTime> intervalEnd = interval.InitialTime() + interval.IntervalDuration();
+            Time<TTime> finalTime = this->InitialTime() + this->DiscreteDuration();
+            Check(intervalEnd <= finalTime);
+
+            // Each buffer holds exactly one (possibly partial) slice, so _data and _buffers correspond index by index.
+            Check(_data.size() == _buffers.size());
+
+            // Return the buffers holding only data before the interval.
+            while (_data[0].InitialTime() + _data[0].Value().SliceDuration() <= interval.InitialTime())
+            {
+                _buffers.erase(_buffers.begin());
+                _data.erase(_data.begin());
+            }
+
+            // Find the slice containing the last sliver of the interval.
+            size_t last = 0;
+            while (_data[last].InitialTime() + _data[last].Value().SliceDuration() < intervalEnd)
+            {
+                last++;
+            }
+
+            // Hand over the slices and buffers up through that one, trimming the first and last slices to the interval.
+            for (size_t i = 0; i <= last; i++)
+            {
+                Interval<TTime> intersection = _data[i].SliceInterval().Intersect(interval);
+                destination->_data.push_back(TimedSlice<TTime, TValue>(
+                    destination->InitialTime() + (intersection.InitialTime() - interval.InitialTime()),
+                    _data[i].Value().Subslice(intersection.InitialTime() - _data[i].InitialTime(), intersection.IntervalDuration())));
+                destination->_buffers.push_back(std::move(_buffers.at(i)));
+                // the destination's timeline differs, so its peaks are rescanned rather than copied
+                const TimedSlice<TTime, TValue>& transferred = destination->_data.back();
+                destination->RecordBlockPeaks(transferred.InitialTime(), transferred.Value());
+            }
+            destination->_discreteDuration = interval.IntervalDuration();
+
+            // Whatever follows the interval in its last slice is unused by the destination once copied back here,
+            // so it becomes the destination's free slice.
+            const Slice<TTime, TValue>& lastSlice = _data[last].Value();
+            Duration<TTime> lastTransferredDuration = intervalEnd - _data[last].InitialTime();
+            Slice<TTime, TValue> tail = lastSlice.SubsliceStartingAt(lastTransferredDuration);
+            OwningBuf<TValue>& lastBuffer = *destination->_buffers.at(destination->_buffers.size() - 1);
+            int lastBufferSlivers = lastBuffer.Length() / this->SliverCount();
+            int freeOffset = (int)(lastSlice.Offset().Value() + lastTransferredDuration.Value());
+            destination->_remainingFreeSlice = Slice<TTime, TValue>(
+                Buf<TValue>(lastBuffer),
+                freeOffset,
+                lastBufferSlivers - freeOffset,
+                this->SliverCount());
+
+            // This stream keeps what follows the interval.
+            _buffers.erase(_buffers.begin(), _buffers.begin() + last + 1);
+            _data.erase(_data.begin(), _data.begin() + last + 1);
+            bool transferredAppendBuffer = _buffers.size() == 0;
+            this->_initialTime = intervalEnd;
+            this->_discreteDuration = finalTime - intervalEnd;
+            DropBlockPeaksBefore(intervalEnd);
+
+            if (!tail.IsEmpty())
+            {
+                // copy the tail into a fresh buffer at the front of this stream
+                _buffers.insert(_buffers.begin(), _allocator->AllocateShared());
+                OwningBuf<TValue>& tailBuffer = *_buffers.at(0);
+                Slice<TTime, TValue> tailCopy(Buf<TValue>(tailBuffer), 0, tail.SliceDuration().Value(), this->SliverCount());
+                tail.CopyTo(tailCopy);
+                _data.insert(_data.begin(), TimedSlice<TTime, TValue>(intervalEnd, tailCopy));
+
+                if (transferredAppendBuffer)
+                {
+                    // the tail buffer is now the append buffer
+                    _remainingFreeSlice = Slice<TTime, TValue>(
+                        Buf<TValue>(tailBuffer),
+                        (int)tail.SliceDuration().Value(),
+                        tailBuffer.Length() / this->SliverCount() - (int)tail.SliceDuration().Value(),
+                        this->SliverCount());
+                }
+            }
+            else if (transferredAppendBuffer)
+            {
+                // the next append will allocate a new buffer
+                _remainingFreeSlice = Slice<TTime, TValue>();
+            }
+        }
+
+        // Make a new stream with this shut stream's current contents, which shares (rather than copies) its buffers.
+        // Overdub copies any shared buffer before writing it, so afterwards each stream sees only its own writes,
+        // and the two differ in memory only by the buffers written since.
+        std::unique_ptr<BufferedSliceStream<TTime, TValue>> Snapshot() const
+        {
+            Check(this->IsShut());
+
+            std::unique_ptr<BufferedSliceStream<TTime, TValue>> snapshot(new BufferedSliceStream<TTime, TValue>(
+                this->InitialTime(),
+                this->SliverCount(),
+                _allocator,
+                _maxBufferedDuration,
+                _useExactLoopingMapper));
+            snapshot->_data = _data;
+            snapshot->_buffers = _buffers;
+            snapshot->_discreteDuration = this->_discreteDuration;
+            snapshot->_blockPeaks = _blockPeaks;
+            snapshot->_firstPeakBlock = _firstPeakBlock;
+            snapshot->Shut(this->ExactDuration());
+            return snapshot;
+        }
+
+        // Find the first buffer that an Overdub of the given interval would write which another stream (such as a
+        // snapshot) shares, and copy it into a buffer only this stream will hold: set *index to the buffer's index
+        // and *copy to the copy, to be installed by ReplaceBuffer.  Returns false if the overdub writes no shared
+        // buffer.
+        //
+        // This only reads this stream, and a shared buffer is never written, so no reader of this stream need be
+        // locked out while it copies; a caller can copy outside its lock, and lock only to ReplaceBuffer.
+        bool CopySharedBuffer(const Interval<TTime>& intervalArgument, size_t* index, SharedBuf<TValue>* copy) const
+        {
+            Check(this->IsShut());
+            // Each buffer holds exactly one slice, so _data and _buffers correspond index by index.
+            Check(_data.size() == _buffers.size());
+
+            Interval<TTime> interval = intervalArgument;
+            while (!interval.IsEmpty())
+            {
+                Interval<TTime> mappedInterval = this->Mapper()->MapNextSubInterval(this, interval);
+                Interval<TTime> remaining = mappedInterval;
+                while (!remaining.IsEmpty())
+                {
+                    const TimedSlice<TTime, TValue>& timedSlice = GetInitialTimedSlice(remaining);
+                    size_t i = &timedSlice - _data.data();
+                    if (_buffers[i].UseCount() > 1)
+                    {
+                        *copy = _allocator->AllocateShared();
+                        Slice<TTime, TValue> copySlice = CopySlice(i, *copy);
+                        timedSlice.Value().CopyTo(copySlice);
+                        *index = i;
+                        return true;
+                    }
+                    remaining = remaining.SubintervalStartingAt(timedSlice.SliceInterval().Intersect(remaining).IntervalDuration());
+                }
+                interval = interval.SubintervalStartingAt(mappedInterval.IntervalDuration());
+            }
+            return false;
+        }
+
+        // Replace the buffer at the given index with the copy of it made by CopySharedBuffer.
+        void ReplaceBuffer(size_t index, SharedBuf<TValue>&& copy)
+        {
+            _data[index] = TimedSlice<TTime, TValue>(_data[index].InitialTime(), CopySlice(index, copy));
+            _buffers[index] = std::move(copy);
+        }
+
+        // Sum the given interval's worth of data into this shut stream, mapping the interval onto the loop exactly
+        // as reading it would, so that it lands on the slivers that play at those times (wrapping around the end of
+        // the loop as need be).  Any buffer written which another stream shares is first copied, as by
+        // CopySharedBuffer, so the other stream never sees the writes.
+        void Overdub(const Interval<TTime>& intervalArgument, const TValue* p)
+        {
+            size_t index;
+            SharedBuf<TValue> copy;
+            while (CopySharedBuffer(intervalArgument, &index, &copy))
+            {
+                ReplaceBuffer(index, std::move(copy));
+            }
+
+            // so we can update it in the loop
+            Interval<TTime> interval = intervalArgument;
+            while (!interval.IsEmpty())
+            {
+                Interval<TTime> mappedInterval = this->Mapper()->MapNextSubInterval(this, interval);
+                Interval<TTime> remaining = mappedInterval;
+                while (!remaining.IsEmpty())
+                {
+                    const TimedSlice<TTime, TValue>& timedSlice = GetInitialTimedSlice(remaining);
+                    Interval<TTime> intersection = timedSlice.SliceInterval().Intersect(remaining);
+                    Slice<TTime, TValue> destination(timedSlice.Value().Subslice(
+                        intersection.InitialTime() - timedSlice.InitialTime(),
+                        intersection.IntervalDuration()));
+
+                    TValue* d = destination.Buffer().Data() + destination.Offset().Value() * this->SliverCount();
+                    int64_t valueCount = destination.SliceDuration().Value() * this->SliverCount();
+                    for (int64_t i = 0; i < valueCount; i++)
+                    {
+                        d[i] += p[i];
+                    }
+                    // (this only ever raises the peaks, which keeps them conservative)
+                    RecordBlockPeaks(intersection.InitialTime(), destination);
+
+                    p += valueCount;
+                    remaining = remaining.SubintervalStartingAt(intersection.IntervalDuration());
+                }
+
+                interval = interval.SubintervalStartingAt(mappedInterval.IntervalDuration());
+            }
         }
 
         // Copy the given interval's worth of data to the destination pointer.
@@ -473,10 +818,207 @@ namespace NowSound
             {
                 Slice<TTime, TValue> source(GetSliceContaining(sourceInterval));
                 source.CopyTo(p);
+                p += source.SliceDuration().Value() * this->SliverCount();
                 sourceInterval = sourceInterval.SubintervalStartingAt(source.SliceDuration());
             }
         }
 
+        // Copy the given interval's worth of data from this shut, single-sliver stream to the destination pointer,
+        // reading each loop iteration at the mapper's sub-sample phase, so that the loop plays at exactly its
+        // ExactDuration rather than at a whole number of slivers.
+        // Loop iterations with zero phase (which is all of them, for a loop with a whole-sliver duration) are plain copies.
+        void CopyToInterpolated(const Interval<TTime>& sourceIntervalArgument, const PolyphaseInterpolator& interpolator, TValue* p) const
+        {
+            Check(this->IsShut());
+            Check(this->SliverCount() == 1);
+
+            // so we can update it in the loop
+            Interval<TTime> sourceInterval = sourceIntervalArgument;
+            while (!sourceInterval.IsEmpty())
+            {
+                Interval<TTime> mappedInterval = this->Mapper()->MapNextSubInterval(this, sourceInterval);
+                int phaseIndex = PolyphaseInterpolator::PhaseIndex(
+                    this->Mapper()->SubSamplePhase(this, sourceInterval.InitialTime()),
+                    IntervalMapper<TTime>::PhaseBits);
+
+                if (phaseIndex == 0)
+                {
+                    CopyTo(sourceInterval.SubintervalOfDuration(mappedInterval.IntervalDuration()), p);
+                }
+                else
+                {
+                    // Gather each chunk along with its neighboring samples (which may wrap around the loop), then interpolate.
+                    TValue window[InterpolationChunkSize + PolyphaseInterpolator::TapCount - 1];
+                    Duration<TTime> offset = mappedInterval.InitialTime() - this->InitialTime();
+                    int remaining = (int)mappedInterval.IntervalDuration().Value();
+                    TValue* destination = p;
+                    while (remaining > 0)
+                    {
+                        int chunk = std::min(remaining, (int)InterpolationChunkSize);
+                        if (IsSilentWrapped(offset - Duration<TTime>(1), chunk + PolyphaseInterpolator::TapCount - 1, 0))
+                        {
+                            // every input is zero, so every output is too
+                            std::fill(destination, destination + chunk, (TValue)0);
+                        }
+                        else
+                        {
+                            CopyWrapped(offset - Duration<TTime>(1), chunk + PolyphaseInterpolator::TapCount - 1, window);
+                            interpolator.Interpolate(window, phaseIndex, destination, chunk);
+                        }
+
+                        offset = offset + Duration<TTime>(chunk);
+                        destination += chunk;
+                        remaining -= chunk;
+                    }
+                }
+
+                p += mappedInterval.IntervalDuration().Value();
+                sourceInterval = sourceInterval.SubintervalStartingAt(mappedInterval.IntervalDuration());
+            }
+        }
+
+        // Copy the given interval's worth of data from this shut, single-sliver stream to the destination pointer,
+        // reading the positions the given playback mapper maps it to rather than playing straight through the loop.
+        // Only the slivers read are copied (into a small window on the stack), so the loop itself is never copied.
+        void CopyToMapped(const Interval<TTime>& sourceIntervalArgument, const PlaybackMapper<TTime>& mapper, const PolyphaseInterpolator& interpolator, TValue* p) const
+        {
+            Check(this->IsShut());
+            Check(this->SliverCount() == 1);
+
+            // so we can update it in the loop
+            Interval<TTime> sourceInterval = sourceIntervalArgument;
+            while (!sourceInterval.IsEmpty())
+            {
+                int64_t position;
+                int64_t step;
+                Duration<TTime> segmentDuration = mapper.MapNextSegment(this, sourceInterval, &position, &step);
+
+                int64_t loopDuration = PlaybackMapper<TTime>::LoopDuration(this);
+                int remaining = (int)segmentDuration.Value();
+                while (remaining > 0)
+                {
+                    // each chunk ends where its positions wrap round the loop's exact end, which is no whole sliver
+                    position = PlaybackMapper<TTime>::Wrap(this, position);
+                    int64_t untilWrap = step > 0 ? (loopDuration - position + step - 1) / step : position / -step + 1;
+                    int chunk = (int)std::min((int64_t)std::min(remaining, (int)InterpolationChunkSize), untilWrap);
+                    CopyChunkMapped(position, step, chunk, interpolator, p);
+
+                    position += step * chunk;
+                    p += chunk;
+                    remaining -= chunk;
+                }
+
+                sourceInterval = sourceInterval.SubintervalStartingAt(segmentDuration);
+            }
+        }
+
+        // Copy count (at most InterpolationChunkSize) slivers, read from the given fixed-point position onwards (or
+        // backwards) at the given fixed-point step, to the destination pointer.  Positions wrap as in CopyWrapped.
+        void CopyChunkMapped(int64_t position, int64_t step, int count, const PolyphaseInterpolator& interpolator, TValue* p) const
+        {
+            const int phaseBits = IntervalMapper<TTime>::PhaseBits;
+            const int64_t phaseMask = ((int64_t)1 << phaseBits) - 1;
+
+            // the whole slivers spanned, plus the interpolator's neighbors on either side
+            int64_t lastPosition = position + step * (count - 1);
+            int64_t first = std::min(position, lastPosition) >> phaseBits;
+            int windowCount = (int)((std::max(position, lastPosition) >> phaseBits) - first) + PolyphaseInterpolator::TapCount;
+            Check(windowCount <= MaxMappedWindowSize);
+
+            if (IsSilentWrapped(Duration<TTime>(first - 1), windowCount, 0))
+            {
+                std::fill(p, p + count, (TValue)0);
+                return;
+            }
+
+            // window[i] is the sliver at first - 1 + i
+            TValue window[MaxMappedWindowSize];
+            CopyWrapped(Duration<TTime>(first - 1), windowCount, window);
+
+            if ((position & phaseMask) == 0 && (step & phaseMask) == 0)
+            {
+                // whole slivers (forwards or backwards), which need no interpolating
+                for (int i = 0; i < count; i++)
+                {
+                    p[i] = window[((position + step * i) >> phaseBits) - first + 1];
+                }
+            }
+            else
+            {
+                for (int i = 0; i < count; i++)
+                {
+                    int64_t sliverPosition = position + step * i;
+                    p[i] = interpolator.Interpolate(
+                        window + ((sliverPosition >> phaseBits) - first),
+                        PolyphaseInterpolator::PhaseIndex((int)(sliverPosition & phaseMask), phaseBits));
+                }
+            }
+        }
+
+        // Copy count slivers, starting at the given offset from the start of this stream, to the destination pointer;
+        // offsets before the start or past the end of the stream wrap around, as they would in a loop.
+        void CopyWrapped(Duration<TTime> offset, int count, TValue* p) const
+        {
+            int64_t discreteDuration = this->DiscreteDuration().Value();
+            Check(discreteDuration > 0);
+
+            int64_t position = ((offset.Value() % discreteDuration) + discreteDuration) % discreteDuration;
+            while (count > 0)
+            {
+                Interval<TTime> interval(this->InitialTime() + Duration<TTime>(position), std::min((int64_t)count, discreteDuration - position));
+                const TimedSlice<TTime, TValue>& timedSlice = GetInitialTimedSlice(interval);
+                Interval<TTime> intersection = timedSlice.SliceInterval().Intersect(interval);
+                Slice<TTime, TValue> source(timedSlice.Value().Subslice(
+                    intersection.InitialTime() - timedSlice.InitialTime(),
+                    intersection.IntervalDuration()));
+
+                source.CopyTo(p);
+                p += source.SliceDuration().Value() * this->SliverCount();
+                count -= (int)source.SliceDuration().Value();
+                position = (position + source.SliceDuration().Value()) % discreteDuration;
+            }
+        }
+
+        // Is every sliver in the count slivers starting at the given offset from the start of this stream no louder
+        // than threshold?  Offsets wrap around as in CopyWrapped.  This consults only the block peaks, so it is
+        // conservative: a block counts as loud if any sliver in it is.
+        bool IsSilentWrapped(Duration<TTime> offset, int count, TValue threshold) const
+        {
+            int64_t discreteDuration = this->DiscreteDuration().Value();
+            Check(discreteDuration > 0);
+
+            if (count >= discreteDuration)
+            {
+                return IsSilentUnwrapped(0, discreteDuration, threshold);
+            }
+
+            int64_t position = ((offset.Value() % discreteDuration) + discreteDuration) % discreteDuration;
+            int64_t firstCount = std::min((int64_t)count, discreteDuration - position);
+            return IsSilentUnwrapped(position, firstCount, threshold)
+                && (firstCount == count || IsSilentUnwrapped(0, count - firstCount, threshold));
+        }
+
+        // Is everything CopyToInterpolated would read to produce the given interval of this shut stream (including
+        // the interpolator's neighboring slivers) no louder than threshold?  With a threshold of zero, a player may
+        // output silence instead of reading the stream, without changing its output at all.
+        bool IsSilent(const Interval<TTime>& sourceInterval, TValue threshold) const
+        {
+            Check(this->IsShut());
+
+            if (sourceInterval.IsEmpty())
+            {
+                return true;
+            }
+
+            Interval<TTime> mappedInterval = this->Mapper()->MapNextSubInterval(this, sourceInterval);
+            // Allow for the neighboring slivers on either side, plus one more since the phase may shift at the loop
+            // boundary.
+            return IsSilentWrapped(
+                mappedInterval.InitialTime() - this->InitialTime() - Duration<TTime>(1),
+                (int)sourceInterval.IntervalDuration().Value() + PolyphaseInterpolator::TapCount,
+                threshold);
+        }
+
         // Append the given interval from this stream to the (end of the) destination stream.
         virtual void AppendTo(Interval<TTime> sourceInterval, DenseSliceStream<TTime, TValue>* destinationStream) const
         {
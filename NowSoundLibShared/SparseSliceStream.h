@@ -0,0 +1,189 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "Check.h"
+#include "IntervalMapper.h"
+#include "SliceStream.h"
+#include "Time.h"
+
+namespace NowSound
+{
+    // One event of a SparseSliceStream: the value the stream takes on from the given time.
+    template<typename TTime, typename TValue>
+    struct SparseEvent
+    {
+        Time<TTime> EventTime;
+        TValue Value;
+    };
+
+    // A stream of sparse, timed values -- such as a parameter's automation, or control events -- rather than of
+    // densely sequenced slices.
+    //
+    // The stream is a step function: its value at any time is that of the latest event at or before that time, or
+    // its initial value before the first event.  The events are kept in one flat array, sorted by time, so seeking
+    // is a binary search and reading onwards touches consecutive memory.  A reader moving forwards in time (as the
+    // mixer does, quantum by quantum) can pass a cursor, which makes each seek O(1) except where the loop wraps.
+    //
+    // Like a BufferedSliceStream, the stream takes appends while open, and once shut, loops through a looping
+    // IntervalMapper; so a stream shut with a track's ExactDuration loops in exact step with the track's audio.
+    template<typename TTime, typename TValue>
+    class SparseSliceStream : public SliceStream<TTime, TValue>
+    {
+    private:
+        // The value before the first event.
+        TValue _initialValue;
+
+        // The events, in strictly increasing order of time, all within the stream's discrete interval.
+        std::vector<SparseEvent<TTime, TValue>> _events;
+
+        // While open, the duration up to and including the last event; once shut, the rounded-up exact duration.
+        Duration<TTime> _discreteDuration;
+
+        // The looping mapper; null until shut (while open, times are not mapped at all).
+        std::unique_ptr<IntervalMapper<TTime>> _intervalMapper;
+
+        bool _useExactLoopingMapper;
+
+        // The index of the first event after the given (mapped) time.  The cursor is tried first, and then the
+        // index after it (since, reading forwards, the next event may just have gone by), before searching.
+        int FindFirstEventAfter(Time<TTime> time, int cursor) const
+        {
+            int count = (int)_events.size();
+            for (int i = (std::max)(0, cursor); i <= count && i <= cursor + 1; i++)
+            {
+                if ((i == 0 || _events[i - 1].EventTime <= time) && (i == count || time < _events[i].EventTime))
+                {
+                    return i;
+                }
+            }
+
+            auto found = std::upper_bound(_events.begin(), _events.end(), time, [](Time<TTime> t, const SparseEvent<TTime, TValue>& e)
+            {
+                return t < e.EventTime;
+            });
+            return (int)(found - _events.begin());
+        }
+
+        // Map the start of the given interval into the stream, returning how much of it maps contiguously.
+        Interval<TTime> MapNextSubInterval(Interval<TTime> interval) const
+        {
+            return this->IsShut() ? _intervalMapper->MapNextSubInterval(this, interval) : interval;
+        }
+
+    public:
+        SparseSliceStream(Time<TTime> initialTime, TValue initialValue, bool useExactLoopingMapper)
+            : SliceStream<TTime, TValue>(initialTime, 1, 0, false),
+            _initialValue{ initialValue },
+            _events{},
+            _discreteDuration{ 0 },
+            _intervalMapper{},
+            _useExactLoopingMapper{ useExactLoopingMapper }
+        { }
+
+        // no copying this
+        SparseSliceStream(const SparseSliceStream<TTime, TValue>&) = delete;
+
+        virtual Duration<TTime> DiscreteDuration() const { return _discreteDuration; }
+
+        TValue InitialValue() const { return _initialValue; }
+
+        int EventCount() const { return (int)_events.size(); }
+
+        const SparseEvent<TTime, TValue>& Event(int index) const { return _events[index]; }
+
+        // Append an event at the given time, which must be no earlier than the last event's; an event at the same
+        // time as the last replaces it.  This must not be shut yet.
+        void Append(Time<TTime> time, TValue value)
+        {
+            Check(!this->IsShut());
+            Check(time >= this->InitialTime());
+
+            if (!_events.empty())
+            {
+                Check(time >= _events.back().EventTime);
+                if (time == _events.back().EventTime)
+                {
+                    _events.back().Value = value;
+                    return;
+                }
+            }
+            _events.push_back(SparseEvent<TTime, TValue>{ time, value });
+            _discreteDuration = (std::max)(_discreteDuration, time - this->InitialTime() + Duration<TTime>(1));
+        }
+
+        // Shut the stream with the given duration, and start looping.  Unlike a dense stream's, the duration may be
+        // longer than the events so far (the last value holds till the end of the loop), or shorter (the events
+        // after the end are dropped).
+        virtual void Shut(ContinuousDuration<TTime> finalDuration)
+        {
+            Check(finalDuration.Value() > 0);
+            SliceStream<TTime, TValue>::Shut(finalDuration);
+
+            _discreteDuration = (int64_t)std::ceil(finalDuration.Value());
+            Time<TTime> end = this->InitialTime() + _discreteDuration;
+            while (!_events.empty() && _events.back().EventTime >= end)
+            {
+                _events.pop_back();
+            }
+
+            if (_useExactLoopingMapper)
+            {
+                _intervalMapper.reset(new ExactLoopingIntervalMapper<TTime>());
+            }
+            else
+            {
+                _intervalMapper.reset(new SimpleLoopingIntervalMapper<TTime>());
+            }
+        }
+
+        // The value at the given time (the initial value before InitialTime).  If cursor is not null, it is used as
+        // the starting point of the search, and updated for the next call; start it at 0.
+        TValue ValueAt(Time<TTime> time, int* cursor) const
+        {
+            if (time < this->InitialTime())
+            {
+                return _initialValue;
+            }
+
+            Time<TTime> mappedTime = MapNextSubInterval(Interval<TTime>(time, 1)).InitialTime();
+            int next = FindFirstEventAfter(mappedTime, cursor == nullptr ? 0 : *cursor);
+            if (cursor != nullptr)
+            {
+                *cursor = next;
+            }
+            return next == 0 ? _initialValue : _events[next - 1].Value;
+        }
+
+        // Call action(offset, value) for each event in the given interval, in order, with its offset from the start
+        // of the interval; a looping stream's events are visited once per loop iteration the interval covers.  Once
+        // shut, the interval must not start before InitialTime.
+        template<typename TAction>
+        void ForEachEvent(Interval<TTime> interval, TAction action) const
+        {
+            Duration<TTime> offset = 0;
+            while (!interval.IsEmpty())
+            {
+                Interval<TTime> mappedInterval = MapNextSubInterval(interval);
+                Time<TTime> mappedEnd = mappedInterval.InitialTime() + mappedInterval.IntervalDuration();
+                for (int i = FindFirstEventAfter(mappedInterval.InitialTime() - Duration<TTime>(1), 0);
+                    i < (int)_events.size() && _events[i].EventTime < mappedEnd;
+                    i++)
+                {
+                    action(offset + (_events[i].EventTime - mappedInterval.InitialTime()), _events[i].Value);
+                }
+
+                offset = offset + mappedInterval.IntervalDuration();
+                interval = interval.SubintervalStartingAt(mappedInterval.IntervalDuration());
+            }
+        }
+    };
+}
@@ -52,12 +52,12 @@ namespace NowSound
 
         static Time<TTime> Min(const Time<TTime>& first, const Time<TTime>& second)
         {
-            return Time<TTime>(__min(first.Value(), second.Value()));
+            return first.Value() < second.Value() ? first : second;
         }
 
         static Time<TTime> Max(const Time<TTime>& first, const Time<TTime>& second)
         {
-            return Time<TTime>(__max(first.Value(), second.Value()));
+            return first.Value() > second.Value() ? first : second;
         }
 
         Time<TTime>& operator=(const Time<TTime>& other)
@@ -95,8 +95,6 @@ namespace NowSound
         {
             return _value >= second.Value();
         }
-
-        double Seconds() const { return ((double)_value.Value()) / Clock::SampleRateHz; }
     };
 
     // A distance between two Times.
@@ -116,7 +114,7 @@ namespace NowSound
 
         static Duration<TTime> Min(Duration<TTime> first, Duration<TTime> second)
         {
-            return new Duration<TTime>(Math.Min(first, second));
+            return first < second ? first : second;
         }
 
         Duration<TTime>& operator=(const Duration<TTime>& other)
@@ -204,7 +202,7 @@ namespace NowSound
     template<typename TTime>
     Time<TTime> operator +(Duration<TTime> first, Time<TTime> second)
     {
-        return Time<TTime>(first._duration + second.Value());
+        return Time<TTime>(first.Value() + second.Value());
     }
 
     // An interval, defined as a start time and a duration (aka length).
@@ -265,7 +263,7 @@ namespace NowSound
 
         bool Contains(Time<TTime> time) const
         {
-            if (IsEmpty) 
+            if (IsEmpty()) 
             {
                 return false;
             }
@@ -282,16 +280,19 @@ namespace NowSound
     };
 
     // A continous distance between two Times.
+    //
+    // This is a double, so that a loop length derived from a BPM (rarely a whole number of samples) keeps its
+    // fraction precisely enough that a loop repeating at it stays in time with the clock all day.
     template<typename TTime>
     struct ContinuousDuration
     {
     private:
-        float _value;
+        double _value;
 
     public:
         ContinuousDuration() = delete;
 
-        ContinuousDuration(float value) : _value(value)
+        ContinuousDuration(double value) : _value(value)
         {
             Check(value >= 0);
         }
@@ -300,7 +301,7 @@ namespace NowSound
         {
         }
 
-        float Value() const { return _value; }
+        double Value() const { return _value; }
 
         ContinuousDuration<TTime>& operator =(const ContinuousDuration<TTime>& other)
         {
@@ -308,9 +309,9 @@ namespace NowSound
             return *this;
         }
 
-        ContinuousDuration<TTime> operator *(float value) const
+        ContinuousDuration<TTime> operator *(double value) const
         {
-            return new ContinuousDuration<TTime>(value * _value);
+            return ContinuousDuration<TTime>(value * _value);
         }
     };
 }
@@ -0,0 +1,193 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#define NOWSOUND_RDTSC 1
+#elif defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define NOWSOUND_RDTSC 1
+#endif
+
+#include "Check.h"
+#include "Trace.h"
+
+using namespace NowSound;
+using namespace std;
+
+namespace
+{
+    struct TraceEventInfo
+    {
+        const char* Name;
+        // Chrome trace event phase: 'B'egin, 'E'nd, or 'i'nstant.
+        char Phase;
+    };
+
+    // Indexed by TraceEvent; Begin and End events share their span's name.
+    const TraceEventInfo s_eventInfos[] =
+    {
+        { "GraphQuantum", 'B' },
+        { "GraphQuantum", 'E' },
+        { "InputDeviceAudio", 'i' },
+        { "MonitorEmitted", 'i' },
+        { "MixerQuantum", 'B' },
+        { "MixerQuantum", 'E' },
+        { "MixerZeroByteFrame", 'i' },
+        { "TrackMix", 'B' },
+        { "TrackMix", 'E' },
+        { "Inserts", 'B' },
+        { "Inserts", 'E' },
+        { "Reverb", 'B' },
+        { "Reverb", 'E' },
+        { "MasterBus", 'B' },
+        { "MasterBus", 'E' },
+        { "TrackRecorded", 'i' },
+        { "TrackStateChanged", 'i' },
+        { "LoopAnalysis", 'B' },
+        { "LoopAnalysis", 'E' },
+        { "GraphStateChanged", 'i' },
+    };
+    static_assert(sizeof(s_eventInfos) / sizeof(s_eventInfos[0]) == (size_t)TraceEvent::Count, "one info per event");
+
+    chrono::steady_clock::time_point SteadyNow() { return chrono::steady_clock::now(); }
+
+    // The trace's time origin, in both ticks and steady clock time, for converting ticks when exporting.
+    const chrono::steady_clock::time_point s_originTime = SteadyNow();
+    const uint64_t s_originTicks = Trace::Timestamp();
+}
+
+std::atomic<bool> Trace::s_isEnabled{ true };
+std::mutex Trace::s_registryMutex{};
+std::vector<std::unique_ptr<TraceRing>> Trace::s_rings{};
+thread_local TraceRing* Trace::s_threadRing{ nullptr };
+
+TraceRing::TraceRing(int threadIndex)
+    : _threadIndex{ threadIndex },
+    _threadName{},
+    _writeIndex{ 0 },
+    _records{ new TraceRecord[Capacity] }
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+}
+
+void TraceRing::Snapshot(std::vector<TraceRecord>& output) const
+{
+    uint64_t end = _writeIndex.load(std::memory_order_acquire);
+    uint64_t begin = end > Capacity ? end - Capacity : 0;
+
+    size_t firstOutput = output.size();
+    for (uint64_t index = begin; index < end; index++)
+    {
+        output.push_back(_records[index & (Capacity - 1)]);
+    }
+
+    // Whatever the writer has started writing since (including the record it may be halfway through) has
+    // overwritten the oldest records we copied; drop those.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t laterEnd = _writeIndex.load(std::memory_order_relaxed);
+    uint64_t firstIntact = laterEnd + 1 > Capacity ? laterEnd + 1 - Capacity : 0;
+    if (firstIntact > begin)
+    {
+        size_t overwritten = (size_t)((std::min)(firstIntact, end) - begin);
+        output.erase(output.begin() + firstOutput, output.begin() + firstOutput + overwritten);
+    }
+}
+
+uint64_t Trace::Timestamp()
+{
+#if NOWSOUND_RDTSC
+    return __rdtsc();
+#else
+    return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(SteadyNow().time_since_epoch()).count();
+#endif
+}
+
+TraceRing* Trace::CreateThreadRing()
+{
+    std::lock_guard<std::mutex> guard(s_registryMutex);
+    s_rings.push_back(std::unique_ptr<TraceRing>(new TraceRing((int)s_rings.size() + 1)));
+    s_threadRing = s_rings.back().get();
+    return s_threadRing;
+}
+
+void Trace::SetThreadName(const char* name)
+{
+    TraceRing* ring = s_threadRing;
+    if (ring == nullptr)
+    {
+        ring = CreateThreadRing();
+    }
+    std::lock_guard<std::mutex> guard(s_registryMutex);
+    ring->ThreadName(name);
+}
+
+const char* Trace::EventName(TraceEvent event)
+{
+    Check(event < TraceEvent::Count);
+    return s_eventInfos[(int)event].Name;
+}
+
+void Trace::WriteChromeJson(std::ostream& output)
+{
+    // Measure the tick rate over the whole life of the trace so far, which makes it as precise as it can be.
+    double ticksPerMicrosecond = 1000;
+#if NOWSOUND_RDTSC
+    double elapsedMicroseconds = chrono::duration<double, micro>(SteadyNow() - s_originTime).count();
+    uint64_t elapsedTicks = Timestamp() - s_originTicks;
+    if (elapsedMicroseconds > 0 && elapsedTicks > 0)
+    {
+        ticksPerMicrosecond = elapsedTicks / elapsedMicroseconds;
+    }
+#endif
+
+    std::lock_guard<std::mutex> guard(s_registryMutex);
+
+    output << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    bool isFirst = true;
+    char line[256];
+    std::vector<TraceRecord> records;
+    for (const std::unique_ptr<TraceRing>& ring : s_rings)
+    {
+        if (!ring->ThreadName().empty())
+        {
+            snprintf(line, sizeof(line), "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                isFirst ? "" : ",\n",
+                ring->ThreadIndex(),
+                ring->ThreadName().c_str());
+            output << line;
+            isFirst = false;
+        }
+
+        records.clear();
+        ring->Snapshot(records);
+        for (const TraceRecord& record : records)
+        {
+            const TraceEventInfo& info = s_eventInfos[(int)record.Event];
+            // Records older than the origin (possible only at static initialization) clamp to zero.
+            double microseconds = record.Timestamp > s_originTicks ? (record.Timestamp - s_originTicks) / ticksPerMicrosecond : 0;
+            snprintf(line, sizeof(line),
+                "%s{\"name\":\"%s\",\"cat\":\"nowsound\",\"ph\":\"%c\",%s\"ts\":%.3f,\"pid\":1,\"tid\":%d,"
+                "\"args\":{\"track\":%d,\"payload0\":%lld,\"payload1\":%lld}}",
+                isFirst ? "" : ",\n",
+                info.Name,
+                info.Phase,
+                // instants are scoped to their thread
+                info.Phase == 'i' ? "\"s\":\"t\"," : "",
+                microseconds,
+                ring->ThreadIndex(),
+                record.TrackId,
+                (long long)record.Payload0,
+                (long long)record.Payload1);
+            output << line;
+            isFirst = false;
+        }
+    }
+    output << "\n]}\n";
+}
@@ -0,0 +1,189 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "stdint.h"
+
+// Set NOWSOUND_TRACING to 0 to compile all NOWSOUND_TRACE statements out entirely.
+#ifndef NOWSOUND_TRACING
+#define NOWSOUND_TRACING 1
+#endif
+
+#if NOWSOUND_TRACING
+// Record a trace event, e.g. NOWSOUND_TRACE(TrackMixBegin, trackId, sampleCount, 0).
+#define NOWSOUND_TRACE(event, trackId, payload0, payload1) \
+    (NowSound::Trace::IsEnabled() \
+        ? NowSound::Trace::Record(NowSound::TraceEvent::event, (int32_t)(trackId), (int64_t)(payload0), (int64_t)(payload1)) \
+        : (void)0)
+// Name the calling thread in exported traces, the first time each thread reaches this statement.
+#define NOWSOUND_TRACE_THREAD_NAME(name) \
+    do \
+    { \
+        static thread_local bool s_isThreadNamed = false; \
+        if (!s_isThreadNamed) { NowSound::Trace::SetThreadName(name); s_isThreadNamed = true; } \
+    } while (0)
+#else
+#define NOWSOUND_TRACE(event, trackId, payload0, payload1) ((void)0)
+#define NOWSOUND_TRACE_THREAD_NAME(name) ((void)0)
+#endif
+
+namespace NowSound
+{
+    // The kinds of trace event.  Those ending in Begin and End delimit spans (and must be properly nested on
+    // each thread); the rest are instants.
+    enum class TraceEvent : uint32_t
+    {
+        // The audio graph's quantum; payload0 is the quantum's sample count.
+        GraphQuantumBegin,
+        GraphQuantumEnd,
+        // An input device delivered audio; payload0 is the sample count, payload1 the device's channel count.
+        InputDeviceAudio,
+        // The monitor bus emitted audio; payload0 is the sample count.
+        MonitorEmitted,
+        // The mixer's quantum; payload0 is the sample count, payload1 the track count.
+        MixerQuantumBegin,
+        MixerQuantumEnd,
+        // The mixer's node asked for zero samples.
+        MixerZeroByteFrame,
+        // One track's audio being read for mixing; payload0 is the sample count, payload1 is 1 if it was silent.
+        TrackMixBegin,
+        TrackMixEnd,
+        // A group of tracks' insert effects being processed together; payload0 is the sample count, payload1 the
+        // number of tracks.
+        InsertsBegin,
+        InsertsEnd,
+        // The send bus being convolved with the reverb's impulse response; payload0 is the sample count, payload1
+        // the number of partitions.
+        ReverbBegin,
+        ReverbEnd,
+        // The mixed output being limited and metered; payload0 is the sample count.
+        MasterBusBegin,
+        MasterBusEnd,
+        // A recording track recorded audio; payload0 is the sample count, payload1 the track's total duration.
+        TrackRecorded,
+        // A track changed state; payload0 is the new NowSoundTrackState.
+        TrackStateChanged,
+        // A shut loop being analyzed; payload0 is the loop's duration.
+        LoopAnalysisBegin,
+        LoopAnalysisEnd,
+        // The graph changed state; payload0 is the new NowSoundGraphState.  (The first GraphQuantumBegin after
+        // the change to GraphRunning marks the first audio.)
+        GraphStateChanged,
+
+        // Not an event; the number of event kinds.
+        Count
+    };
+
+    // One trace event; fixed size, so recording one never allocates or formats anything.
+    struct TraceRecord
+    {
+        // In Trace::Timestamp() ticks.
+        uint64_t Timestamp;
+        // TrackIdUndefined (0) if not specific to a track.
+        int32_t TrackId;
+        TraceEvent Event;
+        int64_t Payload0;
+        int64_t Payload1;
+    };
+
+    // The trace ring of one thread; only that thread records into it, so recording is lock-free and wait-free.
+    // When full, the oldest records are overwritten.
+    class TraceRing
+    {
+    public:
+        // Must be a power of two.
+        static const int Capacity = 8192;
+
+    private:
+        const int _threadIndex;
+        std::string _threadName;
+
+        // The total number of records ever written; the next record goes at _writeIndex % Capacity.
+        std::atomic<uint64_t> _writeIndex;
+
+        std::unique_ptr<TraceRecord[]> _records;
+
+    public:
+        TraceRing(int threadIndex);
+
+        int ThreadIndex() const { return _threadIndex; }
+
+        // Locked by Trace's registry mutex.
+        const std::string& ThreadName() const { return _threadName; }
+        void ThreadName(const std::string& name) { _threadName = name; }
+
+        void Record(uint64_t timestamp, TraceEvent event, int32_t trackId, int64_t payload0, int64_t payload1)
+        {
+            uint64_t index = _writeIndex.load(std::memory_order_relaxed);
+            TraceRecord& record = _records[index & (Capacity - 1)];
+            record.Timestamp = timestamp;
+            record.TrackId = trackId;
+            record.Event = event;
+            record.Payload0 = payload0;
+            record.Payload1 = payload1;
+            _writeIndex.store(index + 1, std::memory_order_release);
+        }
+
+        // Append the ring's current records, oldest first, to output.  Safe to call while the owning thread is
+        // recording; records it overwrites during the copy are dropped rather than returned torn.  (So a full ring
+        // yields Capacity - 1 records, the oldest slot being the one the owning thread would write next.)
+        void Snapshot(std::vector<TraceRecord>& output) const;
+    };
+
+    // A binary event trace, kept in one ring per thread, which can be exported as Chrome trace JSON (viewable
+    // in chrome://tracing or https://ui.perfetto.dev).
+    class Trace
+    {
+    private:
+        static std::atomic<bool> s_isEnabled;
+
+        // All rings ever created; rings live until process exit, so a thread's ring pointer never dangles.
+        static std::mutex s_registryMutex;
+        static std::vector<std::unique_ptr<TraceRing>> s_rings;
+
+        // The calling thread's ring, created on first use.
+        static thread_local TraceRing* s_threadRing;
+
+        static TraceRing* CreateThreadRing();
+
+    public:
+        // Is tracing currently enabled?  (It is by default, when compiled in at all.)
+        static bool IsEnabled() { return s_isEnabled.load(std::memory_order_relaxed); }
+        static void IsEnabled(bool isEnabled) { s_isEnabled = isEnabled; }
+
+        // The current time in trace ticks: the CPU's timestamp counter where there is one (so reading it costs
+        // a few nanoseconds), else the steady clock.  Converted to real time only when exporting.
+        static uint64_t Timestamp();
+
+        // Record an event on the calling thread's ring.  (Use NOWSOUND_TRACE rather than calling this directly.)
+        static void Record(TraceEvent event, int32_t trackId, int64_t payload0, int64_t payload1)
+        {
+            TraceRing* ring = s_threadRing;
+            if (ring == nullptr)
+            {
+                // once per thread
+                ring = CreateThreadRing();
+            }
+            ring->Record(Timestamp(), event, trackId, payload0, payload1);
+        }
+
+        // Name the calling thread in exported traces.
+        static void SetThreadName(const char* name);
+
+        // The name of the given event kind, as exported.
+        static const char* EventName(TraceEvent event);
+
+        // Write all threads' current records as Chrome trace event JSON.
+        static void WriteChromeJson(std::ostream& output);
+    };
+}
@@ -0,0 +1,230 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#include "pch.h"
+
+#include <cstring>
+
+#include "Check.h"
+#include "WavFile.h"
+
+using namespace NowSound;
+
+namespace
+{
+    const uint16_t FormatPcm = 1;
+    const uint16_t FormatFloat = 3;
+    const uint16_t FormatExtensible = 0xFFFE;
+
+    // The header WavWriter writes: RIFF, then a format chunk (of 18 bytes, as non-PCM formats require), a fact chunk
+    // (holding the frame count, likewise), and the data chunk's header.
+    const int HeaderSize = 12 + 8 + 18 + 8 + 4 + 8;
+    const int RiffSizeOffset = 4;
+    const int FactFrameCountOffset = 12 + 8 + 18 + 8;
+    const int DataSizeOffset = HeaderSize - 4;
+
+    // WAV files are little-endian throughout.
+    uint32_t ReadLittleEndian(const uint8_t* bytes, int byteCount)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < byteCount; i++)
+        {
+            value |= (uint32_t)bytes[i] << (i * 8);
+        }
+        return value;
+    }
+
+    void WriteLittleEndian(uint32_t value, int byteCount, uint8_t* bytes)
+    {
+        for (int i = 0; i < byteCount; i++)
+        {
+            bytes[i] = (uint8_t)(value >> (i * 8));
+        }
+    }
+
+    bool ReadBytes(std::istream& input, uint8_t* bytes, size_t byteCount)
+    {
+        input.read((char*)bytes, byteCount);
+        return (size_t)input.gcount() == byteCount;
+    }
+
+    // Convert one sample of the given format to a float in [-1, 1).
+    float SampleValue(const uint8_t* bytes, uint16_t format, int bitsPerSample)
+    {
+        if (format == FormatFloat)
+        {
+            uint32_t bits = ReadLittleEndian(bytes, 4);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        int byteCount = bitsPerSample / 8;
+        // shift the sample to the top of an int32, so its sign extends, then scale it to [-1, 1)
+        int32_t value = (int32_t)(ReadLittleEndian(bytes, byteCount) << (32 - bitsPerSample));
+        return (float)(value / 2147483648.0);
+    }
+}
+
+bool WavFile::Read(std::istream& input, WavData& data)
+{
+    uint8_t header[12];
+    if (!ReadBytes(input, header, sizeof(header))
+        || std::memcmp(header, "RIFF", 4) != 0
+        || std::memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+
+    uint16_t format = 0;
+    int channelCount = 0;
+    int sampleRateHz = 0;
+    int bitsPerSample = 0;
+    bool hasFormat = false;
+
+    while (true)
+    {
+        uint8_t chunkHeader[8];
+        if (!ReadBytes(input, chunkHeader, sizeof(chunkHeader)))
+        {
+            // no data chunk
+            return false;
+        }
+        uint32_t chunkSize = ReadLittleEndian(chunkHeader + 4, 4);
+
+        if (std::memcmp(chunkHeader, "fmt ", 4) == 0)
+        {
+            std::vector<uint8_t> chunk(chunkSize);
+            if (chunkSize < 16 || !ReadBytes(input, chunk.data(), chunkSize))
+            {
+                return false;
+            }
+            format = (uint16_t)ReadLittleEndian(&chunk[0], 2);
+            channelCount = (int)ReadLittleEndian(&chunk[2], 2);
+            sampleRateHz = (int)ReadLittleEndian(&chunk[4], 4);
+            bitsPerSample = (int)ReadLittleEndian(&chunk[14], 2);
+            if (format == FormatExtensible)
+            {
+                // the actual format is the first two bytes of the subformat GUID
+                if (chunkSize < 40)
+                {
+                    return false;
+                }
+                format = (uint16_t)ReadLittleEndian(&chunk[24], 2);
+            }
+            hasFormat = true;
+        }
+        else if (std::memcmp(chunkHeader, "data", 4) == 0)
+        {
+            bool isSupported = (format == FormatPcm && (bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32))
+                || (format == FormatFloat && bitsPerSample == 32);
+            if (!hasFormat || !isSupported || channelCount <= 0 || sampleRateHz <= 0)
+            {
+                return false;
+            }
+
+            int bytesPerSample = bitsPerSample / 8;
+            std::vector<uint8_t> bytes(chunkSize - chunkSize % (bytesPerSample * channelCount));
+            if (!ReadBytes(input, bytes.data(), bytes.size()))
+            {
+                return false;
+            }
+
+            data.ChannelCount = channelCount;
+            data.SampleRateHz = sampleRateHz;
+            data.Samples.resize(bytes.size() / bytesPerSample);
+            for (size_t i = 0; i < data.Samples.size(); i++)
+            {
+                data.Samples[i] = SampleValue(&bytes[i * bytesPerSample], format, bitsPerSample);
+            }
+            return true;
+        }
+        else
+        {
+            input.seekg(chunkSize, std::ios::cur);
+        }
+
+        // chunks are padded to an even length
+        if (chunkSize & 1)
+        {
+            input.seekg(1, std::ios::cur);
+        }
+        if (!input)
+        {
+            return false;
+        }
+    }
+}
+
+WavWriter::WavWriter(std::ostream& output, int channelCount, int sampleRateHz)
+    : _output{ output },
+    _channelCount{ channelCount },
+    _frameCount{ 0 },
+    _bytes{}
+{
+    Check(channelCount > 0);
+    Check(sampleRateHz > 0);
+
+    int bytesPerFrame = channelCount * (int)sizeof(float);
+    uint8_t header[HeaderSize];
+    std::memcpy(header, "RIFF", 4);
+    WriteLittleEndian(0, 4, header + RiffSizeOffset);
+    std::memcpy(header + 8, "WAVE", 4);
+    std::memcpy(header + 12, "fmt ", 4);
+    WriteLittleEndian(18, 4, header + 16);
+    WriteLittleEndian(FormatFloat, 2, header + 20);
+    WriteLittleEndian(channelCount, 2, header + 22);
+    WriteLittleEndian(sampleRateHz, 4, header + 24);
+    WriteLittleEndian(sampleRateHz * bytesPerFrame, 4, header + 28);
+    WriteLittleEndian(bytesPerFrame, 2, header + 32);
+    WriteLittleEndian(32, 2, header + 34);
+    WriteLittleEndian(0, 2, header + 36);
+    std::memcpy(header + 38, "fact", 4);
+    WriteLittleEndian(4, 4, header + 42);
+    WriteLittleEndian(0, 4, header + FactFrameCountOffset);
+    std::memcpy(header + 50, "data", 4);
+    WriteLittleEndian(0, 4, header + DataSizeOffset);
+    _output.write((const char*)header, HeaderSize);
+}
+
+void WavWriter::Write(const float* samples, int frameCount)
+{
+    Check(frameCount >= 0);
+
+    size_t sampleCount = (size_t)frameCount * _channelCount;
+    if (_bytes.size() < sampleCount * 4)
+    {
+        _bytes.resize(sampleCount * 4);
+    }
+    for (size_t i = 0; i < sampleCount; i++)
+    {
+        uint32_t bits;
+        std::memcpy(&bits, &samples[i], sizeof(bits));
+        WriteLittleEndian(bits, 4, &_bytes[i * 4]);
+    }
+    _output.write((const char*)_bytes.data(), sampleCount * 4);
+    _frameCount += frameCount;
+}
+
+bool WavWriter::Finish()
+{
+    int64_t dataSize = _frameCount * _channelCount * (int64_t)sizeof(float);
+    if (HeaderSize + dataSize > UINT32_MAX)
+    {
+        return false;
+    }
+
+    uint8_t size[4];
+    WriteLittleEndian((uint32_t)(HeaderSize - 8 + dataSize), 4, size);
+    _output.seekp(RiffSizeOffset);
+    _output.write((const char*)size, 4);
+    WriteLittleEndian((uint32_t)_frameCount, 4, size);
+    _output.seekp(FactFrameCountOffset);
+    _output.write((const char*)size, 4);
+    WriteLittleEndian((uint32_t)dataSize, 4, size);
+    _output.seekp(DataSizeOffset);
+    _output.write((const char*)size, 4);
+    _output.seekp(0, std::ios::end);
+    _output.flush();
+    return (bool)_output;
+}
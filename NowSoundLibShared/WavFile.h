@@ -0,0 +1,69 @@
+// NowSound library by Rob Jellinghaus, https://github.com/RobJellinghaus/NowSound
+// Licensed under the MIT license
+
+#pragma once
+
+#include "pch.h"
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace NowSound
+{
+    // The audio of a WAV file, converted to floats.
+    struct WavData
+    {
+        int ChannelCount;
+        int SampleRateHz;
+
+        // Interleaved by channel.
+        std::vector<float> Samples;
+
+        WavData() : ChannelCount{ 0 }, SampleRateHz{ 0 }, Samples{} {}
+
+        int64_t FrameCount() const { return ChannelCount == 0 ? 0 : (int64_t)Samples.size() / ChannelCount; }
+    };
+
+    // Reading (RIFF) WAV files.
+    class WavFile
+    {
+    public:
+        // Read a WAV stream of 16-, 24- or 32-bit integer PCM, or 32-bit float, samples (in either the plain or the
+        // extensible format); chunks other than the format and the data are skipped.  Returns false if the stream
+        // is not such a WAV file, or is truncated.
+        static bool Read(std::istream& input, WavData& data);
+    };
+
+    // Writes a WAV stream of 32-bit float samples a block at a time, so that nothing need hold the whole of a long
+    // render in memory.  The header is written first with placeholder sizes, which Finish fills in.
+    class WavWriter
+    {
+    private:
+        std::ostream& _output;
+        const int _channelCount;
+        int64_t _frameCount;
+
+        // The little-endian bytes of the block being written; only ever grows.
+        std::vector<uint8_t> _bytes;
+
+    public:
+        // Write the header to the given (seekable, binary) stream.
+        WavWriter(std::ostream& output, int channelCount, int sampleRateHz);
+
+        // no copying this
+        WavWriter(const WavWriter&) = delete;
+
+        int ChannelCount() const { return _channelCount; }
+
+        int64_t FrameCount() const { return _frameCount; }
+
+        // Append frameCount frames of interleaved samples.
+        void Write(const float* samples, int frameCount);
+
+        // Fill in the sizes in the header, and flush.  Returns false if any write failed, or if the data outgrew
+        // the 4GB a WAV file can hold.
+        bool Finish();
+    };
+}
@@ -212,4 +212,144 @@ namespace RosettaFFT
 			// wcout << L"outputVector[" << i << L"] = " << outputVector[i] << endl;
 		}
 	}
-}
\ No newline at end of file
+
+	FftPlan::FftPlan(int size)
+		: _size{ size },
+		_twiddles(size / 2),
+		_bitReversed(size)
+	{
+		NowSound::Check(size >= 2);
+		NowSound::Check((size & (size - 1)) == 0); // must be a power of two
+
+		for (int k = 0; k < size / 2; k++)
+		{
+			double angle = -2 * PI * k / size;
+			_twiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+		}
+
+		int bits = 0;
+		while ((1 << bits) < size)
+		{
+			bits++;
+		}
+		for (int i = 0; i < size; i++)
+		{
+			int reversed = 0;
+			for (int bit = 0; bit < bits; bit++)
+			{
+				reversed |= ((i >> bit) & 1) << (bits - 1 - bit);
+			}
+			_bitReversed[i] = reversed;
+		}
+	}
+
+	void FftPlan::Transform(std::complex<float>* data, bool inverse) const
+	{
+		for (int i = 0; i < _size; i++)
+		{
+			int j = _bitReversed[i];
+			if (j > i)
+			{
+				swap(data[i], data[j]);
+			}
+		}
+
+		// iterative radix-2 decimation in time; each pass doubles the length of the transforms
+		for (int length = 2; length <= _size; length *= 2)
+		{
+			int half = length / 2;
+			int twiddleStride = _size / length;
+			for (int start = 0; start < _size; start += length)
+			{
+				for (int k = 0; k < half; k++)
+				{
+					std::complex<float> twiddle = _twiddles[k * twiddleStride];
+					if (inverse)
+					{
+						twiddle = std::conj(twiddle);
+					}
+					std::complex<float> even = data[start + k];
+					std::complex<float> odd = data[start + k + half] * twiddle;
+					data[start + k] = even + odd;
+					data[start + k + half] = even - odd;
+				}
+			}
+		}
+	}
+
+	void FftPlan::Forward(std::complex<float>* data) const
+	{
+		Transform(data, false);
+	}
+
+	void FftPlan::Inverse(std::complex<float>* data) const
+	{
+		Transform(data, true);
+	}
+
+	RealFftPlan::RealFftPlan(int size)
+		: _size{ size },
+		_halfPlan{ size / 2 },
+		_twiddles(size / 4 + 1)
+	{
+		NowSound::Check(size >= 4);
+
+		for (int k = 0; k <= size / 4; k++)
+		{
+			double angle = -2 * PI * k / size;
+			_twiddles[k] = std::complex<float>((float)std::cos(angle), (float)std::sin(angle));
+		}
+	}
+
+	// With z[n] = x[2n] + i x[2n+1] and Z its half-size transform, the transforms of the even and odd samples are
+	// E[k] = (Z[k] + conj(Z[h - k])) / 2 and O[k] = (Z[k] - conj(Z[h - k])) / 2i, and X[k] = E[k] + W^k O[k]
+	// (where h is half the size, and W = exp(-2 pi i / size)).  Bins k and h - k are computed together, in place.
+	void RealFftPlan::Forward(const float* input, std::complex<float>* spectrum) const
+	{
+		const int half = _size / 2;
+		std::copy(input, input + _size, reinterpret_cast<float*>(spectrum));
+		_halfPlan.Forward(spectrum);
+
+		std::complex<float> z0 = spectrum[0];
+		spectrum[0] = std::complex<float>(z0.real() + z0.imag(), 0);
+		spectrum[half] = std::complex<float>(z0.real() - z0.imag(), 0);
+
+		for (int k = 1; k <= half / 2; k++)
+		{
+			std::complex<float> zk = spectrum[k];
+			std::complex<float> zMirror = std::conj(spectrum[half - k]);
+			std::complex<float> even = (zk + zMirror) * 0.5f;
+			std::complex<float> odd = (zk - zMirror) * std::complex<float>(0, -0.5f);
+			std::complex<float> twiddledOdd = _twiddles[k] * odd;
+			// X[h - k] = conj(E[k] - W^k O[k])
+			spectrum[half - k] = std::conj(even - twiddledOdd);
+			spectrum[k] = even + twiddledOdd;
+		}
+	}
+
+	// The reverse of the above, without the halving: Z[k] = E[k] + i O[k], where E[k] = X[k] + conj(X[h - k]) and
+	// O[k] = (X[k] - conj(X[h - k])) conj(W^k); so the unscaled half-size inverse comes out at Size() times z.
+	void RealFftPlan::Inverse(std::complex<float>* spectrum, float* output) const
+	{
+		const int half = _size / 2;
+
+		float x0 = spectrum[0].real();
+		float xHalf = spectrum[half].real();
+		spectrum[0] = std::complex<float>(x0 + xHalf, x0 - xHalf);
+
+		for (int k = 1; k <= half / 2; k++)
+		{
+			std::complex<float> xk = spectrum[k];
+			std::complex<float> xMirror = std::conj(spectrum[half - k]);
+			std::complex<float> even = xk + xMirror;
+			std::complex<float> iOdd = std::complex<float>(0, 1) * ((xk - xMirror) * std::conj(_twiddles[k]));
+			// Z[h - k] = conj(E[k] - i O[k])
+			spectrum[half - k] = std::conj(even - iOdd);
+			spectrum[k] = even + iOdd;
+		}
+
+		_halfPlan.Inverse(spectrum);
+		const float* values = reinterpret_cast<const float*>(spectrum);
+		std::copy(values, values + _size, output);
+	}
+}
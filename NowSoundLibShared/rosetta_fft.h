@@ -56,4 +56,59 @@ namespace RosettaFFT
 	// vector from the data according to the bounds.
 	// The output vector must be the same length as the bounds vector.
 	void RescaleFFT(const std::vector<FrequencyBinBounds>& bounds, const CArray& fftData, float* outputVector, int outputCapacity);
+
+	// A plan for repeated single-precision complex FFTs of one power-of-two size: the twiddle factors and the
+	// bit-reversal permutation are computed once, so each transform does only the butterflies, and never allocates
+	// (so it may be used on the audio thread).
+	class FftPlan
+	{
+	private:
+		const int _size;
+
+		// exp(-2 pi i k / size), for k in [0, size / 2).
+		std::vector<std::complex<float>> _twiddles;
+
+		// The bit-reversed index of each index.
+		std::vector<int> _bitReversed;
+
+		void Transform(std::complex<float>* data, bool inverse) const;
+
+	public:
+		FftPlan(int size);
+
+		int Size() const { return _size; }
+
+		// Transform Size() values in place.
+		void Forward(std::complex<float>* data) const;
+
+		// Inverse-transform Size() values in place, unscaled: the result is Size() times the original values.
+		void Inverse(std::complex<float>* data) const;
+	};
+
+	// A plan for repeated FFTs of real signals of one power-of-two size, done as complex FFTs of half the size.
+	// The spectrum of Size() real values is BinCount() complex bins, from 0 up to and including the Nyquist bin.
+	class RealFftPlan
+	{
+	private:
+		const int _size;
+
+		FftPlan _halfPlan;
+
+		// exp(-2 pi i k / size), for k in [0, size / 4].
+		std::vector<std::complex<float>> _twiddles;
+
+	public:
+		RealFftPlan(int size);
+
+		int Size() const { return _size; }
+
+		int BinCount() const { return _size / 2 + 1; }
+
+		// Transform Size() real values into BinCount() bins.
+		void Forward(const float* input, std::complex<float>* spectrum) const;
+
+		// Inverse-transform BinCount() bins (which are overwritten) into Size() real values, unscaled: the result
+		// is Size() times the original values.
+		void Inverse(std::complex<float>* spectrum, float* output) const;
+	};
 }
@@ -1,12 +1,32 @@
 #include "pch.h"
 #include "CppUnitTest.h"
 
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include "AudioKernels.h"
+#include "BiquadBank.h"
 #include "BufferAllocator.h"
 #include "Check.h"
+#include "Clock.h"
+#include "ConstantQAnalyzer.h"
+#include "ForkJoinPool.h"
+#include "FrozenLoop.h"
 #include "Histogram.h"
+#include "LatencyHistogram.h"
+#include "LoopHistory.h"
+#include "MasterBus.h"
+#include "OfflineMixdown.h"
+#include "PartitionedConvolver.h"
+#include "PolyphaseInterpolator.h"
+#include "RealTimeThread.h"
 #include "Slice.h"
 #include "SliceStream.h"
+#include "SparseSliceStream.h"
 #include "Time.h"
+#include "Trace.h"
+#include "WavFile.h"
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace NowSound;
@@ -55,9 +75,801 @@ namespace UnitTestsDesktop
 			Check(h.Average() == -15);
 		}
 
+        // Is actual within the latency histogram's precision of expected?
+        static bool IsWithinPrecision(float actual, float expected)
+        {
+            return std::abs(actual - expected) <= expected / LatencyHistogram::SubBucketHalfCount + 0.01f;
+        }
+
+        TEST_METHOD(TestLatencyHistogram)
+        {
+            LatencyHistogram h(0.01f);
+            Check(h.Count() == 0);
+            Check(h.Percentile(99) == 0);
+
+            // 10000 quanta of 480 samples, with ten spikes: the average barely moves, but p99.9 sees them.
+            for (int i = 0; i < 10000; i++)
+            {
+                h.Record(i % 1000 == 0 ? 4800.0f : 480.0f);
+            }
+            Check(h.Count() == 10000);
+            Check(h.Min() == 480.0f);
+            Check(h.Max() == 4800.0f);
+            Check(IsWithinPrecision(h.Percentile(50), 480));
+            Check(IsWithinPrecision(h.Percentile(99.8), 480));
+            Check(IsWithinPrecision(h.Percentile(99.95), 4800));
+            Check(h.Percentile(100) == 4800.0f);
+
+            // Uniform values, over several orders of magnitude.
+            LatencyHistogram uniform(1);
+            for (int i = 1; i <= 100000; i++)
+            {
+                uniform.Record((float)i);
+            }
+            Check(IsWithinPrecision(uniform.Percentile(0), 1));
+            Check(IsWithinPrecision(uniform.Percentile(10), 10000));
+            Check(IsWithinPrecision(uniform.Percentile(50), 50000));
+            Check(IsWithinPrecision(uniform.Percentile(99.9), 99900));
+            // the top bucket's upper bound is clamped to the actual maximum
+            Check(uniform.Percentile(100) == 100000);
+
+            // Values too big saturate rather than corrupting anything; negative ones record as zero.
+            LatencyHistogram extremes(1);
+            extremes.Record(1e20f);
+            extremes.Record(-1);
+            Check(extremes.Count() == 2 && extremes.Min() == 0 && extremes.Max() == (float)UINT32_MAX);
+
+            // Merging combines counts and extremes, as if all values had been recorded in one histogram.
+            LatencyHistogram merged(0.01f);
+            merged.Record(1.0f);
+            merged.Merge(h);
+            Check(merged.Count() == 10001);
+            Check(merged.Min() == 1.0f && merged.Max() == 4800.0f);
+            Check(IsWithinPrecision(merged.Percentile(50), 480));
+
+            merged.Reset();
+            Check(merged.Count() == 0 && merged.Max() == 0 && merged.Percentile(50) == 0);
+            merged.Record(2.0f);
+            Check(merged.Min() == 2.0f && merged.Percentile(50) == 2.0f);
+
+            // Recording concurrently from several threads loses nothing.
+            LatencyHistogram shared(1);
+            ForkJoinPool pool(4);
+            pool.Run(1000, [&](int, int task) { for (int i = 0; i < 100; i++) { shared.Record((float)(task + 1)); } });
+            Check(shared.Count() == 100000 && shared.Min() == 1 && shared.Max() == 1000);
+            Check(IsWithinPrecision(shared.Percentile(50), 500));
+        }
+
         static const int FloatSliverCount = 2;
         static const int FloatNumSlices = 128;
 
+        TEST_METHOD(TestClockLongSession)
+        {
+            // 91 BPM at 48Khz: 31648.35... samples per beat, so no beat boundary lands on a whole sample.
+            // (Not Clock::Initialize, since this test only needs a local clock.)
+            Clock clock(48000, 2, 91, 4);
+            const int64_t samplesPerMinute = (int64_t)48000 * 60;
+
+            // Sweep three days of session time; the exact beat count is time * 91 / samplesPerMinute.
+            const int64_t sessionSamples = (int64_t)72 * 60 * samplesPerMinute;
+            for (int64_t time = 0; time < sessionSamples; time += 1000003)
+            {
+                BeatPosition position = clock.TimeToBeatPosition(time);
+                Check(position.CompleteBeats == time * 91 / samplesPerMinute);
+                double expectedFraction = (double)(time * 91 % samplesPerMinute) / samplesPerMinute;
+                Check(std::abs(position.FractionalBeat - expectedFraction) < 1e-6);
+            }
+
+            // Near the end of the session, every single sample still advances the beat position.
+            BeatPosition previous = clock.TimeToBeatPosition(sessionSamples - 100000);
+            for (int64_t time = sessionSamples - 99999; time < sessionSamples; time++)
+            {
+                BeatPosition position = clock.TimeToBeatPosition(time);
+                Check(position.CompleteBeats > previous.CompleteBeats
+                    || (position.CompleteBeats == previous.CompleteBeats && position.FractionalBeat > previous.FractionalBeat));
+                Check(position.FractionalBeat >= 0 && position.FractionalBeat < 1);
+                previous = position;
+            }
+
+            // Reducing modulo a track's length keeps the result small enough to be precise as a float.
+            BeatPosition lastBeat = clock.TimeToBeatPosition(sessionSamples);
+            Check(lastBeat.CompleteBeats == sessionSamples * 91 / samplesPerMinute);
+            Check(lastBeat.Modulo(4).CompleteBeats == lastBeat.CompleteBeats % 4);
+            Check(std::abs(lastBeat.Modulo(4).Beats().Value() - (lastBeat.CompleteBeats % 4 + lastBeat.FractionalBeat)) < 1e-5);
+            Check(std::abs(clock.TimeToFractionalBeat(sessionSamples).Value() - lastBeat.FractionalBeat) < 1e-6);
+
+            // Times before the session started are on the same timeline.
+            BeatPosition beforeStart = clock.TimeToBeatPosition(-1);
+            Check(beforeStart.CompleteBeats == -1);
+            Check(beforeStart.FractionalBeat > 0.99 && beforeStart.FractionalBeat < 1);
+        }
+
+        TEST_METHOD(TestAudioKernels)
+        {
+            // center panning preserves power
+            float left, right;
+            AudioKernels::PanCoefficients(0.5f, &left, &right);
+            Check(std::abs(left * left + right * right - 1) < 1e-6);
+            Check(std::abs(left - right) < 1e-6);
+
+            float mono[] = { 1, -1 };
+            float stereo[4];
+            AudioKernels::PanMonoToStereo(mono, 2, 0, stereo);
+            Check(stereo[0] == 1 && stereo[2] == -1);
+            Check(std::abs(stereo[1]) < 1e-6 && std::abs(stereo[3]) < 1e-6);
+
+            // mixing a hard-right input adds to the right channel only
+            AudioKernels::MixMonoToStereo(mono, 2, 1, stereo);
+            Check(std::abs(stereo[0] - 1) < 1e-6 && std::abs(stereo[1] - 1) < 1e-6);
+            Check(std::abs(stereo[2] + 1) < 1e-6 && std::abs(stereo[3] + 1) < 1e-6);
+
+            // ramping from hard left at full gain to hard right at half gain, reaching it just after the last sample
+            float ones[] = { 1, 1, 1, 1 };
+            float ramped[8] = {};
+            AudioKernels::MixMonoToStereoRamped(ones, 4, 0, 1, 1, 0.5f, ramped);
+            Check(ramped[0] == 1 && ramped[1] == 0);
+            Check(std::abs(ramped[4] - 0.5f) < 1e-6 && std::abs(ramped[5] - 0.25f) < 1e-6);
+
+            // five buses (not a power of two) summed over the middle of their range only
+            std::vector<std::vector<float>> buses(5, std::vector<float>(4));
+            std::vector<float*> busPointers;
+            for (int bus = 0; bus < 5; bus++)
+            {
+                std::fill(buses[bus].begin(), buses[bus].end(), (float)(bus + 1));
+                busPointers.push_back(buses[bus].data());
+            }
+            float sum[] = { -1, -1, -1, -1 };
+            AudioKernels::TreeSum(busPointers.data(), 5, 1, 2, sum);
+            Check(sum[0] == -1 && sum[1] == 15 && sum[2] == 15 && sum[3] == -1);
+        }
+
+        // Filter input through one biquad the slow, obvious way (direct form I, in double precision).
+        static std::vector<float> ReferenceBiquad(const BiquadCoefficients& c, const std::vector<float>& input)
+        {
+            std::vector<float> output(input.size());
+            double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+            for (size_t i = 0; i < input.size(); i++)
+            {
+                double y = c.B0 * input[i] + c.B1 * x1 + c.B2 * x2 - c.A1 * y1 - c.A2 * y2;
+                x2 = x1;
+                x1 = input[i];
+                y2 = y1;
+                y1 = y;
+                output[i] = (float)y;
+            }
+            return output;
+        }
+
+        TEST_METHOD(TestBiquadBank)
+        {
+            const float sampleRateHz = 48000;
+
+            // A shelf's gain at DC is its full gain.
+            BiquadCoefficients shelf = BiquadCoefficients::LowShelf(sampleRateHz, 200, 0.7f, 6);
+            float dcGain = (shelf.B0 + shelf.B1 + shelf.B2) / (1 + shelf.A1 + shelf.A2);
+            Check(std::abs(dcGain - std::pow(10.0f, 6 / 20.0f)) < 1e-3);
+
+            // Three lanes, each with a different filter, must each match the reference, across two blocks.
+            BiquadCoefficients filters[] =
+            {
+                BiquadCoefficients::Peaking(sampleRateHz, 1000, 1, 6),
+                BiquadCoefficients::LowPass(sampleRateHz, 500, 0.7f),
+                BiquadCoefficients::HighPass(sampleRateHz, 2000, 0.7f),
+            };
+            const int laneCount = 3;
+            const int blockLength = 100;
+            BiquadCascade cascades[laneCount];
+            BiquadCascade* cascadePointers[laneCount];
+            std::vector<float> input(blockLength * 2);
+            std::vector<std::vector<float>> outputs(laneCount);
+            for (int lane = 0; lane < laneCount; lane++)
+            {
+                Check(!cascades[lane].IsActive());
+                // start on the last stage, so the earlier (inactive) stages must pass audio through
+                cascades[lane].SetStage(BiquadCascade::StageCount - 1, filters[lane]);
+                Check(cascades[lane].IsActive());
+                cascadePointers[lane] = &cascades[lane];
+            }
+            for (size_t i = 0; i < input.size(); i++)
+            {
+                input[i] = (float)std::sin(i * 0.3) * 0.5f + (i % 7 == 0 ? 0.25f : 0);
+            }
+
+            BiquadBank bank;
+            for (int block = 0; block < 2; block++)
+            {
+                std::vector<std::vector<float>> blockBuffers(laneCount);
+                float* bufferPointers[laneCount];
+                for (int lane = 0; lane < laneCount; lane++)
+                {
+                    blockBuffers[lane].assign(input.begin() + block * blockLength, input.begin() + (block + 1) * blockLength);
+                    bufferPointers[lane] = blockBuffers[lane].data();
+                }
+
+                // the coefficients glide from the identity during the first block
+                bank.Process(cascadePointers, bufferPointers, laneCount, blockLength);
+
+                for (int lane = 0; lane < laneCount; lane++)
+                {
+                    outputs[lane].insert(outputs[lane].end(), blockBuffers[lane].begin(), blockBuffers[lane].end());
+                }
+            }
+
+            // At settled coefficients, each filter matches the reference to float precision.
+            for (int lane = 0; lane < laneCount; lane++)
+            {
+                BiquadCascade settled;
+                settled.SetStage(0, filters[lane]);
+                std::vector<float> warmup(1, 0.0f);
+                BiquadCascade* settledPointer = &settled;
+                float* warmupPointer = warmup.data();
+                // one sample of silence finishes the glide, and leaves the state at zero
+                bank.Process(&settledPointer, &warmupPointer, 1, 1);
+
+                std::vector<float> buffer(input);
+                float* bufferPointer = buffer.data();
+                bank.Process(&settledPointer, &bufferPointer, 1, (int)buffer.size());
+                std::vector<float> expected = ReferenceBiquad(filters[lane], input);
+                for (size_t i = 0; i < input.size(); i++)
+                {
+                    Check(std::abs(buffer[i] - expected[i]) < 1e-4);
+                }
+
+                // the lanes which glided in converge on the same output
+                Check(std::abs(outputs[lane].back() - expected.back()) < 0.05);
+            }
+
+            // Bypassing a stage glides it out over one block, after which the cascade is inactive again.
+            cascades[0].SetStage(BiquadCascade::StageCount - 1, BiquadCoefficients::Identity());
+            Check(cascades[0].IsActive());
+            std::vector<float> block(input.begin(), input.begin() + blockLength);
+            float* blockPointer = block.data();
+            bank.Process(cascadePointers, &blockPointer, 1, blockLength);
+            Check(!cascades[0].IsActive());
+
+            // An inactive cascade passes audio through unchanged.
+            std::vector<float> passed(input);
+            float* passedPointer = passed.data();
+            bank.Process(cascadePointers, &passedPointer, 1, (int)passed.size());
+            Check(passed == input);
+
+            // After its input stops, a filter rings on, decaying; until it dies away, silence comes out not silent.
+            Check(cascades[1].IsRinging(0.001f));
+            std::vector<float> silence(blockLength, 0.0f);
+            float* silencePointer = silence.data();
+            bank.Process(&cascadePointers[1], &silencePointer, 1, blockLength);
+            Check(silence[0] != 0);
+            int silentBlocks = 1;
+            while (cascades[1].IsRinging(0.00001f))
+            {
+                std::fill(silence.begin(), silence.end(), 0.0f);
+                bank.Process(&cascadePointers[1], &silencePointer, 1, blockLength);
+                silentBlocks++;
+                Check(silentBlocks < 100);
+            }
+            Check(std::abs(silence.back()) < 0.0001f);
+            Check(cascades[1].IsRinging(0));
+            cascades[1].ClearState();
+            Check(!cascades[1].IsRinging(0));
+            std::fill(silence.begin(), silence.end(), 0.0f);
+            bank.Process(&cascadePointers[1], &silencePointer, 1, blockLength);
+            Check(silence == std::vector<float>(blockLength, 0.0f));
+        }
+
+        TEST_METHOD(TestFftPlan)
+        {
+            const int size = 64;
+            std::vector<float> signal(size);
+            for (int i = 0; i < size; i++)
+            {
+                signal[i] = (float)(std::sin(i * 0.7) + 0.3 * std::cos(i * 2.1)) + (i == 5 ? 1.0f : 0);
+            }
+
+            // The planned complex FFT matches the Rosetta one.
+            RosettaFFT::CArray reference(size);
+            std::vector<std::complex<float>> complexData(size);
+            for (int i = 0; i < size; i++)
+            {
+                reference[i] = RosettaFFT::Complex(signal[i], 0);
+                complexData[i] = std::complex<float>(signal[i], 0);
+            }
+            RosettaFFT::simple_fft(reference);
+            RosettaFFT::FftPlan plan(size);
+            plan.Forward(complexData.data());
+            for (int i = 0; i < size; i++)
+            {
+                Check(std::abs(complexData[i] - std::complex<float>((float)reference[i].real(), (float)reference[i].imag())) < 1e-3);
+            }
+
+            // The real FFT's bins are the first half (plus Nyquist) of the complex FFT's.
+            RosettaFFT::RealFftPlan realPlan(size);
+            std::vector<std::complex<float>> spectrum(realPlan.BinCount());
+            realPlan.Forward(signal.data(), spectrum.data());
+            for (int i = 0; i < realPlan.BinCount(); i++)
+            {
+                Check(std::abs(spectrum[i] - complexData[i]) < 1e-3);
+            }
+
+            // Both inverses are unscaled: they round-trip to size times the original.
+            plan.Inverse(complexData.data());
+            std::vector<float> roundTrip(size);
+            realPlan.Inverse(spectrum.data(), roundTrip.data());
+            for (int i = 0; i < size; i++)
+            {
+                Check(std::abs(complexData[i].real() / size - signal[i]) < 1e-4);
+                Check(std::abs(roundTrip[i] / size - signal[i]) < 1e-4);
+            }
+        }
+
+        TEST_METHOD(TestConstantQAnalyzer)
+        {
+            // four octaves of semitones, from 110Hz up
+            const int sampleRate = 48000;
+            const int frameSize = 4096;
+            ConstantQAnalyzer analyzer(440, 12, 48, 24, sampleRate, frameSize);
+            Check(std::abs(analyzer.BinFrequency(12) - 220) < 1e-9);
+
+            std::vector<float> input(frameSize);
+            std::vector<std::complex<float>> spectrum(analyzer.SpectrumSize());
+            std::vector<float> output(analyzer.BinCount());
+            for (int i = 0; i < frameSize; i++)
+            {
+                input[i] = 0.5f * (float)std::sin(2 * RosettaFFT::PI * 220 * i / sampleRate);
+            }
+            analyzer.Analyze(input.data(), spectrum.data(), output.data());
+
+            // the sinusoid reads its amplitude in its own bin, and next to nothing a few semitones away
+            Check(std::abs(output[12] - 0.5f) < 0.005f);
+            for (int bin = 0; bin < analyzer.BinCount(); bin++)
+            {
+                Check(output[bin] <= output[12]);
+                if (std::abs(bin - 12) >= 4)
+                {
+                    Check(output[bin] < 0.005f);
+                }
+            }
+
+            // an octave to a bin, from 440Hz: the bins at and above half the sample rate have no kernel, and read 0
+            ConstantQAnalyzer octaves(440, 1, 8, 0, sampleRate, frameSize);
+            for (int i = 0; i < frameSize; i++)
+            {
+                input[i] = 1;
+            }
+            octaves.Analyze(input.data(), spectrum.data(), output.data());
+            Check(output[6] == 0 && output[7] == 0);
+        }
+
+        TEST_METHOD(TestPartitionedConvolver)
+        {
+            const int blockSize = 16;
+            // not a whole number of blocks, so the last partition is partial
+            const int impulseLength = blockSize * 5 + 3;
+            const int signalLength = 400;
+            std::vector<float> impulse(impulseLength);
+            for (int i = 0; i < impulseLength; i++)
+            {
+                impulse[i] = (float)(std::exp(-i * 0.03) * std::sin(i * 1.3));
+            }
+            std::vector<float> input(signalLength);
+            for (int i = 0; i < signalLength; i++)
+            {
+                input[i] = (i % 37 == 0 ? 1.0f : 0) + (float)std::sin(i * 0.2) * 0.25f;
+            }
+
+            std::vector<float> expected(signalLength);
+            for (int i = 0; i < signalLength; i++)
+            {
+                for (int j = 0; j <= i && j < impulseLength; j++)
+                {
+                    expected[i] += impulse[j] * input[i - j];
+                }
+            }
+
+            // With or without the tail thread, and fed in chunks which do not line up with the blocks, the output
+            // is the direct convolution, delayed by one block -- so long as the tail thread keeps up, which here it
+            // is given all the time it needs to.
+            for (int useTailThread = 0; useTailThread < 2; useTailThread++)
+            {
+                PartitionedConvolver convolver(blockSize, impulse.data(), impulseLength, useTailThread == 1);
+                Check(convolver.PartitionCount() == 6);
+
+                std::vector<float> output(signalLength);
+                const int chunkSizes[] = { 5, 16, 1, 40, 7 };
+                int position = 0;
+                for (int chunk = 0; position < signalLength; chunk++)
+                {
+                    // (at most a block at a time with the tail thread, so each block's tail can be waited for)
+                    int count = (std::min)(chunkSizes[chunk % 5], signalLength - position);
+                    if (useTailThread == 1)
+                    {
+                        count = (std::min)(count, blockSize);
+                    }
+                    while (!convolver.IsTailReady())
+                    {
+                        std::this_thread::yield();
+                    }
+                    convolver.Process(&input[position], &output[position], count);
+                    position += count;
+                }
+                Check(convolver.LateTailCount() == 0);
+
+                for (int i = 0; i < blockSize; i++)
+                {
+                    Check(output[i] == 0);
+                }
+                for (int i = blockSize; i < signalLength; i++)
+                {
+                    Check(std::abs(output[i] - expected[i - blockSize]) < 1e-4);
+                }
+            }
+
+            // Fed all at once, the tail thread cannot keep up, so late blocks make do with the tail before; that is
+            // not exact, but never louder than the input and impulse response allow, and never waits on a lock.
+            float bound = 0;
+            for (int i = 0; i < impulseLength; i++)
+            {
+                bound += std::abs(impulse[i]) * 1.25f;
+            }
+            PartitionedConvolver hurried(blockSize, impulse.data(), impulseLength, true);
+            std::vector<float> output(signalLength);
+            hurried.Process(input.data(), output.data(), signalLength);
+            Check(hurried.LateTailCount() <= signalLength / blockSize);
+            for (int i = 0; i < signalLength; i++)
+            {
+                Check(std::abs(output[i]) <= bound + 0.001f);
+            }
+        }
+
+        TEST_METHOD(TestWavFile)
+        {
+            // A stereo 16-bit file, with an unknown chunk (of odd length) before the data.
+            std::string bytes = std::string("RIFF") + std::string(4, '\0') + "WAVE";
+            auto append = [&](uint32_t value, int byteCount)
+            {
+                for (int i = 0; i < byteCount; i++)
+                {
+                    bytes.push_back((char)((value >> (i * 8)) & 0xFF));
+                }
+            };
+            bytes += "fmt ";
+            append(16, 4);
+            append(1, 2); // PCM
+            append(2, 2);
+            append(44100, 4);
+            append(44100 * 4, 4);
+            append(4, 2);
+            append(16, 2);
+            bytes += "junk";
+            append(3, 4);
+            bytes += std::string(4, 'x'); // three bytes, and the pad byte
+            bytes += "data";
+            append(8, 4);
+            append(0x4000, 2);
+            append(0xC000, 2);
+            append(0x7FFF, 2);
+            append(0, 2);
+
+            std::istringstream input(bytes);
+            WavData data;
+            Check(WavFile::Read(input, data));
+            Check(data.ChannelCount == 2);
+            Check(data.SampleRateHz == 44100);
+            Check(data.FrameCount() == 2);
+            Check(data.Samples[0] == 0.5f);
+            Check(data.Samples[1] == -0.5f);
+            Check(std::abs(data.Samples[2] - 1) < 1e-4);
+            Check(data.Samples[3] == 0);
+
+            // Not a WAV file.
+            std::istringstream notWav("RIFX....WAVE");
+            Check(!WavFile::Read(notWav, data));
+        }
+
+        TEST_METHOD(TestWavWriter)
+        {
+            std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+            WavWriter writer(stream, 2, 48000);
+            const float first[] = { 0.25f, -0.5f, 1.0f, 0 };
+            const float second[] = { -1.0f, 0.125f };
+            writer.Write(first, 2);
+            writer.Write(second, 1);
+            Check(writer.FrameCount() == 3);
+            Check(writer.Finish());
+
+            // the sizes patched into the header are those of what was written
+            WavData data;
+            Check(WavFile::Read(stream, data));
+            Check(data.ChannelCount == 2);
+            Check(data.SampleRateHz == 48000);
+            Check(data.FrameCount() == 3);
+            const float expected[] = { 0.25f, -0.5f, 1.0f, 0, -1.0f, 0.125f };
+            for (int i = 0; i < 6; i++)
+            {
+                Check(data.Samples[i] == expected[i]);
+            }
+        }
+
+        TEST_METHOD(TestSlidingMaximum)
+        {
+            const int windowLength = 5;
+            SlidingMaximum maximum(windowLength);
+            std::vector<float> values;
+            for (int i = 0; i < 200; i++)
+            {
+                // runs up and down, with repeats, so candidates are both kept and dropped
+                float value = (float)((i * 7919) % 13) + (i % 20 < 10 ? i * 0.01f : -i * 0.01f);
+                values.push_back(value);
+                float expected = *std::max_element(values.begin() + (std::max)(0, i + 1 - windowLength), values.end());
+                Check(maximum.Push(value) == expected);
+            }
+        }
+
+        TEST_METHOD(TestMasterBus)
+        {
+            const float sampleRateHz = 48000;
+            const int lookahead = 32;
+            const float ceiling = 0.5f;
+
+            // Below the ceiling, the limiter only delays the audio.
+            LookaheadLimiter limiter(lookahead, ceiling, 480);
+            const int frameCount = 2000;
+            std::vector<float> quiet(frameCount * 2);
+            for (int i = 0; i < frameCount * 2; i++)
+            {
+                quiet[i] = (float)std::sin(i * 0.05) * 0.4f;
+            }
+            std::vector<float> limited(quiet);
+            limiter.Process(limited.data(), frameCount);
+            for (int i = lookahead * 2; i < frameCount * 2; i++)
+            {
+                Check(limited[i] == quiet[i - lookahead * 2]);
+            }
+            Check(limiter.TakeMinimumGain() == 1);
+
+            // Far above it, nothing gets through over the ceiling, and the gain never jumps.
+            std::vector<float> loud(frameCount * 2);
+            for (int i = 0; i < frameCount * 2; i++)
+            {
+                loud[i] = (float)std::sin(i * 0.05) * 0.4f + (i % 500 == 0 ? 3.0f : 0);
+            }
+            std::vector<float> loudLimited(loud);
+            for (int position = 0; position < frameCount; position += 100)
+            {
+                limiter.Process(&loudLimited[position * 2], 100);
+            }
+            for (int i = 0; i < frameCount * 2; i++)
+            {
+                Check(std::abs(loudLimited[i]) <= ceiling);
+            }
+            // the highest peak is the spike on a zero crossing of the sine
+            Check(std::abs(MasterBus::ToDb(limiter.TakeMinimumGain()) - MasterBus::ToDb(ceiling / 3)) < 0.1);
+            Check(limiter.TakeMinimumGain() == 1);
+
+            // A full-scale 1Khz sine in both channels reads 0 LUFS (the standard's reference), and a sine at a
+            // quarter of the sample rate has true peaks well above its samples, when they straddle the crests.
+            MasterBus masterBus(sampleRateHz, lookahead, 0, 0.1f);
+            const int quantum = 480;
+            std::vector<float> sine(quantum * 2);
+            for (int i = 0; i < 31 * 10; i++)
+            {
+                for (int frame = 0; frame < quantum; frame++)
+                {
+                    double phase = 2 * 3.14159265358979 * 1000 * (i * quantum + frame) / sampleRateHz;
+                    sine[frame * 2] = sine[frame * 2 + 1] = (float)std::sin(phase) * 0.999f;
+                }
+                masterBus.Process(sine.data(), quantum);
+            }
+            Check(std::abs(masterBus.Loudness().MomentaryLufs()) < 0.1);
+            Check(std::abs(masterBus.Loudness().ShortTermLufs()) < 0.1);
+            Check(masterBus.TruePeak().MaximumPeak() <= 1);
+
+            TruePeakMeter truePeak;
+            for (int frame = 0; frame < quantum; frame++)
+            {
+                sine[frame * 2] = sine[frame * 2 + 1] = (float)std::sin(3.14159265358979 * (frame / 2.0 + 0.25)) * 0.5f;
+            }
+            truePeak.Process(sine.data(), quantum);
+            // the samples peak at 0.5 * sin(45 degrees), about -9 dB; the true peak is -6 dB
+            Check(std::abs(MasterBus::ToDb(truePeak.TakePeak()) - MasterBus::ToDb(0.5f)) < 0.25);
+            Check(truePeak.TakePeak() == 0);
+        }
+
+        TEST_METHOD(TestForkJoinPool)
+        {
+            ForkJoinPool pool(4);
+            Check(pool.WorkerCount() == 4);
+
+            // Every task runs exactly once per Run, however the workers divide them, and the pool is reusable.
+            const int taskCount = 1000;
+            std::vector<int> runCounts(taskCount);
+            std::vector<int64_t> workerSums(pool.WorkerCount());
+            std::function<void(int, int)> task = [&](int worker, int taskIndex)
+            {
+                runCounts[taskIndex]++;
+                workerSums[worker] += taskIndex;
+            };
+            for (int run = 0; run < 100; run++)
+            {
+                pool.Run(taskCount, task);
+            }
+
+            int64_t total = 0;
+            for (int worker = 0; worker < pool.WorkerCount(); worker++)
+            {
+                total += workerSums[worker];
+            }
+            Check(total == 100 * (int64_t)taskCount * (taskCount - 1) / 2);
+            for (int taskIndex = 0; taskIndex < taskCount; taskIndex++)
+            {
+                Check(runCounts[taskIndex] == 100);
+            }
+
+            // fewer tasks than workers, and no tasks at all
+            pool.Run(2, task);
+            pool.Run(0, task);
+            Check(runCounts[0] == 101 && runCounts[1] == 101 && runCounts[2] == 100);
+
+            // once idle long enough, the workers park; the next Run wakes them all, but need not wait for them, and
+            // workers waking too late for it take no part in it, nor in the Run after (which they may catch mid-way)
+            for (int cycle = 0; cycle < 3; cycle++)
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(ForkJoinPool::SpinMicroseconds * 3));
+                pool.Run(1, task);
+                pool.Run(taskCount, task);
+            }
+            Check(runCounts[0] == 107 && runCounts[1] == 104 && runCounts[taskCount - 1] == 103);
+
+            // a single worker runs everything on the calling thread
+            ForkJoinPool single(1);
+            single.Run(taskCount, [&](int worker, int taskIndex) { Check(worker == 0); runCounts[taskIndex]--; });
+            Check(runCounts[taskCount - 1] == 102);
+        }
+
+        // Ring out a bank of one-pole filters (like a decaying loop tail) for one second; return the elapsed seconds.
+        static double RingOutFilters(std::vector<float>& state)
+        {
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < 48000; i++)
+            {
+                for (float& y : state)
+                {
+                    y = y * 0.9f + 1e-30f * (i == 0 ? 1.0f : 0.0f);
+                }
+            }
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        TEST_METHOD(TestDenormalFlushing)
+        {
+            if (!RealTimeThread::CanFlushDenormals())
+            {
+                return;
+            }
+
+            double unflushedSeconds, flushedSeconds;
+            std::vector<float> unflushed(64, 1.0f), flushed(64, 1.0f);
+            {
+                RealTimeThread::FlushDenormalsScope scope(false);
+                Check(!RealTimeThread::IsFlushingDenormals());
+                unflushedSeconds = RingOutFilters(unflushed);
+            }
+            {
+                RealTimeThread::FlushDenormalsScope scope(true);
+                Check(RealTimeThread::IsFlushingDenormals());
+                flushedSeconds = RingOutFilters(flushed);
+
+                // nested scopes restore the enclosing state
+                {
+                    RealTimeThread::FlushDenormalsScope inner(false);
+                    Check(!RealTimeThread::IsFlushingDenormals());
+                }
+                Check(RealTimeThread::IsFlushingDenormals());
+            }
+
+            // Without flushing, the tails get stuck at the smallest denormal forever; with it, they reach true zero.
+            Check(std::fpclassify(unflushed[0]) == FP_SUBNORMAL);
+            Check(flushed[0] == 0);
+
+            char message[200];
+            snprintf(message, sizeof(message), "Denormal tails: %.2f msec unflushed, %.2f msec flushed (%.1fx)",
+                unflushedSeconds * 1000, flushedSeconds * 1000, unflushedSeconds / flushedSeconds);
+            Logger::WriteMessage(message);
+        }
+
+        static int CountOccurrences(const std::string& text, const std::string& pattern)
+        {
+            int count = 0;
+            for (size_t position = text.find(pattern); position != std::string::npos; position = text.find(pattern, position + 1))
+            {
+                count++;
+            }
+            return count;
+        }
+
+        TEST_METHOD(TestTrace)
+        {
+            Check(Trace::IsEnabled());
+            Check(std::string(Trace::EventName(TraceEvent::TrackMixBegin)) == "TrackMix");
+
+            // One named thread recording a few events, and one recording more than its ring holds.
+            std::thread named([]()
+            {
+                Trace::SetThreadName("TestTraceNamed");
+                for (int i = 0; i < 5; i++)
+                {
+                    NOWSOUND_TRACE(TrackMixBegin, 12345, 480, i);
+                    NOWSOUND_TRACE(TrackMixEnd, 12345, 480, i);
+                }
+            });
+            named.join();
+            std::thread overflowing([]()
+            {
+                for (int i = 0; i < TraceRing::Capacity + 100; i++)
+                {
+                    NOWSOUND_TRACE(TrackRecorded, 54321, i, 0);
+                }
+            });
+            overflowing.join();
+
+            // Disabled tracing records nothing.
+            Trace::IsEnabled(false);
+            NOWSOUND_TRACE(TrackRecorded, 12345, 0, 0);
+            Trace::IsEnabled(true);
+
+            std::ostringstream output;
+            Trace::WriteChromeJson(output);
+            std::string json = output.str();
+
+            Check(json.find("\"traceEvents\":[") != std::string::npos);
+            Check(CountOccurrences(json, "\"name\":\"TestTraceNamed\"") == 1);
+            Check(CountOccurrences(json, "\"track\":12345,") == 10);
+            Check(CountOccurrences(json, "\"ph\":\"B\"") >= 5);
+            // only the newest records survive overflow (all but the one slot the writer may be overwriting)
+            Check(CountOccurrences(json, "\"track\":54321,") == TraceRing::Capacity - 1);
+            Check(CountOccurrences(json, "\"payload0\":100,") == 0);
+            Check(CountOccurrences(json, "\"payload0\":101,") == 1);
+        }
+
+        TEST_METHOD(TestDeinterleave)
+        {
+            // stereo and eight channels take the SIMD paths (where available); three channels never does;
+            // eleven samples leaves a remainder after the four-sample SIMD steps, and 150 spans several blocks
+            for (int count : { 11, 150 })
+            for (int channelCount : { 2, 3, 8 })
+            {
+                std::vector<float> interleaved(count * channelCount);
+                for (int i = 0; i < count; i++)
+                {
+                    for (int channel = 0; channel < channelCount; channel++)
+                    {
+                        // alternate signs, to check the absolute sums
+                        interleaved[i * channelCount + channel] = (float)((i % 2 == 0 ? 1 : -1) * (i + channel * 100));
+                    }
+                }
+
+                std::vector<std::vector<float>> channelBuffers(channelCount, std::vector<float>(count));
+                std::vector<float*> channelPointers;
+                for (std::vector<float>& channelBuffer : channelBuffers)
+                {
+                    channelPointers.push_back(channelBuffer.data());
+                }
+                std::vector<float> absoluteSums(channelCount, 0.0f);
+
+                AudioKernels::Deinterleave(interleaved.data(), channelCount, count, channelPointers.data(), absoluteSums.data());
+
+                for (int channel = 0; channel < channelCount; channel++)
+                {
+                    float expectedSum = 0;
+                    for (int i = 0; i < count; i++)
+                    {
+                        Check(channelBuffers[channel][i] == interleaved[i * channelCount + channel]);
+                        expectedSum += (float)(i + channel * 100);
+                    }
+                    Check(absoluteSums[channel] == expectedSum);
+                }
+            }
+        }
+
         // Exercise minimal buffer allocation and free list reuse.
         TEST_METHOD(TestBufferAllocator)
         {
@@ -72,6 +884,109 @@ namespace UnitTestsDesktop
             bufferAllocator.Free(std::move(f2));
             OwningBuf<float> f3 = bufferAllocator.Allocate();
             Check(f2ptr == f3.Data()); // need to pull from free list first
+
+            // Accounting: f and f3 are in use, out of two buffers ever allocated, one of which hit the heap.
+            int64_t bufferSize = bufferAllocator.BufferSizeInBytes();
+            Check(bufferSize == FloatNumSlices * 2048 * (int64_t)sizeof(float));
+            Check(bufferAllocator.TotalReservedSpace() == 2 * bufferSize);
+            Check(bufferAllocator.TotalFreeListSpace() == 0);
+            Check(bufferAllocator.TotalInUseSpace() == 2 * bufferSize);
+            Check(bufferAllocator.PeakInUseSpace() == 2 * bufferSize);
+            Check(bufferAllocator.HeapAllocationCount() == 1);
+
+            bufferAllocator.Free(std::move(f));
+            bufferAllocator.Free(std::move(f3));
+            Check(bufferAllocator.TotalFreeListSpace() == 2 * bufferSize);
+            Check(bufferAllocator.TotalInUseSpace() == 0);
+            Check(bufferAllocator.PeakInUseSpace() == 2 * bufferSize);
+
+            // A shared buffer goes back to the free list when its last holder drops it; sharing it allocates nothing.
+            {
+                SharedBuf<float> shared = bufferAllocator.AllocateShared();
+                SharedBuf<float> sharer = shared;
+                Check(shared == sharer && shared.UseCount() == 2);
+                Check(bufferAllocator.TotalInUseSpace() == bufferSize);
+                shared = SharedBuf<float>();
+                Check(sharer.UseCount() == 1 && bufferAllocator.TotalInUseSpace() == bufferSize);
+            }
+            Check(bufferAllocator.TotalInUseSpace() == 0);
+            Check(bufferAllocator.HeapAllocationCount() == 1);
+
+            // A stream accounts for the buffers it holds, and returns them all when destroyed.
+            {
+                BufferedSliceStream<AudioSample, float> stream(FloatSliverCount, &bufferAllocator);
+                // one sliver more than a buffer holds
+                std::vector<float> data((FloatNumSlices * 1024 + 1) * FloatSliverCount);
+                stream.Append(FloatNumSlices * 1024 + 1, data.data());
+                Check(stream.BufferCount() == 2);
+                Check(stream.BufferBytes() == 2 * bufferSize);
+                Check(bufferAllocator.TotalInUseSpace() == 2 * bufferSize);
+                Check(bufferAllocator.HeapAllocationCount() == 1);
+            }
+            Check(bufferAllocator.TotalInUseSpace() == 0);
+
+            // One thread may allocate shared buffers while another drops the last holders of them, as the audio
+            // input thread overdubs while the UI thread drops old loop versions.
+            {
+                BufferAllocator<float> smallAllocator(16, 16);
+                const int handoffCount = 100000;
+                std::vector<SharedBuf<float>> handoffs(handoffCount);
+                std::atomic<int> handedOff{ 0 };
+                std::thread dropping([&]()
+                {
+                    for (int i = 0; i < handoffCount; i++)
+                    {
+                        while (handedOff.load(std::memory_order_acquire) <= i)
+                        {
+                            RealTimeThread::SpinPause();
+                        }
+                        handoffs[i] = SharedBuf<float>();
+                    }
+                });
+                for (int i = 0; i < handoffCount; i++)
+                {
+                    handoffs[i] = smallAllocator.AllocateShared();
+                    handedOff.store(i + 1, std::memory_order_release);
+                }
+                dropping.join();
+
+                Check(smallAllocator.TotalInUseSpace() == 0);
+                Check(smallAllocator.TotalReservedSpace() == smallAllocator.TotalFreeListSpace());
+            }
+        }
+
+        // Test that preallocated buffers are usable at once, while they are still being faulted in.
+        TEST_METHOD(TestBufferAllocatorBackgroundPrefault)
+        {
+            const int bufferLength = 48000 * 2;
+            const int bufferCount = 16;
+            BufferAllocator<float> bufferAllocator(bufferLength, bufferCount, true);
+
+            // The first buffer is the first to be faulted in, and the first handed out; all come from one slab.
+            OwningBuf<float> first(bufferAllocator.Allocate());
+            first.Data()[0] = 1;
+            first.Data()[bufferLength - 1] = 2;
+            OwningBuf<float> second(bufferAllocator.Allocate());
+            Check(second.Data() == first.Data() + bufferLength);
+            second.Data()[0] = 3;
+
+            bufferAllocator.WaitForPrefault();
+            Check(bufferAllocator.IsPrefaulted());
+            // faulting in never disturbs data already written
+            Check(first.Data()[0] == 1);
+            Check(first.Data()[bufferLength - 1] == 2);
+            Check(second.Data()[0] == 3);
+            Check(bufferAllocator.TotalReservedSpace() == bufferCount * bufferAllocator.BufferSizeInBytes());
+            Check(bufferAllocator.HeapAllocationCount() == 0);
+            // every buffer was asked to be locked; how many were depends on the OS's limits
+            Check(bufferAllocator.LockRequestedSpace() >= bufferAllocator.TotalReservedSpace());
+            Check(bufferAllocator.LockedSpace() <= bufferAllocator.LockRequestedSpace());
+
+            bufferAllocator.Free(std::move(second));
+            bufferAllocator.Free(std::move(first));
+
+            // Destroying an allocator while it is still faulting in must stop the background thread cleanly.
+            BufferAllocator<float> abandonedAllocator(bufferLength, bufferCount * 4, true);
         }
 
         // Fill a slice with simple linear data.
@@ -394,6 +1309,659 @@ namespace UnitTestsDesktop
             Check(slice.Get(0, 0) == 0);
         }
 
+        TEST_METHOD(TestStreamLoopingLongSession)
+        {
+            // A loop of 20671.875 samples: not a whole number of samples, and not exactly representable
+            // as a float after even a few hundred iterations' worth of accumulated time.
+            const int loopSamples = 20672;
+            const int64_t exactDurationThousandths = 20671875;
+            BufferAllocator<float> bufferAllocator(loopSamples, 1);
+
+            std::vector<float> data(loopSamples);
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+            stream.Append(Duration<AudioSample>(loopSamples), data.data());
+            stream.Shut(ContinuousDuration<AudioSample>(20671.875f));
+
+            ExactLoopingIntervalMapper<AudioSample> mapper;
+            const int64_t fixedPointDuration = exactDurationThousandths * 65536 / 1000;
+
+            // Simulate 24 hours of 48Khz playback, in 100-msec quanta.
+            const int64_t sessionSamples = (int64_t)24 * 60 * 60 * 48000;
+            const int quantumSamples = 4800;
+
+            int64_t loopIndex = 0;
+            int64_t loopStart = 0;
+            int64_t nextLoopStart = (exactDurationThousandths + 999) / 1000;
+            int64_t now = 0;
+            while (now < sessionSamples)
+            {
+                Interval<AudioSample> quantum(now, quantumSamples);
+                while (!quantum.IsEmpty())
+                {
+                    Interval<AudioSample> mapped = mapper.MapNextSubInterval(&stream, quantum);
+
+                    // every sample of every iteration maps to exactly where it should, with no drift
+                    Check(mapped.InitialTime().Value() == now - loopStart);
+                    Check(mapped.IntervalDuration().Value() == std::min(quantum.IntervalDuration().Value(), nextLoopStart - now));
+
+                    now += mapped.IntervalDuration().Value();
+                    if (now == nextLoopStart)
+                    {
+                        loopIndex++;
+                        loopStart = nextLoopStart;
+                        nextLoopStart = ((loopIndex + 1) * exactDurationThousandths + 999) / 1000;
+
+                        // each iteration's discrete start lags its exact start by exactly the reported phase
+                        Check(mapper.SubSamplePhase(&stream, loopStart) == (int)(loopStart * 65536 - loopIndex * fixedPointDuration));
+                    }
+                    quantum = quantum.SubintervalStartingAt(mapped.IntervalDuration());
+                }
+            }
+
+            Check(now == sessionSamples);
+            Check(loopIndex == sessionSamples * 1000 / exactDurationThousandths);
+        }
+
+        TEST_METHOD(TestStreamLoopingBpmLongSession)
+        {
+            // A one-beat loop at 97 BPM: 2880000 / 97 = 29690.7216... samples, which no binary fraction represents,
+            // so every rounding of it (to float, or to fixed point) drifts against the clock over a long session.
+            const int64_t samplesPerMinute = (int64_t)48000 * 60;
+            const int loopSamples = (int)(samplesPerMinute / 97) + 1;
+            BufferAllocator<float> bufferAllocator(loopSamples, 1);
+
+            std::vector<float> data(loopSamples);
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+            stream.Append(Duration<AudioSample>(loopSamples), data.data());
+            // just as Clock and NowSoundTrack compute it
+            stream.Shut(ContinuousDuration<AudioSample>((double)samplesPerMinute / 97));
+
+            ExactLoopingIntervalMapper<AudioSample> mapper;
+
+            // Simulate 24 hours of 48Khz playback, in 10-msec quanta; iteration k starts exactly at
+            // k * samplesPerMinute / 97, so its discrete start is that rounded up, in integers.
+            const int64_t sessionSamples = (int64_t)24 * 60 * 60 * 48000;
+            const int quantumSamples = 480;
+
+            int64_t loopIndex = 0;
+            int64_t loopStart = 0;
+            int64_t nextLoopStart = (samplesPerMinute + 96) / 97;
+            int64_t now = 0;
+            while (now < sessionSamples)
+            {
+                Interval<AudioSample> quantum(now, quantumSamples);
+                while (!quantum.IsEmpty())
+                {
+                    Interval<AudioSample> mapped = mapper.MapNextSubInterval(&stream, quantum);
+
+                    // still sample-exact after a day, on the clock's beat
+                    Check(mapped.InitialTime().Value() == now - loopStart);
+                    Check(mapped.IntervalDuration().Value() == std::min(quantum.IntervalDuration().Value(), nextLoopStart - now));
+
+                    now += mapped.IntervalDuration().Value();
+                    if (now == nextLoopStart)
+                    {
+                        loopIndex++;
+                        loopStart = nextLoopStart;
+                        nextLoopStart = ((loopIndex + 1) * samplesPerMinute + 96) / 97;
+
+                        // the reported phase is the exact lag, (loopStart * 97 - loopIndex * samplesPerMinute) / 97
+                        int64_t exactPhase = ((loopStart * 97 - loopIndex * samplesPerMinute) * 65536 + 48) / 97;
+                        Check(std::abs(mapper.SubSamplePhase(&stream, loopStart) - exactPhase) <= 1);
+                    }
+                    quantum = quantum.SubintervalStartingAt(mapped.IntervalDuration());
+                }
+            }
+
+            Check(now == sessionSamples);
+            Check(loopIndex == sessionSamples * 97 / samplesPerMinute);
+        }
+
+        TEST_METHOD(TestStreamInterpolatedCopy)
+        {
+            PolyphaseInterpolator interpolator;
+
+            // phase 0 is the identity, and a linear ramp interpolates exactly
+            float ramp[] = { 0, 1, 2, 3 };
+            Check(interpolator.Interpolate(ramp, 0) == 1);
+            Check(interpolator.Interpolate(ramp, PolyphaseInterpolator::PhaseCount / 2) == 1.5f);
+            Check(PolyphaseInterpolator::PhaseIndex(1 << 15, 16) == PolyphaseInterpolator::PhaseCount / 2);
+
+            // a mono loop of 4.5 samples
+            BufferAllocator<float> bufferAllocator(16, 1);
+            float data[] = { 0, 1, 2, 3, 4 };
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+            stream.Append(Duration<AudioSample>(5), data);
+            stream.Shut(ContinuousDuration<AudioSample>(4.5f));
+
+            // [0, 5) is the first iteration, at phase 0; [5, 9) is the second, half a sample later.
+            float output[10];
+            stream.CopyToInterpolated(Interval<AudioSample>(0, 10), interpolator, output);
+            for (int i = 0; i < 5; i++)
+            {
+                Check(output[i] == data[i]);
+            }
+            Check(output[6] == 1.5f);
+            Check(output[7] == 2.5f);
+            // and the third iteration starts on a whole sample again
+            Check(output[9] == 0);
+        }
+
+        TEST_METHOD(TestStreamPlaybackMappers)
+        {
+            PolyphaseInterpolator interpolator;
+            const int64_t one = (int64_t)1 << IntervalMapper<AudioSample>::PhaseBits;
+
+            // a mono loop of 8 samples, each holding its own position
+            BufferAllocator<float> bufferAllocator(16, 1);
+            float data[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+            stream.Append(Duration<AudioSample>(8), data);
+            stream.Shut(ContinuousDuration<AudioSample>(8));
+
+            Check(PlaybackMapper<AudioSample>::LoopPosition(&stream, stream.Mapper(), 11) == 3 * one);
+
+            // backwards from position 3, wrapping round the start of the loop, across several chunks
+            std::vector<float> output(600);
+            SpeedPlaybackMapper<AudioSample> reverse(0, 3 * one, -one);
+            stream.CopyToMapped(Interval<AudioSample>(0, (int64_t)output.size()), reverse, interpolator, output.data());
+            for (int i = 0; i < (int)output.size(); i++)
+            {
+                Check(output[i] == (float)(((3 - i) % 8 + 8) % 8));
+            }
+            Check(reverse.PositionAt(&stream, 5) == 6 * one);
+
+            // half speed interpolates between the samples (exactly, on a ramp)
+            SpeedPlaybackMapper<AudioSample> halfSpeed(0, 2 * one, one / 2);
+            stream.CopyToMapped(Interval<AudioSample>(0, 8), halfSpeed, interpolator, output.data());
+            for (int i = 0; i < 8; i++)
+            {
+                Check(output[i] == 2 + i * 0.5f);
+            }
+
+            // double speed skips every other sample
+            SpeedPlaybackMapper<AudioSample> doubleSpeed(0, 0, 2 * one);
+            stream.CopyToMapped(Interval<AudioSample>(0, 6), doubleSpeed, interpolator, output.data());
+            float doubled[] = { 0, 2, 4, 6, 0, 2 };
+            for (int i = 0; i < 6; i++)
+            {
+                Check(output[i] == doubled[i]);
+            }
+
+            // a stutter taking effect at time 10 repeats the 4 samples from position 6, wrapping round the loop
+            StutterPlaybackMapper<AudioSample> stutter(10, 6 * one, 4);
+            stream.CopyToMapped(Interval<AudioSample>(11, 8), stutter, interpolator, output.data());
+            float repeated[] = { 7, 0, 1, 6, 7, 0, 1, 6 };
+            for (int i = 0; i < 8; i++)
+            {
+                Check(output[i] == repeated[i]);
+            }
+
+            // a loop of seven and a half samples wraps at seven and a half, not at eight: every other time round it
+            // is back on a whole sample, however long it plays
+            BufferedSliceStream<AudioSample, float> halfStream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+            halfStream.Append(Duration<AudioSample>(8), data);
+            halfStream.Shut(ContinuousDuration<AudioSample>(7.5));
+            SpeedPlaybackMapper<AudioSample> forward(0, 0, one);
+            Check(forward.PositionAt(&halfStream, 8) == one / 2);
+            Check(forward.PositionAt(&halfStream, 15) == 0);
+            Check(forward.PositionAt(&halfStream, 7500 + 3) == 3 * one);
+            halfStream.CopyToMapped(Interval<AudioSample>(0, 23), forward, interpolator, output.data());
+            for (int i = 0; i < 8; i++)
+            {
+                Check(output[i] == data[i]);
+                Check(output[i + 15] == data[i]);
+            }
+        }
+
+        TEST_METHOD(TestStreamTransfer)
+        {
+            // mono, ten slivers per buffer
+            BufferAllocator<float> bufferAllocator(10, 1);
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/false);
+
+            std::vector<float> data(50);
+            for (int i = 0; i < (int)data.size(); i++)
+            {
+                data[i] = (float)i;
+            }
+            stream.Append(Duration<AudioSample>(35), data.data());
+
+            // [12, 27) spans the second and third buffers; the first goes back to the allocator,
+            // and 27 through 29 must be copied back since they share the third buffer.
+            // The transferred data starts at the destination's own initial time.
+            BufferedSliceStream<AudioSample, float> transferred(100, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+            const float* secondBufferData = stream.GetSliceContaining(Interval<AudioSample>(12, 1)).Buffer().Data();
+            stream.TransferTo(Interval<AudioSample>(12, 15), &transferred);
+
+            Check(transferred.InitialTime() == 100);
+            Check(transferred.DiscreteDuration() == 15);
+            // zero copy: the transferred stream owns the very same buffer
+            Check(transferred.GetSliceContaining(Interval<AudioSample>(100, 1)).Buffer().Data() == secondBufferData);
+            std::vector<float> output(15);
+            transferred.CopyTo(transferred.DiscreteInterval(), output.data());
+            for (int i = 0; i < 15; i++)
+            {
+                Check(output[i] == 12 + i);
+            }
+
+            // the source stream keeps everything after the interval, and keeps appending normally
+            Check(stream.InitialTime() == 27);
+            Check(stream.DiscreteDuration() == 8);
+            stream.Append(Duration<AudioSample>(10), data.data() + 35);
+            Check(stream.DiscreteDuration() == 18);
+            output.resize(18);
+            stream.CopyTo(stream.DiscreteInterval(), output.data());
+            for (int i = 0; i < 18; i++)
+            {
+                Check(output[i] == 27 + i);
+            }
+
+            // the transferred stream loops like any other
+            transferred.Shut(ContinuousDuration<AudioSample>(15));
+            Check(transferred.GetSliceContaining(Interval<AudioSample>(115, 1)).Get(0, 0) == 12);
+
+            // transferring everything up to the end leaves the source empty, and it still appends afterwards
+            BufferedSliceStream<AudioSample, float> rest(40, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/false);
+            stream.TransferTo(Interval<AudioSample>(40, 5), &rest);
+            Check(stream.InitialTime() == 45);
+            Check(stream.DiscreteDuration() == 0);
+            stream.Append(Duration<AudioSample>(5), data.data() + 45);
+            Check(stream.GetSliceContaining(stream.DiscreteInterval()).Get(0, 0) == 45);
+            Check(rest.GetSliceContaining(rest.DiscreteInterval()).Get(4, 0) == 44);
+        }
+
+        TEST_METHOD(TestStreamOverdub)
+        {
+            // mono, ten slivers per buffer; the loop is 35 slivers, so four buffers
+            BufferAllocator<float> bufferAllocator(10, 1);
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/false);
+            std::vector<float> data(35);
+            for (int i = 0; i < (int)data.size(); i++)
+            {
+                data[i] = (float)i;
+            }
+            stream.Append(Duration<AudioSample>(35), data.data());
+            stream.Shut(ContinuousDuration<AudioSample>(35));
+            const int64_t bufferBytes = bufferAllocator.BufferSizeInBytes();
+            Check(bufferAllocator.TotalInUseSpace() == 4 * bufferBytes);
+
+            // a snapshot costs no buffers
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> snapshot = stream.Snapshot();
+            Check(bufferAllocator.TotalInUseSpace() == 4 * bufferBytes);
+            Check(stream.BufferBytesNotSharedWith(*snapshot) == 0);
+
+            // Overdubbing [65, 75) lands on the end of the fourth loop iteration, [30, 35), and wraps around to
+            // [0, 5); only the two buffers written are copied.
+            std::vector<float> overdub(10, 100.0f);
+            stream.Overdub(Interval<AudioSample>(65, 10), overdub.data());
+            Check(bufferAllocator.TotalInUseSpace() == 6 * bufferBytes);
+            Check(stream.BufferBytesNotSharedWith(*snapshot) == 2 * bufferBytes);
+            Check(snapshot->BufferBytesNotSharedWith(stream) == 2 * bufferBytes);
+
+            std::vector<float> output(35);
+            stream.CopyTo(stream.DiscreteInterval(), output.data());
+            for (int i = 0; i < 35; i++)
+            {
+                Check(output[i] == (i < 5 || i >= 30 ? i + 100 : i));
+            }
+            // the snapshot still has the loop as it was
+            snapshot->CopyTo(snapshot->DiscreteInterval(), output.data());
+            for (int i = 0; i < 35; i++)
+            {
+                Check(output[i] == i);
+            }
+            // and the overdub raised the block peaks, so the stream is no longer silent at any threshold below them
+            Check(!stream.IsSilent(Interval<AudioSample>(0, 35), 100));
+
+            // writing the same buffers again copies nothing more
+            stream.Overdub(Interval<AudioSample>(0, 3), overdub.data());
+            Check(bufferAllocator.TotalInUseSpace() == 6 * bufferBytes);
+            Check(stream.GetSliceContaining(Interval<AudioSample>(0, 1)).Get(0, 0) == 200);
+
+            // Copying ahead of an overdub (as a track does, outside its lock) copies each shared buffer it will write
+            // once, after which the overdub itself copies nothing.
+            size_t index;
+            SharedBuf<float> copy;
+            int copyCount = 0;
+            while (stream.CopySharedBuffer(Interval<AudioSample>(15, 10), &index, &copy))
+            {
+                Check(index == 1 || index == 2);
+                stream.ReplaceBuffer(index, std::move(copy));
+                copyCount++;
+            }
+            Check(copyCount == 2);
+            Check(bufferAllocator.TotalInUseSpace() == 8 * bufferBytes);
+            stream.Overdub(Interval<AudioSample>(15, 10), overdub.data());
+            Check(bufferAllocator.TotalInUseSpace() == 8 * bufferBytes);
+            Check(stream.GetSliceContaining(Interval<AudioSample>(17, 1)).Get(0, 0) == 117);
+
+            // dropping the snapshot returns the buffers only it held
+            snapshot.reset();
+            Check(bufferAllocator.TotalInUseSpace() == 4 * bufferBytes);
+        }
+
+        TEST_METHOD(TestLoopHistory)
+        {
+            // mono, ten slivers per buffer; the loop is 40 slivers, so four buffers
+            BufferAllocator<float> bufferAllocator(10, 1);
+            const int64_t bufferBytes = bufferAllocator.BufferSizeInBytes();
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> loop(
+                new BufferedSliceStream<AudioSample, float>(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/false));
+            std::vector<float> data(40);
+            loop->Append(Duration<AudioSample>(40), data.data());
+            loop->Shut(ContinuousDuration<AudioSample>(40));
+
+            LoopHistory<AudioSample, float> history;
+            Check(history.IsEmpty() && history.Current() == nullptr && !history.CanUndo() && !history.CanRedo());
+            history.Commit(std::move(loop), 0);
+            Check(history.VersionCount() == 1 && !history.CanUndo());
+            Check(history.BufferBytes() == 4 * bufferBytes);
+
+            // each version overdubs the value 1, 2, 3... onto one more buffer of a snapshot of the current one
+            auto commitOverdub = [&](int value, int64_t memoryCapInBytes)
+            {
+                std::unique_ptr<BufferedSliceStream<AudioSample, float>> version = history.Current()->Snapshot();
+                std::vector<float> overdub(10, (float)value);
+                version->Overdub(Interval<AudioSample>((value - 1) % 4 * 10, 10), overdub.data());
+                history.Commit(std::move(version), memoryCapInBytes);
+            };
+            auto firstSample = [&]() { return history.Current()->GetSliceContaining(Interval<AudioSample>(0, 1)).Get(0, 0); };
+
+            commitOverdub(1, 0);
+            commitOverdub(2, 0);
+            Check(history.VersionCount() == 3 && history.CurrentIndex() == 2);
+            // the shared buffers are counted once
+            Check(history.BufferBytes() == 6 * bufferBytes);
+            Check(bufferAllocator.TotalInUseSpace() == 6 * bufferBytes);
+
+            history.Undo();
+            history.Undo();
+            Check(!history.CanUndo() && history.CanRedo());
+            Check(firstSample() == 0);
+            history.Redo();
+            Check(firstSample() == 1);
+
+            // committing after an undo drops the version which could have been redone
+            commitOverdub(5, 0);
+            Check(history.VersionCount() == 3 && !history.CanRedo());
+            Check(firstSample() == 6);
+            Check(bufferAllocator.TotalInUseSpace() == 6 * bufferBytes);
+
+            // a cap of six buffers drops the oldest version to make room for the next...
+            commitOverdub(6, 6 * bufferBytes);
+            Check(history.VersionCount() == 3);
+            Check(history.BufferBytes() == 6 * bufferBytes);
+            Check(bufferAllocator.TotalInUseSpace() == history.BufferBytes());
+
+            // ...but a cap smaller than the current version alone drops all the others, and keeps it
+            commitOverdub(7, bufferBytes);
+            Check(history.VersionCount() == 1 && !history.CanUndo());
+            Check(history.BufferBytes() == 4 * bufferBytes);
+            Check(bufferAllocator.TotalInUseSpace() == 4 * bufferBytes);
+
+            // each version keeps its own analysis, which undo and redo swap along with it; the versions a commit
+            // drops come back to the caller, analyses and all
+            struct FirstSample { float Value; };
+            LoopHistory<AudioSample, float, FirstSample> analyzed;
+            analyzed.Commit(history.Current()->Snapshot(), 0, std::unique_ptr<FirstSample>(new FirstSample{ 7 }));
+            analyzed.Commit(history.Current()->Snapshot(), 0, std::unique_ptr<FirstSample>(new FirstSample{ 8 }));
+            Check(analyzed.CurrentAnalysis()->Value == 8);
+            analyzed.Undo();
+            Check(analyzed.CurrentAnalysis()->Value == 7);
+            analyzed.Redo();
+            Check(analyzed.CurrentAnalysis()->Value == 8);
+            analyzed.Undo();
+            auto dropped = analyzed.Commit(history.Current()->Snapshot(), 0);
+            Check(dropped.size() == 1 && dropped[0].Analysis->Value == 8 && dropped[0].Stream != nullptr);
+            Check(analyzed.VersionCount() == 2 && analyzed.CurrentAnalysis() == nullptr);
+        }
+
+        // A shut mono loop of the given duration, its samples counting up from firstValue, each times scale.
+        static std::unique_ptr<BufferedSliceStream<AudioSample, float>> MakeCountingLoop(
+            BufferAllocator<float>* allocator,
+            int duration,
+            float firstValue,
+            float scale)
+        {
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> loop(
+                new BufferedSliceStream<AudioSample, float>(0, 1, allocator, 0, /*useExactLoopingMapper:*/true));
+            std::vector<float> data(duration);
+            for (int i = 0; i < duration; i++)
+            {
+                data[i] = (firstValue + i) * scale;
+            }
+            loop->Append(Duration<AudioSample>(duration), data.data());
+            loop->Shut(ContinuousDuration<AudioSample>(duration));
+            return loop;
+        }
+
+        TEST_METHOD(TestFrozenLoop)
+        {
+            Check(FrozenLoop::LeastCommonMultiple(4, 6) == 12);
+            Check(FrozenLoop::LeastCommonMultiple(3, 3) == 3);
+            Check(FrozenLoop::LeastCommonMultiple(1, 7) == 7);
+
+            // a 30-sample loop panned hard left, and a 20-sample loop panned hard right, freeze into 60 samples
+            BufferAllocator<float> bufferAllocator(64, 4);
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> left = MakeCountingLoop(&bufferAllocator, 30, 1, 1);
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> right = MakeCountingLoop(&bufferAllocator, 20, 100, 1);
+            // the left loop is five samples further along
+            std::vector<FrozenLoop::Source> sources{ { left.get(), 5, 0 }, { right.get(), 0, 1 } };
+
+            PolyphaseInterpolator interpolator;
+            std::atomic<bool> isCancelled{ true };
+            {
+                FrozenLoop cancelled(&bufferAllocator, ContinuousDuration<AudioSample>(60));
+                Check(!cancelled.Render(sources, interpolator, isCancelled));
+                Check(!cancelled.IsRendered());
+            }
+
+            isCancelled = false;
+            FrozenLoop frozen(&bufferAllocator, ContinuousDuration<AudioSample>(60));
+            Check(frozen.Render(sources, interpolator, isCancelled));
+            Check(frozen.IsRendered());
+            Check(frozen.BufferBytes() == 2 * bufferAllocator.BufferSizeInBytes());
+
+            // two passes through the frozen loop play just as the two loops would
+            std::vector<float> stereo(240);
+            frozen.MixInto(Interval<AudioSample>(0, 120), interpolator, stereo.data());
+            for (int t = 0; t < 120; t++)
+            {
+                Check(std::abs(stereo[t * 2] - (1 + (5 + t) % 30)) < 0.0001f);
+                Check(std::abs(stereo[t * 2 + 1] - (100 + t % 20)) < 0.0001f);
+            }
+
+            // Loops of one and two beats at 97 BPM last fractional numbers of samples, and so does their frozen
+            // loop; each holds 100 cycles of a sinusoid per beat, so however long it plays, the frozen loop stays in
+            // phase with the loops only if its duration is exact.
+            const double beat = 2880000.0 / 97;
+            BufferAllocator<float> beatAllocator(4096, 32);
+            auto makeBeatLoop = [&](int beats)
+            {
+                std::unique_ptr<BufferedSliceStream<AudioSample, float>> loop(
+                    new BufferedSliceStream<AudioSample, float>(0, 1, &beatAllocator, 0, /*useExactLoopingMapper:*/true));
+                std::vector<float> data((size_t)std::ceil(beats * beat));
+                for (size_t i = 0; i < data.size(); i++)
+                {
+                    data[i] = (float)std::sin(2 * RosettaFFT::PI * 100 * i / beat);
+                }
+                loop->Append(Duration<AudioSample>((int64_t)data.size()), data.data());
+                loop->Shut(ContinuousDuration<AudioSample>(beats * beat));
+                return loop;
+            };
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> oneBeat = makeBeatLoop(1);
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> twoBeats = makeBeatLoop(2);
+            std::vector<FrozenLoop::Source> beatSources{ { oneBeat.get(), 0, 0 }, { twoBeats.get(), 0, 1 } };
+            FrozenLoop frozenBeats(&beatAllocator, ContinuousDuration<AudioSample>(2 * beat));
+            Check(frozenBeats.Render(beatSources, interpolator, isCancelled));
+
+            // a thousand times round, over twenty minutes in; rounding the frozen loop's duration to a float would be
+            // off by over a sample by then
+            const int64_t later = (int64_t)(2000 * beat);
+            std::fill(stereo.begin(), stereo.end(), 0.0f);
+            frozenBeats.MixInto(Interval<AudioSample>(later, 120), interpolator, stereo.data());
+            for (int t = 0; t < 120; t++)
+            {
+                float expected = (float)std::sin(2 * RosettaFFT::PI * 100 * (later + t) / beat);
+                Check(std::abs(stereo[t * 2] - expected) < 0.01f);
+                Check(std::abs(stereo[t * 2 + 1] - expected) < 0.01f);
+            }
+        }
+
+        TEST_METHOD(TestOfflineMixdown)
+        {
+            // a 30-sample loop panned hard left, five samples along, and a 20-sample loop panned hard right
+            BufferAllocator<float> bufferAllocator(64, 4);
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> left = MakeCountingLoop(&bufferAllocator, 30, 1, 0.001f);
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> right = MakeCountingLoop(&bufferAllocator, 20, 100, 0.001f);
+
+            // more frames than one block, so the render wraps both loops many times over several blocks
+            const int frameCount = OfflineMixdown::BlockSize + 1000;
+            auto render = [&](MasterBus* masterBus, WavWriter* stem)
+            {
+                std::vector<OfflineMixdown::Source> sources(2);
+                sources[0] = OfflineMixdown::Source{ left.get(), 5, 0, {}, nullptr };
+                sources[1] = OfflineMixdown::Source{ right.get(), 0, 1, {}, stem };
+                for (OfflineMixdown::Source& source : sources)
+                {
+                    std::fill(source.EqBands, source.EqBands + BiquadCascade::StageCount, BiquadCoefficients::Identity());
+                }
+                OfflineMixdown mixdown(std::move(sources), 3);
+
+                std::stringstream stream(std::ios::in | std::ios::out | std::ios::binary);
+                WavWriter mix(stream, 2, 48000);
+                mixdown.Render(frameCount, masterBus, nullptr, mix);
+                Check(mix.Finish());
+                WavData data;
+                Check(WavFile::Read(stream, data));
+                return data;
+            };
+
+            std::stringstream stemStream(std::ios::in | std::ios::out | std::ios::binary);
+            WavWriter stemWriter(stemStream, 2, 48000);
+            WavData mix = render(nullptr, &stemWriter);
+            Check(stemWriter.Finish());
+            WavData stem;
+            Check(WavFile::Read(stemStream, stem));
+
+            Check(mix.FrameCount() == frameCount);
+            Check(stem.FrameCount() == frameCount);
+            for (int t = 0; t < frameCount; t++)
+            {
+                Check(std::abs(mix.Samples[t * 2] - (1 + (5 + t) % 30) / 1000.0f) < 1e-6f);
+                Check(std::abs(mix.Samples[t * 2 + 1] - (100 + t % 20) / 1000.0f) < 1e-6f);
+                Check(std::abs(stem.Samples[t * 2]) < 1e-6f);
+                Check(std::abs(stem.Samples[t * 2 + 1] - mix.Samples[t * 2 + 1]) < 1e-6f);
+            }
+
+            // below the ceiling, the master bus changes nothing: its latency is made up for
+            MasterBus masterBus(48000, 32, -1, 0.1f);
+            WavData mastered = render(&masterBus, nullptr);
+            Check(mastered.FrameCount() == frameCount);
+            for (int i = 0; i < frameCount * 2; i++)
+            {
+                Check(std::abs(mastered.Samples[i] - mix.Samples[i]) < 1e-6f);
+            }
+
+            // the left loop played backwards through a playback effect, and sent to a reverb whose impulse response
+            // is one sample, so that the reverb (into the center) just delays the send by its block
+            const int64_t one = (int64_t)1 << IntervalMapper<AudioSample>::PhaseBits;
+            SpeedPlaybackMapper<AudioSample> reverse(0, 5 * one, -one);
+            const float impulse = 1;
+            const int reverbBlock = 64;
+            PartitionedConvolver reverb(reverbBlock, &impulse, 1, /*useTailThread:*/false);
+            std::vector<OfflineMixdown::Source> effected(1);
+            effected[0] = OfflineMixdown::Source{ left.get(), 0, 0, {}, nullptr };
+            std::fill(effected[0].EqBands, effected[0].EqBands + BiquadCascade::StageCount, BiquadCoefficients::Identity());
+            effected[0].Mapper = &reverse;
+            effected[0].SendLevel = 0.5f;
+            OfflineMixdown effectedMixdown(std::move(effected), 3);
+            std::stringstream effectedStream(std::ios::in | std::ios::out | std::ios::binary);
+            WavWriter effectedWriter(effectedStream, 2, 48000);
+            effectedMixdown.Render(frameCount, nullptr, &reverb, effectedWriter);
+            Check(effectedWriter.Finish());
+            WavData effectedMix;
+            Check(WavFile::Read(effectedStream, effectedMix));
+            Check(effectedMix.FrameCount() == frameCount);
+            float centerLeft, centerRight;
+            AudioKernels::PanCoefficients(0.5f, &centerLeft, &centerRight);
+            auto reversed = [](int t) { return (1 + ((5 - t) % 30 + 30) % 30) / 1000.0f; };
+            for (int t = 0; t < frameCount; t++)
+            {
+                float wet = t < reverbBlock ? 0 : reversed(t - reverbBlock) * 0.5f;
+                Check(std::abs(effectedMix.Samples[t * 2] - (reversed(t) + wet * centerLeft)) < 1e-5f);
+                Check(std::abs(effectedMix.Samples[t * 2 + 1] - wet * centerRight) < 1e-5f);
+            }
+
+            // automating the volume of a constant loop down to half, a third of the way through; each ramp is to the
+            // value just after it
+            std::unique_ptr<BufferedSliceStream<AudioSample, float>> constant(
+                new BufferedSliceStream<AudioSample, float>(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true));
+            std::vector<float> ones(30, 1.0f);
+            constant->Append(Duration<AudioSample>(30), ones.data());
+            constant->Shut(ContinuousDuration<AudioSample>(30));
+            const int loopFrames = OfflineMixdown::RampSize * 6;
+            SparseSliceStream<AudioSample, float> volume(0, 1, /*useExactLoopingMapper:*/true);
+            volume.Append(1000, 0.5f);
+            volume.Shut(ContinuousDuration<AudioSample>(loopFrames));
+
+            std::vector<OfflineMixdown::Source> automated(1);
+            automated[0] = OfflineMixdown::Source{ constant.get(), 0, 0, {}, nullptr };
+            std::fill(automated[0].EqBands, automated[0].EqBands + BiquadCascade::StageCount, BiquadCoefficients::Identity());
+            automated[0].VolumeAutomation = &volume;
+            OfflineMixdown automatedMixdown(std::move(automated), 2);
+            std::stringstream automatedStream(std::ios::in | std::ios::out | std::ios::binary);
+            WavWriter automatedWriter(automatedStream, 2, 48000);
+            automatedMixdown.Render(loopFrames * 2, nullptr, nullptr, automatedWriter);
+            Check(automatedWriter.Finish());
+            WavData automatedMix;
+            Check(WavFile::Read(automatedStream, automatedMix));
+            const int rampSize = OfflineMixdown::RampSize;
+            Check(automatedMix.Samples[(rampSize + 10) * 2] == 1);
+            // the event falls within the third ramp, which goes from 1 to 0.5
+            Check(std::abs(automatedMix.Samples[(rampSize * 2 + rampSize / 2) * 2] - 0.75f) < 1e-6f);
+            Check(automatedMix.Samples[(rampSize * 3 + 10) * 2] == 0.5f);
+            // the next time round the loop starts at full volume again
+            Check(automatedMix.Samples[(loopFrames + 10) * 2] == 1);
+        }
+
+        TEST_METHOD(TestStreamBlockPeaks)
+        {
+            const int blockSize = BufferedSliceStream<AudioSample, float>::PeakBlockSize;
+            BufferAllocator<float> bufferAllocator(300, 1);
+            BufferedSliceStream<AudioSample, float> stream(0, 1, &bufferAllocator, 0, /*useExactLoopingMapper:*/true);
+
+            // silence, except for one sample in the third block
+            std::vector<float> data(blockSize * 4);
+            data[blockSize * 2 + 10] = -1;
+            stream.Append(Duration<AudioSample>((int64_t)data.size()), data.data());
+            stream.Shut(ContinuousDuration<AudioSample>(data.size() - 0.5));
+
+            Check(stream.IsSilentWrapped(0, blockSize * 2, 0));
+            Check(!stream.IsSilentWrapped(0, blockSize * 2 + 1, 0));
+            Check(!stream.IsSilentWrapped(blockSize * 2 + 100, 1, 0));
+            Check(stream.IsSilentWrapped(blockSize * 2 + 100, 1, 1));
+            // wrapping around the end of the loop back into the first block
+            Check(stream.IsSilentWrapped(blockSize * 3, blockSize * 2, 0));
+
+            // near the start of the loop, the interpolator's left neighbor wraps to the (silent) last block
+            Check(stream.IsSilent(Interval<AudioSample>(0, 100), 0));
+            Check(!stream.IsSilent(Interval<AudioSample>(0, blockSize * 2 + 20), 0));
+
+            // Skipping silent chunks leaves the interpolated output unchanged: the second pass through the loop is
+            // read at a half-sample phase, with silence everywhere except around the one loud sample.
+            std::vector<float> output(data.size());
+            PolyphaseInterpolator interpolator;
+            stream.CopyToInterpolated(Interval<AudioSample>((int64_t)data.size(), (int64_t)data.size() - 1), interpolator, output.data());
+            for (int i = 0; i < (int)data.size() - 1; i++)
+            {
+                bool nearLoudSample = std::abs(i - (blockSize * 2 + 10)) <= 2;
+                Check(nearLoudSample || output[i] == 0);
+            }
+            Check(output[blockSize * 2 + 9] < 0);
+        }
+
         /* TODO: perhaps revive this test? I think I already have coverage of Free(), so postponing porting this.
         [TestMethod]
         public void TestDispose()
@@ -451,6 +2019,51 @@ namespace UnitTestsDesktop
             Check(slice.Get(0, 0) == 11);
         }
 
+        TEST_METHOD(TestSparseSliceStream)
+        {
+            SparseSliceStream<AudioSample, float> stream(10, 0.5f, /*useExactLoopingMapper:*/true);
+            stream.Append(12, 1);
+            stream.Append(15, 2);
+            stream.Append(15, 3); // replaces the event before
+            stream.Append(20, 4);
+            Check(stream.EventCount() == 3);
+            Check(stream.DiscreteDuration() == 11);
+            Check(stream.ValueAt(11, nullptr) == 0.5f);
+            Check(stream.ValueAt(12, nullptr) == 1);
+            Check(stream.ValueAt(14, nullptr) == 1);
+            Check(stream.ValueAt(15, nullptr) == 3);
+            Check(stream.ValueAt(100, nullptr) == 4);
+
+            // shutting with a fractional duration shorter than the events drops those after the end
+            stream.Shut(ContinuousDuration<AudioSample>(9.5f));
+            Check(stream.EventCount() == 2);
+            Check(stream.DiscreteDuration() == 10);
+
+            // the second iteration starts at 20 (10 + ceil(9.5)), the third at 29 (10 + 19)
+            Check(stream.ValueAt(19, nullptr) == 3);
+            Check(stream.ValueAt(20, nullptr) == 0.5f);
+            Check(stream.ValueAt(25, nullptr) == 3);
+            Check(stream.ValueAt(31, nullptr) == 1);
+
+            // reading forwards with a cursor, over many iterations, finds the same values as searching afresh
+            int cursor = 0;
+            for (int t = 10; t < 500; t++)
+            {
+                float expected = stream.ValueAt(t, nullptr);
+                Check(stream.ValueAt(t, &cursor) == expected);
+            }
+
+            // the events of an interval spanning a loop boundary, at their offsets within it
+            std::vector<std::pair<int, float>> events;
+            stream.ForEachEvent(Interval<AudioSample>(14, 10), [&](Duration<AudioSample> offset, float value)
+            {
+                events.push_back(std::make_pair((int)offset.Value(), value));
+            });
+            Check(events.size() == 2);
+            Check(events[0] == std::make_pair(1, 3.0f));
+            Check(events[1] == std::make_pair(8, 1.0f));
+        }
+
         /*
         [TestMethod]
         public void TestSparseSampleByteStream()